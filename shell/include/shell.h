@@ -9,26 +9,32 @@
 #include <pwd.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <signal.h>
+#include <termios.h>
 
 #define MAX_PATH_LEN 1024
-#define MAX_TOKENS 512
+#define MAX_EXPANDED_WORDS (1 << 22)    // Most words one brace expansion may produce
 
 
 //enum for token types
 typedef enum {
     TOKEN_NAME, TOKEN_PIPE, TOKEN_AMPERSAND, TOKEN_SEMICOLON,
     TOKEN_INPUT, TOKEN_OUTPUT, TOKEN_DOUBLE_OUTPUT,
+    TOKEN_AND, TOKEN_OR,
+    TOKEN_READ_WRITE, TOKEN_DUP_INPUT, TOKEN_DUP_OUTPUT,
+    TOKEN_OUTPUT_ALL, TOKEN_APPEND_ALL, TOKEN_HERE_STRING, TOKEN_HEREDOC,
     TOKEN_END, TOKEN_INVALID
 } TokenType;
 
 //struct for holding tokens
 typedef struct {
     TokenType type;
-    char value[MAX_PATH_LEN];
+    char *value;        // Text of the token (in the arena unless copied for a program or alias)
+    int heredoc_fd;     // memfd with the body of a << heredoc, -1 otherwise
 } Token;
 
 //global variables
-extern Token tokens[1024];  //array of tokens
+extern Token *tokens;  //array of tokens, grown as needed (always room for the END token)
 extern int token_count;   //token count so far
 extern const char* current_input;  //pointer to start of the command
 
@@ -44,12 +50,25 @@ extern ParserState parser_state;
 //function prototypes
 
 void tokenise(void);
+int reserve_tokens(int count);
+void terminate_tokens(int count);
+int copy_token_values(Token *copy, int count);
+void free_token_values(Token *copy, int count);
 void prompt(const char* home_directory);
 
+// Input lines and the arena for per-line allocations
+char* read_command_line(void);
+int line_continues(const char *line);
+void* arena_alloc(size_t size);
+char* arena_strndup(const char *text, size_t length);
+size_t arena_mark(void);
+void arena_release(size_t mark);
+
 // Parser functions
 int parse(void);
 int parse_shell_cmd(void);
 int parse_cmd_group(void);
+int parse_and_or(void);
 int parse_atomic(void);
 int parse_input(void);
 int parse_output(void);
@@ -78,22 +97,179 @@ char* reconstruct_command_from_tokens(void);
 // Command execution
 int execute_command(void);
 int execute_external_command(char **args);
-int setup_input_redirection(int start_index, int end_index);
-int setup_output_redirection(int start_index, int end_index);
+int has_input_redirection(int start_index, int end_index);
 int has_output_redirection(int start_index, int end_index);
 
-// Pipe functionality
-int execute_pipeline(const char* home_directory);
-int count_pipes(int start_index, int end_index);
-void execute_command_in_pipeline(int cmd_start, int cmd_end, int pipe_in, int pipe_out, const char* home_directory);
-int find_pipe_segments(int **segments, int *num_segments);
-int has_pipes(void);
+// Redirections (n<, n>, n>>, n<>, n>&m, n>&-, &>, <<<, <<)
+#define MAX_SAVED_FDS 16
+
+typedef struct {
+    int fd;             // Descriptor a builtin's redirection replaces
+    int copy;           // Saved original, -1 if fd was not open
+} SavedFd;
+
+int is_redirection_token(TokenType type);
+int is_redirect_filename(int index, int start_index);
+int redirects_fd(int start_index, int end_index, int fd);
+int setup_redirections(int start_index, int end_index);
+int save_redirected_fds(int start_index, int end_index, SavedFd *saved);
+void restore_redirected_fds(SavedFd *saved, int count);
+int create_text_memfd(const char *name, const char *text, size_t length);
+int collect_heredocs(void);
+void release_heredocs(void);
+
+// Expansion ($VAR, ${VAR}, $(...) and `...`) and quote removal
+const char* find_substitution_end(const char *start);
+const char* find_quote_end(const char *start);
+int expand_words(const char *home_directory);
+char* expand_text(const char *word, const char *home_directory);
+char* expand_pattern(const char *word, const char *home_directory);
+void remove_quotes(char *word);
+int in_command_substitution(void);
+int pending_process_substitutions(void);
+void release_process_substitutions(int mark);
+int start_process_substitution(int direction, const char *command, const char *home_directory);
+int run_substitution_command(const char *home_directory);
+int last_substitution_status(void);
+
+// Compound commands (if, while, until, for, case, { ...; }, functions) compiled to bytecode
+typedef enum {
+    OP_RUN,             // Run tokens a..b (a simple pipeline) in the foreground
+    OP_BACKGROUND,      // Start tokens a..b as a background job
+    OP_FORK,            // Run the code up to a in a background shell (job text: tokens b..c)
+    OP_PIPELINE,        // Fork a stages (the OP_STAGE entries that follow), continue at b
+    OP_STAGE,           // A stage's code starts at a (its tokens: b..c)
+    OP_EXIT,            // End of the code a forked shell runs
+    OP_JUMP,            // Go to a
+    OP_JUMP_IF_TRUE,    // Go to a if $? is 0
+    OP_JUMP_IF_FALSE,   // Go to a if $? is not 0
+    OP_NOT,             // Negate $? (! pipeline)
+    OP_SET_STATUS,      // Set $? to a
+    OP_LOOP_BEGIN,      // Enter a while/until loop
+    OP_LOOP_SAVE,       // Remember $? of the loop body
+    OP_LOOP_END,        // Leave the loop; $? is its body's last status
+    OP_FOR_BEGIN,       // Enter a for loop over the expanded tokens a..b (a < 0: over $@)
+    OP_FOR_NEXT,        // Assign the next word to variable strings[a], or go to b
+    OP_CASE_BEGIN,      // Expand token a as the case subject
+    OP_CASE_MATCH,      // Go to b if the subject matches pattern strings[a]
+    OP_REDIRECT,        // Apply the redirections in tokens a..b, or go to c
+    OP_TIME,            // Start the `time` prefixes of tokens a..b, or go to c
+    OP_POP,             // Leave a case or redirection frames
+    OP_BREAK,           // Leave a loops, go to b
+    OP_CONTINUE,        // Leave a - 1 loops, go to b
+    OP_DEFINE,          // Define function strings[a] with the body in tokens b..c
+    OP_RETURN           // Leave the function with status token a (a < 0: $?)
+} OpCode;
+
+typedef struct {
+    OpCode op;
+    int a, b, c;
+} Instruction;
+
+typedef struct {
+    Instruction *code;
+    int length;
+    int capacity;
+    Token *tokens;              // The command's own tokens, referred to by index
+    int token_count;
+    int token_capacity;
+    char **strings;             // Loop variables, case patterns and function names
+    int string_count;
+    int owns_heredocs;          // Function body: closes its own copies of heredoc memfds
+    int references;             // Function body: its definition and the calls running it
+} Program;
+
+int is_compound_command(void);
+int compound_command_incomplete(void);
+Program* compile_program(void);
+Program* compile_function_body(void);
+void free_program(Program *program);
+int run_program(Program *program, const char *home_directory);
+int execute_compound_command(const char *home_directory);
+
+// Brace expansion ({a,b,c} and {x..y[..step]})
+typedef struct {
+    char *prefix;               // Text before the braces (lazy sequences only)
+    char *suffix;               // Text after them
+    long long start;
+    long long end;
+    long long step;             // Signed: towards end
+    long long count;            // Number of values
+    int width;                  // Zero-padded width ({01..10}), 0 for none
+    int letters;                // {a..e}: the values are characters
+} BraceSequence;
+
+int has_brace_expansion(const char *word);
+int expand_braces(const char *word, long long limit, char ***words, int *count);
+int parse_brace_sequence(const char *word, BraceSequence *sequence);
+void format_brace_sequence(const BraceSequence *sequence, long long index, char *buffer, size_t size);
+void free_brace_sequence(BraceSequence *sequence);
+
+// Pathname expansion (*, ?, [...] and **)
+int has_glob_pattern(const char *word);
+int glob_pattern(const char *pattern, char ***matches, int *count);
+void clear_glob_cache(void);
+
+// Arithmetic ($(( )) and let)
+int evaluate_arithmetic(const char *expression, long long *result);
+int execute_let(void);
+
+// Shell variables and environment
+int is_valid_variable_name(const char *name, size_t length);
+int set_variable(const char *name, const char *value, int export);
+const char* get_variable(const char *name);
+void unset_variable(const char *name);
+void init_variables(void);
+char** build_environment(void);
+void exec_with_environment(char **args);
+int is_assignment_word(const char *word);
+int count_assignments(int start_index, int end_index);
+void apply_assignments(int start_index, int count, int export);
+void set_command_assignments(int start_index, int count);
+void clear_command_assignments(void);
+void apply_command_assignments(void);
+void set_last_status(int status);
+int get_last_status(void);
+const char* expand_variable(const char *name, size_t length, char *buffer, size_t size);
+int execute_export(void);
+int execute_unset(void);
+void swap_positional_parameters(char ***words, int *count);
+char** get_positional_parameters(int *count);
+int push_local_scope(void);
+void pop_local_scope(void);
+void apply_local_assignments(int start_index, int count);
+int execute_local(void);
+
+// Command table: builtins, shell functions and aliases
+typedef struct Command {
+    char *name;
+    int (*builtin)(const char *home_directory);     // NULL if not a builtin
+    int redirect;               // The shell applies the builtin's redirections around it
+    Program *function;          // Body of a shell function, NULL if none
+    char *alias;                // Alias text as defined, NULL if none
+    Token *alias_tokens;        // The alias text, tokenised when it was defined
+    int alias_token_count;
+    struct Command *next;       // Next command in the same bucket
+} Command;
+
+void init_builtins(void);
+Command* find_command(const char *name);
+int run_command(Command *command, const char *home_directory);
+void define_function(const char *name, Program *body);
+void undefine_function(const char *name);
+int expand_aliases(void);
+int execute_alias(void);
+int execute_unalias(void);
 
 extern char previous_cwd[MAX_PATH_LEN];
 
 // Sequential execution functions
 int execute_sequential_commands(const char* home_directory);
+int execute_foreground_segment(int start_index, int end_index, const char* home_directory,
+                               int *active_timers);
+void run_background_segment(int start_index, int end_index, const char* home_directory);
 int find_command_segments(int **segments, int *num_segments, TokenType **separators);
+char* reconstruct_command_from_segment(int start_index, int end_index);
 
 // Background execution functions
 #define MAX_BACKGROUND_JOBS 100
@@ -101,16 +277,100 @@ int find_command_segments(int **segments, int *num_segments, TokenType **separat
 // Process states for activities command
 typedef enum {
     PROCESS_RUNNING,
-    PROCESS_STOPPED
+    PROCESS_STOPPED,
+    PROCESS_QUEUED,     // Waiting for a free slot under `set maxjobs`
+    PROCESS_DONE        // Reaped; kept until reported (or its log is read)
 } ProcessState;
 
+// Scheduling class requested with --batch, --idle or --normal
+typedef enum {
+    JOB_SCHED_INHERIT,  // Leave the class unchanged
+    JOB_SCHED_NORMAL,   // SCHED_OTHER
+    JOB_SCHED_BATCH,    // SCHED_BATCH
+    JOB_SCHED_IDLE      // SCHED_IDLE
+} JobSchedClass;
+
+// Options given with the `job` and `limit` prefixes at submission
+typedef struct {
+    int priority;       // Queued jobs with higher priority start first
+    int nice_value;     // Nice level applied before exec
+    int has_nice;
+    long long cpu_seconds;      // RLIMIT_CPU, 0 = inherit
+    long long address_space;    // RLIMIT_AS in bytes, 0 = inherit
+    long long open_files;       // RLIMIT_NOFILE, 0 = inherit
+    long long memory_max;       // cgroup memory.max in bytes, 0 = none
+    int cpu_max_percent;        // cgroup cpu.max in percent of one CPU, 0 = none
+    char cpu_list[64];          // CPU affinity list (e.g. 4-7), empty = inherit
+    JobSchedClass sched_class;
+    int ioprio;                 // Encoded I/O priority, -1 = inherit
+    long long timeout_ms;       // Signal the command after this long, 0 = none
+    long long kill_after_ms;    // Then SIGKILL after this long, 0 = never
+    int timeout_signal;         // Signal sent on timeout (SIGTERM)
+    int batch_jobs;             // batch prefix: batches run at once, 0 = not batched
+    int batch_max_args;         // Items per batch, 0 = as many as fit
+    long long batch_max_bytes;  // Argument bytes per batch, 0 = what exec allows
+} JobOptions;
+
+// Deadline of a running command (timeout prefix, set timeout)
+typedef struct {
+    int fd;                     // timerfd in the event loop
+    int signal;
+    long long kill_after_ms;
+    int stage;                  // 0 armed, 1 signalled, 2 killed
+    int pid_count;
+    pid_t pids[];               // Processes (or group leaders) to signal
+} CommandTimer;
+
+// Captured stdout/stderr of a background job (set capture on)
+typedef struct {
+    int pipe_fd;                // Read end of the job's output pipe, -1 after EOF
+    int memfd;                  // Backing store of the ring
+    char *data;                 // Ring mapped from memfd
+    size_t size;
+    unsigned long long written; // Total bytes ever written to the ring
+    int passthrough;            // Also copy output to the terminal (fg, joblog -f)
+} JobCapture;
+
+// Resource usage of a job sampled from /proc (activities -l / -w)
+typedef struct {
+    int stat_fd;                    // Cached /proc/<pid>/stat, -1 when closed
+    int io_fd;                      // Cached /proc/<pid>/io, -1 when unavailable
+    int cgroup_cpu_fd;              // Cached cpu.stat of the job's cgroup, -1 if none
+    int cgroup_memory_fd;           // Cached memory.current, -1 if none
+    int cgroup_io_fd;               // Cached io.stat, -1 if none
+    int has_io;                     // Read/write rates are available
+    int sampled;                    // Previous sample below is valid
+    double sample_time;             // CLOCK_MONOTONIC seconds of the previous sample
+    unsigned long long cpu_usec;    // CPU time used at the previous sample
+    unsigned long long read_bytes;  // Storage bytes read at the previous sample
+    unsigned long long write_bytes; // Storage bytes written at the previous sample
+    double cpu_percent;             // Rates over the last sampling interval
+    double read_rate;
+    double write_rate;
+    long rss_kb;
+} JobStats;
+
 typedef struct {
-    pid_t pid;
+    pid_t pid;          // 0 while the job is queued
     int job_number;
-    char command[MAX_PATH_LEN];
+    char *command;      // Owned copy of the command text, any length
     char command_name[MAX_PATH_LEN];  // For activities command sorting
     int is_active;
     ProcessState state;
+    JobOptions options;
+    int wait_status;    // Status from waitpid() once PROCESS_DONE
+    int notified;       // Completion has been reported at the prompt
+    int managed;        // Reaped by whoever started or resumed it, not by the reaper
+    JobCapture *capture;
+    CommandTimer *timer;    // Timeout of the job, NULL if none
+    JobStats stats;
+    int cgroup_fd;      // Directory of the job's own cgroup, -1 if none
+    struct termios terminal_modes;  // Terminal modes when the job was stopped
+    int has_terminal_modes;
+    int leader_reaped;  // Leader exited; other processes of its group still run
+    int hidden;         // Process substitution: no job number, never listed or reported
+    Token *queued_tokens;   // Expanded words and redirections of a queued job (owned), NULL otherwise
+    int queued_token_count;
 } BackgroundJob;
 
 extern BackgroundJob background_jobs[MAX_BACKGROUND_JOBS];
@@ -119,28 +379,136 @@ extern int next_job_number;
 void init_background_jobs(void);
 int add_background_job(pid_t pid, const char* command);
 int add_stopped_job(pid_t pid, const char* command);
+int add_hidden_job(pid_t pid, const char* command);
+pid_t fork_background_subshell(const char *command_str);
 void check_background_jobs(void);
+void reap_background_jobs(void);
+int find_job_index_by_pid(pid_t pid);
+int count_running_jobs(void);
+int launch_queued_job(int job_index);
+void start_queued_jobs(void);
 void cleanup_background_job(int job_index);
 int execute_background_command(int start_index, int end_index, const char* command_str);
 
+// Pipe functionality
+int execute_pipeline(const char* home_directory);
+int count_pipes(int start_index, int end_index);
+void execute_command_in_pipeline(int cmd_start, int cmd_end, int pipe_in, int pipe_out, const JobOptions *options,
+                                  const char* home_directory);
+int find_pipe_segments(int **segments, int *num_segments);
+int has_pipes(void);
+
+// Argument vectors, exec failures and the batch prefix
+char** build_arg_vector(int start_index, int end_index, int *count);
+_Noreturn void exit_exec_failure(char **args);
+int run_batches(char **args, const JobOptions *options);
+_Noreturn void exec_command(char **args, const JobOptions *options);
+
+// Job submission options (job prefix)
+void init_job_options(JobOptions *options);
+int parse_job_options(int start_index, int end_index, JobOptions *options);
+void apply_job_options(const JobOptions *options);
+int job_options_need_cgroup(const JobOptions *options);
+int parse_sched_options(int start_index, int end_index, JobOptions *options);
+int job_options_have_sched(const JobOptions *options);
+void merge_sched_options(JobOptions *dest, const JobOptions *src);
+int apply_sched_options_to_group(pid_t pgid, const JobOptions *options);
+
+// Per-job cgroup v2 placement (limit --memory / --cpu)
+int create_job_cgroup(const char *name, const JobOptions *options);
+int create_foreground_cgroup(const JobOptions *options);
+void join_job_cgroup(int cgroup_fd);
+void remove_job_cgroup(int cgroup_fd);
+
+// Shell options (set builtin)
+typedef struct {
+    int max_jobs;       // Running background jobs allowed at once, 0 = unlimited
+    int capture_output; // Capture background job output into per-job rings
+    size_t capture_size;// Ring size per job in bytes
+    long long command_timeout_ms;  // Default timeout of foreground commands, 0 = none
+    long long kill_after_ms;       // Default --kill-after for it, 0 = never
+} ShellOptions;
+
+extern ShellOptions shell_options;
+
+int execute_set(void);
+
 // Activities command
-void execute_activities(void);
+int execute_activities(void);
+
+// Per-job resource sampling from /proc
+void init_job_stats(JobStats *stats);
+void release_job_stats(JobStats *stats);
+int sample_job_stats(BackgroundJob *job);
 
 // Ping command
 void execute_ping(void);
 
 // Signal handling and job control
 void setup_signal_handlers(void);
+void handle_interrupt_request(void);
+void handle_suspend_request(void);
+int add_stopped_foreground_job(pid_t pid);
+void init_job_control(void);
+int job_control_enabled(void);
+void enter_job_process_group(pid_t pgid, int foreground);
+void give_terminal_to(pid_t pgid, const struct termios *job_modes);
+int reclaim_terminal(int status, struct termios *job_modes);
+int wait_for_job(pid_t pgid, pid_t status_pid, int *status);
+int exit_status_of(int status);
 void set_foreground_process(pid_t pgid, const char* command);
 void clear_foreground_process(void);
 void handle_eof(void);
 
 // Global variables for signal handling
 extern pid_t current_foreground_pgid;
+extern volatile sig_atomic_t interrupt_received;  // Set on Ctrl-C, consumed by the event loop
 extern char current_foreground_command[MAX_PATH_LEN];
 
 // fg and bg commands
-void execute_fg(void);
-void execute_bg(void);
+int execute_fg(void);
+int execute_bg(void);
+int is_valid_job_number(const char *str);
+int find_job_by_number(int job_number);
+
+// Event loop (epoll)
+typedef void (*EventCallback)(int fd, void *data);
+
+int init_event_loop(void);
+int queue_signal_event(int sig);
+int event_loop_add(int fd, EventCallback callback, void *data);
+void event_loop_remove(int fd);
+int event_loop_available(void);
+int run_event_loop_once(int timeout_ms);
+void wait_for_input(void);
+int wait_for_input_timeout(int timeout_ms);
+
+// Background output capture
+JobCapture* create_job_capture(int job_number, int *write_fd);
+void handle_capture_event(int fd, void *data);
+void drain_job_capture(JobCapture *capture);
+void release_job_capture(JobCapture *capture);
+void print_job_capture(const JobCapture *capture, int max_lines);
+int execute_joblog(void);
+
+// wait builtin
+int execute_wait(void);
+
+// Parallel execution builtin
+int execute_parallel(void);
+
+// Command timeouts (timeout prefix)
+int parse_duration(const char *str, long long *ms);
+int parse_signal_name(const char *str);
+void apply_default_timeout(JobOptions *options);
+CommandTimer* create_command_timer(const pid_t *pids, int pid_count, const JobOptions *options);
+int release_command_timer(CommandTimer *timer);
+
+// time prefix and resource accounting
+pid_t wait_for_child(pid_t pid, int *status, int options);
+int is_time_prefix(int start_index, int end_index);
+int begin_timing(int start_index, int end_index);
+void end_timing(int status);
+long long monotonic_ms(void);
 
 #endif 
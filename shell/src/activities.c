@@ -1,14 +1,27 @@
 #include "shell.h"
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+#define SAMPLE_INTERVAL_MS 200      // Measuring window of activities -l
+#define DEFAULT_REFRESH_MS 1000     // Refresh interval of activities -w
+#define MIN_REFRESH_MS 100
+#define WATCH_LINE_LEN 256
+#define WATCH_MAX_LINES (MAX_BACKGROUND_JOBS + 3)
 
 /**
  * @brief Structure for sorting activities output
  */
 typedef struct {
     pid_t pid;
+    int job_number;
     char command_name[MAX_PATH_LEN];
+    const char *command;
     ProcessState state;
+    const JobStats *stats;  // NULL when no usage could be sampled
 } ActivityInfo;
 
 /**
@@ -20,48 +33,392 @@ typedef struct {
 int compare_activities(const void *a, const void *b) {
     const ActivityInfo *activity_a = (const ActivityInfo *)a;
     const ActivityInfo *activity_b = (const ActivityInfo *)b;
-    
+
     return strcmp(activity_a->command_name, activity_b->command_name);
 }
 
+/**
+ * @brief Comparison function for the long listing: busiest job first
+ * @param a First activity info
+ * @param b Second activity info
+ * @return Comparison result (CPU% descending, then command name)
+ */
+static int compare_activities_by_cpu(const void *a, const void *b) {
+    const ActivityInfo *activity_a = (const ActivityInfo *)a;
+    const ActivityInfo *activity_b = (const ActivityInfo *)b;
+    double cpu_a = activity_a->stats != NULL ? activity_a->stats->cpu_percent : -1;
+    double cpu_b = activity_b->stats != NULL ? activity_b->stats->cpu_percent : -1;
+
+    if (cpu_a != cpu_b) {
+        return cpu_a < cpu_b ? 1 : -1;
+    }
+    return compare_activities(a, b);
+}
+
+/**
+ * @brief Get the display name of a process state
+ */
+static const char* state_name(ProcessState state) {
+    switch (state) {
+        case PROCESS_STOPPED: return "Stopped";
+        case PROCESS_QUEUED: return "Queued";
+        case PROCESS_DONE: return "Done";
+        default: return "Running";
+    }
+}
+
+/**
+ * @brief Collect all active background jobs
+ * @param activities Output array of MAX_BACKGROUND_JOBS entries
+ * @param with_stats Sample /proc usage for each job
+ * @return Number of jobs collected
+ */
+static int collect_activities(ActivityInfo *activities, int with_stats) {
+    int activity_count = 0;
+
+    for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+        BackgroundJob *job = &background_jobs[i];
+        if (job->is_active && !job->hidden) {
+            activities[activity_count].pid = job->pid;
+            activities[activity_count].job_number = job->job_number;
+            strncpy(activities[activity_count].command_name,
+                   job->command_name,
+                   MAX_PATH_LEN - 1);
+            activities[activity_count].command_name[MAX_PATH_LEN - 1] = '\0';
+            activities[activity_count].command = job->command;
+            activities[activity_count].state = job->state;
+            activities[activity_count].stats = NULL;
+            if (with_stats && sample_job_stats(job) == 0) {
+                activities[activity_count].stats = &job->stats;
+            }
+            activity_count++;
+        }
+    }
+    return activity_count;
+}
+
+/**
+ * @brief Format a byte count as a short human readable size (e.g. 4.2M)
+ */
+static void format_size(double bytes, char *buffer, size_t size) {
+    const char *units = "BKMGT";
+    int unit = 0;
+    while (bytes >= 1024 && unit < 4) {
+        bytes /= 1024;
+        unit++;
+    }
+    if (unit == 0) {
+        snprintf(buffer, size, "%.0f%c", bytes, units[unit]);
+    } else {
+        snprintf(buffer, size, "%.1f%c", bytes, units[unit]);
+    }
+}
+
+/**
+ * @brief Format the column header of the long listing
+ */
+static void format_long_header(char *line, size_t size) {
+    snprintf(line, size, "%-5s %-7s %-8s %6s %7s %8s %8s  %s",
+             "JOB", "PID", "STATE", "CPU%", "RSS", "READ/s", "WRITE/s", "COMMAND");
+}
+
+/**
+ * @brief Format one job of the long listing
+ */
+static void format_long_entry(const ActivityInfo *activity, char *line, size_t size) {
+    char job[16], pid[16], cpu[16] = "-", rss[16] = "-", read_rate[16] = "-", write_rate[16] = "-";
+    snprintf(job, sizeof(job), "[%d]", activity->job_number);
+    snprintf(pid, sizeof(pid), "%d", activity->pid);
+
+    const JobStats *stats = activity->stats;
+    if (stats != NULL) {
+        snprintf(cpu, sizeof(cpu), "%.1f", stats->cpu_percent);
+        format_size(stats->rss_kb * 1024.0, rss, sizeof(rss));
+        if (stats->has_io) {
+            format_size(stats->read_rate, read_rate, sizeof(read_rate));
+            format_size(stats->write_rate, write_rate, sizeof(write_rate));
+        }
+    }
+
+    snprintf(line, size, "%-5s %-7s %-8s %6s %7s %8s %8s  %s",
+             job, activity->pid > 0 ? pid : "-", state_name(activity->state),
+             cpu, rss, read_rate, write_rate, activity->command);
+}
+
+/**
+ * @brief Sleep for a sampling window while still serving the event loop
+ * @param ms Length of the window in milliseconds
+ */
+static void sampling_pause(int ms) {
+    if (!event_loop_available()) {
+        struct timespec pause = { ms / 1000, (ms % 1000) * 1000000L };
+        nanosleep(&pause, NULL);
+        return;
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int elapsed = 0;
+    while (elapsed < ms) {
+        if (run_event_loop_once(ms - elapsed) == -1) {
+            return;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+    }
+}
+
+/**
+ * @brief Print the long listing (activities -l)
+ * @return 0 on success
+ *
+ * Every running job is sampled twice, SAMPLE_INTERVAL_MS apart, so CPU%
+ * and I/O rates describe what the jobs are doing right now.
+ */
+static int print_long_activities(void) {
+    ActivityInfo activities[MAX_BACKGROUND_JOBS];
+    char line[WATCH_LINE_LEN];
+
+    if (collect_activities(activities, 1) == 0) {
+        return 0;
+    }
+    sampling_pause(SAMPLE_INTERVAL_MS);
+
+    int activity_count = collect_activities(activities, 1);
+    qsort(activities, activity_count, sizeof(ActivityInfo), compare_activities_by_cpu);
+
+    format_long_header(line, sizeof(line));
+    printf("%s\n", line);
+    for (int i = 0; i < activity_count; i++) {
+        format_long_entry(&activities[i], line, sizeof(line));
+        printf("%s\n", line);
+    }
+    return 0;
+}
+
+/**
+ * @brief Build one frame of the watch view
+ * @param lines Output lines
+ * @param max_lines Number of lines that fit on the screen
+ * @param width Screen width (lines are truncated to it)
+ * @param refresh_ms Refresh interval shown in the title
+ * @return Number of lines in the frame
+ */
+static int build_watch_frame(char lines[][WATCH_LINE_LEN], int max_lines, int width, int refresh_ms) {
+    ActivityInfo activities[MAX_BACKGROUND_JOBS];
+    int activity_count = collect_activities(activities, 1);
+    qsort(activities, activity_count, sizeof(ActivityInfo), compare_activities_by_cpu);
+
+    int counts[4] = { 0 };
+    double total_cpu = 0;
+    for (int i = 0; i < activity_count; i++) {
+        counts[activities[i].state]++;
+        if (activities[i].stats != NULL) {
+            total_cpu += activities[i].stats->cpu_percent;
+        }
+    }
+
+    int line_count = 0;
+    snprintf(lines[line_count++], WATCH_LINE_LEN,
+             "Jobs: %d running, %d stopped, %d queued, %d done  CPU: %.1f%%  every %.1fs (q to quit)",
+             counts[PROCESS_RUNNING], counts[PROCESS_STOPPED], counts[PROCESS_QUEUED],
+             counts[PROCESS_DONE], total_cpu, refresh_ms / 1000.0);
+    lines[line_count++][0] = '\0';
+    format_long_header(lines[line_count++], WATCH_LINE_LEN);
+    for (int i = 0; i < activity_count && line_count < max_lines; i++) {
+        format_long_entry(&activities[i], lines[line_count++], WATCH_LINE_LEN);
+    }
+
+    if (width > 0 && width < WATCH_LINE_LEN) {
+        for (int i = 0; i < line_count; i++) {
+            lines[i][width] = '\0';
+        }
+    }
+    return line_count;
+}
+
+/**
+ * @brief Draw a frame, rewriting only the lines that changed since the last one
+ * @param lines New frame
+ * @param line_count Number of lines in the new frame
+ * @param previous Previous frame (updated to the new one)
+ * @param previous_count Number of lines in the previous frame, -1 for none
+ */
+static void draw_watch_frame(char lines[][WATCH_LINE_LEN], int line_count,
+                             char previous[][WATCH_LINE_LEN], int previous_count) {
+    if (previous_count == -1) {
+        printf("\033[H\033[2J");
+    }
+    for (int i = 0; i < line_count; i++) {
+        if (i < previous_count && strcmp(lines[i], previous[i]) == 0) {
+            continue;
+        }
+        printf("\033[%d;1H%s\033[K", i + 1, lines[i]);
+        strcpy(previous[i], lines[i]);
+    }
+    if (line_count < previous_count) {
+        // Jobs went away: clear everything below the frame
+        printf("\033[%d;1H\033[J", line_count + 1);
+    }
+    printf("\033[%d;1H", line_count + 1);
+    fflush(stdout);
+}
+
+/**
+ * @brief Check the keyboard for a quit request
+ * @param interactive stdin is a terminal in non-canonical mode
+ * @return 1 if the watch view should end
+ */
+static int watch_should_quit(int interactive) {
+    int c = fgetc(stdin);
+    if (c == EOF) {
+        clearerr(stdin);
+        return 1;
+    }
+    if (!interactive) {
+        // Scripted input: consume the rest of the line
+        int rest = c;
+        while (rest != '\n' && rest != EOF) {
+            rest = fgetc(stdin);
+        }
+    }
+    return c == 'q' || c == 'Q';
+}
+
+/**
+ * @brief Run the top-style watch view (activities -w)
+ * @param refresh_ms Refresh interval in milliseconds
+ * @return 0 on success
+ *
+ * On a terminal only changed lines are redrawn. The view ends on q,
+ * Ctrl-C or end of input; captured output and finished jobs keep being
+ * handled by the event loop meanwhile.
+ */
+static int watch_activities(int refresh_ms) {
+    static char lines[WATCH_MAX_LINES][WATCH_LINE_LEN];
+    static char previous[WATCH_MAX_LINES][WATCH_LINE_LEN];
+    int on_terminal = isatty(STDOUT_FILENO);
+    int interactive = isatty(STDIN_FILENO);
+    struct termios saved_termios;
+
+    if (interactive && tcgetattr(STDIN_FILENO, &saved_termios) == 0) {
+        struct termios raw = saved_termios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    } else {
+        interactive = 0;
+    }
+    if (on_terminal) {
+        printf("\033[?25l");
+    }
+
+    // Baseline sample so the first frame already has rates
+    ActivityInfo baseline[MAX_BACKGROUND_JOBS];
+    collect_activities(baseline, 1);
+    sampling_pause(SAMPLE_INTERVAL_MS);
+
+    int previous_count = -1;
+    while (1) {
+        int max_lines = WATCH_MAX_LINES;
+        int width = 0;
+        struct winsize window;
+        if (on_terminal && ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_row > 1) {
+            max_lines = window.ws_row - 1 < WATCH_MAX_LINES ? window.ws_row - 1 : WATCH_MAX_LINES;
+            width = window.ws_col;
+        }
+
+        int line_count = build_watch_frame(lines, max_lines, width, refresh_ms);
+        if (on_terminal) {
+            draw_watch_frame(lines, line_count, previous, previous_count);
+            previous_count = line_count;
+        } else {
+            for (int i = 0; i < line_count; i++) {
+                printf("%s\n", lines[i]);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+
+        int ready = wait_for_input_timeout(refresh_ms);
+        if (ready == -1 || (ready == 1 && watch_should_quit(interactive))) {
+            break;
+        }
+        reap_background_jobs();
+    }
+
+    if (on_terminal) {
+        printf("\033[?25h");
+        fflush(stdout);
+    }
+    if (interactive) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+    }
+    return 0;
+}
+
 /**
  * @brief Execute the activities command
- * 
+ * @return 0 on success, 1 on invalid usage
+ *
  * Requirements implemented:
  * - Display format: [pid] : command_name - State
  * - Sort output lexicographically by command name
  * - Remove terminated processes from list (done in check_background_jobs)
  * - Show "Running" for running processes and "Stopped" for stopped processes
+ * - Show "Queued" for jobs waiting for a slot under `set maxjobs`
+ * - Show "Done" for finished jobs whose captured output has not been read
+ *
+ * Options:
+ * - -l          add CPU%, RSS and storage read/write rates, busiest job first
+ * - -w [SECS]   top-style view of the -l columns, refreshed every SECS
+ *               seconds (default 1) until q or Ctrl-C
  */
-void execute_activities(void) {
-    ActivityInfo activities[MAX_BACKGROUND_JOBS];
-    int activity_count = 0;
-    
-    // Collect all active background jobs
-    for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
-        if (background_jobs[i].is_active) {
-            activities[activity_count].pid = background_jobs[i].pid;
-            strncpy(activities[activity_count].command_name, 
-                   background_jobs[i].command_name, 
-                   MAX_PATH_LEN - 1);
-            activities[activity_count].command_name[MAX_PATH_LEN - 1] = '\0';
-            activities[activity_count].state = background_jobs[i].state;
-            activity_count++;
+int execute_activities(void) {
+    if (token_count > 1 && tokens[1].type == TOKEN_NAME) {
+        if (strcmp(tokens[1].value, "-l") == 0 && (token_count == 2 || tokens[2].type != TOKEN_NAME)) {
+            return print_long_activities();
+        }
+        if (strcmp(tokens[1].value, "-w") == 0) {
+            int refresh_ms = DEFAULT_REFRESH_MS;
+            if (token_count > 2 && tokens[2].type == TOKEN_NAME) {
+                char *end;
+                double seconds = strtod(tokens[2].value, &end);
+                if (*end != '\0' || seconds * 1000 < MIN_REFRESH_MS) {
+                    printf("activities: Invalid refresh interval: %s\n", tokens[2].value);
+                    return 1;
+                }
+                refresh_ms = (int)(seconds * 1000);
+            }
+            return watch_activities(refresh_ms);
         }
+        printf("Usage: activities [-l | -w [SECONDS]]\n");
+        return 1;
     }
-    
+
+    ActivityInfo activities[MAX_BACKGROUND_JOBS];
+    int activity_count = collect_activities(activities, 0);
+
     // Sort activities lexicographically by command name
     if (activity_count > 0) {
         qsort(activities, activity_count, sizeof(ActivityInfo), compare_activities);
-        
-        // Display sorted activities
+
+        // Display sorted activities; a queued job has no pid yet, so it shows its job number
         for (int i = 0; i < activity_count; i++) {
-            const char *state_str = (activities[i].state == PROCESS_RUNNING) ? "Running" : "Stopped";
-            printf("[%d] : %s - %s\n", 
-                   activities[i].pid, 
-                   activities[i].command_name, 
-                   state_str);
+            if (activities[i].state == PROCESS_QUEUED) {
+                printf("[queued %%%d] : %s - %s\n",
+                       activities[i].job_number,
+                       activities[i].command_name,
+                       state_name(activities[i].state));
+                continue;
+            }
+            printf("[%d] : %s - %s\n",
+                   activities[i].pid,
+                   activities[i].command_name,
+                   state_name(activities[i].state));
         }
     }
     // If no active processes, print nothing (as per requirement)
-}
\ No newline at end of file
+    return 0;
+}
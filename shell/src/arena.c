@@ -0,0 +1,102 @@
+#include "shell.h"
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/**
+ * @brief One block of the arena (blocks are chained newest first)
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *previous;
+    size_t base;                // Arena offset of the block's first byte
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} ArenaBlock;
+
+// Newest block, and one released block kept for reuse
+static ArenaBlock *arena = NULL;
+static ArenaBlock *spare_block = NULL;
+
+/**
+ * @brief Allocate memory that lives until the arena is released past it
+ * @param size Bytes wanted
+ * @return Memory aligned for any type, NULL if out of memory (message printed)
+ *
+ * Allocation is a pointer bump; a new block is only needed every 64 KiB
+ * (or for one larger request). Nothing is freed on its own: see
+ * arena_mark() and arena_release().
+ */
+void* arena_alloc(size_t size) {
+    size_t align = _Alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+    if (arena == NULL || arena->size - arena->used < size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        ArenaBlock *block = spare_block;
+        if (block != NULL && block->size >= block_size) {
+            spare_block = NULL;
+        } else {
+            block = malloc(sizeof(ArenaBlock) + block_size);
+            if (block == NULL) {
+                perror("malloc arena");
+                return NULL;
+            }
+            block->size = block_size;
+        }
+        block->previous = arena;
+        block->base = arena != NULL ? arena->base + arena->used : 0;
+        block->used = 0;
+        arena = block;
+    }
+    void *memory = (char*)arena->data + arena->used;
+    arena->used += size;
+    return memory;
+}
+
+/**
+ * @brief Copy text into the arena
+ * @param text Text to copy (need not be NUL-terminated)
+ * @param length Bytes to copy
+ * @return NUL-terminated copy, NULL if out of memory (message printed)
+ */
+char* arena_strndup(const char *text, size_t length) {
+    char *copy = arena_alloc(length + 1);
+    if (copy != NULL) {
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+/**
+ * @brief Remember how much of the arena is in use
+ * @return Mark to pass to arena_release()
+ */
+size_t arena_mark(void) {
+    return arena != NULL ? arena->base + arena->used : 0;
+}
+
+/**
+ * @brief Free everything allocated since a mark
+ * @param mark Value from arena_mark(); 0 empties the arena
+ *
+ * Marks nest like a stack: releasing a mark also releases every mark
+ * taken after it. The first block is kept, and so is the largest block
+ * released, so a loop that allocates and releases each iteration does
+ * not call malloc again.
+ */
+void arena_release(size_t mark) {
+    while (arena != NULL && arena->previous != NULL && arena->base >= mark) {
+        ArenaBlock *block = arena;
+        arena = block->previous;
+        if (spare_block == NULL || spare_block->size < block->size) {
+            free(spare_block);
+            spare_block = block;
+        } else {
+            free(block);
+        }
+    }
+    if (arena != NULL) {
+        arena->used = mark > arena->base ? mark - arena->base : 0;
+    }
+}
@@ -0,0 +1,242 @@
+#include "shell.h"
+#include <sys/wait.h>
+#include <errno.h>
+
+// Room left for the kernel's own bookkeeping when filling a batch (as xargs does)
+#define ARG_HEADROOM 2048
+// Longest single argument exec accepts (MAX_ARG_STRLEN: 32 pages)
+#define MAX_ARG_LENGTH (32 * 4096)
+
+/**
+ * @brief Collect a command's arguments from the current tokens
+ * @param start_index First token of the command
+ * @param end_index One past its last token
+ * @param count Set to the number of arguments
+ * @return NULL-terminated vector pointing into tokens[], NULL if out of memory
+ *
+ * Redirection operators and their file names are skipped. The vector is
+ * one arena allocation sized for the command, so there is no fixed cap
+ * on the number of arguments and nothing for the caller to free.
+ */
+char** build_arg_vector(int start_index, int end_index, int *count) {
+    *count = 0;
+    for (int i = start_index; i < end_index; i++) {
+        if (tokens[i].type == TOKEN_NAME && !is_redirect_filename(i, start_index)) {
+            (*count)++;
+        }
+    }
+    char **args = arena_alloc(sizeof(char*) * (*count + 1));
+    if (args == NULL) {
+        *count = 0;
+        return NULL;
+    }
+    int arg_count = 0;
+    for (int i = start_index; i < end_index; i++) {
+        if (tokens[i].type == TOKEN_NAME && !is_redirect_filename(i, start_index)) {
+            args[arg_count++] = tokens[i].value;
+        }
+    }
+    args[arg_count] = NULL;
+    return args;
+}
+
+/**
+ * @brief Bytes a string vector takes out of ARG_MAX (strings and pointers)
+ */
+static size_t vector_bytes(char **vector, int *count) {
+    size_t bytes = 0;
+    int n = 0;
+    for (; vector[n] != NULL; n++) {
+        bytes += strlen(vector[n]) + 1 + sizeof(char*);
+    }
+    if (count != NULL) {
+        *count = n;
+    }
+    return bytes + sizeof(char*);
+}
+
+/**
+ * @brief Report a failed exec and end the forked child
+ * @param args The argument vector that could not be run
+ *
+ * An argument list that is too long gets its size and the limit, since
+ * "not found" would send the user looking in the wrong place. Exits
+ * with 127 if the command was not found, 126 otherwise, without
+ * flushing the shell's stdin (which the parent still reads).
+ */
+_Noreturn void exit_exec_failure(char **args) {
+    int error = errno;
+    if (error == E2BIG) {
+        int count;
+        size_t bytes = vector_bytes(args, &count);
+        size_t environment = vector_bytes(build_environment(), NULL);
+        printf("Error: Argument list too long for %s: %d arguments, %zu bytes plus %zu of environment "
+               "(limit %ld); run it with the batch prefix\n",
+               args[0], count, bytes, environment, sysconf(_SC_ARG_MAX));
+    } else if (error == ENOENT) {
+        printf("Command not found!\n");
+    } else {
+        printf("Error: Cannot run %s: %s\n", args[0], strerror(error));
+    }
+    fflush(stdout);
+    _exit(error == ENOENT ? 127 : 126);
+}
+
+/**
+ * @brief Fork and exec one batch
+ * @return Process ID, -1 on error
+ */
+static pid_t start_batch(char **batch) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        exec_with_environment(batch);
+        exit_exec_failure(batch);
+    } else if (pid == -1) {
+        perror("fork");
+    }
+    return pid;
+}
+
+/**
+ * @brief Fold a batch's wait status into the overall status, xargs-style
+ * @return 1 if no further batches should start
+ *
+ * 123 if any batch failed, 124 if one exited with 255, 125 if one was
+ * killed by a signal, 126/127 if the command could not be run.
+ */
+static int record_batch_status(int status, int *result) {
+    if (WIFSIGNALED(status)) {
+        *result = 125;
+        return 1;
+    }
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    if (code == 255 || code == 126 || code == 127) {
+        *result = code == 255 ? 124 : code;
+        return 1;
+    }
+    if (code != 0 && *result == 0) {
+        *result = 123;
+    }
+    return 0;
+}
+
+/**
+ * @brief Run a command as several execs whose argument lists fit (batch prefix)
+ * @param args Full argument vector: command, fixed arguments, [:::], items
+ * @param options batch_jobs, batch_max_args and batch_max_bytes
+ * @return Exit status for the whole command
+ *
+ * Runs in the forked child that would otherwise have exec'd the command,
+ * so the batches share its process group, redirections and limits.
+ * Without ::: only the command name is repeated in every batch; with it,
+ * everything before ::: is. Each batch takes as many items as fit in
+ * ARG_MAX (less the environment) or -s BYTES, and at most -n N of them.
+ * Up to -j N batches run at once. The vector for each batch is built in
+ * one array reused for every batch.
+ */
+int run_batches(char **args, const JobOptions *options) {
+    int total;
+    vector_bytes(args, &total);
+    int fixed = 1;
+    for (int i = 1; i < total; i++) {
+        if (strcmp(args[i], ":::") == 0) {
+            fixed = i;
+            break;
+        }
+    }
+    int first_item = fixed + (fixed < total && strcmp(args[fixed], ":::") == 0);
+
+    long long limit = options->batch_max_bytes;
+    if (limit == 0) {
+        apply_command_assignments();
+        limit = sysconf(_SC_ARG_MAX) - (long long)vector_bytes(build_environment(), NULL) - ARG_HEADROOM;
+    }
+    long long fixed_bytes = sizeof(char*);
+    for (int i = 0; i < fixed; i++) {
+        fixed_bytes += strlen(args[i]) + 1 + sizeof(char*);
+    }
+
+    char **batch = malloc(sizeof(char*) * (total + 1));
+    pid_t *running = malloc(sizeof(pid_t) * options->batch_jobs);
+    if (batch == NULL || running == NULL) {
+        perror("malloc batch");
+        return 1;
+    }
+    memcpy(batch, args, sizeof(char*) * fixed);
+
+    int result = 0;
+    int running_count = 0;
+    int next = first_item;
+    int halted = 0;
+    int started = 0;
+    while (1) {
+        // Fill the free slots with the next batches
+        while (!halted && running_count < options->batch_jobs && (next < total || started == 0)) {
+            int count = fixed;
+            long long bytes = fixed_bytes;
+            while (next < total && (options->batch_max_args == 0 || count - fixed < options->batch_max_args)) {
+                size_t length = strlen(args[next]) + 1;
+                if (length > MAX_ARG_LENGTH || bytes + (long long)(length + sizeof(char*)) > limit) {
+                    break;
+                }
+                bytes += length + sizeof(char*);
+                batch[count++] = args[next++];
+            }
+            if (count == fixed && next < total) {
+                printf("batch: Argument too long to pass to %s: %.40s...\n", args[0], args[next]);
+                result = 126;
+                halted = 1;
+                break;
+            }
+            batch[count] = NULL;
+            pid_t pid = start_batch(batch);
+            if (pid == -1) {
+                result = 126;
+                halted = 1;
+                break;
+            }
+            running[running_count++] = pid;
+            started++;
+        }
+        if (running_count == 0) {
+            break;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int r = 0; r < running_count; r++) {
+            if (running[r] == pid) {
+                running[r] = running[--running_count];
+                halted |= record_batch_status(status, &result);
+                break;
+            }
+        }
+    }
+    free(batch);
+    free(running);
+    return result;
+}
+
+/**
+ * @brief Replace the forked child with a command, or with its batches
+ * @param args NULL-terminated argument vector
+ * @param options Options of the command (NULL for none); a batch prefix
+ *                runs the batches and exits with their status
+ *
+ * Never returns.
+ */
+_Noreturn void exec_command(char **args, const JobOptions *options) {
+    if (options != NULL && options->batch_jobs > 0) {
+        int status = run_batches(args, options);
+        fflush(stdout);
+        _exit(status);
+    }
+    exec_with_environment(args);
+    exit_exec_failure(args);
+}
@@ -0,0 +1,441 @@
+#include "shell.h"
+#include <limits.h>
+
+#define MAX_ARITHMETIC_DEPTH 32    // Variables whose values are expressions, nested
+
+/**
+ * @brief State of one arithmetic evaluation
+ *
+ * The expression is evaluated while it is parsed. Inside the side of
+ * &&, || or ?: that is not taken, skip is set: it is still parsed, but
+ * assigns nothing and cannot divide by zero.
+ */
+typedef struct {
+    const char *text;       // Whole expression, for messages
+    const char *p;          // Current position
+    int skip;
+    int failed;
+    int depth;              // Nesting through variable values
+} Arith;
+
+/**
+ * @brief Binary operators by precedence (higher binds tighter)
+ *
+ * Longer operators come first so that `**` is not read as `*`.
+ */
+static const struct {
+    const char *op;
+    int precedence;
+} binary_operators[] = {
+    { "||", 1 }, { "&&", 2 },
+    { "==", 6 }, { "!=", 6 }, { "<=", 7 }, { ">=", 7 }, { "<<", 8 }, { ">>", 8 }, { "**", 11 },
+    { "|", 3 }, { "^", 4 }, { "&", 5 }, { "<", 7 }, { ">", 7 },
+    { "+", 9 }, { "-", 9 }, { "*", 10 }, { "/", 10 }, { "%", 10 },
+};
+
+/**
+ * @brief Assignment operators, longest first
+ */
+static const char *assignment_operators[] = {
+    "<<=", ">>=", "+=", "-=", "*=", "/=", "%=", "&=", "^=", "|=", "="
+};
+
+static long long parse_comma(Arith *a);
+static long long parse_assignment(Arith *a);
+
+/**
+ * @brief Stop the evaluation with an error
+ */
+static void arith_fail(Arith *a, const char *message) {
+    if (!a->failed) {
+        a->failed = 1;
+        printf("Error: %s: %s\n", a->text, message);
+    }
+}
+
+/**
+ * @brief Skip whitespace
+ */
+static void skip_spaces(Arith *a) {
+    while (isspace((unsigned char)*a->p)) {
+        a->p++;
+    }
+}
+
+/**
+ * @brief Consume an operator if it is next
+ * @return 1 if it was there
+ */
+static int accept(Arith *a, const char *op) {
+    skip_spaces(a);
+    size_t length = strlen(op);
+    if (strncmp(a->p, op, length) == 0) {
+        a->p += length;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Length of the variable name at p, 0 if there is none
+ */
+static size_t name_length(const char *p) {
+    if (!(isalpha((unsigned char)*p) || *p == '_')) {
+        return 0;
+    }
+    size_t length = 1;
+    while (isalnum((unsigned char)p[length]) || p[length] == '_') {
+        length++;
+    }
+    return length;
+}
+
+/**
+ * @brief Get the value of a variable as a number
+ *
+ * Unset and empty variables are 0; any other value is evaluated as an
+ * expression itself, so `a=b+1` makes $((a)) follow b.
+ */
+static long long variable_value(Arith *a, const char *name) {
+    const char *value = get_variable(name);
+    if (value == NULL || *value == '\0') {
+        return 0;
+    }
+    if (a->depth >= MAX_ARITHMETIC_DEPTH) {
+        arith_fail(a, "Expression recursion level exceeded");
+        return 0;
+    }
+    Arith inner = { value, value, a->skip, 0, a->depth + 1 };
+    long long result = parse_comma(&inner);
+    skip_spaces(&inner);
+    if (!inner.failed && *inner.p != '\0') {
+        arith_fail(&inner, "Syntax error in expression");
+    }
+    a->failed |= inner.failed;
+    return result;
+}
+
+/**
+ * @brief Store a number in a variable (not on a skipped side)
+ */
+static void assign(Arith *a, const char *name, long long value) {
+    if (a->skip || a->failed) {
+        return;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), "%lld", value);
+    set_variable(name, text, 0);
+}
+
+/**
+ * @brief Apply a binary operator
+ *
+ * Arithmetic wraps around like in bash: +, - and * are done unsigned,
+ * and LLONG_MIN / -1 gives LLONG_MIN instead of a trap.
+ */
+static long long apply_operator(Arith *a, const char *op, long long left, long long right) {
+    unsigned long long l = (unsigned long long)left;
+    unsigned long long r = (unsigned long long)right;
+    switch (op[0]) {
+    case '+':
+        return (long long)(l + r);
+    case '-':
+        return (long long)(l - r);
+    case '*':
+        if (op[1] == '*') {
+            if (right < 0) {
+                arith_fail(a, "Exponent less than 0");
+                return 0;
+            }
+            unsigned long long result = 1;
+            while (r > 0) {
+                if (r & 1) {
+                    result *= l;
+                }
+                l *= l;
+                r >>= 1;
+            }
+            return (long long)result;
+        }
+        return (long long)(l * r);
+    case '/':
+    case '%':
+        if (right == 0) {
+            if (!a->skip) {
+                arith_fail(a, "Division by zero");
+            }
+            return 0;
+        }
+        if (right == -1) {
+            return op[0] == '/' ? (long long)(0 - l) : 0;
+        }
+        return op[0] == '/' ? left / right : left % right;
+    case '<':
+        if (op[1] == '<') {
+            return (long long)(l << (r & 63));
+        }
+        return op[1] == '=' ? left <= right : left < right;
+    case '>':
+        if (op[1] == '>') {
+            return left >> (r & 63);
+        }
+        return op[1] == '=' ? left >= right : left > right;
+    case '=':
+        return left == right;
+    case '!':
+        return left != right;
+    case '&':
+        return left & right;
+    case '|':
+        return left | right;
+    case '^':
+        return left ^ right;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parse a number, variable or parenthesised expression, with postfix ++/--
+ */
+static long long parse_primary(Arith *a) {
+    skip_spaces(a);
+    if (accept(a, "(")) {
+        long long value = parse_comma(a);
+        if (!accept(a, ")")) {
+            arith_fail(a, "Missing ')'");
+        }
+        return value;
+    }
+    if (isdigit((unsigned char)*a->p)) {
+        char *end;
+        long long value = strtoll(a->p, &end, 0);
+        if (isalnum((unsigned char)*end) || *end == '_') {
+            arith_fail(a, "Value too great for base");
+            return 0;
+        }
+        a->p = end;
+        return value;
+    }
+    size_t length = name_length(a->p);
+    if (length == 0) {
+        arith_fail(a, *a->p == '\0' ? "Operand expected" : "Syntax error in expression");
+        return 0;
+    }
+    char name[MAX_PATH_LEN];
+    snprintf(name, sizeof(name), "%.*s", (int)length, a->p);
+    a->p += length;
+    long long value = variable_value(a, name);
+    if (accept(a, "++")) {
+        assign(a, name, (long long)((unsigned long long)value + 1));
+    } else if (accept(a, "--")) {
+        assign(a, name, (long long)((unsigned long long)value - 1));
+    }
+    return value;
+}
+
+/**
+ * @brief Parse unary operators: + - ! ~ and prefix ++/--
+ */
+static long long parse_unary(Arith *a) {
+    skip_spaces(a);
+    if ((strncmp(a->p, "++", 2) == 0 || strncmp(a->p, "--", 2) == 0)) {
+        const char *after = a->p + 2;
+        while (isspace((unsigned char)*after)) {
+            after++;
+        }
+        size_t length = name_length(after);
+        if (length > 0) {
+            int increment = a->p[0] == '+' ? 1 : -1;
+            char name[MAX_PATH_LEN];
+            snprintf(name, sizeof(name), "%.*s", (int)length, after);
+            a->p = after + length;
+            long long value = (long long)((unsigned long long)variable_value(a, name) + increment);
+            assign(a, name, value);
+            return value;
+        }
+    }
+    if (accept(a, "+")) {
+        return parse_unary(a);
+    }
+    if (accept(a, "-")) {
+        return (long long)(0 - (unsigned long long)parse_unary(a));
+    }
+    if (accept(a, "!")) {
+        return !parse_unary(a);
+    }
+    if (accept(a, "~")) {
+        return ~parse_unary(a);
+    }
+    return parse_primary(a);
+}
+
+/**
+ * @brief Find the binary operator at the current position
+ * @return Index in binary_operators, -1 if there is none
+ *
+ * An operator followed by `=` (`+=`, `<<=`) is an assignment, not a
+ * binary operator.
+ */
+static int peek_binary_operator(Arith *a) {
+    skip_spaces(a);
+    for (size_t i = 0; i < sizeof(binary_operators) / sizeof(binary_operators[0]); i++) {
+        const char *op = binary_operators[i].op;
+        size_t length = strlen(op);
+        if (strncmp(a->p, op, length) == 0) {
+            int comparison = strcmp(op, "==") == 0 || strcmp(op, "!=") == 0 ||
+                             strcmp(op, "<=") == 0 || strcmp(op, ">=") == 0;
+            if (a->p[length] == '=' && !comparison) {
+                return -1;
+            }
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Precedence climbing over the binary operators
+ * @param min_precedence Only operators binding at least this tightly
+ *
+ * All operators are left-associative except `**`. The right side of
+ * && and || is skipped once the left side decides.
+ */
+static long long parse_binary(Arith *a, int min_precedence) {
+    long long left = parse_unary(a);
+    while (!a->failed) {
+        int index = peek_binary_operator(a);
+        if (index < 0 || binary_operators[index].precedence < min_precedence) {
+            break;
+        }
+        const char *op = binary_operators[index].op;
+        int precedence = binary_operators[index].precedence;
+        a->p += strlen(op);
+
+        int short_circuit = (strcmp(op, "&&") == 0 && left == 0) || (strcmp(op, "||") == 0 && left != 0);
+        a->skip += short_circuit;
+        long long right = parse_binary(a, strcmp(op, "**") == 0 ? precedence : precedence + 1);
+        a->skip -= short_circuit;
+
+        if (strcmp(op, "&&") == 0) {
+            left = left != 0 && right != 0;
+        } else if (strcmp(op, "||") == 0) {
+            left = left != 0 || right != 0;
+        } else {
+            left = apply_operator(a, op, left, right);
+        }
+    }
+    return left;
+}
+
+/**
+ * @brief Parse cond ? expr : expr
+ */
+static long long parse_conditional(Arith *a) {
+    long long condition = parse_binary(a, 1);
+    if (a->failed || !accept(a, "?")) {
+        return condition;
+    }
+    a->skip += condition == 0;
+    long long when_true = parse_comma(a);
+    a->skip -= condition == 0;
+    if (!accept(a, ":")) {
+        arith_fail(a, "Expected ':' in conditional expression");
+        return 0;
+    }
+    a->skip += condition != 0;
+    long long when_false = parse_conditional(a);
+    a->skip -= condition != 0;
+    return condition != 0 ? when_true : when_false;
+}
+
+/**
+ * @brief Parse NAME op= expr (right-associative), or a conditional
+ */
+static long long parse_assignment(Arith *a) {
+    skip_spaces(a);
+    size_t length = name_length(a->p);
+    if (length > 0) {
+        const char *after = a->p + length;
+        while (isspace((unsigned char)*after)) {
+            after++;
+        }
+        for (size_t i = 0; i < sizeof(assignment_operators) / sizeof(assignment_operators[0]); i++) {
+            const char *op = assignment_operators[i];
+            size_t op_length = strlen(op);
+            if (strncmp(after, op, op_length) != 0 || (strcmp(op, "=") == 0 && after[1] == '=')) {
+                continue;
+            }
+            char name[MAX_PATH_LEN];
+            snprintf(name, sizeof(name), "%.*s", (int)length, a->p);
+            a->p = after + op_length;
+            long long value = parse_assignment(a);
+            if (op_length > 1) {
+                char binary[3] = { op[0], op_length == 3 ? op[1] : '\0', '\0' };
+                value = apply_operator(a, binary, variable_value(a, name), value);
+            }
+            assign(a, name, value);
+            return value;
+        }
+    }
+    return parse_conditional(a);
+}
+
+/**
+ * @brief Parse expr , expr ... (the value of the last one)
+ */
+static long long parse_comma(Arith *a) {
+    long long value = parse_assignment(a);
+    while (!a->failed && accept(a, ",")) {
+        value = parse_assignment(a);
+    }
+    return value;
+}
+
+/**
+ * @brief Evaluate an arithmetic expression in the shell
+ * @param expression Text between $(( and )), already expanded
+ * @param result Set to the value
+ * @return 0 on success, -1 on error (message printed)
+ *
+ * Integers are 64-bit. Supported, loosest binding first: `,`, the
+ * assignments (= += -= *= /= %= <<= >>= &= ^= |=), ?:, ||, &&, |, ^, &,
+ * == !=, < <= > >=, << >>, + -, * / %, ** and the unary + - ! ~ ++ --.
+ * Numbers may be decimal, 0x hex or 0 octal; bare names are variables.
+ * An empty expression is 0.
+ */
+int evaluate_arithmetic(const char *expression, long long *result) {
+    Arith a = { expression, expression, 0, 0, 0 };
+    skip_spaces(&a);
+    *result = *a.p == '\0' ? 0 : parse_comma(&a);
+    skip_spaces(&a);
+    if (!a.failed && *a.p != '\0') {
+        arith_fail(&a, "Syntax error in expression");
+    }
+    return a.failed ? -1 : 0;
+}
+
+/**
+ * @brief Execute the let command
+ * @return 0 if the last expression is non-zero, 1 if it is zero or on error
+ *
+ * Syntax: let EXPRESSION...
+ * Every argument is one expression, e.g. `let i++ total+=i`.
+ */
+int execute_let(void) {
+    long long value = 0;
+    int expressions = 0;
+    for (int i = 1; i < token_count && tokens[i].type == TOKEN_NAME; i++) {
+        if (is_redirect_filename(i, 0)) {
+            continue;
+        }
+        expressions++;
+        if (evaluate_arithmetic(tokens[i].value, &value) == -1) {
+            return 1;
+        }
+    }
+    if (expressions == 0) {
+        printf("let: Expression expected\n");
+        return 1;
+    }
+    return value == 0;
+}
@@ -7,6 +7,78 @@
 BackgroundJob background_jobs[MAX_BACKGROUND_JOBS];
 int next_job_number = 1;
 
+/**
+ * @brief Reset the bookkeeping fields of a job slot
+ * @param job Slot to reset (its capture, timer, stats and cgroup must already be released)
+ */
+static void reset_job_slot(BackgroundJob *job) {
+    job->state = PROCESS_RUNNING;
+    init_job_options(&job->options);
+    job->wait_status = 0;
+    job->notified = 0;
+    job->managed = 0;
+    job->capture = NULL;
+    job->timer = NULL;
+    init_job_stats(&job->stats);
+    job->cgroup_fd = -1;
+    job->has_terminal_modes = 0;
+    job->leader_reaped = 0;
+    job->hidden = 0;
+    job->queued_tokens = NULL;
+    job->queued_token_count = 0;
+}
+
+/**
+ * @brief Free the tokens a queued job was saved with
+ */
+static void release_queued_tokens(BackgroundJob *job) {
+    if (job->queued_tokens == NULL) {
+        return;
+    }
+    for (int i = 0; i < job->queued_token_count; i++) {
+        if (job->queued_tokens[i].heredoc_fd != -1) {
+            close(job->queued_tokens[i].heredoc_fd);
+        }
+    }
+    free_token_values(job->queued_tokens, job->queued_token_count);
+    free(job->queued_tokens);
+    job->queued_tokens = NULL;
+    job->queued_token_count = 0;
+}
+
+/**
+ * @brief Keep the expanded tokens of a command in a queued job
+ * @param job Job to run them later
+ * @param start_index First token of the command (after any job prefix)
+ * @param end_index One past its last token
+ * @return 0 on success, -1 on error
+ *
+ * The words are stored as expansion left them, together with their
+ * redirection operators and heredoc bodies, so the job runs exactly
+ * this command: nothing in it is lexed or expanded again.
+ */
+static int save_queued_tokens(BackgroundJob *job, int start_index, int end_index) {
+    int count = end_index - start_index;
+    Token *copy = malloc(sizeof(Token) * (count > 0 ? count : 1));
+    if (copy == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(copy, tokens + start_index, sizeof(Token) * count);
+    if (copy_token_values(copy, count) == -1) {
+        free(copy);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (copy[i].heredoc_fd != -1 && (copy[i].heredoc_fd = fcntl(copy[i].heredoc_fd, F_DUPFD_CLOEXEC, 0)) == -1) {
+            perror("heredoc dup");
+        }
+    }
+    job->queued_tokens = copy;
+    job->queued_token_count = count;
+    return 0;
+}
+
 /**
  * @brief Initialize the background jobs system
  */
@@ -15,13 +87,33 @@ void init_background_jobs(void) {
         background_jobs[i].is_active = 0;
         background_jobs[i].pid = 0;
         background_jobs[i].job_number = 0;
-        background_jobs[i].command[0] = '\0';
+        background_jobs[i].command = NULL;
         background_jobs[i].command_name[0] = '\0';
-        background_jobs[i].state = PROCESS_RUNNING;
+        reset_job_slot(&background_jobs[i]);
     }
     next_job_number = 1;
 }
 
+/**
+ * @brief Free the slot of the oldest finished job kept only for its log
+ * @return 1 if a slot was freed, 0 otherwise
+ */
+static int evict_finished_job(void) {
+    int oldest = -1;
+    for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+        if (background_jobs[i].is_active && background_jobs[i].state == PROCESS_DONE &&
+            background_jobs[i].notified &&
+            (oldest == -1 || background_jobs[i].job_number < background_jobs[oldest].job_number)) {
+            oldest = i;
+        }
+    }
+    if (oldest == -1) {
+        return 0;
+    }
+    cleanup_background_job(oldest);
+    return 1;
+}
+
 /**
  * @brief Add a background job to the tracking system
  * @param pid Process ID of the background job
@@ -32,12 +124,15 @@ int add_background_job(pid_t pid, const char* command) {
     // Find an empty slot
     for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
         if (!background_jobs[i].is_active) {
+            background_jobs[i].command = strdup(command);
+            if (background_jobs[i].command == NULL) {
+                perror("strdup");
+                return -1;
+            }
             background_jobs[i].pid = pid;
             background_jobs[i].job_number = next_job_number++;
             background_jobs[i].is_active = 1;
-            background_jobs[i].state = PROCESS_RUNNING;
-            strncpy(background_jobs[i].command, command, MAX_PATH_LEN - 1);
-            background_jobs[i].command[MAX_PATH_LEN - 1] = '\0';
+            reset_job_slot(&background_jobs[i]);
             
             // Extract command name (first word) for activities sorting
             strncpy(background_jobs[i].command_name, command, MAX_PATH_LEN - 1);
@@ -53,12 +148,75 @@ int add_background_job(pid_t pid, const char* command) {
         }
     }
     
+    // Finished jobs kept for `joblog` give way to new ones
+    if (evict_finished_job()) {
+        return add_background_job(pid, command);
+    }
+    
+    printf("Error: Maximum number of background jobs reached\n");
+    return -1;
+}
+
+/**
+ * @brief Check that add_background_job() will find a slot, before forking
+ * @param command Command string for the error message
+ * @return 1 if a slot is free (a finished job may be evicted for it), 0 if not (message printed)
+ *
+ * A job that cannot be tracked must not start: nothing could wait for
+ * it, and its cgroup would be removed before the child joined it.
+ */
+static int has_free_job_slot(const char *command) {
+    for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+        if (!background_jobs[i].is_active) {
+            return 1;
+        }
+    }
+    if (evict_finished_job()) {
+        return 1;
+    }
+    printf("Error: Maximum number of background jobs reached (%d), %s not started\n",
+           MAX_BACKGROUND_JOBS, command);
+    return 0;
+}
+
+/**
+ * @brief Track the process of a <(...) or >(...) process substitution
+ * @param pid Process ID (leader of its own process group)
+ * @param command Substitution text
+ * @return Index in background_jobs, or -1 if no slots available
+ * 
+ * Hidden jobs are reaped like any other, but take no job number and are
+ * never listed, reported or counted against `set maxjobs`.
+ */
+int add_hidden_job(pid_t pid, const char* command) {
+    for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+        if (!background_jobs[i].is_active) {
+            background_jobs[i].command = strdup(command);
+            if (background_jobs[i].command == NULL) {
+                perror("strdup");
+                return -1;
+            }
+            background_jobs[i].pid = pid;
+            background_jobs[i].job_number = 0;
+            background_jobs[i].is_active = 1;
+            reset_job_slot(&background_jobs[i]);
+            background_jobs[i].hidden = 1;
+            strncpy(background_jobs[i].command_name, command, MAX_PATH_LEN - 1);
+            background_jobs[i].command_name[MAX_PATH_LEN - 1] = '\0';
+            return i;
+        }
+    }
+    
+    if (evict_finished_job()) {
+        return add_hidden_job(pid, command);
+    }
+    
     printf("Error: Maximum number of background jobs reached\n");
     return -1;
 }
 
 /**
- * @brief Add a stopped job to the tracking system (used by signal handlers)
+ * @brief Add a stopped job to the tracking system (used when a foreground command stops)
  * @param pid Process ID of the stopped job
  * @param command Command string for display purposes
  * @return Job number assigned, or -1 if no slots available
@@ -67,12 +225,16 @@ int add_stopped_job(pid_t pid, const char* command) {
     // Find an empty slot
     for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
         if (!background_jobs[i].is_active) {
+            background_jobs[i].command = strdup(command);
+            if (background_jobs[i].command == NULL) {
+                perror("strdup");
+                return -1;
+            }
             background_jobs[i].pid = pid;
             background_jobs[i].job_number = next_job_number++;
             background_jobs[i].is_active = 1;
+            reset_job_slot(&background_jobs[i]);
             background_jobs[i].state = PROCESS_STOPPED;
-            strncpy(background_jobs[i].command, command, MAX_PATH_LEN - 1);
-            background_jobs[i].command[MAX_PATH_LEN - 1] = '\0';
             
             // Extract command name (first word) for activities sorting
             strncpy(background_jobs[i].command_name, command, MAX_PATH_LEN - 1);
@@ -88,46 +250,218 @@ int add_stopped_job(pid_t pid, const char* command) {
         }
     }
     
+    if (evict_finished_job()) {
+        return add_stopped_job(pid, command);
+    }
+    
     return -1; // No slots available
 }
 
 /**
- * @brief Check for completed background jobs and report their status
+ * @brief Find the job table slot of a process
+ * @param pid Process ID to look up
+ * @return Index in the background_jobs array, or -1 if not tracked
  */
-void check_background_jobs(void) {
+int find_job_index_by_pid(pid_t pid) {
+    for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+        if (background_jobs[i].is_active && background_jobs[i].pid == pid && pid > 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Reap the exited processes of a job's group other than its leader
+ * @param pgid Process group of the job (the leader's pid)
+ * @return 1 while other processes of the group are still alive, 0 once none are left
+ * 
+ * A pipeline that was stopped and became a job has one process per
+ * stage; the job is only finished once all of them are gone.
+ */
+static int reap_group_members(pid_t pgid) {
+    siginfo_t info;
+    while (1) {
+        info.si_pid = 0;
+        // WNOWAIT peeks first, so the leader's own status is never taken here
+        if (waitid(P_PGID, pgid, &info, WEXITED | WNOHANG | WNOWAIT) == -1) {
+            return 0;
+        }
+        if (info.si_pid == 0 || info.si_pid == pgid) {
+            return 1;
+        }
+        waitpid(info.si_pid, NULL, WNOHANG);
+    }
+}
+
+/**
+ * @brief Mark a job as finished and release what it held while running
+ * @param job Job whose processes are all gone
+ */
+static void finish_background_job(BackgroundJob *job) {
+    job->state = PROCESS_DONE;
+    drain_job_capture(job->capture);
+    release_command_timer(job->timer);
+    job->timer = NULL;
+    release_job_stats(&job->stats);
+    remove_job_cgroup(job->cgroup_fd);
+    job->cgroup_fd = -1;
+}
+
+/**
+ * @brief Reap finished background jobs without reporting them
+ * 
+ * Safe to run from the event loop at any time: finished jobs become
+ * PROCESS_DONE and keep their wait status until check_background_jobs()
+ * reports them. Jobs marked `managed` are left to whoever waits for them.
+ * The job's status is its leader's; the job is done once the leader and
+ * every other process of its group have exited.
+ */
+void reap_background_jobs(void) {
     int status;
     pid_t pid;
     
-    // Check all active background jobs
     for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
-        if (background_jobs[i].is_active) {
-            // Use WNOHANG to check without blocking, WUNTRACED to detect stopped processes
-            pid = waitpid(background_jobs[i].pid, &status, WNOHANG | WUNTRACED);
-            
-            if (pid > 0) {
-                char *command_name = background_jobs[i].command;
-                
-                if (WIFSTOPPED(status)) {
-                    // Process was stopped (e.g., by SIGSTOP or Ctrl+Z)
-                    // Note: No output required for stopped processes
-                    background_jobs[i].state = PROCESS_STOPPED;
-                } else if (WIFEXITED(status) || WIFSIGNALED(status)) {
-                    // Process has terminated - print the full command with " &"
-                    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-                        printf("%s & with pid %d exited normally\n", command_name, background_jobs[i].pid);
-                    } else {
-                        printf("%s & with pid %d exited abnormally\n", command_name, background_jobs[i].pid);
-                    }
-                    
-                    // Clean up this job slot for terminated processes
-                    cleanup_background_job(i);
+        BackgroundJob *job = &background_jobs[i];
+        if (!job->is_active || job->managed ||
+            job->state == PROCESS_QUEUED || job->state == PROCESS_DONE) {
+            continue;
+        }
+        
+        if (job->leader_reaped) {
+            if (!reap_group_members(job->pid)) {
+                finish_background_job(job);
+            }
+            continue;
+        }
+        
+        // Use WNOHANG to check without blocking, WUNTRACED to detect stopped processes
+        pid = waitpid(job->pid, &status, WNOHANG | WUNTRACED);
+        
+        if (pid > 0) {
+            if (WIFSTOPPED(status)) {
+                // Process was stopped (e.g., by SIGSTOP or Ctrl+Z)
+                // Note: No output required for stopped processes
+                job->state = PROCESS_STOPPED;
+            } else if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                job->wait_status = status;
+                job->leader_reaped = 1;
+                if (!reap_group_members(job->pid)) {
+                    finish_background_job(job);
                 }
-                // If process continues running, leave it as is
-            } else if (pid == -1) {
-                // Error occurred - process might have already been reaped
+            }
+            // If process continues running, leave it as is
+        } else if (pid == -1) {
+            // Error occurred - process might have already been reaped
+            cleanup_background_job(i);
+        }
+        // If pid == 0, process is still running, continue
+    }
+}
+
+/**
+ * @brief Check for completed background jobs and report their status
+ */
+void check_background_jobs(void) {
+    reap_background_jobs();
+    
+    for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+        BackgroundJob *job = &background_jobs[i];
+        if (!job->is_active || job->state != PROCESS_DONE || job->notified) {
+            continue;
+        }
+        if (job->hidden) {
+            cleanup_background_job(i);
+            continue;
+        }
+        
+        // Process has terminated - print the full command with " &"
+        int status = job->wait_status;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            printf("%s & with pid %d exited normally\n", job->command, job->pid);
+        } else {
+            printf("%s & with pid %d exited abnormally\n", job->command, job->pid);
+        }
+        job->notified = 1;
+        
+        // Clean up this job slot, unless its output is kept for `joblog`
+        if (job->capture == NULL) {
+            cleanup_background_job(i);
+        }
+    }
+    
+    // Finished jobs free slots for queued ones
+    start_queued_jobs();
+}
+
+/**
+ * @brief Count background jobs that are currently running
+ * @return Number of running (not stopped or queued) jobs
+ */
+int count_running_jobs(void) {
+    int running = 0;
+    for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+        if (background_jobs[i].is_active && background_jobs[i].state == PROCESS_RUNNING &&
+            !background_jobs[i].hidden) {
+            running++;
+        }
+    }
+    return running;
+}
+
+/**
+ * @brief Add a job that waits for a free slot under `set maxjobs`
+ * @param start_index First token of the command (without job prefix) to run once admitted
+ * @param end_index One past its last token
+ * @param command Command string shown for the job
+ * @param options Options given at submission
+ * @return Job number assigned, or -1 on error
+ */
+static int add_queued_job(int start_index, int end_index, const char* command, const JobOptions *options) {
+    int job_number = add_background_job(0, command);
+    if (job_number == -1) {
+        return -1;
+    }
+    
+    for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+        if (background_jobs[i].is_active && background_jobs[i].job_number == job_number) {
+            background_jobs[i].state = PROCESS_QUEUED;
+            background_jobs[i].options = *options;
+            if (save_queued_tokens(&background_jobs[i], start_index, end_index) == -1) {
                 cleanup_background_job(i);
+                return -1;
+            }
+            break;
+        }
+    }
+    return job_number;
+}
+
+/**
+ * @brief Start queued jobs while there are free slots under `set maxjobs`
+ * 
+ * Highest priority first; jobs of equal priority start in submission order.
+ */
+void start_queued_jobs(void) {
+    while (shell_options.max_jobs == 0 || count_running_jobs() < shell_options.max_jobs) {
+        int best = -1;
+        for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+            if (!background_jobs[i].is_active || background_jobs[i].state != PROCESS_QUEUED) {
+                continue;
             }
-            // If pid == 0, process is still running, continue
+            if (best == -1 ||
+                background_jobs[i].options.priority > background_jobs[best].options.priority ||
+                (background_jobs[i].options.priority == background_jobs[best].options.priority &&
+                 background_jobs[i].job_number < background_jobs[best].job_number)) {
+                best = i;
+            }
+        }
+        
+        if (best == -1) {
+            return;
+        }
+        if (launch_queued_job(best) == -1) {
+            cleanup_background_job(best);
         }
     }
 }
@@ -141,10 +475,162 @@ void cleanup_background_job(int job_index) {
         background_jobs[job_index].is_active = 0;
         background_jobs[job_index].pid = 0;
         background_jobs[job_index].job_number = 0;
-        background_jobs[job_index].command[0] = '\0';
+        free(background_jobs[job_index].command);
+        background_jobs[job_index].command = NULL;
         background_jobs[job_index].command_name[0] = '\0';
-        background_jobs[job_index].state = PROCESS_RUNNING;
+        release_job_capture(background_jobs[job_index].capture);
+        release_command_timer(background_jobs[job_index].timer);
+        release_job_stats(&background_jobs[job_index].stats);
+        remove_job_cgroup(background_jobs[job_index].cgroup_fd);
+        release_queued_tokens(&background_jobs[job_index]);
+        reset_job_slot(&background_jobs[job_index]);
+    }
+}
+
+/**
+ * @brief Set up a freshly forked background child
+ * @param capture_fd Pipe for stdout/stderr when output is captured, -1 otherwise
+ */
+static void detach_background_child(int capture_fd) {
+    // Own process group, so job control and scheduling changes cover
+    // the whole job and Ctrl-C at the prompt does not reach it
+    enter_job_process_group(0, 0);
+    
+    // Redirect stdin to /dev/null for background processes
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd != -1) {
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+    
+    // Captured jobs write into the shell's ring; explicit redirections still win
+    if (capture_fd != -1) {
+        dup2(capture_fd, STDOUT_FILENO);
+        dup2(capture_fd, STDERR_FILENO);
+        close(capture_fd);
+    }
+}
+
+/**
+ * @brief Run a background command in the freshly forked child
+ * @param start_index Starting token index for the command
+ * @param end_index Ending token index for the command
+ * @param args NULL-terminated argument array
+ * @param options Job options applied before exec
+ * @param capture_fd Pipe for stdout/stderr when output is captured, -1 otherwise
+ * @param cgroup_fd cgroup to join before exec, -1 for none
+ */
+static _Noreturn void run_background_child(int start_index, int end_index, char **args,
+                                           const JobOptions *options, int capture_fd, int cgroup_fd) {
+    detach_background_child(capture_fd);
+    
+    // Set up redirections if specified
+    if (setup_redirections(start_index, end_index) == -1) {
+        fflush(stdout);
+        _exit(1);
+    }
+    
+    join_job_cgroup(cgroup_fd);
+    apply_job_options(options);
+    
+    // Leading NAME=value words go into the command's environment
+    apply_assignments(start_index, count_assignments(start_index, end_index), 1);
+    
+    // Execute the command
+    exec_command(args, options);
+}
+
+/**
+ * @brief Fork and exec a background process
+ * @param start_index Starting token index for the command
+ * @param end_index Ending token index for the command
+ * @param args NULL-terminated argument array
+ * @param options Job options applied in the child before exec
+ * @param capture_fd Pipe for stdout/stderr when output is captured, -1 otherwise
+ * @param cgroup_fd cgroup the child joins before exec, -1 for none
+ * @return Process ID of the child, -1 on error
+ */
+static pid_t spawn_background_process(int start_index, int end_index, char **args, const JobOptions *options,
+                                      int capture_fd, int cgroup_fd) {
+    pid_t pid = fork();
+    
+    if (pid == 0) {
+        run_background_child(start_index, end_index, args, options, capture_fd, cgroup_fd);
+    } else if (pid > 0) {
+        // Also set it here so it holds before the shell signals the group
+        setpgid(pid, pid);
+    } else {
+        perror("fork");
+    }
+    
+    return pid;
+}
+
+/**
+ * @brief Create the cgroup of a background job
+ * @param job_number Job number (names the cgroup job-N)
+ * @param options Job options with the cgroup caps to apply
+ * @return Directory fd of the cgroup, -1 if cgroups are unavailable
+ */
+static int create_background_cgroup(int job_number, const JobOptions *options) {
+    char name[32];
+    snprintf(name, sizeof(name), "job-%d", job_number);
+    return create_job_cgroup(name, options);
+}
+
+/**
+ * @brief Start a queued job now, regardless of `set maxjobs`
+ * @param job_index Index of a PROCESS_QUEUED job in background_jobs
+ * @return 0 on success, -1 on error
+ * 
+ * The job runs the tokens it was queued with. Only the forked child
+ * loads them into the shell's tokens: this is called when a slot frees
+ * up, which may be while a foreground command is still using them.
+ */
+int launch_queued_job(int job_index) {
+    BackgroundJob *job = &background_jobs[job_index];
+    if (!job->is_active || job->state != PROCESS_QUEUED || job->queued_tokens == NULL) {
+        return -1;
+    }
+    
+    int capture_fd = -1;
+    if (shell_options.capture_output) {
+        job->capture = create_job_capture(job->job_number, &capture_fd);
+    }
+    job->cgroup_fd = create_background_cgroup(job->job_number, &job->options);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int count = job->queued_token_count;
+        if (reserve_tokens(count) == -1) {
+            fflush(stdout);
+            _exit(1);
+        }
+        memcpy(tokens, job->queued_tokens, sizeof(Token) * count);
+        terminate_tokens(count);
+        int arg_count;
+        char **args = build_arg_vector(count_assignments(0, count), count, &arg_count);
+        if (args == NULL || arg_count == 0) {
+            fflush(stdout);
+            _exit(1);
+        }
+        run_background_child(0, count, args, &job->options, capture_fd, job->cgroup_fd);
+    } else if (pid > 0) {
+        setpgid(pid, pid);
+    } else {
+        perror("fork");
+    }
+    if (capture_fd != -1) {
+        close(capture_fd);
     }
+    
+    if (pid == -1) {
+        return -1;
+    }
+    release_queued_tokens(job);
+    job->pid = pid;
+    job->state = PROCESS_RUNNING;
+    job->timer = create_command_timer(&pid, 1, &job->options);
+    return 0;
 }
 
 /**
@@ -153,93 +639,141 @@ void cleanup_background_job(int job_index) {
  * @param end_index Ending token index for the command
  * @param command_str String representation of the command for tracking
  * @return 0 on success, -1 on error
+ * 
+ * A leading `job` or `limit` prefix sets the job's priority, nice level and
+ * resource limits. With `set maxjobs N`, jobs beyond N running ones are
+ * queued instead of forked. Each job runs in its own cgroup when cgroup v2
+ * delegation is available, so its caps and usage cover all its processes.
  */
 int execute_background_command(int start_index, int end_index, const char* command_str) {
-    // Build argument array for the command
-    char *args[256];
-    int arg_count = 0;
-    
-    // Extract command and arguments (skip redirection tokens and filenames)
-    for (int i = start_index; i < end_index; i++) {
-        if (tokens[i].type == TOKEN_NAME) {
-            // Check if this token is a redirection filename
-            bool is_redirect_file = false;
-            if (i > 0) {
-                TokenType prev_type = tokens[i-1].type;
-                if (prev_type == TOKEN_INPUT || 
-                    prev_type == TOKEN_OUTPUT || 
-                    prev_type == TOKEN_DOUBLE_OUTPUT) {
-                    is_redirect_file = true;
-                }
-            }
-            
-            // If it's not a redirection filename, add it as a command argument
-            if (!is_redirect_file) {
-                args[arg_count] = tokens[i].value;
-                arg_count++;
-                if (arg_count >= 255) break;
-            }
-        }
+    JobOptions options;
+    int cmd_start = parse_job_options(start_index, end_index, &options);
+    if (cmd_start == -1) {
+        return -1;
     }
-    args[arg_count] = NULL;
     
+    // Build the argument vector (skip NAME=value words, redirection tokens and filenames)
+    int arg_count;
+    char **args = build_arg_vector(cmd_start + count_assignments(cmd_start, end_index), end_index, &arg_count);
+    if (args == NULL) {
+        return -1;
+    }
     if (arg_count == 0) {
         printf("Error: No command found for background execution\n");
         return -1;
     }
     
-    // Check if it's a built-in command (these can't run in background effectively)
-    if (strcmp(args[0], "hop") == 0 || 
-        strcmp(args[0], "reveal") == 0 || 
-        strcmp(args[0], "log") == 0 ||
-        strcmp(args[0], "activities") == 0 ||
-        strcmp(args[0], "ping") == 0) {
-        // Built-in commands cannot run in background - silently ignore
+    // Built-in commands (exit too) cannot run in background - silently ignore
+    Command *command = find_command(args[0]);
+    if (command != NULL && command->builtin != NULL) {
         return -1;
     }
     
-    if (strcmp(args[0], "exit") == 0) {
-        // exit command cannot run in background - silently ignore
-        return -1;
+    // Track the job without its `job` prefix
+    char *job_str = NULL;
+    if (cmd_start != start_index) {
+        job_str = reconstruct_command_from_segment(cmd_start, end_index);
+        if (job_str) {
+            command_str = job_str;
+        }
     }
     
-    // Fork a child process for background execution
-    pid_t pid = fork();
-    
-    if (pid == 0) {
-        // Child process
-        
-        // Redirect stdin to /dev/null for background processes
-        int null_fd = open("/dev/null", O_RDONLY);
-        if (null_fd != -1) {
-            dup2(null_fd, STDIN_FILENO);
-            close(null_fd);
+    int result = 0;
+    if (!has_free_job_slot(command_str)) {
+        result = -1;
+    } else if (shell_options.max_jobs > 0 && count_running_jobs() >= shell_options.max_jobs) {
+        // Admission control: wait for a running job to finish
+        if (add_queued_job(cmd_start, end_index, command_str, &options) == -1) {
+            result = -1;
         }
-        
-        // Set up output redirection if specified
-        if (setup_output_redirection(start_index, end_index) == -1) {
-            exit(1);
+    } else {
+        int capture_fd = -1;
+        JobCapture *capture = NULL;
+        if (shell_options.capture_output) {
+            capture = create_job_capture(next_job_number, &capture_fd);
         }
         
-        // Set up input redirection if specified (though uncommon for background)
-        if (setup_input_redirection(start_index, end_index) == -1) {
-            exit(1);
+        int cgroup_fd = create_background_cgroup(next_job_number, &options);
+        pid_t pid = spawn_background_process(cmd_start, end_index, args, &options, capture_fd, cgroup_fd);
+        if (capture_fd != -1) {
+            close(capture_fd);
         }
         
-        // Execute the command
-        execvp(args[0], args);
+        int job_index = -1;
+        if (pid > 0) {
+            // Parent process - don't wait, just add to background jobs
+            add_background_job(pid, command_str);
+            job_index = find_job_index_by_pid(pid);
+        } else {
+            result = -1;
+        }
         
-        // If execvp returns, there was an error
-        printf("Command not found!\n");
-        exit(127);
-    } else if (pid > 0) {
-        // Parent process - don't wait, just add to background jobs
-        add_background_job(pid, command_str);
+        if (job_index != -1) {
+            background_jobs[job_index].options = options;
+            background_jobs[job_index].capture = capture;
+            background_jobs[job_index].cgroup_fd = cgroup_fd;
+            background_jobs[job_index].timer = create_command_timer(&pid, 1, &options);
+        } else {
+            release_job_capture(capture);
+            remove_job_cgroup(cgroup_fd);
+        }
+    }
+    
+    return result;
+}
+
+/**
+ * @brief Fork the shell to run a conditional list as one background job
+ * @param command_str Command text the job is tracked under
+ * @return 0 in the child, which must run the list and exit; the child's
+ *         pid in the shell; -1 on error
+ * 
+ * Used for `a && b &`: the child is a copy of the shell in its own
+ * process group, so the whole list is a single job that fg, bg and
+ * activities treat like any other. It gets the job's cgroup and output
+ * capture, but bypasses `set maxjobs` since it is not a plain command.
+ */
+pid_t fork_background_subshell(const char *command_str) {
+    if (!has_free_job_slot(command_str)) {
+        return -1;
+    }
+    JobOptions options;
+    init_job_options(&options);
+    
+    int capture_fd = -1;
+    JobCapture *capture = NULL;
+    if (shell_options.capture_output) {
+        capture = create_job_capture(next_job_number, &capture_fd);
+    }
+    int cgroup_fd = create_background_cgroup(next_job_number, &options);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        detach_background_child(capture_fd);
+        join_job_cgroup(cgroup_fd);
         return 0;
+    }
+    
+    if (capture_fd != -1) {
+        close(capture_fd);
+    }
+    int job_index = -1;
+    if (pid > 0) {
+        setpgid(pid, pid);
+        add_background_job(pid, command_str);
+        job_index = find_job_index_by_pid(pid);
     } else {
         perror("fork");
-        return -1;
     }
+    
+    if (job_index != -1) {
+        background_jobs[job_index].capture = capture;
+        background_jobs[job_index].cgroup_fd = cgroup_fd;
+    } else {
+        release_job_capture(capture);
+        remove_job_cgroup(cgroup_fd);
+    }
+    return pid;
 }
 
 //LLM GENERATED CODE ENDS HERE
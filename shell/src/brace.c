@@ -0,0 +1,422 @@
+#include "shell.h"
+#include <errno.h>
+#include <limits.h>
+
+#define MAX_RANGE_TEXT 64
+
+/**
+ * @brief The first brace group of a word that expands
+ */
+typedef struct {
+    const char *open;           // The `{`
+    const char *close;          // Its matching `}`
+    int is_sequence;            // {x..y[..z]} rather than {a,b,...}
+    BraceSequence sequence;     // Sequences: the range (prefix and suffix unset)
+} BraceGroup;
+
+/**
+ * @brief Words produced by a brace expansion
+ */
+typedef struct {
+    char **items;
+    int count;
+    int capacity;
+    int failed;
+} BraceWords;
+
+/**
+ * @brief Parse one end of a range: an integer or a single letter
+ * @return 1 if valid (letter set for letters), 0 otherwise
+ */
+static int parse_range_end(const char *text, long long *value, int *letter, int *width) {
+    if (isalpha((unsigned char)text[0]) && text[1] == '\0') {
+        *value = (unsigned char)text[0];
+        *letter = 1;
+        *width = 0;
+        return 1;
+    }
+    const char *digits = text + (text[0] == '-' || text[0] == '+');
+    if (!isdigit((unsigned char)*digits)) {
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    *value = strtoll(text, &end, 10);
+    if (errno == ERANGE || *end != '\0') {
+        return 0;
+    }
+    *letter = 0;
+    *width = digits[0] == '0' && digits[1] != '\0' ? (int)strlen(text) : 0;
+    return 1;
+}
+
+/**
+ * @brief Parse the inside of {x..y} or {x..y..step}
+ * @param start First character after the `{`
+ * @param end The closing `}`
+ * @return 1 if it is a valid sequence, 0 otherwise
+ *
+ * Both ends are integers or both are letters. The step's sign is
+ * ignored (the sequence always runs from x towards y) and 0 means 1.
+ * Leading zeros on either end pad every value to the longer width.
+ */
+static int parse_range(const char *start, const char *end, BraceSequence *sequence) {
+    char text[MAX_RANGE_TEXT];
+    size_t length = end - start;
+    if (length >= sizeof(text)) {
+        return 0;
+    }
+    memcpy(text, start, length);
+    text[length] = '\0';
+
+    char *second = strstr(text, "..");
+    if (second == NULL) {
+        return 0;
+    }
+    *second = '\0';
+    second += 2;
+    char *third = strstr(second, "..");
+    if (third != NULL) {
+        *third = '\0';
+        third += 2;
+    }
+
+    int first_letter, second_letter, first_width, second_width, step_letter, step_width;
+    long long step = 1;
+    if (!parse_range_end(text, &sequence->start, &first_letter, &first_width) ||
+        !parse_range_end(second, &sequence->end, &second_letter, &second_width) ||
+        first_letter != second_letter ||
+        (third != NULL && (!parse_range_end(third, &step, &step_letter, &step_width) || step_letter))) {
+        return 0;
+    }
+    if (step == LLONG_MIN) {
+        return 0;
+    }
+    step = step < 0 ? -step : (step == 0 ? 1 : step);
+
+    unsigned long long span = sequence->start <= sequence->end
+        ? (unsigned long long)sequence->end - (unsigned long long)sequence->start
+        : (unsigned long long)sequence->start - (unsigned long long)sequence->end;
+    unsigned long long count = span / (unsigned long long)step + 1;
+    sequence->count = count > LLONG_MAX ? LLONG_MAX : (long long)count;
+    sequence->step = sequence->start <= sequence->end ? step : -step;
+    sequence->letters = first_letter;
+    sequence->width = first_width > second_width ? first_width : second_width;
+    return 1;
+}
+
+/**
+ * @brief Find the end of a $(...), `...`, ${...}, quoted section or escape starting at p
+ * @return Pointer to its last character, NULL if p starts none or it is unterminated
+ */
+static const char* skip_substitution(const char *p) {
+    if (p[0] == '\'' || p[0] == '"' || p[0] == '\\') {
+        return find_quote_end(p);
+    }
+    if (p[0] == '$' && p[1] == '{') {
+        return strchr(p + 2, '}');
+    }
+    if (p[0] == '$' && p[1] == '(') {
+        return find_substitution_end(p + 1);
+    }
+    if (p[0] == '`') {
+        return find_substitution_end(p);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Find the first brace group of a text that expands
+ * @return 1 if found, 0 if the text has none
+ *
+ * A `{` without a matching `}`, or whose group has neither a top-level
+ * comma nor a valid range, is an ordinary character. Braces inside
+ * ${...}, $(...) and `...` are left to the later expansions, and quoted
+ * or escaped braces and commas are ordinary characters.
+ */
+static int find_group(const char *text, BraceGroup *group) {
+    for (const char *p = text; *p != '\0'; p++) {
+        const char *end = skip_substitution(p);
+        if (end != NULL) {
+            p = end;
+            continue;
+        }
+        if (*p != '{') {
+            continue;
+        }
+        int depth = 0;
+        int comma = 0;
+        const char *close = NULL;
+        for (const char *q = p; *q != '\0' && close == NULL; q++) {
+            if ((end = skip_substitution(q)) != NULL) {
+                q = end;
+            } else if (*q == '{') {
+                depth++;
+            } else if (*q == '}' && --depth == 0) {
+                close = q;
+            } else if (*q == ',' && depth == 1) {
+                comma = 1;
+            }
+        }
+        if (close == NULL) {
+            continue;
+        }
+        group->open = p;
+        group->close = close;
+        group->is_sequence = !comma;
+        if (comma || parse_range(p + 1, close, &group->sequence)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Find the end of the alternative of a {a,b,...} group starting at p
+ * @return Pointer to the `,` or `}` after it
+ */
+static const char* alternative_end(const char *p) {
+    int depth = 0;
+    for (; *p != '\0'; p++) {
+        const char *end = skip_substitution(p);
+        if (end != NULL) {
+            p = end;
+        } else if (*p == '{') {
+            depth++;
+        } else if (*p == '}' && depth-- == 0) {
+            break;
+        } else if (*p == ',' && depth == 0) {
+            break;
+        }
+    }
+    return p;
+}
+
+/**
+ * @brief Concatenate up to three pieces of text
+ * @return New string, NULL if out of memory
+ */
+static char* concat(const char *a, size_t a_length, const char *b, size_t b_length, const char *c) {
+    size_t c_length = strlen(c);
+    char *text = malloc(a_length + b_length + c_length + 1);
+    if (text != NULL) {
+        memcpy(text, a, a_length);
+        memcpy(text + a_length, b, b_length);
+        memcpy(text + a_length + b_length, c, c_length + 1);
+    }
+    return text;
+}
+
+/**
+ * @brief Multiply two word counts, saturating at LLONG_MAX
+ */
+static long long multiply_counts(long long a, long long b) {
+    return a != 0 && b > LLONG_MAX / a ? LLONG_MAX : a * b;
+}
+
+/**
+ * @brief Count the words a text expands to, without producing them
+ * @return The count, LLONG_MAX if it is at least that large
+ */
+static long long count_words(const char *text) {
+    BraceGroup group;
+    if (!find_group(text, &group)) {
+        return 1;
+    }
+    long long inner = 0;
+    if (group.is_sequence) {
+        inner = group.sequence.count;
+    } else {
+        const char *p = group.open + 1;
+        while (1) {
+            const char *end = alternative_end(p);
+            char *alternative = concat(p, end - p, "", 0, "");
+            long long count = alternative != NULL ? count_words(alternative) : 1;
+            free(alternative);
+            inner = count > LLONG_MAX - inner ? LLONG_MAX : inner + count;
+            if (*end != ',') {
+                break;
+            }
+            p = end + 1;
+        }
+    }
+    return multiply_counts(inner, count_words(group.close + 1));
+}
+
+/**
+ * @brief Format value `index` of a sequence (without prefix and suffix)
+ */
+static void format_value(const BraceSequence *sequence, long long index, char *buffer, size_t size) {
+    long long value = (long long)((unsigned long long)sequence->start +
+                                  (unsigned long long)sequence->step * (unsigned long long)index);
+    if (sequence->letters) {
+        snprintf(buffer, size, "%c", (char)value);
+    } else {
+        snprintf(buffer, size, "%0*lld", sequence->width, value);
+    }
+}
+
+/**
+ * @brief Add a finished word
+ * @param word Word (taken over)
+ */
+static void add_word(BraceWords *words, char *word) {
+    if (word == NULL) {
+        words->failed = 1;
+        return;
+    }
+    if (words->count == words->capacity) {
+        int capacity = words->capacity ? words->capacity * 2 : 16;
+        char **items = realloc(words->items, sizeof(char*) * capacity);
+        if (items == NULL) {
+            free(word);
+            words->failed = 1;
+            return;
+        }
+        words->items = items;
+        words->capacity = capacity;
+    }
+    words->items[words->count++] = word;
+}
+
+/**
+ * @brief Expand the brace groups of text, after the already expanded done
+ */
+static void generate_words(BraceWords *words, const char *done, const char *text) {
+    BraceGroup group;
+    if (words->failed) {
+        return;
+    }
+    if (!find_group(text, &group)) {
+        add_word(words, concat(done, strlen(done), "", 0, text));
+        return;
+    }
+    char *prefix = concat(done, strlen(done), text, group.open - text, "");
+    if (prefix == NULL) {
+        words->failed = 1;
+        return;
+    }
+    const char *suffix = group.close + 1;
+    if (group.is_sequence) {
+        for (long long i = 0; i < group.sequence.count && !words->failed; i++) {
+            char value[32];
+            format_value(&group.sequence, i, value, sizeof(value));
+            char *expanded = concat(prefix, strlen(prefix), value, strlen(value), "");
+            if (expanded == NULL) {
+                words->failed = 1;
+                break;
+            }
+            generate_words(words, expanded, suffix);
+            free(expanded);
+        }
+    } else {
+        const char *p = group.open + 1;
+        while (!words->failed) {
+            const char *end = alternative_end(p);
+            char *rest = concat(p, end - p, "", 0, suffix);
+            if (rest == NULL) {
+                words->failed = 1;
+                break;
+            }
+            generate_words(words, prefix, rest);
+            free(rest);
+            if (*end != ',') {
+                break;
+            }
+            p = end + 1;
+        }
+    }
+    free(prefix);
+}
+
+/**
+ * @brief Check whether a word has a brace group to expand
+ */
+int has_brace_expansion(const char *word) {
+    BraceGroup group;
+    return strchr(word, '{') != NULL && find_group(word, &group);
+}
+
+/**
+ * @brief Expand {a,b,c} and {x..y[..step]} groups in a word
+ * @param word Word with at least one group (see has_brace_expansion())
+ * @param limit Most words the caller can take
+ * @param words Set to the words in order (caller frees each and the array)
+ * @param count Set to the number of words
+ * @return 0 on success, -1 on error (message printed)
+ *
+ * The words are counted before any is produced, so `{1..100000000}`
+ * fails at once instead of filling memory. Groups nest and combine
+ * left to right: a{b,c{1..2}}d gives abd ac1d ac2d.
+ */
+int expand_braces(const char *word, long long limit, char ***words, int *count) {
+    *words = NULL;
+    *count = 0;
+    long long total = count_words(word);
+    if (total > limit) {
+        if (total == LLONG_MAX) {
+            printf("Error: Brace expansion %s gives too many words\n", word);
+        } else {
+            printf("Error: Brace expansion %s gives %lld words (at most %lld here)\n", word, total, limit);
+        }
+        return -1;
+    }
+    BraceWords result = { 0 };
+    generate_words(&result, "", word);
+    if (result.failed) {
+        printf("Error: Out of memory expanding %s\n", word);
+        for (int i = 0; i < result.count; i++) {
+            free(result.items[i]);
+        }
+        free(result.items);
+        return -1;
+    }
+    *words = result.items;
+    *count = result.count;
+    return 0;
+}
+
+/**
+ * @brief Recognise a word that is one sequence with plain text around it
+ * @param word Word such as `{1..10000000}` or `img{001..250}.png`
+ * @param sequence Set to the sequence, with copies of the text around it
+ * @return 1 if the word can be generated lazily, 0 otherwise
+ *
+ * Such a word needs no other expansion, so a for loop can produce its
+ * values one at a time instead of holding all of them.
+ */
+int parse_brace_sequence(const char *word, BraceSequence *sequence) {
+    BraceGroup group;
+    if (strpbrk(word, "$`*?['\"\\") != NULL || !find_group(word, &group) || !group.is_sequence ||
+        has_brace_expansion(group.close + 1)) {
+        return 0;
+    }
+    *sequence = group.sequence;
+    sequence->prefix = strndup(word, group.open - word);
+    sequence->suffix = strdup(group.close + 1);
+    if (sequence->prefix == NULL || sequence->suffix == NULL) {
+        free_brace_sequence(sequence);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Format one word of a lazily generated sequence
+ * @param index Position in the sequence (0 to count - 1)
+ */
+void format_brace_sequence(const BraceSequence *sequence, long long index, char *buffer, size_t size) {
+    char value[32];
+    format_value(sequence, index, value, sizeof(value));
+    snprintf(buffer, size, "%s%s%s", sequence->prefix, value, sequence->suffix);
+}
+
+/**
+ * @brief Free the text around a sequence
+ */
+void free_brace_sequence(BraceSequence *sequence) {
+    free(sequence->prefix);
+    free(sequence->suffix);
+    sequence->prefix = NULL;
+    sequence->suffix = NULL;
+}
@@ -0,0 +1,638 @@
+#include "shell.h"
+
+#define COMMAND_BUCKETS 128         // Power of two
+#define MAX_ALIAS_EXPANSIONS 16     // Aliases expanded in one command position
+#define MAX_FUNCTION_DEPTH 256      // Nested function calls
+
+/**
+ * @brief Commands the shell knows by name: builtins, functions and aliases
+ *
+ * One hash lookup of the command word finds all three, so a function or
+ * alias costs no more to resolve than a builtin.
+ */
+static Command *command_buckets[COMMAND_BUCKETS];
+
+static int function_depth = 0;
+
+static int run_hop(const char *home_directory) {
+    execute_hop(home_directory);
+    return 0;
+}
+
+static int run_reveal(const char *home_directory) {
+    execute_reveal(home_directory);
+    return 0;
+}
+
+static int run_log(const char *home_directory) {
+    execute_log(home_directory);
+    return 0;
+}
+
+static int run_activities(const char *home_directory) {
+    (void)home_directory;
+    return execute_activities();
+}
+
+static int run_ping(const char *home_directory) {
+    (void)home_directory;
+    execute_ping();
+    return 0;
+}
+
+static int run_fg(const char *home_directory) {
+    (void)home_directory;
+    return execute_fg();
+}
+
+static int run_bg(const char *home_directory) {
+    (void)home_directory;
+    return execute_bg();
+}
+
+static int run_parallel(const char *home_directory) {
+    (void)home_directory;
+    return execute_parallel();
+}
+
+static int run_set(const char *home_directory) {
+    (void)home_directory;
+    return execute_set();
+}
+
+static int run_joblog(const char *home_directory) {
+    (void)home_directory;
+    return execute_joblog();
+}
+
+static int run_wait(const char *home_directory) {
+    (void)home_directory;
+    return execute_wait();
+}
+
+static int run_export(const char *home_directory) {
+    (void)home_directory;
+    return execute_export();
+}
+
+static int run_unset(const char *home_directory) {
+    (void)home_directory;
+    return execute_unset();
+}
+
+static int run_local(const char *home_directory) {
+    (void)home_directory;
+    return execute_local();
+}
+
+static int run_let(const char *home_directory) {
+    (void)home_directory;
+    return execute_let();
+}
+
+static int run_alias(const char *home_directory) {
+    (void)home_directory;
+    return execute_alias();
+}
+
+static int run_unalias(const char *home_directory) {
+    (void)home_directory;
+    return execute_unalias();
+}
+
+static int run_exit(const char *home_directory) {
+    (void)home_directory;
+    printf("Shell terminated.\n");
+    exit(0);
+}
+
+/**
+ * @brief The builtin commands
+ *
+ * With redirect set, the shell applies the command's redirections
+ * around it; the others (hop, log, ...) handle their arguments alone.
+ */
+static const struct {
+    const char *name;
+    int (*run)(const char *home_directory);
+    int redirect;
+} builtin_table[] = {
+    { "hop",        run_hop,        0 },
+    { "reveal",     run_reveal,     1 },
+    { "log",        run_log,        0 },
+    { "activities", run_activities, 1 },
+    { "ping",       run_ping,       0 },
+    { "fg",         run_fg,         0 },
+    { "bg",         run_bg,         0 },
+    { "parallel",   run_parallel,   1 },
+    { "set",        run_set,        1 },
+    { "joblog",     run_joblog,     1 },
+    { "wait",       run_wait,       1 },
+    { "export",     run_export,     1 },
+    { "unset",      run_unset,      1 },
+    { "local",      run_local,      1 },
+    { "let",        run_let,        1 },
+    { "alias",      run_alias,      1 },
+    { "unalias",    run_unalias,    1 },
+    { "exit",       run_exit,       0 },
+};
+
+/**
+ * @brief FNV-1a hash of a command name
+ */
+static size_t hash_command_name(const char *name) {
+    size_t hash = 2166136261u;
+    for (const char *p = name; *p != '\0'; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return hash & (COMMAND_BUCKETS - 1);
+}
+
+/**
+ * @brief Look up a command name
+ * @param name Command word
+ * @return Its entry, NULL if it is neither a builtin, a function nor an alias
+ */
+Command* find_command(const char *name) {
+    Command *command = command_buckets[hash_command_name(name)];
+    while (command != NULL && strcmp(command->name, name) != 0) {
+        command = command->next;
+    }
+    return command;
+}
+
+/**
+ * @brief Get the entry for a name, creating an empty one if needed
+ * @return The entry, NULL if out of memory
+ */
+static Command* add_command(const char *name) {
+    Command *command = find_command(name);
+    if (command != NULL) {
+        return command;
+    }
+    command = calloc(1, sizeof(Command));
+    if (command == NULL || (command->name = strdup(name)) == NULL) {
+        perror("calloc command");
+        free(command);
+        return NULL;
+    }
+    size_t index = hash_command_name(name);
+    command->next = command_buckets[index];
+    command_buckets[index] = command;
+    return command;
+}
+
+/**
+ * @brief Drop an entry that no longer names anything
+ */
+static void remove_unused_command(Command *command) {
+    if (command->builtin != NULL || command->function != NULL || command->alias != NULL) {
+        return;
+    }
+    Command **link = &command_buckets[hash_command_name(command->name)];
+    while (*link != command) {
+        link = &(*link)->next;
+    }
+    *link = command->next;
+    free(command->name);
+    free(command);
+}
+
+/**
+ * @brief Enter the builtins into the command table (called once at startup)
+ */
+void init_builtins(void) {
+    for (size_t i = 0; i < sizeof(builtin_table) / sizeof(builtin_table[0]); i++) {
+        Command *command = add_command(builtin_table[i].name);
+        if (command != NULL) {
+            command->builtin = builtin_table[i].run;
+            command->redirect = builtin_table[i].redirect;
+        }
+    }
+}
+
+/**
+ * @brief Drop one reference to a function body, freeing it after the last
+ */
+static void release_function_body(Program *body) {
+    if (body != NULL && --body->references == 0) {
+        free_program(body);
+    }
+}
+
+/**
+ * @brief Define (or redefine) a shell function
+ * @param name Function name
+ * @param body Compiled body; the command table takes it over
+ *
+ * A body that is still running (the function redefines itself) is
+ * freed when its last call returns.
+ */
+void define_function(const char *name, Program *body) {
+    Command *command = add_command(name);
+    if (command == NULL) {
+        free_program(body);
+        return;
+    }
+    body->references = 1;
+    release_function_body(command->function);
+    command->function = body;
+}
+
+/**
+ * @brief Remove a shell function
+ * @param name Function name (nothing happens if there is none)
+ */
+void undefine_function(const char *name) {
+    Command *command = find_command(name);
+    if (command != NULL && command->function != NULL) {
+        release_function_body(command->function);
+        command->function = NULL;
+        remove_unused_command(command);
+    }
+}
+
+/**
+ * @brief Call a shell function with the current tokens as its command
+ * @return Exit status of the function
+ *
+ * The body runs in the shell itself: the arguments become $1, $2, ...
+ * and `local` variables are undone when it returns.
+ */
+static int call_function(Command *command, const char *home_directory) {
+    if (function_depth >= MAX_FUNCTION_DEPTH) {
+        printf("Error: %s: Function calls nested too deeply\n", command->name);
+        return 1;
+    }
+    char **arguments = malloc(sizeof(char*) * token_count);
+    if (arguments == NULL) {
+        perror("malloc arguments");
+        return 1;
+    }
+    int count = 0;
+    for (int i = 1; i < token_count; i++) {
+        if (tokens[i].type == TOKEN_NAME && !is_redirect_filename(i, 0)) {
+            arguments[count++] = tokens[i].value;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        arguments[i] = strdup(arguments[i]);
+    }
+
+    Program *body = command->function;
+    body->references++;
+    function_depth++;
+    swap_positional_parameters(&arguments, &count);
+    int status = push_local_scope() == 0 ? run_program(body, home_directory) : 1;
+    pop_local_scope();
+    swap_positional_parameters(&arguments, &count);
+    function_depth--;
+    release_function_body(body);
+
+    for (int i = 0; i < count; i++) {
+        free(arguments[i]);
+    }
+    free(arguments);
+    return status;
+}
+
+/**
+ * @brief Run a function or builtin with the current tokens as its command
+ * @param command Entry from find_command() with a function or builtin
+ * @param home_directory Shell home directory
+ * @return Exit status
+ *
+ * A function is preferred over a builtin of the same name.
+ */
+int run_command(Command *command, const char *home_directory) {
+    if (command->function != NULL) {
+        return call_function(command, home_directory);
+    }
+    return command->builtin(home_directory);
+}
+
+/**
+ * @brief Replace aliases in command position with their tokens
+ * @return 0 on success, -1 if out of memory (message printed)
+ *
+ * Works on the current tokens: the first word of every pipeline stage
+ * (after NAME=value words) is looked up. The alias was tokenised when
+ * it was defined, so expanding it is a copy. An alias is not expanded
+ * again in the words it produced, so `alias ls=ls -F` works.
+ */
+int expand_aliases(void) {
+    for (int i = 0; i < token_count; i++) {
+        if (i > 0 && tokens[i - 1].type != TOKEN_PIPE) {
+            continue;
+        }
+        int word = i;
+        while (word < token_count && tokens[word].type == TOKEN_NAME && is_assignment_word(tokens[word].value)) {
+            word++;
+        }
+
+        const Command *expanded[MAX_ALIAS_EXPANSIONS];
+        int expanded_count = 0;
+        while (word < token_count && tokens[word].type == TOKEN_NAME && expanded_count < MAX_ALIAS_EXPANSIONS) {
+            Command *command = find_command(tokens[word].value);
+            if (command == NULL || command->alias == NULL) {
+                break;
+            }
+            int seen = 0;
+            for (int e = 0; e < expanded_count; e++) {
+                seen |= expanded[e] == command;
+            }
+            if (seen) {
+                break;
+            }
+            expanded[expanded_count++] = command;
+
+            int count = command->alias_token_count;
+            if (reserve_tokens(token_count - 1 + count) == -1) {
+                return -1;
+            }
+            memmove(&tokens[word + count], &tokens[word + 1], sizeof(Token) * (token_count - word));
+            memcpy(&tokens[word], command->alias_tokens, sizeof(Token) * count);
+            token_count += count - 1;
+            if (count == 0) {
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether a name can be used for an alias
+ */
+static int is_valid_alias_name(const char *name) {
+    if (name[0] == '\0') {
+        return 0;
+    }
+    for (const char *p = name; *p != '\0'; p++) {
+        if (isspace((unsigned char)*p) || strchr("|&;<>()$`=", *p) != NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Free the tokens of an alias and their text
+ */
+static void free_alias_tokens(Token *alias_tokens, int count) {
+    if (alias_tokens != NULL) {
+        free_token_values(alias_tokens, count);
+        free(alias_tokens);
+    }
+}
+
+/**
+ * @brief Define (or redefine) an alias
+ * @param name Alias name
+ * @param text Replacement text
+ * @return 0 on success, 1 if the text cannot be an alias
+ *
+ * The text is tokenised here, once; the current tokens are put back
+ * afterwards.
+ */
+static int define_alias(const char *name, const char *text) {
+    Token *saved_tokens = malloc(sizeof(Token) * (token_count + 1));
+    char *alias = strdup(text);
+    if (saved_tokens == NULL || alias == NULL) {
+        perror("malloc alias");
+        free(saved_tokens);
+        free(alias);
+        return 1;
+    }
+    int saved_count = token_count;
+    const char *saved_input = current_input;
+    memcpy(saved_tokens, tokens, sizeof(Token) * (token_count + 1));
+
+    current_input = alias;
+    tokenise();
+    int status = 0;
+    for (int i = 0; i < token_count && status == 0; i++) {
+        TokenType type = tokens[i].type;
+        if (type == TOKEN_SEMICOLON || type == TOKEN_AMPERSAND || type == TOKEN_AND ||
+            type == TOKEN_OR || type == TOKEN_HEREDOC || type == TOKEN_INVALID) {
+            printf("alias: %s: Only a command or pipeline can be an alias\n", name);
+            status = 1;
+        }
+    }
+    Token *alias_tokens = NULL;
+    int alias_token_count = token_count;
+    if (status == 0 && token_count > 0) {
+        alias_tokens = malloc(sizeof(Token) * token_count);
+        if (alias_tokens == NULL) {
+            perror("malloc alias");
+            status = 1;
+        } else {
+            memcpy(alias_tokens, tokens, sizeof(Token) * token_count);
+            if (copy_token_values(alias_tokens, token_count) == -1) {
+                free(alias_tokens);
+                alias_tokens = NULL;
+                status = 1;
+            }
+        }
+    }
+
+    memcpy(tokens, saved_tokens, sizeof(Token) * (saved_count + 1));
+    token_count = saved_count;
+    current_input = saved_input;
+    free(saved_tokens);
+
+    Command *command = status == 0 ? add_command(name) : NULL;
+    if (command == NULL) {
+        free_alias_tokens(alias_tokens, alias_token_count);
+        free(alias);
+        return 1;
+    }
+    free(command->alias);
+    free_alias_tokens(command->alias_tokens, command->alias_token_count);
+    command->alias = alias;
+    command->alias_tokens = alias_tokens;
+    command->alias_token_count = alias_token_count;
+    return 0;
+}
+
+/**
+ * @brief Compare two commands by name (for the alias listing)
+ */
+static int compare_commands(const void *a, const void *b) {
+    return strcmp((*(Command* const*)a)->name, (*(Command* const*)b)->name);
+}
+
+/**
+ * @brief Print an alias as the command that defines it
+ *
+ * The text is single-quoted (a ' in it becomes '\''), so the listing
+ * can be fed back to the shell even when the text has spaces or |.
+ */
+static void print_alias(const Command *command) {
+    printf("alias %s='", command->name);
+    for (const char *p = command->alias; *p != '\0'; p++) {
+        if (*p == '\'') {
+            printf("'\\''");
+        } else {
+            putchar(*p);
+        }
+    }
+    printf("'\n");
+}
+
+/**
+ * @brief Execute the alias command
+ * @return 0 on success, 1 if an alias was not found or invalid
+ *
+ * Syntax: alias [NAME[=TEXT] ...]
+ * - NAME=TEXT defines an alias; the text runs up to the next NAME=TEXT
+ *   word, so `alias ll=ls -l` needs no quotes
+ * - NAME prints one alias, no arguments print them all sorted by name,
+ *   as alias commands that define them again
+ */
+int execute_alias(void) {
+    // Keep the words: defining an alias tokenises its text
+    char **words = malloc(sizeof(char*) * token_count);
+    if (words == NULL) {
+        perror("malloc alias");
+        return 1;
+    }
+    int count = 0;
+    for (int i = 1; i < token_count && tokens[i].type == TOKEN_NAME; i++) {
+        if (!is_redirect_filename(i, 0)) {
+            words[count++] = tokens[i].value;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        words[i] = strdup(words[i]);
+    }
+
+    int status = 0;
+    if (count == 0) {
+        int alias_count = 0;
+        for (int b = 0; b < COMMAND_BUCKETS; b++) {
+            for (Command *command = command_buckets[b]; command != NULL; command = command->next) {
+                alias_count += command->alias != NULL;
+            }
+        }
+        Command **aliases = arena_alloc(sizeof(Command*) * (alias_count + 1));
+        if (aliases == NULL) {
+            alias_count = 0;
+            status = 1;
+        }
+        for (int b = 0, a = 0; b < COMMAND_BUCKETS && a < alias_count; b++) {
+            for (Command *command = command_buckets[b]; command != NULL; command = command->next) {
+                if (command->alias != NULL) {
+                    aliases[a++] = command;
+                }
+            }
+        }
+        if (alias_count > 1) {
+            qsort(aliases, alias_count, sizeof(Command*), compare_commands);
+        }
+        for (int i = 0; i < alias_count; i++) {
+            print_alias(aliases[i]);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        char *equals = words[i] != NULL ? strchr(words[i], '=') : NULL;
+        if (equals == NULL) {
+            Command *command = words[i] != NULL ? find_command(words[i]) : NULL;
+            if (command != NULL && command->alias != NULL) {
+                print_alias(command);
+            } else {
+                printf("alias: %s: Not found\n", words[i] != NULL ? words[i] : "");
+                status = 1;
+            }
+            continue;
+        }
+
+        // Join the text up to the next NAME=TEXT word
+        size_t length = strlen(equals + 1);
+        int last = i;
+        while (last + 1 < count && words[last + 1] != NULL && strchr(words[last + 1], '=') == NULL) {
+            length += strlen(words[++last]) + 1;
+        }
+        char *text = malloc(length + 1);
+        if (text == NULL) {
+            perror("malloc alias");
+            status = 1;
+            break;
+        }
+        strcpy(text, equals + 1);
+        for (int w = i + 1; w <= last; w++) {
+            strcat(text, " ");
+            strcat(text, words[w]);
+        }
+
+        *equals = '\0';
+        if (!is_valid_alias_name(words[i])) {
+            printf("alias: Invalid alias name: %s\n", words[i]);
+            status = 1;
+        } else {
+            status |= define_alias(words[i], text);
+        }
+        free(text);
+        i = last;
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(words[i]);
+    }
+    free(words);
+    return status;
+}
+
+/**
+ * @brief Remove the alias of a command entry
+ */
+static void remove_alias(Command *command) {
+    free(command->alias);
+    free_alias_tokens(command->alias_tokens, command->alias_token_count);
+    command->alias = NULL;
+    command->alias_tokens = NULL;
+    command->alias_token_count = 0;
+    remove_unused_command(command);
+}
+
+/**
+ * @brief Execute the unalias command
+ * @return 0 on success, 1 if an alias was not found
+ *
+ * Syntax: unalias [-a] NAME...
+ */
+int execute_unalias(void) {
+    int status = 0;
+    int all = token_count > 1 && tokens[1].type == TOKEN_NAME && strcmp(tokens[1].value, "-a") == 0;
+    if (all) {
+        for (int b = 0; b < COMMAND_BUCKETS; b++) {
+            Command *command = command_buckets[b];
+            while (command != NULL) {
+                Command *next = command->next;
+                if (command->alias != NULL) {
+                    remove_alias(command);
+                }
+                command = next;
+            }
+        }
+        return 0;
+    }
+    if (token_count < 2) {
+        printf("Usage: unalias [-a] NAME...\n");
+        return 2;
+    }
+    for (int i = 1; i < token_count && tokens[i].type == TOKEN_NAME; i++) {
+        if (is_redirect_filename(i, 0)) {
+            continue;
+        }
+        Command *command = find_command(tokens[i].value);
+        if (command == NULL || command->alias == NULL) {
+            printf("unalias: %s: Not found\n", tokens[i].value);
+            status = 1;
+            continue;
+        }
+        remove_alias(command);
+    }
+    return status;
+}
@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define CAPTURE_READ_SIZE 16384
+
+/**
+ * @brief Create a capture ring for a background job
+ * @param job_number Job number (used to name the memfd)
+ * @param write_fd Set to the pipe end the child should use for stdout/stderr
+ * @return New capture, or NULL on error (the job then writes to the shell's stdout)
+ *
+ * The ring lives in a memfd of shell_options.capture_size bytes so each
+ * job's retained output is bounded and costs no disk I/O. The pipe is
+ * only handed out once the event loop watches it: an undrained pipe
+ * would block the job as soon as it filled up.
+ */
+JobCapture* create_job_capture(int job_number, int *write_fd) {
+    JobCapture *capture = calloc(1, sizeof(JobCapture));
+    if (capture == NULL) {
+        perror("calloc capture");
+        return NULL;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "shell-job-%d", job_number);
+    capture->size = shell_options.capture_size;
+    capture->memfd = memfd_create(name, MFD_CLOEXEC);
+    if (capture->memfd == -1 || ftruncate(capture->memfd, capture->size) == -1) {
+        perror("memfd_create");
+        if (capture->memfd != -1) close(capture->memfd);
+        free(capture);
+        return NULL;
+    }
+
+    capture->data = mmap(NULL, capture->size, PROT_READ | PROT_WRITE, MAP_SHARED, capture->memfd, 0);
+    if (capture->data == MAP_FAILED) {
+        perror("mmap capture");
+        close(capture->memfd);
+        free(capture);
+        return NULL;
+    }
+
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("pipe");
+        munmap(capture->data, capture->size);
+        close(capture->memfd);
+        free(capture);
+        return NULL;
+    }
+
+    capture->pipe_fd = pipe_fds[0];
+    if (event_loop_add(capture->pipe_fd, handle_capture_event, capture) == -1) {
+        printf("Warning: Output of job %d is not captured (event loop full)\n", job_number);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        munmap(capture->data, capture->size);
+        close(capture->memfd);
+        free(capture);
+        return NULL;
+    }
+
+    // The child's end must block normally once it has been dup2'd
+    fcntl(pipe_fds[1], F_SETFL, 0);
+    *write_fd = pipe_fds[1];
+    return capture;
+}
+
+/**
+ * @brief Append bytes to the ring, overwriting the oldest output
+ */
+static void ring_write(JobCapture *capture, const char *bytes, size_t length) {
+    // Only the newest `size` bytes can survive
+    if (length > capture->size) {
+        capture->written += length - capture->size;
+        bytes += length - capture->size;
+        length = capture->size;
+    }
+
+    size_t offset = capture->written % capture->size;
+    size_t first = capture->size - offset;
+    if (first > length) {
+        first = length;
+    }
+    memcpy(capture->data + offset, bytes, first);
+    memcpy(capture->data, bytes + first, length - first);
+    capture->written += length;
+}
+
+/**
+ * @brief Close the job's end of the pipe once it reaches EOF
+ */
+static void close_capture_pipe(JobCapture *capture) {
+    if (capture->pipe_fd != -1) {
+        event_loop_remove(capture->pipe_fd);
+        close(capture->pipe_fd);
+        capture->pipe_fd = -1;
+    }
+}
+
+/**
+ * @brief Event loop callback: move available job output into the ring
+ * @param fd Read end of the job's output pipe
+ * @param data The job's JobCapture
+ *
+ * While the job is in the foreground (passthrough), output is also
+ * copied to the terminal.
+ */
+void handle_capture_event(int fd, void *data) {
+    JobCapture *capture = data;
+    char buffer[CAPTURE_READ_SIZE];
+
+    while (1) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            ring_write(capture, buffer, n);
+            if (capture->passthrough) {
+                fwrite(buffer, 1, n, stdout);
+                fflush(stdout);
+            }
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 || errno != EAGAIN) {
+            close_capture_pipe(capture);
+        }
+        return;
+    }
+}
+
+/**
+ * @brief Read whatever output the job has left in its pipe
+ * @param capture Job capture (may be NULL)
+ */
+void drain_job_capture(JobCapture *capture) {
+    if (capture != NULL && capture->pipe_fd != -1) {
+        handle_capture_event(capture->pipe_fd, capture);
+    }
+}
+
+/**
+ * @brief Release a job's pipe, ring and memfd
+ * @param capture Job capture (may be NULL)
+ */
+void release_job_capture(JobCapture *capture) {
+    if (capture == NULL) {
+        return;
+    }
+    close_capture_pipe(capture);
+    munmap(capture->data, capture->size);
+    close(capture->memfd);
+    free(capture);
+}
+
+/**
+ * @brief Print the retained output of a job
+ * @param capture Job capture
+ * @param max_lines Print only the last max_lines lines (0 for everything)
+ */
+void print_job_capture(const JobCapture *capture, int max_lines) {
+    size_t length = capture->written < capture->size ? capture->written : capture->size;
+    size_t start = (capture->written - length) % capture->size;
+
+    // Walk backwards from the newest byte to find where the tail starts
+    size_t skip = 0;
+    if (max_lines > 0) {
+        int lines = 0;
+        for (size_t i = length; i > 0; i--) {
+            char c = capture->data[(start + i - 1) % capture->size];
+            // A trailing newline ends the last line rather than starting one
+            if (c == '\n' && i != length && ++lines == max_lines) {
+                skip = i;
+                break;
+            }
+        }
+    }
+
+    size_t from = (start + skip) % capture->size;
+    size_t remaining = length - skip;
+    size_t first = capture->size - from;
+    if (first > remaining) {
+        first = remaining;
+    }
+    fwrite(capture->data + from, 1, first, stdout);
+    fwrite(capture->data, 1, remaining - first, stdout);
+    fflush(stdout);
+}
+
+/**
+ * @brief Execute the joblog command
+ * @return 0 on success, 1 on error
+ *
+ * Syntax: joblog [-n LINES] [-f] [%job | job_number]
+ * - Prints the captured output of a job (default: most recent captured job)
+ * - -n prints only the last LINES lines
+ * - -f keeps following the output until the job exits or Ctrl-C
+ * - A finished job is removed from the job table once its log is read
+ */
+int execute_joblog(void) {
+    int max_lines = 0;
+    int follow = 0;
+    int job_index = -1;
+
+    for (int i = 1; i < token_count && tokens[i].type == TOKEN_NAME; i++) {
+        // %N names a job as in wait; a bare N is a job number too
+        const char *number = tokens[i].value + (tokens[i].value[0] == '%');
+        if (strcmp(tokens[i].value, "-n") == 0 && i + 1 < token_count) {
+            max_lines = atoi(tokens[++i].value);
+        } else if (strcmp(tokens[i].value, "-f") == 0) {
+            follow = 1;
+        } else if (is_valid_job_number(number)) {
+            job_index = find_job_by_number(atoi(number));
+            if (job_index == -1) {
+                printf("No such job\n");
+                return 1;
+            }
+        } else {
+            printf("Usage: joblog [-n LINES] [-f] [%%job | job_number]\n");
+            return 1;
+        }
+    }
+
+    if (job_index == -1) {
+        // Default to the most recent job that has a log
+        for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+            if (background_jobs[i].is_active && background_jobs[i].capture != NULL &&
+                (job_index == -1 || background_jobs[i].job_number > background_jobs[job_index].job_number)) {
+                job_index = i;
+            }
+        }
+        if (job_index == -1) {
+            printf("No such job\n");
+            return 1;
+        }
+    }
+
+    BackgroundJob *job = &background_jobs[job_index];
+    if (job->capture == NULL) {
+        printf("joblog: Output of job %d is not captured\n", job->job_number);
+        return 1;
+    }
+
+    drain_job_capture(job->capture);
+    print_job_capture(job->capture, max_lines);
+
+    if (follow) {
+        // Stream new output until the pipe closes; Ctrl-C interrupts the wait
+        job->capture->passthrough = 1;
+        while (job->is_active && job->capture->pipe_fd != -1) {
+            if (run_event_loop_once(-1) == -1) {
+                break;
+            }
+        }
+        if (job->is_active && job->capture != NULL) {
+            job->capture->passthrough = 0;
+        }
+    }
+
+    // A finished job was only kept around for its log
+    if (job->is_active && job->state == PROCESS_DONE && job->notified) {
+        cleanup_background_job(job_index);
+    }
+    return 0;
+}
@@ -18,15 +18,13 @@ int execute_external_command(char **args) {
     
     if (pid == 0) {
         // Child process: execute the command
-        execvp(args[0], args);
+        exec_with_environment(args);
         
-        // If execvp returns, there was an error
-        perror(args[0]);
-        exit(127); // Use exit code 127 for "command not found"
+        exit_exec_failure(args);
     } else if (pid > 0) {
         // Parent process: wait for child to complete
         int status;
-        if (waitpid(pid, &status, 0) == -1) {
+        if (wait_for_child(pid, &status, 0) == -1) {
             perror("waitpid");
             return -1;
         }
@@ -56,10 +54,6 @@ int execute_command(void) {
         return 0;
     }
     
-    // Build argument array for the command, excluding redirection parts
-    char *args[256]; // Maximum 256 arguments
-    int arg_count = 0;
-    
     // Find the boundaries of the command (stop at pipes, semicolons, ampersands)
     int cmd_end = token_count;
     for (int i = 0; i < token_count; i++) {
@@ -71,30 +65,20 @@ int execute_command(void) {
         }
     }
     
-    // Extract command and arguments (skip redirection tokens and filenames)
-    for (int i = 0; i < cmd_end; i++) {
-        if (tokens[i].type == TOKEN_NAME) {
-            // Check if this token is a redirection filename
-            bool is_redirect_file = false;
-            if (i > 0) {
-                TokenType prev_type = tokens[i-1].type;
-                if (prev_type == TOKEN_INPUT || 
-                    prev_type == TOKEN_OUTPUT || 
-                    prev_type == TOKEN_DOUBLE_OUTPUT) {
-                    is_redirect_file = true;
-                }
-            }
-            
-            // If it's not a redirection filename, add it as a command argument
-            if (!is_redirect_file) {
-                args[arg_count] = tokens[i].value;
-                arg_count++;
-                if (arg_count >= 255) break; // Prevent overflow
-            }
-        }
+    // A leading `job`, `limit` or `timeout` prefix sets the nice level and limits of the command
+    JobOptions options;
+    int cmd_start = parse_job_options(0, cmd_end, &options);
+    if (cmd_start == -1) {
+        return 1;
     }
-    args[arg_count] = NULL; // NULL-terminate the argument array
+    apply_default_timeout(&options);
     
+    // Build the argument vector (skip redirection tokens and filenames)
+    int arg_count;
+    char **args = build_arg_vector(cmd_start, cmd_end, &arg_count);
+    if (args == NULL) {
+        return -1;
+    }
     if (arg_count == 0) {
         printf("Error: No command found\n");
         return -1;
@@ -108,62 +92,86 @@ int execute_command(void) {
         return 0;
     }
     
+    int cgroup_fd = create_foreground_cgroup(&options);
+    
     // Fork a child process for external command execution
     pid_t pid = fork();
     
     if (pid == 0) {
         // Child process: set up process group and redirections
         
-        // Create new process group for job control
-        setpgid(0, 0);
+        // Create new process group for job control and take the terminal
+        enter_job_process_group(0, 1);
         
-        // Set up input redirection
-        if (setup_input_redirection(0, cmd_end) == -1) {
-            exit(1);
+        // Set up redirections, left to right
+        if (setup_redirections(0, cmd_end) == -1) {
+            // _exit: exit() would flush stdin and move the shell's read offset back
+            fflush(stdout);
+            _exit(1);
         }
         
-        // Set up output redirection
-        if (setup_output_redirection(0, cmd_end) == -1) {
-            exit(1);
-        }
-        
-        // Execute the command
-        execvp(args[0], args);
+        join_job_cgroup(cgroup_fd);
+        apply_job_options(&options);
         
-        // If execvp returns, there was an error
-        printf("Command not found!\n");
-        exit(127);
+        // Execute the command (or its batches)
+        exec_command(args, &options);
     } else if (pid > 0) {
         // Parent process: set up foreground tracking and wait for child
         
-        // Set child as its own process group leader
+        // Set child as its own process group leader and give it the terminal
         setpgid(pid, pid);
+        give_terminal_to(pid, NULL);
         
         // Track this as the current foreground process
         set_foreground_process(pid, args[0]);
+        CommandTimer *timer = create_command_timer(&pid, 1, &options);
         
         int status;
-        if (waitpid(pid, &status, WUNTRACED) == -1) {
+        if (wait_for_child(pid, &status, WUNTRACED) == -1) {
             perror("waitpid");
+            reclaim_terminal(0, NULL);
             clear_foreground_process();
+            release_command_timer(timer);
+            remove_job_cgroup(cgroup_fd);
             return -1;
         }
+        struct termios job_modes;
+        int has_job_modes = reclaim_terminal(status, &job_modes);
+        
+        // A stopped command becomes a job and takes its cgroup, timeout
+        // and terminal modes along
+        int job_index = WIFSTOPPED(status) ? add_stopped_foreground_job(pid) : -1;
         
         // Clear foreground tracking
         clear_foreground_process();
         
+        if (job_index != -1) {
+            background_jobs[job_index].cgroup_fd = cgroup_fd;
+            background_jobs[job_index].timer = timer;
+            background_jobs[job_index].terminal_modes = job_modes;
+            background_jobs[job_index].has_terminal_modes = has_job_modes;
+        } else {
+            remove_job_cgroup(cgroup_fd);
+            int timeout_status = release_command_timer(timer);
+            if (timeout_status != 0) {
+                return timeout_status;
+            }
+        }
+        
         if (WIFEXITED(status)) {
             return WEXITSTATUS(status);
         } else if (WIFSIGNALED(status)) {
             return 128 + WTERMSIG(status);
         } else if (WIFSTOPPED(status)) {
-            // Process was stopped - it should be handled by signal handler
-            return 0;
+            // Process was stopped and is now a job; fail like bash so
+            // `cmd && next` does not go on without it
+            return 128 + WSTOPSIG(status);
         } else {
             return -1;
         }
     } else {
         perror("fork");
+        remove_job_cgroup(cgroup_fd);
         return -1;
     }
 }
\ No newline at end of file
@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#define CPU_MAX_PERIOD_US 100000
+
+// Per-shell cgroup that holds one child cgroup per job, -1 until set up
+static int jobs_root_fd = -1;
+static int cgroup_state = 0;   // 0 not tried yet, 1 ready, -1 unavailable
+static pid_t cgroup_owner = 0;
+static char parent_path[PATH_MAX];
+static char jobs_root_path[PATH_MAX + 32];
+
+/**
+ * @brief Write a string to a file inside a cgroup directory
+ * @return 0 on success, -1 on error (errno set)
+ */
+static int write_cgroup_file(int dir_fd, const char *file, const char *value) {
+    int fd = openat(dir_fd, file, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t written = write(fd, value, strlen(value));
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return written == (ssize_t)strlen(value) ? 0 : -1;
+}
+
+/**
+ * @brief Find the cgroup v2 directory the shell currently lives in
+ * @param path Filled with the absolute directory path
+ * @return 0 on success, -1 if there is no cgroup v2 hierarchy
+ */
+static int find_own_cgroup(char *path, size_t size) {
+    const char *mount = NULL;
+    if (access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0) {
+        mount = "/sys/fs/cgroup";
+    } else if (access("/sys/fs/cgroup/unified/cgroup.controllers", F_OK) == 0) {
+        // Hybrid layout: v2 is mounted next to the v1 controllers
+        mount = "/sys/fs/cgroup/unified";
+    } else {
+        return -1;
+    }
+
+    FILE *file = fopen("/proc/self/cgroup", "r");
+    if (file == NULL) {
+        return -1;
+    }
+    char line[PATH_MAX];
+    int found = -1;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            // The root cgroup is "/", which would leave a double slash
+            snprintf(path, size, "%s%s", mount, strcmp(line + 3, "/") == 0 ? "" : line + 3);
+            found = 0;
+            break;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+/**
+ * @brief Move the shell back to its original cgroup and remove its own ones
+ *
+ * Registered with atexit(); job cgroups that still hold processes
+ * (jobs outliving the shell) are left in place.
+ */
+static void teardown_job_cgroups(void) {
+    if (cgroup_state != 1 || getpid() != cgroup_owner) {
+        return;
+    }
+    int parent_fd = open(parent_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (parent_fd != -1) {
+        char pid[32];
+        snprintf(pid, sizeof(pid), "%d", getpid());
+        write_cgroup_file(parent_fd, "cgroup.procs", pid);
+        close(parent_fd);
+    }
+    unlinkat(jobs_root_fd, "shell", AT_REMOVEDIR);
+    close(jobs_root_fd);
+    rmdir(jobs_root_path);
+}
+
+/**
+ * @brief Set up the shell's job cgroups on first use
+ * @return 1 if per-job cgroups can be created, 0 otherwise
+ *
+ * Layout under the shell's own cgroup P:
+ *   P/shell-<pid>/shell   the shell itself
+ *   P/shell-<pid>/job-N   one per background job (fg-N for foreground ones)
+ * The shell has to leave P/shell-<pid> because cgroup v2 only hands
+ * controllers to children of a cgroup that has no processes of its own.
+ * If mkdir or the move fails, delegation is not available.
+ */
+static int init_job_cgroups(void) {
+    if (cgroup_state != 0) {
+        return cgroup_state == 1;
+    }
+    cgroup_state = -1;
+    cgroup_owner = getpid();
+
+    if (find_own_cgroup(parent_path, sizeof(parent_path)) == -1) {
+        return 0;
+    }
+    snprintf(jobs_root_path, sizeof(jobs_root_path), "%s/shell-%d", parent_path, getpid());
+    if (mkdir(jobs_root_path, 0755) == -1 && errno != EEXIST) {
+        return 0;
+    }
+    jobs_root_fd = open(jobs_root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (jobs_root_fd == -1) {
+        rmdir(jobs_root_path);
+        return 0;
+    }
+
+    if ((mkdirat(jobs_root_fd, "shell", 0755) == -1 && errno != EEXIST) ||
+        write_cgroup_file(jobs_root_fd, "shell/cgroup.procs", "0") == -1) {
+        unlinkat(jobs_root_fd, "shell", AT_REMOVEDIR);
+        close(jobs_root_fd);
+        jobs_root_fd = -1;
+        rmdir(jobs_root_path);
+        return 0;
+    }
+
+    // Hand controllers down; each one may already be enabled or not delegated
+    int parent_fd = open(parent_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    const char *controllers[] = { "+memory", "+cpu", "+io" };
+    for (size_t i = 0; i < sizeof(controllers) / sizeof(controllers[0]); i++) {
+        if (parent_fd != -1) {
+            write_cgroup_file(parent_fd, "cgroup.subtree_control", controllers[i]);
+        }
+        write_cgroup_file(jobs_root_fd, "cgroup.subtree_control", controllers[i]);
+    }
+    if (parent_fd != -1) {
+        close(parent_fd);
+    }
+
+    cgroup_state = 1;
+    atexit(teardown_job_cgroups);
+    return 1;
+}
+
+/**
+ * @brief Create a cgroup for a job and apply its memory/CPU caps
+ * @param name Cgroup name (job-N, fg-N)
+ * @param options Job options; memory_max and cpu_max_percent are applied
+ * @return Directory fd of the new cgroup, -1 if cgroups are unavailable
+ *
+ * Caps that cannot be applied (controller not delegated) are reported
+ * and the job runs without them.
+ */
+int create_job_cgroup(const char *name, const JobOptions *options) {
+    if (!init_job_cgroups()) {
+        if (job_options_need_cgroup(options)) {
+            printf("limit: cgroup v2 delegation not available, --memory/--cpu ignored\n");
+        }
+        return -1;
+    }
+
+    if (mkdirat(jobs_root_fd, name, 0755) == -1 && errno != EEXIST) {
+        perror("limit: mkdir cgroup");
+        return -1;
+    }
+    int cgroup_fd = openat(jobs_root_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroup_fd == -1) {
+        perror("limit: open cgroup");
+        unlinkat(jobs_root_fd, name, AT_REMOVEDIR);
+        return -1;
+    }
+
+    char value[64];
+    if (options->memory_max > 0) {
+        snprintf(value, sizeof(value), "%lld", options->memory_max);
+        if (write_cgroup_file(cgroup_fd, "memory.max", value) == -1) {
+            printf("limit: Cannot set memory.max (memory controller not delegated)\n");
+        }
+    }
+    if (options->cpu_max_percent > 0) {
+        long long quota = (long long)options->cpu_max_percent * CPU_MAX_PERIOD_US / 100;
+        snprintf(value, sizeof(value), "%lld %d", quota, CPU_MAX_PERIOD_US);
+        if (write_cgroup_file(cgroup_fd, "cpu.max", value) == -1) {
+            printf("limit: Cannot set cpu.max (cpu controller not delegated)\n");
+        }
+    }
+    return cgroup_fd;
+}
+
+/**
+ * @brief Create a cgroup for a foreground command if its options need one
+ * @param options Job options of the command
+ * @return Directory fd of the cgroup, -1 if no cgroup caps were asked for
+ *
+ * Unlike background jobs, foreground commands only get a cgroup for
+ * --memory and --cpu; nothing samples their usage.
+ */
+int create_foreground_cgroup(const JobOptions *options) {
+    static int foreground_count = 0;
+    if (!job_options_need_cgroup(options)) {
+        return -1;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "fg-%d", ++foreground_count);
+    return create_job_cgroup(name, options);
+}
+
+/**
+ * @brief Move the calling process into a job cgroup (used in the child before exec)
+ * @param cgroup_fd Directory fd from create_job_cgroup(), -1 for none
+ */
+void join_job_cgroup(int cgroup_fd) {
+    if (cgroup_fd != -1 && write_cgroup_file(cgroup_fd, "cgroup.procs", "0") == -1) {
+        perror("limit: join cgroup");
+    }
+}
+
+/**
+ * @brief Remove a job cgroup once its processes are gone
+ * @param cgroup_fd Directory fd from create_job_cgroup(), -1 for none
+ *
+ * Processes the job left behind keep the cgroup alive; it is then
+ * simply left in place.
+ */
+void remove_job_cgroup(int cgroup_fd) {
+    if (cgroup_fd == -1) {
+        return;
+    }
+    char link[64], path[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", cgroup_fd);
+    ssize_t length = readlink(link, path, sizeof(path) - 1);
+    close(cgroup_fd);
+    if (length > 0) {
+        path[length] = '\0';
+        rmdir(path);
+    }
+}
@@ -0,0 +1,1101 @@
+#include "shell.h"
+#include <fcntl.h>
+
+#define MAX_LOOP_NESTING 64
+#define EXTRA_TOKENS 64        // Room for case patterns written as `a)cmd`
+
+/**
+ * @brief Jump targets of a loop being compiled
+ */
+typedef struct {
+    int continue_target;       // Where `continue` goes
+    int *breaks;               // OP_BREAKs to point past the loop
+    int break_count;
+    int break_capacity;
+} LoopLabels;
+
+/**
+ * @brief Jumps to the end of an if or case, patched once the end is known
+ */
+typedef struct {
+    int *jumps;
+    int count;
+    int capacity;
+} JumpList;
+
+/**
+ * @brief State of one compilation
+ *
+ * The compiler sometimes reads a command twice: once with dry_run set,
+ * to find out where it ends (is it followed by `&` or a redirection?),
+ * and once to emit its code. Nothing is emitted during a dry run.
+ */
+typedef struct {
+    Program *program;
+    int pos;                   // Current token
+    int dry_run;
+    int failed;
+    int incomplete;            // The input ended inside a compound command
+    char message[128];
+    LoopLabels loops[MAX_LOOP_NESTING];
+    int loop_count;
+    int in_function;           // Compiling a function body: return is allowed
+} Compiler;
+
+static void compile_list(Compiler *c);
+static int compile_and_or(Compiler *c);
+static void compile_command(Compiler *c, int emit_simple);
+
+/**
+ * @brief Get the current token (TOKEN_END past the last one)
+ */
+static Token* peek(Compiler *c) {
+    return &c->program->tokens[c->pos];
+}
+
+/**
+ * @brief Check whether the current token is the given word
+ */
+static int at_word(Compiler *c, const char *word) {
+    Token *token = peek(c);
+    return token->type == TOKEN_NAME && strcmp(token->value, word) == 0;
+}
+
+/**
+ * @brief Check whether the current token is a plain `;` (not `;;`)
+ */
+static int at_semicolon(Compiler *c) {
+    Token *token = peek(c);
+    return token->type == TOKEN_SEMICOLON && strcmp(token->value, ";") == 0;
+}
+
+/**
+ * @brief Skip empty commands (`;` left by joined lines)
+ */
+static void skip_semicolons(Compiler *c) {
+    while (at_semicolon(c)) {
+        c->pos++;
+    }
+}
+
+/**
+ * @brief Stop compiling with an error
+ *
+ * Running into the end of the input is not an error but a command that
+ * goes on in the next line.
+ */
+static void fail(Compiler *c, const char *message) {
+    if (c->failed) {
+        return;
+    }
+    c->failed = 1;
+    if (peek(c)->type == TOKEN_END) {
+        c->incomplete = 1;
+    } else {
+        snprintf(c->message, sizeof(c->message), "%s", message);
+    }
+}
+
+/**
+ * @brief Consume an expected keyword
+ * @return 1 if it was there, 0 after failing
+ */
+static int expect_word(Compiler *c, const char *word) {
+    if (at_word(c, word)) {
+        c->pos++;
+        return 1;
+    }
+    char message[128];
+    snprintf(message, sizeof(message), "Error: Expected '%s' before '%.64s'", word, peek(c)->value);
+    fail(c, message);
+    return 0;
+}
+
+/**
+ * @brief Append an instruction
+ * @return Its index, -1 during a dry run
+ */
+static int emit(Compiler *c, OpCode op, int a, int b, int cc) {
+    if (c->dry_run || c->failed) {
+        return -1;
+    }
+    Program *program = c->program;
+    if (program->length == program->capacity) {
+        int capacity = program->capacity ? program->capacity * 2 : 64;
+        Instruction *code = realloc(program->code, sizeof(Instruction) * capacity);
+        if (code == NULL) {
+            fail(c, "Error: Out of memory");
+            return -1;
+        }
+        program->code = code;
+        program->capacity = capacity;
+    }
+    Instruction *instruction = &program->code[program->length];
+    instruction->op = op;
+    instruction->a = a;
+    instruction->b = b;
+    instruction->c = cc;
+    return program->length++;
+}
+
+/**
+ * @brief Index of the next instruction to be emitted
+ */
+static int here(Compiler *c) {
+    return c->program->length;
+}
+
+/**
+ * @brief Point a jump (operand a) at the next instruction
+ */
+static void patch_jump(Compiler *c, int index) {
+    if (index >= 0) {
+        c->program->code[index].a = here(c);
+    }
+}
+
+/**
+ * @brief Remember a jump for patch_jump_list() (nothing during a dry run)
+ */
+static void add_jump(Compiler *c, JumpList *list, int index) {
+    if (index < 0) {
+        return;
+    }
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 8;
+        int *jumps = realloc(list->jumps, sizeof(int) * capacity);
+        if (jumps == NULL) {
+            fail(c, "Error: Out of memory");
+            return;
+        }
+        list->jumps = jumps;
+        list->capacity = capacity;
+    }
+    list->jumps[list->count++] = index;
+}
+
+/**
+ * @brief Point every jump of a list at the next instruction, then free the list
+ */
+static void patch_jump_list(Compiler *c, JumpList *list) {
+    for (int i = 0; i < list->count && !c->failed; i++) {
+        patch_jump(c, list->jumps[i]);
+    }
+    free(list->jumps);
+}
+
+/**
+ * @brief Keep a string (loop variable or case pattern) in the program
+ * @return Index in program->strings, -1 during a dry run
+ */
+static int add_string(Compiler *c, const char *text, size_t length) {
+    if (c->dry_run || c->failed) {
+        return -1;
+    }
+    Program *program = c->program;
+    char **strings = realloc(program->strings, sizeof(char*) * (program->string_count + 1));
+    char *copy = strndup(text, length);
+    if (strings == NULL || copy == NULL) {
+        if (strings != NULL) {
+            program->strings = strings;
+        }
+        free(copy);
+        fail(c, "Error: Out of memory");
+        return -1;
+    }
+    program->strings = strings;
+    program->strings[program->string_count] = copy;
+    return program->string_count++;
+}
+
+/**
+ * @brief Check whether a word ends the list it appears in
+ */
+static int is_list_terminator(const char *word) {
+    static const char *terminators[] = { "then", "elif", "else", "fi", "do", "done", "esac", "}" };
+    for (size_t i = 0; i < sizeof(terminators) / sizeof(terminators[0]); i++) {
+        if (strcmp(word, terminators[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether a word starts a compound command
+ */
+static int is_compound_keyword(const char *word) {
+    return strcmp(word, "if") == 0 || strcmp(word, "while") == 0 || strcmp(word, "until") == 0 ||
+           strcmp(word, "for") == 0 || strcmp(word, "case") == 0 || strcmp(word, "{") == 0;
+}
+
+/**
+ * @brief Check whether a token ends a simple command
+ */
+static int ends_simple_command(TokenType type) {
+    return type == TOKEN_PIPE || type == TOKEN_SEMICOLON || type == TOKEN_AMPERSAND ||
+           type == TOKEN_AND || type == TOKEN_OR || type == TOKEN_END;
+}
+
+/**
+ * @brief Open a loop for break and continue
+ */
+static void push_loop(Compiler *c, int continue_target) {
+    if (c->loop_count == MAX_LOOP_NESTING) {
+        fail(c, "Error: Loops nested too deeply");
+        return;
+    }
+    LoopLabels *loop = &c->loops[c->loop_count++];
+    memset(loop, 0, sizeof(*loop));
+    loop->continue_target = continue_target;
+}
+
+/**
+ * @brief Close the innermost loop: its breaks go to the next instruction
+ */
+static void pop_loop(Compiler *c) {
+    if (c->loop_count == 0) {
+        return;
+    }
+    LoopLabels *loop = &c->loops[--c->loop_count];
+    for (int i = 0; i < loop->break_count; i++) {
+        c->program->code[loop->breaks[i]].b = here(c);
+    }
+    free(loop->breaks);
+}
+
+/**
+ * @brief Compile `break [n]` or `continue [n]`
+ */
+static void compile_break(Compiler *c) {
+    int is_break = at_word(c, "break");
+    if (c->loop_count == 0) {
+        fail(c, is_break ? "break: Only meaningful in a loop" : "continue: Only meaningful in a loop");
+        return;
+    }
+    c->pos++;
+    int levels = 1;
+    Token *count = peek(c);
+    if (count->type == TOKEN_NAME) {
+        char *end;
+        long value = strtol(count->value, &end, 10);
+        if (*end != '\0' || value < 1) {
+            fail(c, is_break ? "break: Loop count out of range" : "continue: Loop count out of range");
+            return;
+        }
+        levels = value > c->loop_count ? c->loop_count : (int)value;
+        c->pos++;
+    }
+
+    LoopLabels *loop = &c->loops[c->loop_count - levels];
+    if (!is_break) {
+        emit(c, OP_CONTINUE, levels, loop->continue_target, 0);
+        return;
+    }
+    int index = emit(c, OP_BREAK, levels, -1, 0);
+    if (index == -1) {
+        return;
+    }
+    if (loop->break_count == loop->break_capacity) {
+        int capacity = loop->break_capacity ? loop->break_capacity * 2 : 8;
+        int *breaks = realloc(loop->breaks, sizeof(int) * capacity);
+        if (breaks == NULL) {
+            fail(c, "Error: Out of memory");
+            return;
+        }
+        loop->breaks = breaks;
+        loop->break_capacity = capacity;
+    }
+    loop->breaks[loop->break_count++] = index;
+}
+
+/**
+ * @brief Compile if/elif/else/fi
+ *
+ * Each condition that fails jumps to the next one; a taken branch jumps
+ * to the end. With no branch taken the status is 0.
+ */
+static void compile_if(Compiler *c) {
+    JumpList ends = { 0 };
+
+    do {
+        c->pos++;   // if or elif
+        compile_list(c);
+        if (!expect_word(c, "then")) {
+            break;
+        }
+        int skip = emit(c, OP_JUMP_IF_FALSE, -1, 0, 0);
+        compile_list(c);
+        add_jump(c, &ends, emit(c, OP_JUMP, -1, 0, 0));
+        patch_jump(c, skip);
+    } while (!c->failed && at_word(c, "elif"));
+
+    if (!c->failed) {
+        if (at_word(c, "else")) {
+            c->pos++;
+            compile_list(c);
+        } else {
+            emit(c, OP_SET_STATUS, 0, 0, 0);
+        }
+        expect_word(c, "fi");
+    }
+    patch_jump_list(c, &ends);
+}
+
+/**
+ * @brief Compile while/until ... do ... done
+ */
+static void compile_while(Compiler *c) {
+    int until = at_word(c, "until");
+    c->pos++;
+    emit(c, OP_LOOP_BEGIN, 0, 0, 0);
+    int top = here(c);
+    push_loop(c, top);
+
+    compile_list(c);
+    if (!expect_word(c, "do")) {
+        return;
+    }
+    int exit = emit(c, until ? OP_JUMP_IF_TRUE : OP_JUMP_IF_FALSE, -1, 0, 0);
+    compile_list(c);
+    if (!expect_word(c, "done")) {
+        return;
+    }
+    emit(c, OP_LOOP_SAVE, 0, 0, 0);
+    emit(c, OP_JUMP, top, 0, 0);
+    patch_jump(c, exit);
+    emit(c, OP_LOOP_END, 0, 0, 0);
+    pop_loop(c);
+}
+
+/**
+ * @brief Compile for NAME [in WORDS] ; do ... done
+ *
+ * The words are expanded once, when the loop starts.
+ */
+static void compile_for(Compiler *c) {
+    c->pos++;
+    Token *name = peek(c);
+    if (name->type != TOKEN_NAME || !is_valid_variable_name(name->value, strlen(name->value))) {
+        fail(c, "Error: Bad for loop variable");
+        return;
+    }
+    int variable = add_string(c, name->value, strlen(name->value));
+    c->pos++;
+
+    // Without `in` the loop goes over the positional parameters
+    int words_start = -1;
+    int words_end = -1;
+    if (at_word(c, "in")) {
+        c->pos++;
+        words_start = c->pos;
+        while (peek(c)->type == TOKEN_NAME) {
+            c->pos++;
+        }
+        words_end = c->pos;
+        if (!at_semicolon(c)) {
+            fail(c, "Error: Expected ';' after for loop words");
+            return;
+        }
+    }
+    skip_semicolons(c);
+    if (!expect_word(c, "do")) {
+        return;
+    }
+
+    emit(c, OP_FOR_BEGIN, words_start, words_end, 0);
+    int next = emit(c, OP_FOR_NEXT, variable, -1, 0);
+    push_loop(c, next);
+    compile_list(c);
+    if (!expect_word(c, "done")) {
+        return;
+    }
+    emit(c, OP_LOOP_SAVE, 0, 0, 0);
+    emit(c, OP_JUMP, next, 0, 0);
+    if (next >= 0) {
+        c->program->code[next].b = here(c);
+    }
+    emit(c, OP_LOOP_END, 0, 0, 0);
+    pop_loop(c);
+}
+
+/**
+ * @brief Find the `)` that ends a case pattern in a word
+ * @return Pointer to it, NULL if the word has none outside substitutions
+ */
+static const char* find_pattern_end(const char *word) {
+    for (const char *p = word; *p != '\0'; p++) {
+        if ((p[0] == '$' && p[1] == '(') || p[0] == '`') {
+            const char *end = find_substitution_end(p);
+            if (end == NULL) {
+                return NULL;
+            }
+            p = end;
+        } else if (*p == ')') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Split a token in two, so `a)cmd` reads like `a) cmd`
+ * @param index Token to split
+ * @param offset Length of the first part
+ *
+ * Splitting is done by the first (dry) pass; the second pass sees the
+ * tokens already split, so token indices stay the same for both.
+ */
+static void split_token(Compiler *c, int index, size_t offset) {
+    Program *program = c->program;
+    if (program->token_count + 1 >= program->token_capacity) {
+        fail(c, "Error: Too many words");
+        return;
+    }
+    char *rest = strdup(program->tokens[index].value + offset);
+    if (rest == NULL) {
+        fail(c, "Error: Out of memory");
+        return;
+    }
+    memmove(&program->tokens[index + 2], &program->tokens[index + 1],
+            sizeof(Token) * (program->token_count - index));
+    Token *second = &program->tokens[index + 1];
+    *second = program->tokens[index];
+    second->value = rest;
+    program->tokens[index].value[offset] = '\0';
+    program->token_count++;
+}
+
+/**
+ * @brief Compile the patterns of one case item: [(]pattern[|pattern]...)
+ */
+static void compile_case_patterns(Compiler *c) {
+    int first = 1;
+    while (!c->failed) {
+        Token *token = peek(c);
+        if (token->type != TOKEN_NAME) {
+            fail(c, "Error: Expected case pattern");
+            return;
+        }
+        const char *pattern = token->value;
+        if (first && pattern[0] == '(') {
+            pattern++;
+        }
+        first = 0;
+
+        const char *end = find_pattern_end(pattern);
+        if (end != NULL) {
+            if (end[1] != '\0') {
+                split_token(c, c->pos, end + 1 - token->value);
+                token = peek(c);
+                end = token->value + strlen(token->value) - 1;
+            }
+            emit(c, OP_CASE_MATCH, add_string(c, pattern, end - pattern), -1, 0);
+            c->pos++;
+            return;
+        }
+
+        emit(c, OP_CASE_MATCH, add_string(c, pattern, strlen(pattern)), -1, 0);
+        c->pos++;
+        if (at_word(c, ")")) {
+            c->pos++;
+            return;
+        }
+        if (peek(c)->type != TOKEN_PIPE) {
+            fail(c, "Error: Expected ')' after case pattern");
+            return;
+        }
+        c->pos++;
+    }
+}
+
+/**
+ * @brief Compile case WORD in pattern) list ;; ... esac
+ *
+ * Every pattern of an item jumps to its list when it matches; the list
+ * then jumps to the end. With no match the status is 0.
+ */
+static void compile_case(Compiler *c) {
+    c->pos++;
+    if (peek(c)->type != TOKEN_NAME) {
+        fail(c, "Error: Expected word after 'case'");
+        return;
+    }
+    emit(c, OP_CASE_BEGIN, c->pos, 0, 0);
+    c->pos++;
+    if (!expect_word(c, "in")) {
+        return;
+    }
+    skip_semicolons(c);
+
+    JumpList ends = { 0 };
+    while (!c->failed && !at_word(c, "esac")) {
+        int matches = here(c);
+        compile_case_patterns(c);
+        int skip = emit(c, OP_JUMP, -1, 0, 0);
+        for (int i = matches; skip >= 0 && i < skip; i++) {
+            c->program->code[i].b = here(c);
+        }
+
+        int body = here(c);
+        compile_list(c);
+        if (here(c) == body) {
+            emit(c, OP_SET_STATUS, 0, 0, 0);
+        }
+        add_jump(c, &ends, emit(c, OP_JUMP, -1, 0, 0));
+        patch_jump(c, skip);
+
+        if (peek(c)->type == TOKEN_SEMICOLON && strcmp(peek(c)->value, ";;") == 0) {
+            c->pos++;
+        } else if (!at_word(c, "esac")) {
+            fail(c, "Error: Expected ';;' or 'esac' in case");
+            break;
+        }
+        skip_semicolons(c);
+    }
+    if (!c->failed && expect_word(c, "esac")) {
+        emit(c, OP_SET_STATUS, 0, 0, 0);
+        patch_jump_list(c, &ends);
+        emit(c, OP_POP, 1, 0, 0);
+    } else {
+        free(ends.jumps);
+    }
+}
+
+/**
+ * @brief Compile the compound command at the current token, without redirections
+ */
+static void compile_compound_body(Compiler *c) {
+    if (at_word(c, "if")) {
+        compile_if(c);
+    } else if (at_word(c, "while") || at_word(c, "until")) {
+        compile_while(c);
+    } else if (at_word(c, "for")) {
+        compile_for(c);
+    } else if (at_word(c, "case")) {
+        compile_case(c);
+    } else {
+        c->pos++;   // {
+        compile_list(c);
+        expect_word(c, "}");
+    }
+}
+
+/**
+ * @brief Compile a compound command and the redirections after it
+ *
+ * `done > file` applies to the whole loop: the redirections are set up
+ * before it runs (a frame the VM undoes when the command is left).
+ */
+static void compile_compound(Compiler *c) {
+    int start = c->pos;
+    int redirect = -1;
+    if (!c->dry_run) {
+        c->dry_run++;
+        compile_compound_body(c);
+        c->dry_run--;
+        if (!c->failed && is_redirection_token(peek(c)->type)) {
+            redirect = emit(c, OP_REDIRECT, 0, 0, 0);
+        }
+        c->pos = start;
+    }
+
+    compile_compound_body(c);
+    int redirections = c->pos;
+    while (!c->failed && is_redirection_token(peek(c)->type)) {
+        c->pos++;
+        if (peek(c)->type != TOKEN_NAME) {
+            fail(c, "Error: Expected file name after redirection");
+            return;
+        }
+        c->pos++;
+    }
+    if (redirect >= 0 && !c->failed) {
+        c->program->code[redirect].a = redirections;
+        c->program->code[redirect].b = c->pos;
+        emit(c, OP_POP, 1, 0, 0);
+        c->program->code[redirect].c = here(c);
+    }
+}
+
+/**
+ * @brief Check whether a word can name a function
+ */
+static int is_valid_function_name(const char *name, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (isspace((unsigned char)name[i]) || strchr("|&;<>()$`=", name[i]) != NULL) {
+            return 0;
+        }
+    }
+    char word[MAX_PATH_LEN];
+    snprintf(word, sizeof(word), "%.*s", (int)length, name);
+    return !is_compound_keyword(word) && !is_list_terminator(word);
+}
+
+/**
+ * @brief Check whether tokens start a function definition
+ * @param token First token: `NAME()`, `NAME ()`, `function NAME [()]`
+ * @return Number of tokens before the body, 0 if it is no definition
+ */
+static int function_header_length(const Token *token) {
+    if (token[0].type != TOKEN_NAME) {
+        return 0;
+    }
+    if (strcmp(token[0].value, "function") == 0 && token[1].type == TOKEN_NAME) {
+        return token[2].type == TOKEN_NAME && strcmp(token[2].value, "()") == 0 ? 3 : 2;
+    }
+    size_t length = strlen(token[0].value);
+    if (length > 2 && strcmp(token[0].value + length - 2, "()") == 0) {
+        return 1;
+    }
+    return token[1].type == TOKEN_NAME && strcmp(token[1].value, "()") == 0 ? 2 : 0;
+}
+
+/**
+ * @brief Compile a function definition
+ *
+ * The body is only checked here. OP_DEFINE compiles it into a program of
+ * its own when the definition runs, so every later call just runs it.
+ */
+static void compile_function(Compiler *c) {
+    int header = function_header_length(peek(c));
+    const char *name = peek(c)->value;
+    if (strcmp(name, "function") == 0) {
+        name = c->program->tokens[c->pos + 1].value;
+    }
+    size_t length = strlen(name);
+    if (length > 2 && strcmp(name + length - 2, "()") == 0) {
+        length -= 2;
+    }
+    if (!is_valid_function_name(name, length)) {
+        char message[128];
+        snprintf(message, sizeof(message), "Error: Invalid function name: %.64s", name);
+        fail(c, message);
+        return;
+    }
+    int string = add_string(c, name, length);
+    c->pos += header;
+    skip_semicolons(c);
+
+    Token *token = peek(c);
+    if (token->type != TOKEN_NAME || !is_compound_keyword(token->value)) {
+        fail(c, "Error: Function body must be a compound command");
+        return;
+    }
+    int start = c->pos;
+    int in_function = c->in_function;
+    c->in_function = 1;
+    c->dry_run++;
+    compile_compound(c);
+    c->dry_run--;
+    c->in_function = in_function;
+    emit(c, OP_DEFINE, string, start, c->pos);
+}
+
+/**
+ * @brief Compile `return [n]`
+ */
+static void compile_return(Compiler *c) {
+    if (!c->in_function) {
+        fail(c, "return: Can only be used in a function");
+        return;
+    }
+    c->pos++;
+    int status = -1;
+    Token *token = peek(c);
+    if (token->type == TOKEN_NAME && !is_list_terminator(token->value)) {
+        status = c->pos++;
+    }
+    emit(c, OP_RETURN, status, 0, 0);
+}
+
+/**
+ * @brief Compile one command of a pipeline
+ * @param emit_simple Emit OP_RUN for a simple command (otherwise the
+ *        caller runs the whole pipeline at once)
+ */
+static void compile_command(Compiler *c, int emit_simple) {
+    Token *token = peek(c);
+    if (token->type == TOKEN_NAME && is_compound_keyword(token->value)) {
+        compile_compound(c);
+    } else if (function_header_length(token) > 0) {
+        compile_function(c);
+    } else if (at_word(c, "break") || at_word(c, "continue")) {
+        compile_break(c);
+    } else if (at_word(c, "return")) {
+        compile_return(c);
+    } else if (token->type == TOKEN_NAME || is_redirection_token(token->type)) {
+        int start = c->pos;
+        while (!ends_simple_command(peek(c)->type)) {
+            c->pos++;
+        }
+        if (emit_simple) {
+            emit(c, OP_RUN, start, c->pos, 0);
+        }
+    } else {
+        char message[128];
+        snprintf(message, sizeof(message), "Error: Unexpected '%.64s'", token->value);
+        fail(c, message);
+    }
+}
+
+/**
+ * @brief Check whether the current command is one the compiler turns into code
+ */
+static int at_compiled_command(Compiler *c) {
+    Token *token = peek(c);
+    return token->type == TOKEN_NAME &&
+           (is_compound_keyword(token->value) || function_header_length(token) > 0 ||
+            strcmp(token->value, "break") == 0 || strcmp(token->value, "continue") == 0 ||
+            strcmp(token->value, "return") == 0);
+}
+
+/**
+ * @brief Skip the `time` prefixes of a pipeline and their flags
+ * @return Number of prefixes skipped
+ */
+static int skip_time_prefixes(Compiler *c) {
+    int count = 0;
+    while (at_word(c, "time")) {
+        count++;
+        c->pos++;
+        while (peek(c)->type == TOKEN_NAME && peek(c)->value[0] == '-') {
+            int last = strcmp(peek(c)->value, "--") == 0;
+            c->pos++;
+            if (last) {
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Compile a pipeline: [time] [!] command [| command]...
+ * @return 1 if it is one plain (simple, not negated) pipeline
+ *
+ * Pipelines of simple commands become one OP_RUN that the existing
+ * pipeline code executes, `time` prefix included. With a compound stage,
+ * every stage runs in a forked shell (OP_PIPELINE), and a `time` prefix
+ * becomes an OP_TIME frame around the whole pipeline.
+ */
+static int compile_pipeline(Compiler *c) {
+    int time_start = c->pos;
+    int timers = skip_time_prefixes(c);
+    int negate = 0;
+    if (at_word(c, "!")) {
+        negate = 1;
+        c->pos++;
+    }
+
+    int start = c->pos;
+    int stage_count = 0;
+    int compiled = 0;
+    c->dry_run++;
+    do {
+        if (stage_count > 0) {
+            c->pos++;   // |
+        }
+        compiled |= at_compiled_command(c);
+        compile_command(c, 0);
+        stage_count++;
+    } while (!c->failed && peek(c)->type == TOKEN_PIPE);
+    c->dry_run--;
+    int end = c->pos;
+
+    if (c->failed || c->dry_run) {
+        return !compiled && !negate;
+    }
+    int timer = -1;
+    if (timers > 0 && (compiled || negate)) {
+        timer = emit(c, OP_TIME, time_start, start, 0);
+    } else if (!negate) {
+        start = time_start;   // OP_RUN handles the time prefix itself
+    }
+    if (!compiled) {
+        emit(c, OP_RUN, start, end, 0);
+    } else if (stage_count == 1) {
+        c->pos = start;
+        compile_command(c, 1);
+    } else {
+        c->pos = start;
+        int pipeline = emit(c, OP_PIPELINE, stage_count, -1, 0);
+        int stages = here(c);
+        for (int i = 0; i < stage_count; i++) {
+            emit(c, OP_STAGE, -1, 0, 0);
+        }
+        for (int i = 0; i < stage_count && !c->failed; i++) {
+            if (i > 0) {
+                c->pos++;   // |
+            }
+            c->program->code[stages + i].a = here(c);
+            c->program->code[stages + i].b = c->pos;
+            compile_command(c, 1);
+            c->program->code[stages + i].c = c->pos;
+            emit(c, OP_EXIT, 0, 0, 0);
+        }
+        if (pipeline >= 0) {
+            c->program->code[pipeline].b = here(c);
+        }
+    }
+    if (negate) {
+        emit(c, OP_NOT, 0, 0, 0);
+    }
+    if (timer >= 0) {
+        emit(c, OP_POP, timers, 0, 0);
+        c->program->code[timer].b = end;
+        c->program->code[timer].c = here(c);
+    }
+    return !compiled && !negate;
+}
+
+/**
+ * @brief Compile a conditional list: pipeline [&& | || pipeline]...
+ * @return 1 if it is a single plain pipeline
+ *
+ * `a && b` jumps over b when a fails, `a || b` when a succeeds; a
+ * skipped command leaves the status unchanged, as in seq.c.
+ */
+static int compile_and_or(Compiler *c) {
+    int plain = compile_pipeline(c);
+    while (!c->failed && (peek(c)->type == TOKEN_AND || peek(c)->type == TOKEN_OR)) {
+        OpCode op = peek(c)->type == TOKEN_AND ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE;
+        c->pos++;
+        skip_semicolons(c);
+        int skip = emit(c, op, -1, 0, 0);
+        compile_pipeline(c);
+        patch_jump(c, skip);
+        plain = 0;
+    }
+    return plain;
+}
+
+/**
+ * @brief Compile a list of conditional lists separated by ; and &
+ *
+ * Stops at the end of the input, at `;;` or at a keyword that ends a
+ * list (then, do, done, fi, ...); the caller checks which one it is.
+ */
+static void compile_list(Compiler *c) {
+    while (!c->failed) {
+        skip_semicolons(c);
+        Token *token = peek(c);
+        if (token->type == TOKEN_END || token->type == TOKEN_SEMICOLON ||
+            (token->type == TOKEN_NAME && is_list_terminator(token->value))) {
+            return;
+        }
+
+        // Look ahead for a trailing & first: it changes how the list runs
+        int start = c->pos;
+        int background = 0;
+        int plain = 0;
+        int end = start;
+        if (!c->dry_run) {
+            c->dry_run++;
+            plain = compile_and_or(c);
+            c->dry_run--;
+            background = !c->failed && peek(c)->type == TOKEN_AMPERSAND;
+            end = c->pos;
+            c->pos = start;
+        }
+        if (c->failed) {
+            return;
+        }
+
+        if (background && plain) {
+            // A plain pipeline becomes an ordinary background job
+            emit(c, OP_BACKGROUND, start, end, 0);
+            c->pos = end;
+        } else if (background) {
+            // Anything else runs in a forked shell that is the job
+            int fork = emit(c, OP_FORK, -1, start, end);
+            compile_and_or(c);
+            emit(c, OP_EXIT, 0, 0, 0);
+            patch_jump(c, fork);
+        } else {
+            compile_and_or(c);
+        }
+
+        if (!c->failed && (at_semicolon(c) || peek(c)->type == TOKEN_AMPERSAND)) {
+            c->pos++;
+        } else {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Free a compiled program
+ */
+void free_program(Program *program) {
+    if (program == NULL) {
+        return;
+    }
+    for (int i = 0; program->owns_heredocs && i < program->token_count; i++) {
+        if (program->tokens[i].heredoc_fd != -1) {
+            close(program->tokens[i].heredoc_fd);
+        }
+    }
+    for (int i = 0; i < program->string_count; i++) {
+        free(program->strings[i]);
+    }
+    free(program->strings);
+    free(program->code);
+    if (program->tokens != NULL) {
+        free_token_values(program->tokens, program->token_count + 1);
+    }
+    free(program->tokens);
+    free(program);
+}
+
+/**
+ * @brief Compile the current tokens into a program
+ * @param quiet Do not print syntax errors
+ * @param in_function Compile a function body (return is allowed)
+ * @param incomplete Set to 1 if the input ends inside a compound command
+ * @return New program, NULL on error or incomplete input
+ *
+ * The program keeps its own copy of the tokens and their text; instructions refer to
+ * token ranges in it, so running a loop never tokenises again.
+ */
+static Program* compile_tokens(int quiet, int in_function, int *incomplete) {
+    *incomplete = 0;
+    Compiler *c = calloc(1, sizeof(Compiler));
+    Program *program = calloc(1, sizeof(Program));
+    if (c == NULL || program == NULL) {
+        perror("calloc program");
+        free(c);
+        free(program);
+        return NULL;
+    }
+    program->token_capacity = token_count + 1 + EXTRA_TOKENS;
+    program->tokens = malloc(sizeof(Token) * program->token_capacity);
+    if (program->tokens == NULL) {
+        perror("malloc program");
+        free(c);
+        free(program);
+        return NULL;
+    }
+    memcpy(program->tokens, tokens, sizeof(Token) * (token_count + 1));
+    if (copy_token_values(program->tokens, token_count + 1) == -1) {
+        free(program->tokens);
+        free(c);
+        free(program);
+        return NULL;
+    }
+    program->token_count = token_count;
+    c->program = program;
+    c->in_function = in_function;
+
+    compile_list(c);
+    if (!c->failed && peek(c)->type != TOKEN_END) {
+        char message[128];
+        snprintf(message, sizeof(message), "Error: Unexpected '%.64s'", peek(c)->value);
+        fail(c, message);
+    }
+    while (c->loop_count > 0) {
+        free(c->loops[--c->loop_count].breaks);
+    }
+
+    if (c->failed) {
+        *incomplete = c->incomplete;
+        if (!quiet && !c->incomplete) {
+            printf("%s\n", c->message);
+        }
+        free_program(program);
+        program = NULL;
+    }
+    free(c);
+    return program;
+}
+
+/**
+ * @brief Compile the current tokens into a program
+ * @return New program, NULL on a syntax error (message printed)
+ */
+Program* compile_program(void) {
+    int incomplete;
+    Program *program = compile_tokens(0, 0, &incomplete);
+    if (program == NULL && incomplete) {
+        printf("Error: Unexpected end of input\n");
+    }
+    return program;
+}
+
+/**
+ * @brief Compile the current tokens as the body of a function
+ * @return New program, NULL on a syntax error (message printed)
+ *
+ * The body outlives the command line that defined it, so it keeps its
+ * own copies of the heredoc memfds the line's tokens refer to.
+ */
+Program* compile_function_body(void) {
+    int incomplete;
+    Program *program = compile_tokens(0, 1, &incomplete);
+    if (program == NULL) {
+        if (incomplete) {
+            printf("Error: Unexpected end of input\n");
+        }
+        return NULL;
+    }
+    program->owns_heredocs = 1;
+    for (int i = 0; i < program->token_count; i++) {
+        if (program->tokens[i].heredoc_fd != -1) {
+            program->tokens[i].heredoc_fd = fcntl(program->tokens[i].heredoc_fd, F_DUPFD_CLOEXEC, 0);
+        }
+    }
+    return program;
+}
+
+/**
+ * @brief Check whether the current tokens hold a compound command
+ * @return 1 if a command position holds if, while, until, for, case, {,
+ *         !, break, continue, return or a function definition, possibly
+ *         after a `time` prefix
+ */
+int is_compound_command(void) {
+    for (int i = 0; i < token_count; i++) {
+        if (tokens[i].type != TOKEN_NAME) {
+            continue;
+        }
+        if (i > 0 && tokens[i - 1].type != TOKEN_PIPE && tokens[i - 1].type != TOKEN_SEMICOLON &&
+            tokens[i - 1].type != TOKEN_AMPERSAND && tokens[i - 1].type != TOKEN_AND &&
+            tokens[i - 1].type != TOKEN_OR) {
+            continue;
+        }
+        // A `time` prefix (and its flags) times whatever follows it
+        int word_index = i;
+        while (word_index < token_count && tokens[word_index].type == TOKEN_NAME &&
+               strcmp(tokens[word_index].value, "time") == 0) {
+            word_index++;
+            while (word_index < token_count && tokens[word_index].type == TOKEN_NAME &&
+                   tokens[word_index].value[0] == '-') {
+                if (strcmp(tokens[word_index++].value, "--") == 0) {
+                    break;
+                }
+            }
+        }
+        if (word_index == token_count || tokens[word_index].type != TOKEN_NAME) {
+            continue;
+        }
+        const char *word = tokens[word_index].value;
+        if (is_compound_keyword(word) || strcmp(word, "!") == 0 || function_header_length(&tokens[word_index]) > 0 ||
+            strcmp(word, "break") == 0 || strcmp(word, "continue") == 0 || strcmp(word, "return") == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether a compound command goes on in the next line
+ * @return 1 if the current tokens end inside one (e.g. after `do`)
+ */
+int compound_command_incomplete(void) {
+    int incomplete;
+    free_program(compile_tokens(1, 0, &incomplete));
+    return incomplete;
+}
@@ -9,20 +9,55 @@
 pid_t current_foreground_pgid = 0;
 char current_foreground_command[MAX_PATH_LEN] = "";
 
+// Terminal job control; only enabled when stdin is a terminal
+static int shell_terminal = -1;
+static pid_t shell_pgid = 0;
+static struct termios shell_modes;
+
+// Lets the event loop tell Ctrl-C apart from other signals that interrupt a wait
+volatile sig_atomic_t interrupt_received = 0;
+
 /**
  * @brief Signal handler for SIGINT (Ctrl-C)
  * 
+ * Only queues the signal; handle_interrupt_request() does the work in
+ * the event loop. Outside the shell process (a builtin running in a
+ * pipeline child) it just sets interrupt_received, which ends the
+ * builtin's poll() wait.
+ */
+void sigint_handler(int sig) {
+    if (!queue_signal_event(sig)) {
+        interrupt_received = 1;
+    }
+}
+
+/**
+ * @brief Signal handler for SIGTSTP (Ctrl-Z)
+ * 
+ * Only queues the signal; handle_suspend_request() does the work in the
+ * event loop, so no job table changes or output happen in signal context.
+ */
+void sigtstp_handler(int sig) {
+    (void)queue_signal_event(sig);
+}
+
+/**
+ * @brief React to Ctrl-C from the event loop
+ * 
+ * Without a terminal (or job control) the shell forwards the signal to
+ * the foreground job itself.
+ * 
  * Requirements implemented:
  * - Send SIGINT to current foreground child process group if one exists
  * - Shell itself must not terminate on Ctrl-C
  */
-void sigint_handler(int sig) {
-    (void)sig; // Suppress unused parameter warning
-    
-    if (current_foreground_pgid > 0) {
+void handle_interrupt_request(void) {
+    // With job control the terminal sends Ctrl-C to the job itself
+    if (current_foreground_pgid > 0 && shell_terminal == -1) {
         // Send SIGINT to the foreground process group
         kill(-current_foreground_pgid, SIGINT);
     }
+    interrupt_received = 1;
     
     // Print newline and prompt to maintain shell responsiveness
     printf("\n");
@@ -30,45 +65,43 @@ void sigint_handler(int sig) {
 }
 
 /**
- * @brief Signal handler for SIGTSTP (Ctrl-Z)
+ * @brief React to Ctrl-Z from the event loop
  * 
  * Requirements implemented:
  * - Send SIGTSTP to current foreground child process group if one exists
- * - Move stopped process to background list with status "Stopped"
- * - Print: [job_number] Stopped command_name
  * - Shell itself must not stop on Ctrl-Z
+ * 
+ * The job is added to the job list by whoever waits for the foreground
+ * process once it has actually stopped (see add_stopped_foreground_job()).
  */
-void sigtstp_handler(int sig) {
-    (void)sig; // Suppress unused parameter warning
-    
-    if (current_foreground_pgid > 0) {
+void handle_suspend_request(void) {
+    if (current_foreground_pgid > 0 && shell_terminal == -1) {
         // Send SIGTSTP to the foreground process group
         kill(-current_foreground_pgid, SIGTSTP);
-        
-        // Add the stopped process to background jobs (without launch message)
-        int job_number = add_stopped_job(current_foreground_pgid, current_foreground_command);
-        
-        if (job_number > 0) {
-            // Extract command name for display
-            char command_name[MAX_PATH_LEN];
-            strncpy(command_name, current_foreground_command, MAX_PATH_LEN - 1);
-            command_name[MAX_PATH_LEN - 1] = '\0';
-            char *space = strchr(command_name, ' ');
-            if (space) {
-                *space = '\0';
-            }
-            
-            printf("\n[%d] Stopped %s\n", job_number, command_name);
-        }
-        
-        // Clear foreground process tracking
-        current_foreground_pgid = 0;
-        current_foreground_command[0] = '\0';
     } else {
         printf("\n");
+        fflush(stdout);
     }
-    
+}
+
+/**
+ * @brief Move the stopped foreground process to the job list
+ * @param pid Process ID that stopped (must be the current foreground process)
+ * @return Index of the new job, -1 if the job list is full
+ * 
+ * Requirements implemented:
+ * - Move stopped process to background list with status "Stopped"
+ * - Print: [job_number] Stopped command_name
+ */
+int add_stopped_foreground_job(pid_t pid) {
+    int job_number = add_stopped_job(pid, current_foreground_command);
+    if (job_number <= 0) {
+        return -1;
+    }
+    int job_index = find_job_by_number(job_number);
+    printf("\n[%d] Stopped %s\n", job_number, background_jobs[job_index].command_name);
     fflush(stdout);
+    return job_index;
 }
 
 /**
@@ -77,6 +110,8 @@ void sigtstp_handler(int sig) {
  * Requirements implemented:
  * - Install signal handler for SIGINT (Ctrl-C)
  * - Install signal handler for SIGTSTP (Ctrl-Z)
+ * 
+ * Call after init_event_loop(): the handlers feed its self-pipe.
  */
 void setup_signal_handlers(void) {
     struct sigaction sa_int, sa_tstp;
@@ -98,6 +133,179 @@ void setup_signal_handlers(void) {
     }
 }
 
+/**
+ * @brief Take control of the terminal if the shell is interactive
+ * 
+ * Waits until the shell is in the foreground, puts it into its own
+ * process group and saves the terminal modes that are restored whenever
+ * a foreground job gives the terminal back. SIGTTOU and SIGTTIN are
+ * ignored so the shell can reclaim the terminal from a background group.
+ */
+void init_job_control(void) {
+    if (!isatty(STDIN_FILENO)) {
+        return;
+    }
+    
+    // Started in the background (e.g. `./shell.out &`): wait to be foregrounded
+    while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp())) {
+        kill(-shell_pgid, SIGTTIN);
+    }
+    
+    signal(SIGTTOU, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    
+    shell_pgid = getpid();
+    if (getpgrp() != shell_pgid && setpgid(0, shell_pgid) == -1) {
+        perror("setpgid");
+        return;
+    }
+    if (tcsetpgrp(STDIN_FILENO, shell_pgid) == -1 || tcgetattr(STDIN_FILENO, &shell_modes) == -1) {
+        perror("tcsetpgrp");
+        return;
+    }
+    shell_terminal = STDIN_FILENO;
+}
+
+/**
+ * @brief Check whether foreground jobs get the terminal
+ * @return 1 for an interactive shell, 0 when reading a script or pipe
+ */
+int job_control_enabled(void) {
+    return shell_terminal != -1;
+}
+
+/**
+ * @brief Put a forked child into its job's process group (called in the child)
+ * @param pgid Process group to join, 0 to lead a new one
+ * @param foreground Also take the terminal (interactive shell only); a
+ *        background child gives up job control for its own children
+ * 
+ * The parent makes the same setpgid()/tcsetpgrp() calls, so whichever
+ * runs first wins and the child never execs outside its group. Signal
+ * dispositions the shell changed are reset for the command.
+ */
+void enter_job_process_group(pid_t pgid, int foreground) {
+    pid_t pid = getpid();
+    if (pgid == 0) {
+        pgid = pid;
+    }
+    setpgid(pid, pgid);
+    if (foreground && shell_terminal != -1) {
+        tcsetpgrp(shell_terminal, pgid);
+    } else {
+        // A background child (e.g. a `a && b &` subshell) must never take
+        // the terminal for the commands it runs itself
+        shell_terminal = -1;
+    }
+    
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+}
+
+/**
+ * @brief Hand the terminal to a foreground job (called in the shell)
+ * @param pgid Process group of the job
+ * @param job_modes Terminal modes to restore for a resumed job, NULL for none
+ * 
+ * Terminal signals (Ctrl-C, Ctrl-Z) then go straight from the kernel to
+ * every process of the job.
+ */
+void give_terminal_to(pid_t pgid, const struct termios *job_modes) {
+    if (shell_terminal == -1) {
+        return;
+    }
+    if (job_modes != NULL) {
+        tcsetattr(shell_terminal, TCSADRAIN, job_modes);
+    }
+    tcsetpgrp(shell_terminal, pgid);
+}
+
+/**
+ * @brief Take the terminal back after a foreground job finished or stopped
+ * @param status Wait status of the job
+ * @param job_modes Receives the job's terminal modes if it stopped (may be NULL)
+ * @return 1 if job_modes was filled, 0 otherwise
+ * 
+ * The shell's own modes are restored when the job stopped or was killed,
+ * so a program that dies in raw mode does not leave the prompt unusable.
+ * After a normal exit the shell adopts the current modes instead, which
+ * keeps changes made with stty.
+ */
+int reclaim_terminal(int status, struct termios *job_modes) {
+    if (shell_terminal == -1) {
+        return 0;
+    }
+    tcsetpgrp(shell_terminal, shell_pgid);
+    
+    int saved = 0;
+    if (WIFSTOPPED(status) && job_modes != NULL) {
+        saved = tcgetattr(shell_terminal, job_modes) == 0;
+    }
+    if (WIFEXITED(status)) {
+        tcgetattr(shell_terminal, &shell_modes);
+    } else {
+        tcsetattr(shell_terminal, TCSADRAIN, &shell_modes);
+    }
+    
+    // Ctrl-C went to the job alone; end its line like the shell used to
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+        printf("\n");
+        fflush(stdout);
+        
+        // In the forked shell of a $(...) the Ctrl-C ends the whole
+        // substitution too, as if it had been in the job's group
+        if (in_command_substitution() && getpid() != shell_pgid) {
+            signal(SIGINT, SIG_DFL);
+            raise(SIGINT);
+        }
+    }
+    return saved;
+}
+
+/**
+ * @brief Convert a wait status into a shell exit status
+ * @return The exit code, 128 + N for signal N (killed or stopped)
+ */
+int exit_status_of(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    if (WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+    }
+    return 0;
+}
+
+/**
+ * @brief Wait until every process of a foreground job has exited or one stops
+ * @param pgid Process group of the job
+ * @param status_pid Process whose exit status is the job's (the last pipeline stage)
+ * @param status Receives that exit status, or the stop status
+ * @return 1 if the job stopped, 0 once all of it has finished, -1 on error
+ */
+int wait_for_job(pid_t pgid, pid_t status_pid, int *status) {
+    int child_status;
+    *status = 0;
+    while (1) {
+        pid_t pid = wait_for_child(-pgid, &child_status, WUNTRACED);
+        if (pid == -1) {
+            return errno == ECHILD ? 0 : -1;
+        }
+        if (WIFSTOPPED(child_status)) {
+            *status = child_status;
+            return 1;
+        }
+        if (pid == status_pid) {
+            *status = child_status;
+        }
+    }
+}
+
 /**
  * @brief Set the current foreground process for signal handling
  * @param pgid Process group ID of the foreground process
@@ -135,7 +343,8 @@ void handle_eof(void) {
     
     // Send SIGKILL to all background processes
     for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
-        if (background_jobs[i].is_active) {
+        if (background_jobs[i].is_active && background_jobs[i].pid > 0 &&
+            background_jobs[i].state != PROCESS_DONE) {
             kill(background_jobs[i].pid, SIGKILL);
         }
     }
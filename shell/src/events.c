@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+#define MAX_EVENT_SOURCES 256
+#define MAX_EVENTS_PER_WAIT 32
+
+/**
+ * @brief A file descriptor watched by the event loop
+ */
+typedef struct {
+    int fd;
+    EventCallback callback;
+    void *data;
+    int in_use;
+} EventSource;
+
+static EventSource event_sources[MAX_EVENT_SOURCES];
+static int epoll_fd = -1;
+static int signal_pipe[2] = { -1, -1 };
+static pid_t event_loop_owner = 0;   // Forked children must not share the loop
+
+// Signals caught since the self-pipe was last drained, indexed by number
+static volatile sig_atomic_t pending_signals[NSIG];
+
+/**
+ * @brief Hand a caught signal to the event loop (async-signal-safe)
+ * @param sig Signal number
+ * @return 1 if the signal was queued, 0 outside the shell process
+ *
+ * Signal handlers call this and nothing else that touches shell state:
+ * the signal is flagged and the self-pipe wakes the loop, which does the
+ * actual work in handle_signal_event(). A forked child (e.g. a builtin
+ * in a pipeline) still shares the pipe with the shell, so it is ignored.
+ */
+int queue_signal_event(int sig) {
+    if (signal_pipe[1] == -1 || sig <= 0 || sig >= NSIG || getpid() != event_loop_owner) {
+        return 0;
+    }
+    int saved_errno = errno;
+    pending_signals[sig] = 1;
+    char byte = (char)sig;
+    // A full pipe already guarantees a wakeup, so EAGAIN is fine
+    if (write(signal_pipe[1], &byte, 1) == -1) {
+        // Nothing to do
+    }
+    errno = saved_errno;
+    return 1;
+}
+
+/**
+ * @brief SIGCHLD handler: only wakes the event loop
+ */
+static void sigchld_handler(int sig) {
+    (void)queue_signal_event(sig);
+}
+
+/**
+ * @brief Check and clear the pending flag of a signal
+ */
+static int take_pending_signal(int sig) {
+    if (!pending_signals[sig]) {
+        return 0;
+    }
+    pending_signals[sig] = 0;
+    return 1;
+}
+
+/**
+ * @brief Self-pipe callback: act on the signals caught since the last wakeup
+ *
+ * Runs in the main loop, so this is the only place where signals lead to
+ * output or job table changes: Ctrl-C and Ctrl-Z are forwarded to the
+ * foreground job, SIGCHLD reaps background jobs and admits queued ones.
+ * The pipe is drained before the flags are read, so a signal arriving in
+ * between leaves a byte behind and is picked up on the next wakeup.
+ * Finished jobs are reported by check_background_jobs() before the next
+ * prompt.
+ */
+static void handle_signal_event(int fd, void *data) {
+    (void)data;
+    char buffer[64];
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+        // Drain all pending notifications
+    }
+    if (take_pending_signal(SIGTSTP)) {
+        handle_suspend_request();
+    }
+    if (take_pending_signal(SIGINT)) {
+        handle_interrupt_request();
+    }
+    if (take_pending_signal(SIGCHLD)) {
+        reap_background_jobs();
+        start_queued_jobs();
+    }
+}
+
+/**
+ * @brief Create the epoll instance and install the signal self-pipe
+ * @return 0 on success, -1 on error
+ *
+ * Must run before setup_signal_handlers(), whose handlers feed the pipe.
+ */
+int init_event_loop(void) {
+    event_loop_owner = getpid();
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    if (pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    event_loop_add(signal_pipe[0], handle_signal_event, NULL);
+
+    struct sigaction sa_chld;
+    sa_chld.sa_handler = sigchld_handler;
+    sigemptyset(&sa_chld.sa_mask);
+    sa_chld.sa_flags = SA_RESTART;
+    if (sigaction(SIGCHLD, &sa_chld, NULL) == -1) {
+        perror("sigaction SIGCHLD");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Watch a file descriptor for input
+ * @param fd File descriptor to watch
+ * @param callback Called with fd and data whenever fd is readable or hung up
+ * @param data Passed through to the callback
+ * @return 0 on success, -1 on error
+ */
+int event_loop_add(int fd, EventCallback callback, void *data) {
+    for (int i = 0; i < MAX_EVENT_SOURCES; i++) {
+        if (!event_sources[i].in_use) {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+                return -1;
+            }
+            event_sources[i].fd = fd;
+            event_sources[i].callback = callback;
+            event_sources[i].data = data;
+            event_sources[i].in_use = 1;
+            return 0;
+        }
+    }
+    printf("Error: Too many event sources\n");
+    return -1;
+}
+
+/**
+ * @brief Stop watching a file descriptor (call before closing it)
+ * @param fd File descriptor previously passed to event_loop_add()
+ */
+void event_loop_remove(int fd) {
+    for (int i = 0; i < MAX_EVENT_SOURCES; i++) {
+        if (event_sources[i].in_use && event_sources[i].fd == fd) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            event_sources[i].in_use = 0;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Wait for events and run their callbacks
+ * @param timeout_ms Maximum time to wait, -1 for no limit
+ * @param watch_fd Extra descriptor whose readiness ends the wait (-1 for none);
+ *                 it is reported but no callback is run for it
+ * @return 1 if watch_fd became ready, 0 otherwise, -1 if interrupted by Ctrl-C
+ *
+ * Signals interrupt epoll_wait(), but their work arrives through the
+ * self-pipe, so EINTR only counts as a wakeup. Ctrl-C is reported once
+ * its self-pipe event has been handled (i.e. forwarded to the foreground
+ * job).
+ */
+static int dispatch_events(int timeout_ms, int watch_fd) {
+    struct epoll_event events[MAX_EVENTS_PER_WAIT];
+    int count = epoll_wait(epoll_fd, events, MAX_EVENTS_PER_WAIT, timeout_ms);
+    if (count == -1) {
+        if (errno != EINTR) {
+            perror("epoll_wait");
+            return -1;
+        }
+        return 0;
+    }
+
+    int watched_ready = 0;
+    for (int e = 0; e < count; e++) {
+        int fd = events[e].data.fd;
+        if (fd == watch_fd) {
+            watched_ready = 1;
+            continue;
+        }
+        // A callback may have removed this source earlier in the batch
+        for (int i = 0; i < MAX_EVENT_SOURCES; i++) {
+            if (event_sources[i].in_use && event_sources[i].fd == fd) {
+                event_sources[i].callback(fd, event_sources[i].data);
+                break;
+            }
+        }
+    }
+    if (interrupt_received) {
+        interrupt_received = 0;
+        return -1;
+    }
+    return watched_ready;
+}
+
+/**
+ * @brief Check whether the calling process owns the event loop
+ * @return 1 in the shell itself, 0 in forked children and before initialisation
+ *
+ * A forked child shares the epoll instance with the shell, so it must
+ * never wait on it or it would steal the shell's events.
+ */
+int event_loop_available(void) {
+    return epoll_fd != -1 && getpid() == event_loop_owner;
+}
+
+/**
+ * @brief Wait for events and run their callbacks once
+ * @param timeout_ms Maximum time to wait, -1 for no limit
+ * @return 0 on success, -1 if interrupted by Ctrl-C
+ */
+int run_event_loop_once(int timeout_ms) {
+    return dispatch_events(timeout_ms, -1) == -1 ? -1 : 0;
+}
+
+/**
+ * @brief Check whether stdio has already buffered input from stdin
+ *
+ * epoll only sees the file descriptor, so lines stdio read ahead
+ * (e.g. a pasted block or a script on a pipe) must be consumed first.
+ */
+static int stdin_has_buffered_input(void) {
+#ifdef __GLIBC__
+    return stdin->_IO_read_ptr < stdin->_IO_read_end;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Run the event loop until the shell's stdin has input
+ *
+ * Keeps captured job output draining and queued jobs starting while the
+ * shell sits at the prompt. Returns immediately for input that epoll
+ * cannot watch (regular files).
+ */
+void wait_for_input(void) {
+    // A Ctrl-C typed at the previous prompt must not end the next wait
+    interrupt_received = 0;
+
+    while (wait_for_input_timeout(-1) == -1) {
+        // Ctrl-C at the prompt only prints a newline
+    }
+}
+
+/**
+ * @brief Run the event loop until stdin has input or the timeout expires
+ * @param timeout_ms Maximum time to wait, -1 for no limit
+ * @return 1 if stdin is readable, 0 on timeout, -1 if interrupted by Ctrl-C
+ *
+ * Outside the shell process (e.g. a builtin in a pipeline) this is a
+ * plain poll() on stdin.
+ */
+int wait_for_input_timeout(int timeout_ms) {
+    if (!event_loop_available()) {
+        struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready == -1) {
+            return errno == EINTR ? -1 : 1;
+        }
+        return ready > 0;
+    }
+    if (stdin_has_buffered_input()) {
+        return 1;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = STDIN_FILENO;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == -1) {
+        // Regular files cannot be watched but are always readable
+        return 1;
+    }
+
+    long long deadline = timeout_ms < 0 ? -1 : monotonic_ms() + timeout_ms;
+    int result;
+    while (1) {
+        int remaining = -1;
+        if (deadline != -1) {
+            long long left = deadline - monotonic_ms();
+            remaining = left > 0 ? (int)left : 0;
+        }
+        result = dispatch_events(remaining, STDIN_FILENO);
+        if (result != 0 || remaining == 0) {
+            break;
+        }
+    }
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+    return result;
+}
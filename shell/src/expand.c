@@ -0,0 +1,1171 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define MAX_SUBSTITUTION_DEPTH 32
+#define MAX_PROCESS_SUBSTITUTIONS 64
+#define CAPTURE_CHUNK 4096
+
+// Nesting level of the command substitution being run (also set in forked children)
+static int substitution_depth = 0;
+
+// Exit status of the last $(...) run by expand_words(), -1 if it ran none
+static int substitution_status = -1;
+
+// Held for the command about to run: shell ends of its <(...) and >(...)
+// pipes and the memfds of its expanded heredoc bodies
+static int process_substitution_fds[MAX_PROCESS_SUBSTITUTIONS];
+static int process_substitution_count = 0;
+
+/**
+ * @brief Growable text buffer for captured output and words being built
+ */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} TextBuffer;
+
+/**
+ * @brief How expand_word() treats the text it expands
+ */
+typedef enum {
+    EXPAND_SPLIT,       // Command words: expansions are split into words
+    EXPAND_UNSPLIT,     // Assignment values and single words: one word
+    EXPAND_HEREDOC      // Heredoc body: as inside "...", but `"` is literal
+} ExpandMode;
+
+/**
+ * @brief Growable list of words produced by one expanded token
+ */
+typedef struct {
+    char **items;
+    int count;
+    int capacity;
+} WordList;
+
+/**
+ * @brief Make room for at least `extra` more bytes (plus a terminating NUL)
+ * @return 0 on success, -1 if out of memory
+ */
+static int reserve_text(TextBuffer *buffer, size_t extra) {
+    if (buffer->length + extra + 1 <= buffer->capacity) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 256;
+    while (capacity < buffer->length + extra + 1) {
+        capacity *= 2;
+    }
+    char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        perror("realloc");
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Append one character to a text buffer
+ */
+static int append_char(TextBuffer *buffer, char c) {
+    if (reserve_text(buffer, 1) == -1) {
+        return -1;
+    }
+    buffer->data[buffer->length++] = c;
+    buffer->data[buffer->length] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Move the finished word in `current` onto the word list
+ * @return 0 on success, -1 if out of memory
+ */
+static int push_word(WordList *words, TextBuffer *current) {
+    if (words->count == words->capacity) {
+        int capacity = words->capacity ? words->capacity * 2 : 8;
+        char **items = realloc(words->items, sizeof(char*) * capacity);
+        if (items == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        words->items = items;
+        words->capacity = capacity;
+    }
+    words->items[words->count++] = current->data ? current->data : strdup("");
+    current->data = NULL;
+    current->length = 0;
+    current->capacity = 0;
+    return 0;
+}
+
+/**
+ * @brief Move a word onto the word list
+ * @param text Word (taken over, freed on failure)
+ * @return 0 on success, -1 if out of memory
+ */
+static int push_text(WordList *words, char *text) {
+    if (text == NULL) {
+        perror("strdup");
+        return -1;
+    }
+    TextBuffer current = { text, strlen(text), strlen(text) + 1 };
+    if (push_word(words, &current) == -1) {
+        free(text);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Free a word list
+ */
+static void free_words(WordList *words) {
+    for (int i = 0; i < words->count; i++) {
+        free(words->items[i]);
+    }
+    free(words->items);
+}
+
+/**
+ * @brief Check whether the shell is running a command substitution
+ * @return 1 inside $(...) (in-process or in the forked child), 0 otherwise
+ */
+int in_command_substitution(void) {
+    return substitution_depth > 0;
+}
+
+/**
+ * @brief Find the end of a quoted section or an escape
+ * @param start Points at a `'`, a `"` or a backslash
+ * @return Pointer to the closing quote or the escaped character, NULL if unterminated
+ *
+ * Inside double quotes a backslash escapes the next character and a
+ * `$(...)` or backtick section is skipped whole, so `"$(echo ")")"`
+ * is one quoted section.
+ */
+const char* find_quote_end(const char *start) {
+    if (*start == '\'') {
+        return strchr(start + 1, '\'');
+    }
+    if (*start == '\\') {
+        return start[1] != '\0' ? start + 1 : NULL;
+    }
+    for (const char *p = start + 1; *p != '\0'; p++) {
+        if (*p == '"') {
+            return p;
+        }
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+        } else if ((*p == '$' && p[1] == '(') || *p == '`') {
+            p = find_substitution_end(p);
+            if (p == NULL) {
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Check whether a reserved word starts a command at p
+ * @param start Opening `(` of the substitution
+ * @param p Position in the substitution's text, after start
+ * @param keyword Reserved word such as "case"
+ *
+ * The word must stand alone, after `(`, `;`, `&`, `|`, a newline or
+ * one of then/do/else/{/!, so `echo case` is not a case command.
+ */
+static int is_keyword_at(const char *start, const char *p, const char *keyword) {
+    size_t length = strlen(keyword);
+    if (strncmp(p, keyword, length) != 0 || (p[length] != '\0' && strchr(" \t\n;&|)", p[length]) == NULL)) {
+        return 0;
+    }
+    const char *before = p;
+    while (before[-1] == ' ' || before[-1] == '\t') {
+        before--;
+    }
+    if (before == start + 1 || strchr("(;&|\n", before[-1]) != NULL) {
+        return 1;
+    }
+    static const char *openers[] = { "then", "do", "else", "{", "!" };
+    for (size_t i = 0; i < sizeof(openers) / sizeof(openers[0]); i++) {
+        size_t opener_length = strlen(openers[i]);
+        const char *word = before - opener_length;
+        if (word > start && strncmp(word, openers[i], opener_length) == 0 &&
+            strchr(" \t\n;&|(", word[-1]) != NULL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Find the end of a command substitution
+ * @param start Points at the `$` of `$(` or at an opening backtick
+ * @return Pointer to the matching `)` or backtick, NULL if unterminated
+ *
+ * Parentheses nest, so `$(echo $(pwd))` ends at the last `)`; a
+ * backtick section inside `$(...)` is skipped as a whole, and so are
+ * quoted sections, so `$(echo ")")` ends at the last `)` too. Between
+ * `case` and `esac`, a `)` at the depth the case started at ends a
+ * pattern, not the substitution.
+ */
+const char* find_substitution_end(const char *start) {
+    if (*start == '`') {
+        return strchr(start + 1, '`');
+    }
+    int depth = 0;
+    int case_depths[MAX_SUBSTITUTION_DEPTH];
+    int case_count = 0;
+    for (const char *p = start + 1; *p != '\0'; p++) {
+        if (depth > 0 && is_keyword_at(start + 1, p, "case")) {
+            if (case_count < MAX_SUBSTITUTION_DEPTH) {
+                case_depths[case_count] = depth;
+            }
+            case_count++;
+            p += 3;
+        } else if (case_count > 0 && is_keyword_at(start + 1, p, "esac")) {
+            case_count--;
+            p += 3;
+        } else if (*p == ')' && case_count > 0 && case_count <= MAX_SUBSTITUTION_DEPTH &&
+                   case_depths[case_count - 1] == depth) {
+            continue;   // End of a case pattern
+        } else if (*p == '`') {
+            p = strchr(p + 1, '`');
+            if (p == NULL) {
+                return NULL;
+            }
+        } else if (*p == '\'' || *p == '"' || *p == '\\') {
+            p = find_quote_end(p);
+            if (p == NULL) {
+                return NULL;
+            }
+        } else if (*p == '(') {
+            depth++;
+        } else if (*p == ')' && --depth == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Check whether the current tokens are a builtin that only reports state
+ * @return 1 if it can run inside the shell with its output captured
+ *
+ * Builtins that change the shell (hop, fg, set with arguments, ...) must
+ * not affect it from inside $(...), so only these run in-process.
+ */
+static int is_capturable_builtin(void) {
+    if (token_count == 0 || tokens[0].type != TOKEN_NAME) {
+        return 0;
+    }
+    for (int i = 0; i < token_count; i++) {
+        if (tokens[i].type == TOKEN_PIPE || tokens[i].type == TOKEN_HEREDOC) {
+            return 0;
+        }
+        if (tokens[i].type != TOKEN_NAME && !is_redirection_token(tokens[i].type)) {
+            return 0;   // ; & && ||
+        }
+    }
+    const char *name = tokens[0].value;
+    if (strcmp(name, "activities") == 0 || strcmp(name, "joblog") == 0 || strcmp(name, "reveal") == 0) {
+        return 1;
+    }
+    // Bare `log` and `set` only print
+    return token_count == 1 && (strcmp(name, "log") == 0 || strcmp(name, "set") == 0);
+}
+
+/**
+ * @brief Run the current tokens in-process with stdout captured in a memfd
+ * @param home_directory Shell home directory for built-in commands
+ * @param output Filled with the captured text
+ * @return 0 on success, -1 on error
+ *
+ * A memfd rather than a pipe: the builtin writes everything before
+ * anything is read, which a full pipe would deadlock on.
+ */
+static int capture_builtin_output(const char *home_directory, TextBuffer *output) {
+    int memfd = memfd_create("substitution", MFD_CLOEXEC);
+    if (memfd == -1) {
+        perror("memfd_create");
+        return -1;
+    }
+    fflush(stdout);
+    int saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    if (saved_stdout == -1 || dup2(memfd, STDOUT_FILENO) == -1) {
+        perror("dup2 substitution");
+        close(memfd);
+        if (saved_stdout != -1) {
+            close(saved_stdout);
+        }
+        return -1;
+    }
+
+    substitution_status = run_substitution_command(home_directory);
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    off_t size = lseek(memfd, 0, SEEK_END);
+    int result = 0;
+    if (size > 0 && reserve_text(output, size) == 0) {
+        ssize_t n = pread(memfd, output->data, size, 0);
+        output->length = n > 0 ? n : 0;
+        output->data[output->length] = '\0';
+    } else if (size > 0) {
+        result = -1;
+    }
+    close(memfd);
+    return result;
+}
+
+/**
+ * @brief Run the current tokens in a forked shell, reading its stdout from a pipe
+ * @param home_directory Shell home directory for built-in commands
+ * @param output Filled with the captured text
+ * @return 0 on success, -1 on error
+ *
+ * The child is a copy of the shell that already holds the tokens, so it
+ * runs pipelines, lists and nested substitutions like the shell would,
+ * and exits with the command's status. The parent reads while the child
+ * runs, so output of any size fits.
+ */
+static int capture_forked_output(const char *home_directory, TextBuffer *output) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        int status = run_substitution_command(home_directory);
+        fflush(stdout);
+        // _exit: exit() would rewind the shell's shared stdin offset
+        _exit(status);
+    }
+
+    close(fds[1]);
+    int result = 0;
+    while (1) {
+        if (reserve_text(output, CAPTURE_CHUNK) == -1) {
+            result = -1;
+            break;
+        }
+        ssize_t n = read(fds[0], output->data + output->length, CAPTURE_CHUNK);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        output->length += n;
+        output->data[output->length] = '\0';
+    }
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+    }
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+        // Interrupted with Ctrl-C: the command line does not run
+        printf("\n");
+        return -1;
+    }
+    substitution_status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    return result;
+}
+
+/**
+ * @brief Run a substitution's command (in the current tokens) like a command line
+ * @param home_directory Shell home directory for built-in commands
+ * @return Exit status of the command
+ *
+ * if, while, for, case, { } and function definitions go to the bytecode
+ * compiler as they do in the main loop; anything else is a list.
+ */
+int run_substitution_command(const char *home_directory) {
+    if (is_compound_command()) {
+        return execute_compound_command(home_directory);
+    }
+    execute_sequential_commands(home_directory);
+    return get_last_status();
+}
+
+/**
+ * @brief Saved shell tokens while a substitution's command is tokenised
+ */
+typedef struct {
+    Token *tokens;
+    int count;
+    const char *input;
+} SavedTokens;
+
+/**
+ * @brief Tokenise and parse a substitution's command in place of the current tokens
+ * @param command Text between the parentheses or backticks
+ * @param saved Receives the shell's tokens, for leave_substitution()
+ * @return 1 if the command parsed, 0 on a syntax error, -1 on error
+ */
+static int enter_substitution(const char *command, SavedTokens *saved) {
+    if (substitution_depth >= MAX_SUBSTITUTION_DEPTH) {
+        printf("Error: Command substitution nested too deeply\n");
+        return -1;
+    }
+    saved->tokens = malloc(sizeof(Token) * (token_count + 1));
+    if (saved->tokens == NULL) {
+        perror("malloc tokens");
+        return -1;
+    }
+    saved->count = token_count;
+    saved->input = current_input;
+    memcpy(saved->tokens, tokens, sizeof(Token) * (token_count + 1));
+
+    current_input = command;
+    tokenise();
+    substitution_depth++;
+    // Compound commands are compiled when they run, as in the main loop
+    if (is_compound_command()) {
+        if (compound_command_incomplete()) {
+            printf("Error: Unexpected end of input\n");
+            return 0;
+        }
+        return 1;
+    }
+    if (!parse()) {
+        printf("Invalid Syntax!\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Put the shell's tokens back after enter_substitution()
+ */
+static void leave_substitution(SavedTokens *saved) {
+    substitution_depth--;
+    memcpy(tokens, saved->tokens, sizeof(Token) * (saved->count + 1));
+    token_count = saved->count;
+    current_input = saved->input;
+    free(saved->tokens);
+}
+
+/**
+ * @brief Run a command line and collect what it writes to stdout
+ * @param command Text between $( and ) or between backticks
+ * @param home_directory Shell home directory for built-in commands
+ * @param output Filled with the captured text
+ * @return 0 on success, -1 on error
+ */
+static int capture_command_output(const char *command, const char *home_directory, TextBuffer *output) {
+    SavedTokens saved;
+    int parsed = enter_substitution(command, &saved);
+    if (parsed == -1) {
+        return -1;
+    }
+
+    int result = parsed ? 0 : -1;
+    if (parsed && token_count > 0) {
+        result = is_capturable_builtin() ? capture_builtin_output(home_directory, output)
+                                         : capture_forked_output(home_directory, output);
+    }
+    leave_substitution(&saved);
+    return result;
+}
+
+/**
+ * @brief Start a <(...) or >(...) and get the path the consumer opens
+ * @param word The whole token, e.g. "<(sort a)"
+ * @param home_directory Shell home directory for built-in commands
+ * @param path Receives "/dev/fd/N"
+ * @return 0 on success, -1 on error (message printed)
+ *
+ * The pipe end stays open in the shell (and is inherited by the
+ * consumer) until release_process_substitutions() after the command.
+ */
+static int open_process_substitution(const char *word, const char *home_directory, char *path, size_t size) {
+    const char *end = find_substitution_end(word);
+    if (end == NULL || end[1] != '\0') {
+        printf("Error: Bad process substitution: %s\n", word);
+        return -1;
+    }
+    if (process_substitution_count == MAX_PROCESS_SUBSTITUTIONS) {
+        printf("Error: Too many process substitutions\n");
+        return -1;
+    }
+
+    // The token itself is overwritten once the command is tokenised
+    char label[MAX_PATH_LEN];
+    snprintf(label, sizeof(label), "%s", word);
+    char *command = strndup(word + 2, end - word - 2);
+    if (command == NULL) {
+        perror("strndup");
+        return -1;
+    }
+    SavedTokens saved;
+    int parsed = enter_substitution(command, &saved);
+    int fd = -1;
+    if (parsed == 1) {
+        fd = start_process_substitution(label[0], label, home_directory);
+    }
+    if (parsed != -1) {
+        leave_substitution(&saved);
+    }
+    free(command);
+    if (fd == -1) {
+        return -1;
+    }
+
+    process_substitution_fds[process_substitution_count++] = fd;
+    snprintf(path, size, "/dev/fd/%d", fd);
+    return 0;
+}
+
+/**
+ * @brief Count the process substitution pipes the shell holds open
+ * @return Mark for release_process_substitutions()
+ */
+int pending_process_substitutions(void) {
+    return process_substitution_count;
+}
+
+/**
+ * @brief Close the shell's ends of process substitutions opened since a mark
+ * @param mark Value of pending_process_substitutions() before expanding (0 for all)
+ *
+ * Called once the command has started (or finished): the substitution
+ * then sees EOF or SIGPIPE when the consumer is done with it. The mark
+ * keeps a builtin run inside $(...) from closing the pipes of the
+ * command that is still being expanded around it.
+ */
+void release_process_substitutions(int mark) {
+    while (process_substitution_count > mark) {
+        close(process_substitution_fds[--process_substitution_count]);
+    }
+}
+
+/**
+ * @brief Append a character that came from quoted text or an escape
+ *
+ * Words are built with their quoting kept as escapes: characters that
+ * globbing treats specially get a backslash, so fnmatch() sees `\*` as
+ * a literal star. remove_escapes() takes the backslashes out again.
+ */
+static int append_quoted_char(TextBuffer *buffer, char c) {
+    if (strchr("*?[]\\", c) != NULL && append_char(buffer, '\\') == -1) {
+        return -1;
+    }
+    return append_char(buffer, c);
+}
+
+/**
+ * @brief Drop the escapes added while a word was built
+ */
+static void remove_escapes(char *word) {
+    char *out = word;
+    for (const char *p = word; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+        }
+        *out++ = *p;
+    }
+    *out = '\0';
+}
+
+/**
+ * @brief Add expanded text to the word being built
+ * @param text Output of a substitution or value of a variable
+ * @param length Length of text
+ * @param split Split on whitespace into separate words
+ * @param quoted The expansion was inside double quotes: no pattern characters
+ * @param current Word being built
+ * @param pending Set while current holds a word (possibly still empty)
+ * @param words Finished words
+ * @return 0 on success, -1 if out of memory
+ */
+static int append_expansion(const char *text, size_t length, int split, int quoted,
+                            TextBuffer *current, int *pending, WordList *words) {
+    for (size_t k = 0; k < length; k++) {
+        int status;
+        if (split && isspace((unsigned char)text[k])) {
+            if (*pending && push_word(words, current) == -1) {
+                return -1;
+            }
+            *pending = 0;
+            continue;
+        } else if (quoted) {
+            status = append_quoted_char(current, text[k]);
+        } else {
+            // An unquoted expansion can still be a pattern, but a backslash in it is literal
+            status = text[k] == '\\' ? append_quoted_char(current, text[k]) : append_char(current, text[k]);
+        }
+        if (status == -1) {
+            return -1;
+        }
+        *pending = 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether a character names a special parameter ($?, $$, $#, $@, $*)
+ */
+static int is_special_parameter(char c) {
+    return c == '?' || c == '$' || c == '#' || c == '@' || c == '*';
+}
+
+/**
+ * @brief Check whether a braced name is a positional parameter (${10})
+ */
+static int is_positional_number(const char *name, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (!isdigit((unsigned char)name[i])) {
+            return 0;
+        }
+    }
+    return length > 0;
+}
+
+/**
+ * @brief Find the name of a variable reference
+ * @param p Points at the `$`
+ * @param name Receives the start of the name
+ * @param length Receives the length of the name
+ * @return Pointer just past the reference, NULL if p is not a valid one
+ *
+ * Accepts $NAME, ${NAME}, the positional parameters $1..$9 and ${N},
+ * and the special parameters $?, $$, $#, $@ and $*.
+ */
+static const char* parse_variable_reference(const char *p, const char **name, size_t *length) {
+    if (p[1] == '{') {
+        const char *close = strchr(p + 2, '}');
+        if (close == NULL) {
+            return NULL;
+        }
+        *name = p + 2;
+        *length = close - *name;
+        if (!(*length == 1 && is_special_parameter(**name)) && !is_positional_number(*name, *length) &&
+            !is_valid_variable_name(*name, *length)) {
+            return NULL;
+        }
+        return close + 1;
+    }
+    if (is_special_parameter(p[1]) || isdigit((unsigned char)p[1])) {
+        *name = p + 1;
+        *length = 1;
+        return p + 2;
+    }
+    if (!(isalpha((unsigned char)p[1]) || p[1] == '_')) {
+        return NULL;
+    }
+    *name = p + 1;
+    *length = 1;
+    while (isalnum((unsigned char)(*name)[*length]) || (*name)[*length] == '_') {
+        (*length)++;
+    }
+    return *name + *length;
+}
+
+/**
+ * @brief Add "$@" to the word being built: one word per positional parameter
+ * @return 0 on success, -1 if out of memory
+ */
+static int append_parameters(TextBuffer *current, int *pending, WordList *words) {
+    int count;
+    char **parameters = get_positional_parameters(&count);
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && push_word(words, current) == -1) {
+            return -1;
+        }
+        if (append_expansion(parameters[i], strlen(parameters[i]), 0, 1, current, pending, words) == -1) {
+            return -1;
+        }
+        *pending = 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Expand the quoting, variables and command substitutions in one word
+ * @param word Token text, e.g. "v$(uname -r)", "$HOME/bin", "`ls`" or "'a b'"
+ * @param home_directory Shell home directory for built-in commands
+ * @param mode Split expanded text into words, or keep it as one (see ExpandMode)
+ * @param words Filled with the resulting words, quoted characters escaped
+ * @return 0 on success, -1 on error (message printed)
+ *
+ * Trailing newlines of command output are dropped and expanded text is
+ * split on whitespace, so `$(ls)` gives one word per file and
+ * `a$(echo b c)d` gives "ab" and "cd". An expansion that is empty or all
+ * whitespace yields no word. A `$` that starts no reference stays as is.
+ * `$((expression))` is arithmetic, evaluated without forking.
+ *
+ * Text in single quotes is literal. Double quotes keep expansions but
+ * not splitting ("$@" gives one word per parameter), and a backslash in
+ * them only escapes $, `, " and itself. Outside quotes a backslash
+ * escapes any character. `""` is an empty word rather than none.
+ *
+ * A heredoc body is read as if it were all inside double quotes, except
+ * that quote characters are literal and a backslash only escapes $, `
+ * and itself; "$@" joins the parameters like $*.
+ */
+static int expand_word(const char *word, const char *home_directory, ExpandMode mode, WordList *words) {
+    TextBuffer current = { 0 };
+    int heredoc = mode == EXPAND_HEREDOC;
+    int split = mode == EXPAND_SPLIT;
+    int pending = 0;        // current holds a word (possibly still empty)
+    int quoted = heredoc;   // inside double quotes
+    int status = 0;
+
+    int parameter_count;
+    get_positional_parameters(&parameter_count);
+    if (parameter_count == 0 && !heredoc && (strcmp(word, "\"$@\"") == 0 || strcmp(word, "\"${@}\"") == 0)) {
+        return 0;
+    }
+
+    const char *p = word;
+    while (*p != '\0' && status == 0) {
+        const char *name;
+        size_t length;
+        const char *after;
+        const char *arithmetic_end;
+        if (!quoted && p[0] == '\'') {
+            const char *end = strchr(p + 1, '\'');
+            if (end == NULL) {
+                printf("Error: Unterminated quote: %s\n", word);
+                status = -1;
+                break;
+            }
+            for (p++; p < end && status == 0; p++) {
+                status = append_quoted_char(&current, *p);
+            }
+            pending = 1;
+            p = end + 1;
+        } else if (p[0] == '"' && !heredoc) {
+            quoted = !quoted;
+            pending = 1;
+            p++;
+        } else if (p[0] == '\\' && p[1] == '\n') {
+            p += 2;   // line continuation
+        } else if (p[0] == '\\' && p[1] != '\0' &&
+                   (!quoted || strchr(heredoc ? "$`\\" : "$`\"\\", p[1]) != NULL)) {
+            status = append_quoted_char(&current, p[1]);
+            pending = 1;
+            p += 2;
+        } else if (p[0] == '$' && p[1] == '(' && p[2] == '(' &&
+            (arithmetic_end = find_substitution_end(p + 1)) != NULL && arithmetic_end[1] == ')') {
+            // $((expression)): expanded first, then evaluated in the shell
+            char *expression = strndup(p + 3, arithmetic_end - p - 3);
+            char *expanded = expression != NULL ? expand_text(expression, home_directory) : NULL;
+            long long value;
+            status = expanded != NULL ? evaluate_arithmetic(expanded, &value) : -1;
+            if (status == 0) {
+                char text[32];
+                int length = snprintf(text, sizeof(text), "%lld", value);
+                status = append_expansion(text, length, split && !quoted, quoted, &current, &pending, words);
+            }
+            free(expanded);
+            free(expression);
+            p = arithmetic_end + 2;
+        } else if ((p[0] == '$' && p[1] == '(') || p[0] == '`') {
+            const char *end = find_substitution_end(p);
+            if (end == NULL) {
+                printf("Error: Unterminated command substitution\n");
+                status = -1;
+                break;
+            }
+            size_t offset = p[0] == '`' ? 1 : 2;
+            char *command = strndup(p + offset, end - p - offset);
+            TextBuffer output = { 0 };
+            status = command != NULL ? capture_command_output(command, home_directory, &output) : -1;
+            free(command);
+            if (status == 0) {
+                while (output.length > 0 && output.data[output.length - 1] == '\n') {
+                    output.length--;
+                }
+                status = append_expansion(output.data, output.length, split && !quoted, quoted,
+                                          &current, &pending, words);
+            }
+            free(output.data);
+            p = end + 1;
+        } else if (p[0] == '$' && (after = parse_variable_reference(p, &name, &length)) != NULL) {
+            if (quoted && !heredoc && length == 1 && name[0] == '@') {
+                status = append_parameters(&current, &pending, words);
+            } else {
+                char buffer[32];
+                const char *value = expand_variable(name, length, buffer, sizeof(buffer));
+                status = append_expansion(value, strlen(value), split && !quoted, quoted, &current, &pending, words);
+            }
+            p = after;
+        } else if (p[0] == '$' && p[1] == '{') {
+            printf("Error: Bad substitution: %s\n", word);
+            status = -1;
+        } else {
+            status = quoted ? append_quoted_char(&current, *p) : append_char(&current, *p);
+            pending = 1;
+            p++;
+        }
+    }
+    if (status == 0 && quoted && !heredoc) {
+        printf("Error: Unterminated quote: %s\n", word);
+        status = -1;
+    }
+
+    if (status == 0 && pending) {
+        return push_word(words, &current);
+    }
+    free(current.data);
+    return status;
+}
+
+/**
+ * @brief Expand one word without splitting it (keeping its escapes)
+ * @return Newly allocated expansion, NULL on error (message printed)
+ */
+static char* expand_single_word(const char *word, const char *home_directory) {
+    WordList words = { 0 };
+    if (expand_word(word, home_directory, EXPAND_UNSPLIT, &words) == -1) {
+        free_words(&words);
+        return NULL;
+    }
+    char *text = strdup(words.count > 0 ? words.items[0] : "");
+    free_words(&words);
+    return text;
+}
+
+/**
+ * @brief Expand one word without splitting it
+ * @param word Word text (a case subject or an arithmetic expression)
+ * @param home_directory Shell home directory for built-in commands
+ * @return Newly allocated expansion with its quotes removed, NULL on error (message printed)
+ */
+char* expand_text(const char *word, const char *home_directory) {
+    char *text = expand_single_word(word, home_directory);
+    if (text != NULL) {
+        remove_escapes(text);
+    }
+    return text;
+}
+
+/**
+ * @brief Expand a case pattern for fnmatch()
+ * @param word Pattern text
+ * @param home_directory Shell home directory for built-in commands
+ * @return Newly allocated pattern, NULL on error (message printed)
+ *
+ * Quoted characters come back escaped, so `"*"` only matches a star.
+ */
+char* expand_pattern(const char *word, const char *home_directory) {
+    return expand_single_word(word, home_directory);
+}
+
+/**
+ * @brief Remove the quotes from a word without expanding it (heredoc delimiters)
+ * @param word Word, changed in place
+ */
+void remove_quotes(char *word) {
+    char *out = word;
+    int quoted = 0;
+    for (const char *p = word; *p != '\0'; p++) {
+        if (!quoted && *p == '\'') {
+            const char *end = strchr(p + 1, '\'');
+            size_t length = end != NULL ? (size_t)(end - p - 1) : strlen(p + 1);
+            memmove(out, p + 1, length);
+            out += length;
+            p += length + (end != NULL);
+        } else if (*p == '"') {
+            quoted = !quoted;
+        } else if (*p == '\\' && p[1] != '\0' && (!quoted || strchr("$`\"\\", p[1]) != NULL)) {
+            *out++ = *++p;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+}
+
+/**
+ * @brief Replace each word that is a glob pattern with the sorted paths it matches
+ * @param words Words of one token, quoted characters escaped; patterns
+ *              matching nothing stay as they are, and every word that is
+ *              not replaced has its escapes removed
+ * @param glob Match patterns (0 for assignments and redirection targets)
+ * @return 0 on success, -1 on error (message printed)
+ */
+static int expand_glob_words(WordList *words, int glob) {
+    WordList result = { 0 };
+    for (int w = 0; w < words->count; w++) {
+        char *word = words->items[w];
+        words->items[w] = NULL;
+        char **matches = NULL;
+        int count = 0;
+        if (glob && has_glob_pattern(word) && glob_pattern(word, &matches, &count) == -1) {
+            free(word);
+            free_words(&result);
+            return -1;
+        }
+        if (count == 0) {
+            remove_escapes(word);
+            if (push_text(&result, word) == -1) {
+                free_words(&result);
+                return -1;
+            }
+            continue;
+        }
+        free(word);
+        int failed = 0;
+        for (int m = 0; m < count; m++) {
+            if (failed || push_text(&result, matches[m]) == -1) {
+                failed = 1;
+            }
+        }
+        free(matches);
+        if (failed) {
+            free_words(&result);
+            return -1;
+        }
+    }
+    free_words(words);
+    *words = result;
+    return 0;
+}
+
+/**
+ * @brief Brace-expand a word, then expand each resulting word
+ * @param limit Most words the brace expansion may produce
+ * @return 0 on success, -1 on error (message printed)
+ */
+static int expand_brace_word(const char *word, const char *home_directory, long long limit, WordList *words) {
+    char **pieces;
+    int count;
+    if (expand_braces(word, limit, &pieces, &count) == -1) {
+        return -1;
+    }
+    int status = 0;
+    for (int p = 0; p < count; p++) {
+        if (status == 0 && pieces[p][0] != '\0') {   // a{,b}: the empty word is dropped
+            status = strpbrk(pieces[p], "$`'\"\\") != NULL
+                ? expand_word(pieces[p], home_directory, EXPAND_SPLIT, words)
+                : push_text(words, strdup(pieces[p]));
+        }
+        free(pieces[p]);
+    }
+    free(pieces);
+    return status;
+}
+
+/**
+ * @brief Check whether token i is the file name of a redirection
+ */
+static int is_redirection_target(int i) {
+    if (i == 0) {
+        return 0;
+    }
+    switch (tokens[i - 1].type) {
+        case TOKEN_INPUT: case TOKEN_OUTPUT: case TOKEN_DOUBLE_OUTPUT:
+        case TOKEN_READ_WRITE: case TOKEN_DUP_INPUT: case TOKEN_DUP_OUTPUT:
+        case TOKEN_OUTPUT_ALL: case TOKEN_APPEND_ALL: case TOKEN_HERE_STRING:
+        case TOKEN_HEREDOC:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Expand the body of a heredoc with an unquoted delimiter
+ * @param fd memfd holding the body as typed
+ * @param home_directory Shell home directory for built-in commands
+ * @return memfd with the expanded body, -1 on error (message printed)
+ *
+ * The new memfd is held like a process substitution pipe, so
+ * release_process_substitutions() closes it after the command; the
+ * original body stays in its token for the next run.
+ */
+static int expand_heredoc(int fd, const char *home_directory) {
+    if (process_substitution_count == MAX_PROCESS_SUBSTITUTIONS) {
+        printf("Error: Too many heredocs\n");
+        return -1;
+    }
+    TextBuffer body = { 0 };
+    while (1) {
+        if (reserve_text(&body, CAPTURE_CHUNK) == -1) {
+            free(body.data);
+            return -1;
+        }
+        ssize_t n = pread(fd, body.data + body.length, CAPTURE_CHUNK, body.length);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            perror("heredoc read");
+            free(body.data);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        body.length += n;
+    }
+    body.data[body.length] = '\0';
+
+    WordList words = { 0 };
+    int status = expand_word(body.data, home_directory, EXPAND_HEREDOC, &words);
+    free(body.data);
+    int expanded = -1;
+    if (status == 0) {
+        char *text = words.count > 0 ? words.items[0] : "";
+        remove_escapes(text);
+        expanded = create_text_memfd("heredoc", text, strlen(text));
+    }
+    free_words(&words);
+    if (expanded != -1) {
+        process_substitution_fds[process_substitution_count++] = expanded;
+    }
+    return expanded;
+}
+
+/**
+ * @brief Expand the current tokens (see expand_words())
+ */
+static int expand_tokens(const char *home_directory) {
+    int mark = pending_process_substitutions();
+
+    int command_start = 1;   // Still in the NAME=value words of a command
+    for (int i = 0; i < token_count; i++) {
+        if (tokens[i].type != TOKEN_NAME) {
+            command_start = tokens[i].type == TOKEN_PIPE || tokens[i].type == TOKEN_SEMICOLON ||
+                            tokens[i].type == TOKEN_AMPERSAND || tokens[i].type == TOKEN_AND ||
+                            tokens[i].type == TOKEN_OR;
+            continue;
+        }
+        int assignment = command_start && is_assignment_word(tokens[i].value);
+        command_start = assignment;
+        if (i > 0 && tokens[i - 1].type == TOKEN_HEREDOC) {
+            // The delimiter stays as is; quoting any of it keeps the body literal
+            if (tokens[i - 1].heredoc_fd != -1 && strpbrk(tokens[i].value, "'\"\\") == NULL) {
+                int fd = expand_heredoc(tokens[i - 1].heredoc_fd, home_directory);
+                if (fd == -1) {
+                    release_process_substitutions(mark);
+                    return -1;
+                }
+                tokens[i - 1].heredoc_fd = fd;
+            }
+            continue;
+        }
+        const char *value = tokens[i].value;
+        if ((value[0] == '<' || value[0] == '>') && value[1] == '(') {
+            char path[32];
+            if (open_process_substitution(value, home_directory, path, sizeof(path)) == -1) {
+                release_process_substitutions(mark);
+                return -1;
+            }
+            if ((tokens[i].value = arena_strndup(path, strlen(path))) == NULL) {
+                release_process_substitutions(mark);
+                return -1;
+            }
+            continue;
+        }
+        int expandable = !assignment && !is_redirection_target(i);
+        int braces = expandable && has_brace_expansion(value);
+        int substitute = strpbrk(value, "$`'\"\\") != NULL;
+        int glob = expandable && (braces || substitute || has_glob_pattern(value));
+        if (!braces && !substitute && !glob) {
+            continue;
+        }
+
+        WordList words = { 0 };
+        int status = braces ? expand_brace_word(value, home_directory, MAX_EXPANDED_WORDS, &words)
+                   : substitute ? expand_word(tokens[i].value, home_directory,
+                                                assignment ? EXPAND_UNSPLIT : EXPAND_SPLIT, &words)
+                   : push_text(&words, strdup(value));
+        if (status == 0) {
+            status = expand_glob_words(&words, glob);
+        }
+        if (status == -1) {
+            free_words(&words);
+            release_process_substitutions(mark);
+            return -1;
+        }
+        if (reserve_tokens(token_count - 1 + words.count) == -1) {
+            free_words(&words);
+            release_process_substitutions(mark);
+            return -1;
+        }
+
+        // Make room for the new words (the END token moves along)
+        memmove(&tokens[i + words.count], &tokens[i + 1], sizeof(Token) * (token_count - i));
+        for (int w = 0; w < words.count; w++) {
+            tokens[i + w].type = TOKEN_NAME;
+            tokens[i + w].value = arena_strndup(words.items[w], strlen(words.items[w]));
+            tokens[i + w].heredoc_fd = -1;
+            if (tokens[i + w].value == NULL) {
+                tokens[i + w].value = "";
+                status = -1;
+            }
+        }
+        token_count += words.count - 1;
+        i += words.count - 1;
+        free_words(&words);
+        if (status == -1) {
+            release_process_substitutions(mark);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Expand quotes, $VAR, ${VAR}, $((...)), $(...) and `...` in the current tokens
+ * @param home_directory Shell home directory for built-in commands
+ * @return 0 on success, -1 on error (message printed)
+ *
+ * Runs on one command segment right before it executes, so commands see
+ * the effects of the ones before them (`hop /tmp ; echo $(pwd)`). A
+ * token can become several words or none; later tokens shift to match.
+ * Heredoc delimiters are left alone, and the value of a leading
+ * NAME=value word is not split. A heredoc whose delimiter is unquoted
+ * gets its $VAR, $(...), `...` and $((...)) expanded into a new memfd.
+ *
+ * Brace groups ({a,b}, {1..5}) are expanded first, and words with *, ?
+ * or [...] become the paths they match, in sorted order (neither applies
+ * to assignments and redirection targets). Quoted or escaped characters
+ * take part in neither, and the quotes are removed last.
+ *
+ * A <(...) or >(...) token starts its command at once and becomes a
+ * /dev/fd path; the caller must call release_process_substitutions()
+ * after running the segment.
+ */
+int expand_words(const char *home_directory) {
+    substitution_status = -1;
+    int result = expand_tokens(home_directory);
+    clear_glob_cache();
+    return result;
+}
+
+/**
+ * @brief Exit status of the last command substitution of the last expand_words()
+ * @return The status, -1 if the words had no $(...) or `...`
+ *
+ * A command of NAME=value words only takes its status from it, as in
+ * `x=$(false)`.
+ */
+int last_substitution_status(void) {
+    return substitution_status;
+}
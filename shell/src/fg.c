@@ -35,6 +35,7 @@ int find_most_recent_job(void) {
     
     for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
         if (background_jobs[i].is_active && 
+            background_jobs[i].state != PROCESS_DONE &&
             background_jobs[i].job_number > highest_job_number) {
             highest_job_number = background_jobs[i].job_number;
             most_recent = i;
@@ -59,6 +60,56 @@ int find_job_by_number(int job_number) {
     return -1;
 }
 
+/**
+ * @brief Parse the arguments of fg and bg: [job_number] [scheduling options]
+ * @param options Filled with the scheduling options given (see parse_sched_options)
+ * @return Index of the job in background_jobs, -1 on error (already reported)
+ */
+static int parse_job_control_arguments(JobOptions *options) {
+    int job_index;
+    int first_option = 1;
+    
+    if (token_count > 1 && tokens[1].type == TOKEN_NAME && tokens[1].value[0] != '-') {
+        // Job number provided
+        if (!is_valid_job_number(tokens[1].value)) {
+            printf("No such job\n");
+            return -1;
+        }
+        job_index = find_job_by_number(atoi(tokens[1].value));
+        first_option = 2;
+    } else {
+        // No job number provided - use most recent job
+        job_index = find_most_recent_job();
+    }
+    
+    if (job_index == -1) {
+        printf("No such job\n");
+        return -1;
+    }
+    if (parse_sched_options(first_option, token_count, options) == -1) {
+        return -1;
+    }
+    return job_index;
+}
+
+/**
+ * @brief Apply scheduling options given to fg/bg to a job
+ * @param job Job to update
+ * @param options Options parsed by parse_job_control_arguments()
+ *
+ * The options are remembered with the job, so a queued job gets them at
+ * launch; a started job gets them applied to its whole process group.
+ */
+static void update_job_scheduling(BackgroundJob *job, const JobOptions *options) {
+    if (!job_options_have_sched(options)) {
+        return;
+    }
+    merge_sched_options(&job->options, options);
+    if (job->state == PROCESS_RUNNING || job->state == PROCESS_STOPPED) {
+        apply_sched_options_to_group(job->pid, options);
+    }
+}
+
 /**
  * @brief Execute the fg command
  * 
@@ -69,34 +120,19 @@ int find_job_by_number(int job_number) {
  * - Use most recent job if no number provided
  * - Print "No such job" for invalid job numbers
  * - Print entire command when bringing to foreground
+ * - Start queued jobs immediately
+ * - Replay captured output before attaching to a captured job
+ * - Optional --cpus, --batch/--idle/--normal, --nice and --ioprio are
+ *   applied to the job's process group first
+ *
+ * @return The job's exit status (128 + N if signal N killed or stopped
+ *         it), 1 if there is no such job or it cannot be resumed
  */
-void execute_fg(void) {
-    int job_index = -1;
-    
-    // Check arguments
-    if (token_count == 1) {
-        // No job number provided - use most recent job
-        job_index = find_most_recent_job();
-        if (job_index == -1) {
-            printf("No such job\n");
-            return;
-        }
-    } else if (token_count == 2) {
-        // Job number provided
-        if (tokens[1].type != TOKEN_NAME || !is_valid_job_number(tokens[1].value)) {
-            printf("No such job\n");
-            return;
-        }
-        
-        int job_number = atoi(tokens[1].value);
-        job_index = find_job_by_number(job_number);
-        if (job_index == -1) {
-            printf("No such job\n");
-            return;
-        }
-    } else {
-        printf("No such job\n");
-        return;
+int execute_fg(void) {
+    JobOptions options;
+    int job_index = parse_job_control_arguments(&options);
+    if (job_index == -1) {
+        return 1;
     }
     
     // Get the job
@@ -104,39 +140,78 @@ void execute_fg(void) {
     
     // Print the command being brought to foreground
     printf("%s\n", job->command);
+    fflush(stdout);
+    
+    update_job_scheduling(job, &options);
+    
+    // A job that already finished only has its captured output left
+    if (job->state == PROCESS_DONE) {
+        if (job->capture != NULL) {
+            print_job_capture(job->capture, 0);
+        }
+        int finished = exit_status_of(job->wait_status);
+        cleanup_background_job(job_index);
+        return finished;
+    }
+    
+    // A queued job is started right away, bypassing `set maxjobs`
+    if (job->state == PROCESS_QUEUED && launch_queued_job(job_index) == -1) {
+        cleanup_background_job(job_index);
+        return 1;
+    }
+    
+    // Replay captured output, then stream the rest straight to the terminal
+    if (job->capture != NULL) {
+        drain_job_capture(job->capture);
+        print_job_capture(job->capture, 0);
+        job->capture->passthrough = 1;
+    }
+    
+    // Hand over the terminal with the modes the job had when it stopped
+    give_terminal_to(job->pid, job->has_terminal_modes ? &job->terminal_modes : NULL);
     
     // If job is stopped, send SIGCONT to resume it
     if (job->state == PROCESS_STOPPED) {
         if (kill(-job->pid, SIGCONT) == -1) {
             perror("kill SIGCONT");
-            return;
+            reclaim_terminal(0, NULL);
+            return 1;
         }
     }
     
     // Set as foreground process
     set_foreground_process(job->pid, job->command);
     
-    // Wait for the job to complete or stop
+    // Wait for the whole job (every pipeline stage) to complete or stop;
+    // the reaper must leave it alone
     int status;
-    pid_t result = waitpid(job->pid, &status, WUNTRACED);
+    job->managed = 1;
+    int result = wait_for_job(job->pid, job->pid, &status);
+    job->managed = 0;
+    job->has_terminal_modes = reclaim_terminal(status, &job->terminal_modes);
     
     if (result == -1) {
         perror("waitpid");
         clear_foreground_process();
-        return;
+        return 1;
     }
     
     // Clear foreground tracking
     clear_foreground_process();
     
-    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+    if (result == 0) {
         // Job terminated - remove from background jobs
+        drain_job_capture(job->capture);
         cleanup_background_job(job_index);
-    } else if (WIFSTOPPED(status)) {
+    } else {
         // Job was stopped again - update state
+        if (job->capture != NULL) {
+            job->capture->passthrough = 0;
+        }
         job->state = PROCESS_STOPPED;
         printf("\n[%d] Stopped %s\n", job->job_number, job->command_name);
     }
+    return exit_status_of(status);
 }
 
 /**
@@ -148,44 +223,46 @@ void execute_fg(void) {
  * - Print [job_number] command_name & when resuming
  * - Print "Job already running" for running jobs
  * - Print "No such job" for invalid job numbers
- * - Only stopped jobs can be resumed
+ * - Only stopped jobs can be resumed; queued jobs are started immediately
+ * - Optional --cpus, --batch/--idle/--normal, --nice and --ioprio change
+ *   the scheduling of the whole job, e.g. `bg 3 --cpus 4-7 --idle`;
+ *   a running job is then adjusted in place
+ *
+ * @return 0 once the job runs, 1 if there is no such job or it cannot be resumed
  */
-void execute_bg(void) {
-    int job_index = -1;
-    
-    // Check arguments
-    if (token_count == 1) {
-        // No job number provided - use most recent job
-        job_index = find_most_recent_job();
-        if (job_index == -1) {
-            printf("No such job\n");
-            return;
-        }
-    } else if (token_count == 2) {
-        // Job number provided
-        if (tokens[1].type != TOKEN_NAME || !is_valid_job_number(tokens[1].value)) {
-            printf("No such job\n");
-            return;
-        }
-        
-        int job_number = atoi(tokens[1].value);
-        job_index = find_job_by_number(job_number);
-        if (job_index == -1) {
-            printf("No such job\n");
-            return;
-        }
-    } else {
-        printf("No such job\n");
-        return;
+int execute_bg(void) {
+    JobOptions options;
+    int job_index = parse_job_control_arguments(&options);
+    if (job_index == -1) {
+        return 1;
     }
     
     // Get the job
     BackgroundJob *job = &background_jobs[job_index];
     
+    if (job->state == PROCESS_DONE) {
+        printf("Job has finished\n");
+        return 1;
+    }
+    
+    update_job_scheduling(job, &options);
+    
     // Check if job is already running
     if (job->state == PROCESS_RUNNING) {
-        printf("Job already running\n");
-        return;
+        if (!job_options_have_sched(&options)) {
+            printf("Job already running\n");
+        }
+        return 0;
+    }
+    
+    // A queued job is started right away, bypassing `set maxjobs`
+    if (job->state == PROCESS_QUEUED) {
+        if (launch_queued_job(job_index) == -1) {
+            cleanup_background_job(job_index);
+            return 1;
+        }
+        printf("[%d] %s &\n", job->job_number, job->command_name);
+        return 0;
     }
     
     // Job must be stopped to be resumed
@@ -193,7 +270,7 @@ void execute_bg(void) {
         // Send SIGCONT to resume the job
         if (kill(-job->pid, SIGCONT) == -1) {
             perror("kill SIGCONT");
-            return;
+            return 1;
         }
         
         // Update state to running
@@ -201,9 +278,10 @@ void execute_bg(void) {
         
         // Print resumption message
         printf("[%d] %s &\n", job->job_number, job->command_name);
-    } else {
-        printf("No such job\n");
+        return 0;
     }
+    printf("No such job\n");
+    return 1;
 }
 
 //LLM GENERATED CODE ENDS HERE
\ No newline at end of file
@@ -0,0 +1,698 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <dirent.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define INITIAL_LISTING_BUCKETS 64
+#define MAX_WALK_THREADS 8
+
+/**
+ * @brief The entries of one directory, read once per command
+ *
+ * Names are stored back to back in one buffer, so a directory with
+ * 200k entries costs three allocations instead of 200k.
+ */
+typedef struct Listing {
+    char *path;                 // Directory as read ("." for the current one)
+    char *names;                // NUL-terminated names, back to back
+    size_t *offsets;            // Start of each name in names
+    unsigned char *types;       // d_type of each entry
+    int count;
+    struct Listing *next;       // Next listing in the same bucket
+} Listing;
+
+// Directory reads of the command being expanded (see clear_glob_cache())
+static Listing **listing_buckets = NULL;
+static size_t listing_bucket_count = 0;
+static size_t listing_count = 0;
+static pthread_mutex_t listing_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief State of one pattern being expanded
+ */
+typedef struct {
+    char **components;          // The pattern split at '/'
+    int component_count;
+    int absolute;               // The pattern starts with '/'
+    int dir_only;               // The pattern ends with '/': only directories match
+    char **matches;
+    int match_count;
+    int match_capacity;
+    int failed;
+} Glob;
+
+/**
+ * @brief Work shared by the threads walking the tree under `**`
+ */
+typedef struct {
+    char **queue;               // Directories still to be read
+    int queue_count;
+    int queue_capacity;
+    int pending;                // Queued or being read
+    char **found;               // Every directory reached, the start included
+    int found_count;
+    int found_capacity;
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} Walk;
+
+/**
+ * @brief Check whether a word is a glob pattern
+ * @return 1 if it has `*`, `?` or a `[...]` bracket expression
+ *
+ * A lone `[` (the test command) is not a pattern, so it never costs a
+ * directory read. A character escaped with a backslash (quoted in the
+ * command line) is not special.
+ */
+int has_glob_pattern(const char *word) {
+    for (const char *p = word; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+        } else if (*p == '*' || *p == '?') {
+            return 1;
+        }
+        if (*p == '[' && p[1] != '\0' && strchr(p + 2, ']') != NULL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief FNV-1a hash of a directory path
+ */
+static size_t hash_path(const char *path) {
+    size_t hash = 2166136261u;
+    for (const char *p = path; *p != '\0'; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Free one directory listing
+ */
+static void free_listing(Listing *listing) {
+    free(listing->path);
+    free(listing->names);
+    free(listing->offsets);
+    free(listing->types);
+    free(listing);
+}
+
+/**
+ * @brief Read a directory into a new listing
+ * @return The listing (empty if the directory cannot be read), NULL if out of memory
+ */
+static Listing* read_listing(const char *path) {
+    Listing *listing = calloc(1, sizeof(Listing));
+    if (listing == NULL || (listing->path = strdup(path)) == NULL) {
+        free(listing);
+        return NULL;
+    }
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return listing;
+    }
+
+    size_t names_length = 0;
+    size_t names_capacity = 0;
+    int capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        size_t length = strlen(name) + 1;
+        if (names_length + length > names_capacity) {
+            size_t new_capacity = names_capacity ? names_capacity * 2 : 4096;
+            while (new_capacity < names_length + length) {
+                new_capacity *= 2;
+            }
+            char *names = realloc(listing->names, new_capacity);
+            if (names == NULL) {
+                break;
+            }
+            listing->names = names;
+            names_capacity = new_capacity;
+        }
+        if (listing->count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 64;
+            size_t *offsets = realloc(listing->offsets, sizeof(size_t) * new_capacity);
+            if (offsets != NULL) {
+                listing->offsets = offsets;
+            }
+            unsigned char *types = realloc(listing->types, new_capacity);
+            if (types != NULL) {
+                listing->types = types;
+            }
+            if (offsets == NULL || types == NULL) {
+                break;
+            }
+            capacity = new_capacity;
+        }
+        memcpy(listing->names + names_length, name, length);
+        listing->offsets[listing->count] = names_length;
+        listing->types[listing->count] = entry->d_type;
+        listing->count++;
+        names_length += length;
+    }
+    closedir(dir);
+    return listing;
+}
+
+/**
+ * @brief Double the listing table (called with listing_lock held)
+ */
+static void grow_listing_table(void) {
+    size_t count = listing_bucket_count ? listing_bucket_count * 2 : INITIAL_LISTING_BUCKETS;
+    Listing **buckets = calloc(count, sizeof(Listing*));
+    if (buckets == NULL) {
+        return;   // Longer chains, still correct
+    }
+    for (size_t i = 0; i < listing_bucket_count; i++) {
+        Listing *listing = listing_buckets[i];
+        while (listing != NULL) {
+            Listing *next = listing->next;
+            size_t index = hash_path(listing->path) & (count - 1);
+            listing->next = buckets[index];
+            buckets[index] = listing;
+            listing = next;
+        }
+    }
+    free(listing_buckets);
+    listing_buckets = buckets;
+    listing_bucket_count = count;
+}
+
+/**
+ * @brief Find a listing in the table (called with listing_lock held)
+ */
+static Listing* find_listing(const char *path) {
+    if (listing_bucket_count == 0) {
+        return NULL;
+    }
+    Listing *listing = listing_buckets[hash_path(path) & (listing_bucket_count - 1)];
+    while (listing != NULL && strcmp(listing->path, path) != 0) {
+        listing = listing->next;
+    }
+    return listing;
+}
+
+/**
+ * @brief Get the entries of a directory, reading it only the first time
+ * @param path Directory ("." for the current one)
+ * @return The listing, NULL if out of memory
+ *
+ * Safe to call from the walker threads: the directory is read outside
+ * the lock, and a listing another thread stored first wins.
+ */
+static Listing* get_listing(const char *path) {
+    pthread_mutex_lock(&listing_lock);
+    Listing *listing = find_listing(path);
+    pthread_mutex_unlock(&listing_lock);
+    if (listing != NULL) {
+        return listing;
+    }
+
+    Listing *read = read_listing(path);
+    if (read == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&listing_lock);
+    listing = find_listing(path);
+    if (listing == NULL) {
+        if (listing_count >= listing_bucket_count) {
+            grow_listing_table();
+        }
+        if (listing_bucket_count > 0) {
+            size_t index = hash_path(path) & (listing_bucket_count - 1);
+            read->next = listing_buckets[index];
+            listing_buckets[index] = read;
+            listing_count++;
+            listing = read;
+            read = NULL;
+        }
+    }
+    pthread_mutex_unlock(&listing_lock);
+    if (read != NULL) {
+        free_listing(read);
+    }
+    return listing;
+}
+
+/**
+ * @brief Forget all directory reads
+ *
+ * Called after every command's expansion, so the next command sees
+ * files created in between.
+ */
+void clear_glob_cache(void) {
+    for (size_t i = 0; i < listing_bucket_count; i++) {
+        while (listing_buckets[i] != NULL) {
+            Listing *listing = listing_buckets[i];
+            listing_buckets[i] = listing->next;
+            free_listing(listing);
+        }
+    }
+    listing_count = 0;
+}
+
+/**
+ * @brief Join a directory and a name ("" is the current directory)
+ * @return New path, NULL if out of memory
+ */
+static char* join_path(const char *directory, const char *name) {
+    size_t directory_length = strlen(directory);
+    size_t name_length = strlen(name);
+    char *path = malloc(directory_length + name_length + 2);
+    if (path == NULL) {
+        return NULL;
+    }
+    memcpy(path, directory, directory_length);
+    size_t length = directory_length;
+    if (directory_length > 0 && directory[directory_length - 1] != '/') {
+        path[length++] = '/';
+    }
+    memcpy(path + length, name, name_length + 1);
+    return path;
+}
+
+/**
+ * @brief Check whether a listing entry is a directory
+ * @param type d_type of the entry
+ * @param path Path of the entry
+ * @param follow Follow a symbolic link to a directory
+ */
+static int is_directory_entry(unsigned char type, const char *path, int follow) {
+    if (type == DT_DIR) {
+        return 1;
+    }
+    if (type != DT_UNKNOWN && (type != DT_LNK || !follow)) {
+        return 0;
+    }
+    struct stat st;
+    int result = follow ? stat(path, &st) : lstat(path, &st);
+    return result == 0 && S_ISDIR(st.st_mode);
+}
+
+/**
+ * @brief Literal parts of a pattern, checked before fnmatch
+ *
+ * Most names fail on the literal prefix or suffix (`*.log`, `core.*`),
+ * so fnmatch only sees the few that could match. A pattern that is one
+ * `*` between literals needs no fnmatch at all.
+ */
+typedef struct {
+    const char *pattern;
+    size_t prefix_length;       // Characters before the first special one
+    const char *suffix;         // Characters after the last special one
+    size_t suffix_length;
+    int single_star;            // prefix*suffix: the literals decide
+} Matcher;
+
+/**
+ * @brief Prepare the literal checks for one pattern component
+ */
+static void init_matcher(Matcher *matcher, const char *pattern) {
+    const char *first = strpbrk(pattern, "*?[\\");
+    const char *last = first;
+    for (const char *p = first; p != NULL && *p != '\0'; p++) {
+        if (strchr("*?[]\\", *p) != NULL) {
+            last = p;
+        }
+    }
+    size_t length = strlen(pattern);
+    matcher->pattern = pattern;
+    matcher->prefix_length = first != NULL ? (size_t)(first - pattern) : length;
+    matcher->suffix = last != NULL ? last + 1 : pattern + length;
+    matcher->suffix_length = strlen(matcher->suffix);
+    matcher->single_star = first != NULL && first == last && *first == '*';
+}
+
+/**
+ * @brief Match a name against a pattern component
+ *
+ * A leading dot must be matched by a leading dot in the pattern.
+ */
+static int matcher_matches(const Matcher *matcher, const char *name) {
+    if (name[0] == '.' && matcher->pattern[0] != '.') {
+        return 0;
+    }
+    size_t length = strlen(name);
+    if (length < matcher->prefix_length + matcher->suffix_length ||
+        strncmp(name, matcher->pattern, matcher->prefix_length) != 0 ||
+        memcmp(name + length - matcher->suffix_length, matcher->suffix, matcher->suffix_length) != 0) {
+        return 0;
+    }
+    return matcher->single_star || fnmatch(matcher->pattern, name, FNM_PERIOD) == 0;
+}
+
+/**
+ * @brief Record a matching path
+ * @param path Path (taken over)
+ */
+static void add_match(Glob *glob, char *path) {
+    if (path == NULL) {
+        glob->failed = 1;
+        return;
+    }
+    if (glob->dir_only) {
+        char *with_slash = join_path(path, "");
+        free(path);
+        if ((path = with_slash) == NULL) {
+            glob->failed = 1;
+            return;
+        }
+    }
+    if (glob->match_count == glob->match_capacity) {
+        int capacity = glob->match_capacity ? glob->match_capacity * 2 : 16;
+        char **matches = realloc(glob->matches, sizeof(char*) * capacity);
+        if (matches == NULL) {
+            free(path);
+            glob->failed = 1;
+            return;
+        }
+        glob->matches = matches;
+        glob->match_capacity = capacity;
+    }
+    glob->matches[glob->match_count++] = path;
+}
+
+/**
+ * @brief Append a path to a growable array
+ * @return 0 on success, -1 if out of memory
+ */
+static int push_path(char ***paths, int *count, int *capacity, char *path) {
+    if (path == NULL) {
+        return -1;
+    }
+    if (*count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 64;
+        char **grown = realloc(*paths, sizeof(char*) * new_capacity);
+        if (grown == NULL) {
+            free(path);
+            return -1;
+        }
+        *paths = grown;
+        *capacity = new_capacity;
+    }
+    (*paths)[(*count)++] = path;
+    return 0;
+}
+
+/**
+ * @brief Walker thread: read queued directories and queue their subdirectories
+ *
+ * Hidden directories and symbolic links are not entered. The walk ends
+ * when no directory is queued or being read.
+ */
+static void* walk_directories(void *data) {
+    Walk *walk = data;
+    pthread_mutex_lock(&walk->lock);
+    while (1) {
+        while (walk->queue_count == 0 && walk->pending > 0) {
+            pthread_cond_wait(&walk->wake, &walk->lock);
+        }
+        if (walk->queue_count == 0) {
+            break;
+        }
+        char *directory = walk->queue[--walk->queue_count];
+        pthread_mutex_unlock(&walk->lock);
+
+        char **subdirectories = NULL;
+        int subdirectory_count = 0;
+        int subdirectory_capacity = 0;
+        int failed = 0;
+        Listing *listing = get_listing(directory[0] != '\0' ? directory : ".");
+        failed |= listing == NULL;
+        for (int i = 0; listing != NULL && i < listing->count && !failed; i++) {
+            const char *name = listing->names + listing->offsets[i];
+            if (name[0] == '.') {
+                continue;
+            }
+            char *path = join_path(directory, name);
+            if (path != NULL && !is_directory_entry(listing->types[i], path, 0)) {
+                free(path);
+                continue;
+            }
+            failed |= push_path(&subdirectories, &subdirectory_count, &subdirectory_capacity, path) == -1;
+        }
+
+        pthread_mutex_lock(&walk->lock);
+        failed |= push_path(&walk->found, &walk->found_count, &walk->found_capacity, directory) == -1;
+        for (int i = 0; i < subdirectory_count; i++) {
+            if (failed || push_path(&walk->queue, &walk->queue_count, &walk->queue_capacity, subdirectories[i]) == -1) {
+                failed = 1;
+                free(subdirectories[i]);
+                continue;
+            }
+            walk->pending++;
+        }
+        free(subdirectories);
+        walk->failed |= failed;
+        walk->pending--;
+        pthread_cond_broadcast(&walk->wake);
+    }
+    pthread_mutex_unlock(&walk->lock);
+    return NULL;
+}
+
+/**
+ * @brief Find every directory under one, in parallel
+ * @param start Directory to start from ("" for the current one)
+ * @param count Set to the number of directories
+ * @return The directories, start first; NULL on error (or none)
+ *
+ * Up to one thread per CPU (at most MAX_WALK_THREADS) reads directories
+ * from a shared queue; the shell's own thread takes part as well.
+ */
+static char** walk_tree(const char *start, int *count) {
+    Walk walk = { 0 };
+    *count = 0;
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.wake, NULL);
+    if (push_path(&walk.queue, &walk.queue_count, &walk.queue_capacity, strdup(start)) == 0) {
+        walk.pending = 1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = cpus > MAX_WALK_THREADS ? MAX_WALK_THREADS : (cpus > 1 ? (int)cpus : 1);
+    pthread_t threads[MAX_WALK_THREADS];
+    int started = 0;
+    for (int i = 1; i < thread_count; i++) {
+        if (pthread_create(&threads[started], NULL, walk_directories, &walk) == 0) {
+            started++;
+        }
+    }
+    walk_directories(&walk);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&walk.lock);
+    pthread_cond_destroy(&walk.wake);
+    free(walk.queue);
+    if (walk.failed) {
+        for (int i = 0; i < walk.found_count; i++) {
+            free(walk.found[i]);
+        }
+        free(walk.found);
+        return NULL;
+    }
+    *count = walk.found_count;
+    return walk.found;
+}
+
+static void match_components(Glob *glob, const char *directory, int index, int verify);
+
+/**
+ * @brief Match a `**` component: zero or more directories
+ *
+ * As the last component it matches the directory and everything below it.
+ */
+static void match_globstar(Glob *glob, const char *directory, int index) {
+    int count;
+    char **directories = walk_tree(directory, &count);
+    if (directories == NULL) {
+        glob->failed = 1;
+        return;
+    }
+    int last = index + 1 == glob->component_count;
+    if (last && directory[0] != '\0') {
+        add_match(glob, join_path(directory, ""));   // dir/** includes dir/ itself
+    }
+    for (int d = 0; d < count && !glob->failed; d++) {
+        if (!last) {
+            match_components(glob, directories[d], index + 1, 0);
+            continue;
+        }
+        Listing *listing = get_listing(directories[d][0] != '\0' ? directories[d] : ".");
+        for (int i = 0; listing != NULL && i < listing->count && !glob->failed; i++) {
+            const char *name = listing->names + listing->offsets[i];
+            if (name[0] == '.') {
+                continue;
+            }
+            char *path = join_path(directories[d], name);
+            if (glob->dir_only && path != NULL && !is_directory_entry(listing->types[i], path, 1)) {
+                free(path);
+                continue;
+            }
+            add_match(glob, path);
+        }
+    }
+    for (int d = 0; d < count; d++) {
+        free(directories[d]);
+    }
+    free(directories);
+}
+
+/**
+ * @brief Match the pattern components from index on, below a directory
+ * @param directory Path matched so far ("" for the current directory)
+ * @param index First component still to match
+ * @param verify The path so far came from literal components and may not exist
+ */
+static void match_components(Glob *glob, const char *directory, int index, int verify) {
+    if (glob->failed) {
+        return;
+    }
+    if (index == glob->component_count) {
+        struct stat st;
+        if (verify && lstat(directory, &st) != 0) {
+            return;
+        }
+        if (glob->dir_only && (stat(directory, &st) != 0 || !S_ISDIR(st.st_mode))) {
+            return;
+        }
+        add_match(glob, strdup(directory));
+        return;
+    }
+
+    const char *component = glob->components[index];
+    if (strcmp(component, "**") == 0) {
+        match_globstar(glob, directory, index);
+        return;
+    }
+    if (!has_glob_pattern(component)) {
+        char *path = join_path(directory, component);
+        if (path == NULL) {
+            glob->failed = 1;
+            return;
+        }
+        // Drop the escapes of quoted characters from the part just added
+        char *out = path + strlen(path) - strlen(component);
+        for (const char *p = out; *p != '\0'; p++) {
+            if (*p == '\\' && p[1] != '\0') {
+                p++;
+            }
+            *out++ = *p;
+        }
+        *out = '\0';
+        match_components(glob, path, index + 1, 1);
+        free(path);
+        return;
+    }
+
+    Listing *listing = get_listing(directory[0] != '\0' ? directory : ".");
+    if (listing == NULL) {
+        glob->failed = 1;
+        return;
+    }
+    Matcher matcher;
+    init_matcher(&matcher, component);
+    int last = index + 1 == glob->component_count;
+    for (int i = 0; i < listing->count && !glob->failed; i++) {
+        const char *name = listing->names + listing->offsets[i];
+        if (!matcher_matches(&matcher, name)) {
+            continue;
+        }
+        char *path = join_path(directory, name);
+        if (path == NULL) {
+            glob->failed = 1;
+            return;
+        }
+        if ((!last || glob->dir_only) && !is_directory_entry(listing->types[i], path, 1)) {
+            free(path);
+            continue;
+        }
+        if (last) {
+            add_match(glob, path);
+        } else {
+            match_components(glob, path, index + 1, 0);
+            free(path);
+        }
+    }
+}
+
+/**
+ * @brief Compare two paths (for sorting matches)
+ */
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief Expand a glob pattern into the paths it matches
+ * @param pattern Pattern, e.g. "*.log", "src/?ain.[ch]" or "**"
+ * @param matches Set to the sorted matches (caller frees each and the array)
+ * @param count Set to the number of matches, 0 if nothing matched
+ * @return 0 on success, -1 if out of memory (message printed)
+ *
+ * Every directory is read at most once per command (the cache is
+ * shared by all patterns until clear_glob_cache()), and only for
+ * components that have wildcards. Names starting with a dot need a dot
+ * in the pattern. `**` matches any number of directories and walks the
+ * tree with several threads.
+ */
+int glob_pattern(const char *pattern, char ***matches, int *count) {
+    *matches = NULL;
+    *count = 0;
+    char *copy = strdup(pattern);
+    Glob glob = { 0 };
+    glob.components = malloc(sizeof(char*) * (strlen(pattern) / 2 + 1));
+    if (copy == NULL || glob.components == NULL) {
+        perror("malloc glob");
+        free(copy);
+        free(glob.components);
+        return -1;
+    }
+    glob.absolute = pattern[0] == '/';
+    glob.dir_only = pattern[strlen(pattern) - 1] == '/';
+    char *save = NULL;
+    for (char *component = strtok_r(copy, "/", &save); component != NULL; component = strtok_r(NULL, "/", &save)) {
+        glob.components[glob.component_count++] = component;
+    }
+
+    match_components(&glob, glob.absolute ? "/" : "", 0, 0);
+    free(glob.components);
+    free(copy);
+    if (glob.failed) {
+        printf("Error: Out of memory expanding %s\n", pattern);
+        for (int i = 0; i < glob.match_count; i++) {
+            free(glob.matches[i]);
+        }
+        free(glob.matches);
+        return -1;
+    }
+
+    // Sort, dropping duplicates (`**` can reach a path twice)
+    if (glob.match_count > 1) {
+        qsort(glob.matches, glob.match_count, sizeof(char*), compare_paths);
+    }
+    int unique = 0;
+    for (int i = 0; i < glob.match_count; i++) {
+        if (unique > 0 && strcmp(glob.matches[unique - 1], glob.matches[i]) == 0) {
+            free(glob.matches[i]);
+        } else {
+            glob.matches[unique++] = glob.matches[i];
+        }
+    }
+    *matches = glob.matches;
+    *count = unique;
+    return 0;
+}
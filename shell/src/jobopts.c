@@ -0,0 +1,603 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+
+/**
+ * @brief Reset job options to their defaults
+ * @param options Options to initialise
+ */
+void init_job_options(JobOptions *options) {
+    options->priority = 0;
+    options->nice_value = 0;
+    options->has_nice = 0;
+    options->cpu_seconds = 0;
+    options->address_space = 0;
+    options->open_files = 0;
+    options->memory_max = 0;
+    options->cpu_max_percent = 0;
+    options->cpu_list[0] = '\0';
+    options->sched_class = JOB_SCHED_INHERIT;
+    options->ioprio = -1;
+    options->timeout_ms = 0;
+    options->kill_after_ms = 0;
+    options->timeout_signal = SIGTERM;
+    options->batch_jobs = 0;
+    options->batch_max_args = 0;
+    options->batch_max_bytes = 0;
+}
+
+// ioprio_set() has no glibc wrapper; values from linux/ioprio.h
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_WHO_PGRP 2
+
+/**
+ * @brief Parse a signed integer option value
+ * @return 0 on success, -1 if the string is not a number
+ */
+static int parse_int_value(const char *str, int *value) {
+    char *end;
+    errno = 0;
+    long parsed = strtol(str, &end, 10);
+    if (*str == '\0' || *end != '\0' || errno != 0) {
+        return -1;
+    }
+    *value = (int)parsed;
+    return 0;
+}
+
+/**
+ * @brief Parse a CPU list such as "4-7" or "0,2,8-11"
+ * @param list CPU list
+ * @param set Filled with the CPUs in the list
+ * @return 0 on success, -1 if the list is malformed or out of range
+ */
+static int parse_cpu_list(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p != '\0') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+        if (last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        p = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Parse an I/O priority "CLASS[:LEVEL]" (rt, be or idle; level 0-7)
+ * @return Encoded ioprio value, -1 if invalid
+ */
+static int parse_ioprio(const char *str) {
+    const char *classes[] = { "rt", "be", "idle" };
+    const char *colon = strchr(str, ':');
+    size_t name_length = colon != NULL ? (size_t)(colon - str) : strlen(str);
+    int level = 4;
+    if (colon != NULL && (parse_int_value(colon + 1, &level) == -1 || level < 0 || level > 7)) {
+        return -1;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (strlen(classes[i]) == name_length && strncmp(str, classes[i], name_length) == 0) {
+            // The idle class has no levels
+            return ((i + 1) << IOPRIO_CLASS_SHIFT) | (i == 2 ? 0 : level);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Parse a positive size with an optional K, M, G or T suffix (powers of 1024)
+ * @return 0 on success, -1 if the string is not a valid size
+ */
+static int parse_size_value(const char *str, long long *value) {
+    char *end;
+    errno = 0;
+    long long parsed = strtoll(str, &end, 10);
+    if (end == str || errno != 0 || parsed <= 0) {
+        return -1;
+    }
+
+    const char *units = "KMGT";
+    const char *unit = *end != '\0' ? strchr(units, toupper((unsigned char)*end)) : NULL;
+    if (unit != NULL && end[1] == '\0') {
+        for (const char *u = units; u <= unit; u++) {
+            if (parsed > LLONG_MAX / 1024) {
+                return -1;
+            }
+            parsed *= 1024;
+        }
+    } else if (*end != '\0') {
+        return -1;
+    }
+    *value = parsed;
+    return 0;
+}
+
+/**
+ * @brief Parse a scheduling option, valid at launch and on `bg`/`fg`
+ * @param flag Option name
+ * @param value Option value (NULL if there is none)
+ * @param options Options to update
+ * @return Number of tokens used (1 or 2), 0 if flag is not a scheduling
+ *         option, -1 on an invalid value
+ */
+static int parse_sched_option(const char *flag, const char *value, JobOptions *options) {
+    if (strcmp(flag, "--batch") == 0 || strcmp(flag, "--idle") == 0 || strcmp(flag, "--normal") == 0) {
+        options->sched_class = flag[2] == 'b' ? JOB_SCHED_BATCH :
+                               flag[2] == 'i' ? JOB_SCHED_IDLE : JOB_SCHED_NORMAL;
+        return 1;
+    }
+    if (strcmp(flag, "-n") != 0 && strcmp(flag, "--nice") != 0 &&
+        strcmp(flag, "--cpus") != 0 && strcmp(flag, "--ioprio") != 0) {
+        return 0;
+    }
+    if (value == NULL) {
+        return -1;
+    }
+
+    if (strcmp(flag, "--cpus") == 0) {
+        cpu_set_t set;
+        if (strlen(value) >= sizeof(options->cpu_list) || parse_cpu_list(value, &set) == -1) {
+            return -1;
+        }
+        strcpy(options->cpu_list, value);
+    } else if (strcmp(flag, "--ioprio") == 0) {
+        options->ioprio = parse_ioprio(value);
+        if (options->ioprio == -1) {
+            return -1;
+        }
+    } else {
+        options->has_nice = 1;
+        if (parse_int_value(value, &options->nice_value) == -1) {
+            return -1;
+        }
+    }
+    return 2;
+}
+
+/**
+ * @brief Parse one option of a `job` or `limit` prefix
+ * @param flag Option name
+ * @param value Option value (NULL if there is none)
+ * @param options Options to update
+ * @return Number of tokens used (1 or 2), -1 on an unknown option or invalid value
+ */
+static int parse_job_option(const char *flag, const char *value, JobOptions *options) {
+    int used = parse_sched_option(flag, value, options);
+    if (used != 0) {
+        return used;
+    }
+    if (value == NULL) {
+        return -1;
+    }
+
+    int number;
+    if (strcmp(flag, "-p") == 0 || strcmp(flag, "--priority") == 0) {
+        return parse_int_value(value, &options->priority) == -1 ? -1 : 2;
+    }
+    if (strcmp(flag, "--cpu-time") == 0) {
+        if (parse_int_value(value, &number) == -1 || number <= 0) {
+            return -1;
+        }
+        options->cpu_seconds = number;
+        return 2;
+    }
+    if (strcmp(flag, "--as") == 0) {
+        return parse_size_value(value, &options->address_space) == -1 ? -1 : 2;
+    }
+    if (strcmp(flag, "--nofile") == 0) {
+        if (parse_int_value(value, &number) == -1 || number <= 0) {
+            return -1;
+        }
+        options->open_files = number;
+        return 2;
+    }
+    if (strcmp(flag, "--memory") == 0) {
+        return parse_size_value(value, &options->memory_max) == -1 ? -1 : 2;
+    }
+    if (strcmp(flag, "--cpu") == 0) {
+        return parse_int_value(value, &options->cpu_max_percent) == -1 ||
+               options->cpu_max_percent <= 0 ? -1 : 2;
+    }
+    return -1;
+}
+
+/**
+ * @brief Parse the arguments of a `timeout` prefix
+ * @param index Index of the token after "timeout"
+ * @param end_index Ending token index of the command
+ * @param options Receives timeout_ms, kill_after_ms and timeout_signal
+ * @return Index of the token after the prefix, -1 on error
+ *
+ * Syntax: timeout [-k|--kill-after D] [-s|--signal SIG] DURATION
+ * The options may also follow the duration.
+ */
+static int parse_timeout_prefix(int index, int end_index, JobOptions *options) {
+    int have_duration = 0;
+    while (index < end_index && tokens[index].type == TOKEN_NAME) {
+        const char *arg = tokens[index].value;
+        const char *value = index + 1 < end_index && tokens[index + 1].type == TOKEN_NAME ?
+                            tokens[index + 1].value : NULL;
+        if (strcmp(arg, "-k") == 0 || strcmp(arg, "--kill-after") == 0) {
+            if (value == NULL || parse_duration(value, &options->kill_after_ms) == -1) {
+                return -1;
+            }
+            index += 2;
+        } else if (strcmp(arg, "-s") == 0 || strcmp(arg, "--signal") == 0) {
+            if (value == NULL || (options->timeout_signal = parse_signal_name(value)) == -1) {
+                return -1;
+            }
+            index += 2;
+        } else if (!have_duration && arg[0] != '-') {
+            if (parse_duration(arg, &options->timeout_ms) == -1) {
+                return -1;
+            }
+            have_duration = 1;
+            index++;
+        } else {
+            break;
+        }
+    }
+    return have_duration ? index : -1;
+}
+
+/**
+ * @brief Parse the options of a `batch` prefix
+ * @param index Index of the token after "batch"
+ * @param end_index Ending token index of the command
+ * @param options Receives batch_jobs, batch_max_args and batch_max_bytes
+ * @return Index of the token after the prefix, -1 on error
+ *
+ * Syntax: batch [-j N] [-n N] [-s SIZE] [--]
+ * -j 0 runs one batch per online CPU.
+ */
+static int parse_batch_prefix(int index, int end_index, JobOptions *options) {
+    options->batch_jobs = 1;
+    while (index < end_index && tokens[index].type == TOKEN_NAME && tokens[index].value[0] == '-') {
+        const char *arg = tokens[index].value;
+        const char *value = index + 1 < end_index && tokens[index + 1].type == TOKEN_NAME ?
+                            tokens[index + 1].value : NULL;
+        if (strcmp(arg, "--") == 0) {
+            return index + 1;
+        }
+        if (value == NULL) {
+            return -1;
+        }
+        if (strcmp(arg, "-j") == 0) {
+            if (parse_int_value(value, &options->batch_jobs) == -1 || options->batch_jobs < 0) {
+                return -1;
+            }
+            if (options->batch_jobs == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                options->batch_jobs = cpus > 0 ? (int)cpus : 1;
+            }
+        } else if (strcmp(arg, "-n") == 0) {
+            if (parse_int_value(value, &options->batch_max_args) == -1 || options->batch_max_args <= 0) {
+                return -1;
+            }
+        } else if (strcmp(arg, "-s") == 0) {
+            if (parse_size_value(value, &options->batch_max_bytes) == -1) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+        index += 2;
+    }
+    return index;
+}
+
+/**
+ * @brief Parse `job` and `limit` prefixes at the start of a command
+ * @param start_index Starting token index of the command
+ * @param end_index Ending token index of the command
+ * @param options Filled with the parsed options (reset first)
+ * @return Index of the first token of the real command, -1 on error
+ *
+ * Syntax: job|limit [options] [--] command
+ * - -p|--priority N    start before lower priority queued jobs
+ * - -n|--nice N        nice level
+ * - --cpus LIST        CPU affinity, e.g. 4-7 or 0,2
+ * - --batch|--idle|--normal   scheduling class (SCHED_BATCH, SCHED_IDLE, SCHED_OTHER)
+ * - --ioprio CLASS[:N] I/O priority: rt, be or idle, level 0-7
+ * - --cpu-time SECS    CPU time limit (SIGXCPU, then SIGKILL a second later)
+ * - --as SIZE          address space limit, e.g. 512M
+ * - --nofile N         open file limit
+ * - --memory SIZE      cgroup v2 memory.max for the whole job
+ * - --cpu PERCENT      cgroup v2 cpu.max, in percent of one CPU (200 = two CPUs)
+ * Both prefixes take every option; they may be chained, and later
+ * options override earlier ones. A `timeout DURATION` prefix (see
+ * parse_timeout_prefix()) and a `batch` prefix (see parse_batch_prefix())
+ * can be chained with them.
+ */
+int parse_job_options(int start_index, int end_index, JobOptions *options) {
+    init_job_options(options);
+
+    int i = start_index;
+    while (i < end_index && tokens[i].type == TOKEN_NAME &&
+           (strcmp(tokens[i].value, "job") == 0 || strcmp(tokens[i].value, "limit") == 0 ||
+            strcmp(tokens[i].value, "timeout") == 0 || strcmp(tokens[i].value, "batch") == 0)) {
+        const char *prefix = tokens[i].value;
+        i++;
+        if (strcmp(prefix, "timeout") == 0) {
+            i = parse_timeout_prefix(i, end_index, options);
+            if (i == -1) {
+                printf("Usage: timeout [-k|--kill-after DURATION] [-s|--signal SIG] DURATION command\n");
+                return -1;
+            }
+            continue;
+        }
+        if (strcmp(prefix, "batch") == 0) {
+            i = parse_batch_prefix(i, end_index, options);
+            if (i == -1) {
+                printf("Usage: batch [-j N] [-n N] [-s SIZE] command [args...] [::: items...]\n");
+                return -1;
+            }
+            continue;
+        }
+        while (i < end_index && tokens[i].type == TOKEN_NAME && tokens[i].value[0] == '-') {
+            const char *flag = tokens[i].value;
+            if (strcmp(flag, "--") == 0) {
+                i++;
+                break;
+            }
+
+            const char *value = i + 1 < end_index && tokens[i + 1].type == TOKEN_NAME ?
+                                tokens[i + 1].value : NULL;
+            int used = parse_job_option(flag, value, options);
+            if (used == -1) {
+                printf("Usage: %s [-p|--priority N] [-n|--nice N] [--cpus LIST] [--batch|--idle|--normal]\n"
+                       "       [--ioprio CLASS[:LEVEL]] [--cpu-time SECS] [--as SIZE] [--nofile N]\n"
+                       "       [--memory SIZE] [--cpu PERCENT] command\n", prefix);
+                return -1;
+            }
+            i += used;
+        }
+    }
+
+    if (i > start_index && i >= end_index) {
+        printf("%s: No command given\n", tokens[start_index].value);
+        return -1;
+    }
+    return i;
+}
+
+/**
+ * @brief Parse scheduling options given to `bg` or `fg` for a running job
+ * @param start_index Index of the first option token
+ * @param end_index Ending token index
+ * @param options Filled with the parsed options (reset first)
+ * @return 0 on success, -1 on error
+ *
+ * Accepts -n|--nice, --cpus, --batch, --idle, --normal and --ioprio.
+ */
+int parse_sched_options(int start_index, int end_index, JobOptions *options) {
+    init_job_options(options);
+    for (int i = start_index; i < end_index && tokens[i].type == TOKEN_NAME; ) {
+        const char *value = i + 1 < end_index && tokens[i + 1].type == TOKEN_NAME ?
+                            tokens[i + 1].value : NULL;
+        int used = parse_sched_option(tokens[i].value, value, options);
+        if (used <= 0) {
+            printf("Usage: %s [job_number] [-n|--nice N] [--cpus LIST] [--batch|--idle|--normal]\n"
+                   "       [--ioprio CLASS[:LEVEL]]\n", tokens[0].value);
+            return -1;
+        }
+        i += used;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether job options change scheduling (nice, affinity, class, ioprio)
+ * @param options Options to check
+ * @return 1 if any scheduling option is set
+ */
+int job_options_have_sched(const JobOptions *options) {
+    return options->has_nice || options->cpu_list[0] != '\0' ||
+           options->sched_class != JOB_SCHED_INHERIT || options->ioprio != -1;
+}
+
+/**
+ * @brief Copy the scheduling options that are set from one option set to another
+ * @param dest Options to update (e.g. a job's stored options)
+ * @param src Newly given options
+ */
+void merge_sched_options(JobOptions *dest, const JobOptions *src) {
+    if (src->has_nice) {
+        dest->has_nice = 1;
+        dest->nice_value = src->nice_value;
+    }
+    if (src->cpu_list[0] != '\0') {
+        strcpy(dest->cpu_list, src->cpu_list);
+    }
+    if (src->sched_class != JOB_SCHED_INHERIT) {
+        dest->sched_class = src->sched_class;
+    }
+    if (src->ioprio != -1) {
+        dest->ioprio = src->ioprio;
+    }
+}
+
+/**
+ * @brief Set the CPU affinity and scheduling class of one thread
+ * @param tid Thread id (0 for the calling thread)
+ * @param options Options to apply
+ * @return 0 on success, -1 on error (errno set)
+ */
+static int apply_thread_sched(pid_t tid, const JobOptions *options) {
+    if (options->cpu_list[0] != '\0') {
+        cpu_set_t set;
+        parse_cpu_list(options->cpu_list, &set);
+        if (sched_setaffinity(tid, sizeof(set), &set) == -1) {
+            return -1;
+        }
+    }
+    if (options->sched_class != JOB_SCHED_INHERIT) {
+        int policy = options->sched_class == JOB_SCHED_BATCH ? SCHED_BATCH :
+                     options->sched_class == JOB_SCHED_IDLE ? SCHED_IDLE : SCHED_OTHER;
+        struct sched_param param = { .sched_priority = 0 };
+        if (sched_setscheduler(tid, policy, &param) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Read the process group of a process from /proc/<pid>/stat
+ * @return Process group id, -1 if the process is gone
+ */
+static pid_t read_process_group(const char *pid) {
+    char path[64], buffer[512];
+    snprintf(path, sizeof(path), "/proc/%s/stat", pid);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    size_t n = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+    buffer[n] = '\0';
+
+    int pgrp;
+    char *fields = strrchr(buffer, ')');
+    if (fields == NULL || sscanf(fields + 2, "%*c %*d %d", &pgrp) != 1) {
+        return -1;
+    }
+    return pgrp;
+}
+
+/**
+ * @brief Apply scheduling options to every process of a running job
+ * @param pgid Process group of the job
+ * @param options Options to apply (only the scheduling ones are used)
+ * @return 0 on success, -1 if any part failed (reported)
+ *
+ * Nice level and ioprio have process group forms. Affinity and scheduling
+ * class are per thread, so every thread of every process in the group is
+ * updated.
+ */
+int apply_sched_options_to_group(pid_t pgid, const JobOptions *options) {
+    int result = 0;
+    if (options->has_nice && setpriority(PRIO_PGRP, pgid, options->nice_value) == -1) {
+        perror("setpriority");
+        result = -1;
+    }
+    if (options->ioprio != -1 && syscall(SYS_ioprio_set, IOPRIO_WHO_PGRP, pgid, options->ioprio) == -1) {
+        perror("ioprio_set");
+        result = -1;
+    }
+    if (options->cpu_list[0] == '\0' && options->sched_class == JOB_SCHED_INHERIT) {
+        return result;
+    }
+
+    DIR *proc = opendir("/proc");
+    if (proc == NULL) {
+        perror("opendir /proc");
+        return -1;
+    }
+    struct dirent *process;
+    while ((process = readdir(proc)) != NULL) {
+        if (!isdigit((unsigned char)process->d_name[0]) || read_process_group(process->d_name) != pgid) {
+            continue;
+        }
+        char path[sizeof(process->d_name) + 16];
+        snprintf(path, sizeof(path), "/proc/%s/task", process->d_name);
+        DIR *tasks = opendir(path);
+        if (tasks == NULL) {
+            continue;   // Exited meanwhile
+        }
+        struct dirent *task;
+        while ((task = readdir(tasks)) != NULL) {
+            if (isdigit((unsigned char)task->d_name[0]) &&
+                apply_thread_sched(atoi(task->d_name), options) == -1 && errno != ESRCH && result == 0) {
+                perror(options->cpu_list[0] != '\0' ? "sched_setaffinity" : "sched_setscheduler");
+                result = -1;
+            }
+        }
+        closedir(tasks);
+    }
+    closedir(proc);
+    return result;
+}
+
+/**
+ * @brief Lower one resource limit of the calling process
+ * @param resource RLIMIT_* constant
+ * @param soft New soft limit
+ * @param hard New hard limit (clamped to the current hard limit)
+ */
+static void lower_resource_limit(int resource, rlim_t soft, rlim_t hard) {
+    struct rlimit limit;
+    if (getrlimit(resource, &limit) == 0 && limit.rlim_max != RLIM_INFINITY) {
+        if (hard > limit.rlim_max) hard = limit.rlim_max;
+        if (soft > hard) soft = hard;
+    }
+    limit.rlim_cur = soft;
+    limit.rlim_max = hard;
+    if (setrlimit(resource, &limit) == -1) {
+        perror("limit: setrlimit");
+    }
+}
+
+/**
+ * @brief Apply job options to the calling process (used in the child before exec)
+ * @param options Options to apply
+ *
+ * cgroup caps are not handled here; see create_job_cgroup().
+ */
+void apply_job_options(const JobOptions *options) {
+    if (options->has_nice && setpriority(PRIO_PROCESS, 0, options->nice_value) == -1) {
+        perror("job: setpriority");
+    }
+    if (apply_thread_sched(0, options) == -1) {
+        perror(options->cpu_list[0] != '\0' ? "job: sched_setaffinity" : "job: sched_setscheduler");
+    }
+    if (options->ioprio != -1 && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, options->ioprio) == -1) {
+        perror("job: ioprio_set");
+    }
+    if (options->cpu_seconds > 0) {
+        // The soft limit sends SIGXCPU, the hard one a second later SIGKILL
+        lower_resource_limit(RLIMIT_CPU, options->cpu_seconds, options->cpu_seconds + 1);
+    }
+    if (options->address_space > 0) {
+        lower_resource_limit(RLIMIT_AS, options->address_space, options->address_space);
+    }
+    if (options->open_files > 0) {
+        lower_resource_limit(RLIMIT_NOFILE, options->open_files, options->open_files);
+    }
+}
+
+/**
+ * @brief Check whether job options ask for caps that need a cgroup
+ * @param options Options to check
+ * @return 1 if --memory or --cpu was given
+ */
+int job_options_need_cgroup(const JobOptions *options) {
+    return options->memory_max > 0 || options->cpu_max_percent > 0;
+}
@@ -0,0 +1,171 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <fcntl.h>
+
+/**
+ * @brief Reset job stats to "nothing sampled, nothing open"
+ * @param stats Stats to initialise
+ */
+void init_job_stats(JobStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->stat_fd = -1;
+    stats->io_fd = -1;
+    stats->cgroup_cpu_fd = -1;
+    stats->cgroup_memory_fd = -1;
+    stats->cgroup_io_fd = -1;
+}
+
+/**
+ * @brief Close the cached /proc descriptors of a job
+ * @param stats Stats to release
+ */
+void release_job_stats(JobStats *stats) {
+    int fds[] = { stats->stat_fd, stats->io_fd, stats->cgroup_cpu_fd,
+                  stats->cgroup_memory_fd, stats->cgroup_io_fd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] != -1) {
+            close(fds[i]);
+        }
+    }
+    init_job_stats(stats);
+}
+
+/**
+ * @brief Read a whole /proc file through a cached descriptor
+ * @return Number of bytes read, -1 on error
+ *
+ * pread() at offset 0 makes the kernel regenerate the contents, so the
+ * descriptor can be reused for every sample without lseek().
+ */
+static ssize_t read_proc_file(int fd, char *buffer, size_t size) {
+    ssize_t n = pread(fd, buffer, size - 1, 0);
+    if (n >= 0) {
+        buffer[n] = '\0';
+    }
+    return n;
+}
+
+/**
+ * @brief Find a "name: value" or "name value" field in a /proc or cgroup file
+ */
+static unsigned long long io_field(const char *buffer, const char *name) {
+    const char *field = strstr(buffer, name);
+    return field != NULL ? strtoull(field + strlen(name), NULL, 10) : 0;
+}
+
+/**
+ * @brief Sum the rbytes= and wbytes= fields of all devices in io.stat
+ */
+static void sum_io_stat(const char *buffer, unsigned long long *read_bytes, unsigned long long *write_bytes) {
+    *read_bytes = 0;
+    *write_bytes = 0;
+    for (const char *p = strstr(buffer, "rbytes="); p != NULL; p = strstr(p + 1, "rbytes=")) {
+        *read_bytes += strtoull(p + 7, NULL, 10);
+    }
+    for (const char *p = strstr(buffer, "wbytes="); p != NULL; p = strstr(p + 1, "wbytes=")) {
+        *write_bytes += strtoull(p + 7, NULL, 10);
+    }
+}
+
+/**
+ * @brief Open the files a job is sampled from
+ * @return 0 on success, -1 if the process is gone
+ */
+static int open_job_stat_files(BackgroundJob *job) {
+    JobStats *stats = &job->stats;
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", job->pid);
+    stats->stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (stats->stat_fd == -1) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "/proc/%d/io", job->pid);
+    stats->io_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    // A cgroup covers every process of the job, not just the one we started
+    if (job->cgroup_fd != -1) {
+        stats->cgroup_cpu_fd = openat(job->cgroup_fd, "cpu.stat", O_RDONLY | O_CLOEXEC);
+        stats->cgroup_memory_fd = openat(job->cgroup_fd, "memory.current", O_RDONLY | O_CLOEXEC);
+        stats->cgroup_io_fd = openat(job->cgroup_fd, "io.stat", O_RDONLY | O_CLOEXEC);
+    }
+    stats->has_io = stats->io_fd != -1 || stats->cgroup_io_fd != -1;
+    return 0;
+}
+
+/**
+ * @brief Take a resource usage sample of a running or stopped job
+ * @param job Job to sample
+ * @return 0 on success, -1 if the process cannot be read
+ *
+ * The /proc files are opened on the first sample and kept open until the
+ * job finishes, so refreshing costs one pread() per file. A descriptor
+ * stays bound to its process, so a recycled pid is never misreported.
+ * CPU% and I/O rates cover the time since the previous sample; they stay
+ * 0 until a job has been sampled twice. /proc/<pid>/io may be unreadable,
+ * in which case the rates are not shown.
+ *
+ * Jobs with their own cgroup are measured from cpu.stat, memory.current
+ * and io.stat instead, which include all of the job's children; memory
+ * is then the cgroup's charge (page cache included) rather than RSS.
+ */
+int sample_job_stats(BackgroundJob *job) {
+    JobStats *stats = &job->stats;
+    if (job->pid <= 0 || (job->state != PROCESS_RUNNING && job->state != PROCESS_STOPPED)) {
+        return -1;
+    }
+
+    if (stats->stat_fd == -1 && open_job_stat_files(job) == -1) {
+        return -1;
+    }
+
+    char buffer[1024];
+    if (read_proc_file(stats->stat_fd, buffer, sizeof(buffer)) <= 0) {
+        return -1;
+    }
+
+    // The command name may contain spaces and ')', so parse after the last ')'
+    char *fields = strrchr(buffer, ')');
+    unsigned long long utime, stime;
+    long rss_pages;
+    if (fields == NULL ||
+        sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu "
+               "%*d %*d %*d %*d %*d %*d %*u %*u %ld",
+               &utime, &stime, &rss_pages) != 3) {
+        return -1;
+    }
+
+    unsigned long long cpu_usec = (utime + stime) * 1000000ULL / sysconf(_SC_CLK_TCK);
+    long rss_kb = rss_pages * (sysconf(_SC_PAGESIZE) / 1024);
+    if (stats->cgroup_cpu_fd != -1 && read_proc_file(stats->cgroup_cpu_fd, buffer, sizeof(buffer)) > 0) {
+        cpu_usec = io_field(buffer, "usage_usec ");
+    }
+    if (stats->cgroup_memory_fd != -1 && read_proc_file(stats->cgroup_memory_fd, buffer, sizeof(buffer)) > 0) {
+        rss_kb = strtoull(buffer, NULL, 10) / 1024;
+    }
+
+    unsigned long long read_bytes = 0, write_bytes = 0;
+    if (stats->cgroup_io_fd != -1 && read_proc_file(stats->cgroup_io_fd, buffer, sizeof(buffer)) >= 0) {
+        sum_io_stat(buffer, &read_bytes, &write_bytes);
+    } else if (stats->io_fd != -1 && read_proc_file(stats->io_fd, buffer, sizeof(buffer)) > 0) {
+        // Leading newlines keep "write_bytes" from matching "cancelled_write_bytes"
+        read_bytes = io_field(buffer, "\nread_bytes:");
+        write_bytes = io_field(buffer, "\nwrite_bytes:");
+    }
+
+    double now = monotonic_ms() / 1e3;
+    if (stats->sampled && now > stats->sample_time) {
+        double elapsed = now - stats->sample_time;
+        stats->cpu_percent = (cpu_usec - stats->cpu_usec) / 1e4 / elapsed;
+        stats->read_rate = (read_bytes - stats->read_bytes) / elapsed;
+        stats->write_rate = (write_bytes - stats->write_bytes) / elapsed;
+    }
+
+    stats->rss_kb = rss_kb;
+    stats->cpu_usec = cpu_usec;
+    stats->read_bytes = read_bytes;
+    stats->write_bytes = write_bytes;
+    stats->sample_time = now;
+    stats->sampled = 1;
+    return 0;
+}
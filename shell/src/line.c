@@ -0,0 +1,120 @@
+#include "shell.h"
+
+/**
+ * @brief Growable buffer holding the command line being read
+ *
+ * Reused for every line, so reading costs no allocation once it has
+ * grown to the longest line seen.
+ */
+static char *command_line = NULL;
+static size_t command_line_length = 0;
+static size_t command_line_capacity = 0;
+
+// getline() buffer for the physical lines that make up a command line
+static char *read_buffer = NULL;
+static size_t read_buffer_size = 0;
+
+/**
+ * @brief Check whether a line needs the next one to be complete
+ * @param line Text read so far, without its final newline
+ * @return 0 if complete, 1 inside a quote, 2 if it ends with an escaping backslash
+ *
+ * A quoted section that is not closed goes on across the line break
+ * (which stays part of it); a backslash at the very end of the line
+ * joins the next line to this one.
+ */
+int line_continues(const char *line) {
+    for (const char *p = line; *p != '\0'; p++) {
+        if (*p == '\'' || *p == '"' || *p == '\\') {
+            const char *end = find_quote_end(p);
+            if (end == NULL) {
+                return *p == '\\' ? 2 : 1;
+            }
+            p = end;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Append text to the command line buffer
+ * @return 0 on success, -1 if out of memory
+ */
+static int append_line_text(const char *text, size_t length) {
+    if (command_line_length + length + 1 > command_line_capacity) {
+        size_t capacity = command_line_capacity ? command_line_capacity : 256;
+        while (capacity < command_line_length + length + 1) {
+            capacity *= 2;
+        }
+        char *grown = realloc(command_line, capacity);
+        if (grown == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        command_line = grown;
+        command_line_capacity = capacity;
+    }
+    memcpy(command_line + command_line_length, text, length);
+    command_line_length += length;
+    command_line[command_line_length] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Read one physical line from stdin
+ * @return Length without the newline, -1 at end of input
+ */
+static ssize_t read_physical_line(void) {
+    ssize_t length = getline(&read_buffer, &read_buffer_size, stdin);
+    if (length > 0 && read_buffer[length - 1] == '\n') {
+        read_buffer[--length] = '\0';
+    }
+    return length;
+}
+
+/**
+ * @brief Read a command line of any length from stdin
+ * @return The line without its final newline (valid until the next
+ *         call), NULL at end of input
+ *
+ * Lines are read with getline(), so nothing is cut off or split into
+ * separate commands however long it is. An open quote or a trailing
+ * backslash continues the line: an interactive shell prompts with "> "
+ * for each extra line. A quote still open at end of input is reported
+ * and the line dropped, so half a command never runs.
+ */
+char* read_command_line(void) {
+    command_line_length = 0;
+    ssize_t length = read_physical_line();
+    if (length == -1) {
+        return NULL;
+    }
+    if (append_line_text(read_buffer, length) == -1) {
+        return "";
+    }
+
+    int state;
+    while ((state = line_continues(command_line)) != 0) {
+        if (state == 2) {
+            // The backslash and the line break both go
+            command_line[--command_line_length] = '\0';
+        }
+        if (isatty(STDIN_FILENO)) {
+            printf("> ");
+            fflush(stdout);
+        }
+        wait_for_input();
+        length = read_physical_line();
+        if (length == -1) {
+            if (state == 1) {
+                printf("Error: Unexpected end of input (unterminated quote)\n");
+                return "";
+            }
+            break;
+        }
+        if ((state == 1 && append_line_text("\n", 1) == -1) || append_line_text(read_buffer, length) == -1) {
+            return "";
+        }
+    }
+    return command_line;
+}
@@ -3,10 +3,9 @@
 #include <fcntl.h>
 
 #define MAX_LOG_ENTRIES 15
-#define MAX_COMMAND_LEN 1024
 
-// Global log storage
-static char command_log[MAX_LOG_ENTRIES][MAX_COMMAND_LEN];
+// Global log storage (each entry allocated to its command's length)
+static char *command_log[MAX_LOG_ENTRIES];
 static int log_count = 0;
 static int log_start = 0; // Circular buffer start index
 static char log_file_path[MAX_PATH_LEN];
@@ -21,7 +20,8 @@ void init_log(const char* home_directory) {
     
     // Initialize log arrays
     for (int i = 0; i < MAX_LOG_ENTRIES; i++) {
-        command_log[i][0] = '\0';
+        free(command_log[i]);
+        command_log[i] = NULL;
     }
     log_count = 0;
     log_start = 0;
@@ -41,21 +41,22 @@ void load_log_from_file(const char* home_directory) {
         return;
     }
     
-    char line[MAX_COMMAND_LEN];
+    char *line = NULL;
+    size_t line_size = 0;
     log_count = 0;
     log_start = 0;
     
-    // Read commands from file (they are stored oldest to newest)
-    while (fgets(line, sizeof(line), file) && log_count < MAX_LOG_ENTRIES) {
+    // Read commands from file (they are stored oldest to newest), whole however long
+    while (log_count < MAX_LOG_ENTRIES && getline(&line, &line_size, file) != -1) {
         // Remove newline character
         line[strcspn(line, "\n")] = '\0';
         
-        if (strlen(line) > 0) {
-            strcpy(command_log[log_count], line);
+        if (strlen(line) > 0 && (command_log[log_count] = strdup(line)) != NULL) {
             log_count++;
         }
     }
     
+    free(line);
     fclose(file);
 }
 
@@ -81,35 +82,11 @@ void save_log_to_file(const char* home_directory) {
 
 /**
  * @brief Reconstruct the full command string from current tokens
- * @return Dynamically allocated string containing the full command (caller must free)
+ * @return Command text in the arena (valid until the arena is released
+ *         past it), NULL if there are no tokens
  */
 char* reconstruct_command_from_tokens(void) {
-    if (token_count == 0) {
-        return NULL;
-    }
-    
-    // Calculate required buffer size
-    int total_len = 0;
-    for (int i = 0; i < token_count; i++) {
-        total_len += strlen(tokens[i].value) + 1; // +1 for space or null terminator
-    }
-    
-    char *command = malloc(total_len + 1);
-    if (command == NULL) {
-        return NULL;
-    }
-    
-    command[0] = '\0';
-    
-    // Reconstruct command with proper spacing
-    for (int i = 0; i < token_count; i++) {
-        if (i > 0) {
-            strcat(command, " ");
-        }
-        strcat(command, tokens[i].value);
-    }
-    
-    return command;
+    return reconstruct_command_from_segment(0, token_count);
 }
 
 /**
@@ -121,9 +98,10 @@ char* reconstruct_command_from_tokens(void) {
  * - Don't log if command starts with "log"
  * - Don't log if identical to the most recent command
  * - Don't log empty commands
+ * - Don't log commands spanning lines (the log file has one per line)
  */
 int should_log_command(const char* command) {
-    if (command == NULL || strlen(command) == 0) {
+    if (command == NULL || strlen(command) == 0 || strchr(command, '\n') != NULL) {
         return 0;
     }
     
@@ -149,7 +127,8 @@ int should_log_command(const char* command) {
  * @param command The command string to add
  */
 void add_command_to_log(const char* command) {
-    if (!should_log_command(command)) {
+    // Commands inside $(...) are part of the line that was logged
+    if (in_command_substitution() || !should_log_command(command)) {
         return;
     }
     
@@ -166,11 +145,16 @@ void add_command_to_log(const char* command) {
     }
     
     // Store the command
-    strncpy(command_log[insert_index], command, MAX_COMMAND_LEN - 1);
-    command_log[insert_index][MAX_COMMAND_LEN - 1] = '\0';
+    char *copy = strdup(command);
+    if (copy == NULL) {
+        perror("strdup");
+        return;
+    }
+    free(command_log[insert_index]);
+    command_log[insert_index] = copy;
     
     // Save to file to ensure persistence
-    save_log_to_file(getenv("HOME")); // Using HOME env var as fallback
+    save_log_to_file(get_variable("HOME")); // Using HOME env var as fallback
 }
 
 /**
@@ -223,14 +207,18 @@ void execute_log(const char* home_directory) {
         int in_pipeline = !isatty(STDOUT_FILENO);
         
         // Save current shell state only if not in pipeline (to avoid issues in child processes)
-        Token saved_tokens[1024];
+        Token *saved_tokens = NULL;
         int saved_token_count = token_count;
         const char* saved_current_input = current_input;
         ParserState saved_parser_state = parser_state;
         
         if (!in_pipeline) {
             // Copy current tokens to saved state
-            memcpy(saved_tokens, tokens, sizeof(Token) * token_count);
+            saved_tokens = arena_alloc(sizeof(Token) * (token_count + 1));
+            if (saved_tokens == NULL) {
+                return;
+            }
+            memcpy(saved_tokens, tokens, sizeof(Token) * (token_count + 1));
         }
         
         // Tokenize and execute the stored command
@@ -283,7 +271,7 @@ void execute_log(const char* home_directory) {
         
         // Restore shell state only if not in pipeline
         if (!in_pipeline) {
-            memcpy(tokens, saved_tokens, sizeof(Token) * saved_token_count);
+            memcpy(tokens, saved_tokens, sizeof(Token) * (saved_token_count + 1));
             token_count = saved_token_count;
             current_input = saved_current_input;
             parser_state = saved_parser_state;
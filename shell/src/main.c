@@ -4,40 +4,24 @@
 
 // Function to execute a single atomic command (with redirections)
 int execute_atomic_command(int start_index, int end_index) {
-    // Build argument array for execvp
-    char *args[256]; // Max 256 arguments
-    int arg_count = 0;
-    
-    // Extract command and arguments (skip redirection tokens)
-    for (int i = start_index; i < end_index; i++) {
-        if (tokens[i].type == TOKEN_NAME) {
-            // Check if this is a redirection filename (preceded by redirection token)
-            if (i > start_index && 
-                (tokens[i-1].type == TOKEN_INPUT || 
-                 tokens[i-1].type == TOKEN_OUTPUT || 
-                 tokens[i-1].type == TOKEN_DOUBLE_OUTPUT)) {
-                continue; // Skip redirection filenames
-            }
-            args[arg_count] = tokens[i].value;
-            arg_count++;
-        }
+    // Build argument vector for exec (skip redirection tokens)
+    int arg_count;
+    char **args = build_arg_vector(start_index, end_index, &arg_count);
+    if (args == NULL) {
+        return -1;
     }
-    args[arg_count] = NULL; // Null-terminate for execvp
     
+    int result = 0;
     if (arg_count == 0) {
         printf("Error: No command found\n");
-        return -1;
-    }
-    
-    // Check if it's a built-in command
-    if (strcmp(args[0], "hop") == 0) {
+        result = -1;
+    } else if (strcmp(args[0], "hop") == 0) {
+        // Check if it's a built-in command
         // For built-ins, we don't fork - just execute directly
         // But we need to handle the fact that we're already parsing differently
         printf("Built-in commands should be handled in main execution flow\n");
-        return 0;
     } else if (strcmp(args[0], "reveal") == 0) {
         printf("Built-in commands should be handled in main execution flow\n");
-        return 0;
     } else if (strcmp(args[0], "exit") == 0) {
         exit(0);
     } else if (strcmp(args[0], "pwd") == 0) {
@@ -47,33 +31,108 @@ int execute_atomic_command(int start_index, int end_index) {
         } else {
             perror("pwd");
         }
-        return 0;
+    } else {
+        // Fork and exec for external commands
+        pid_t pid = fork();
+        if (pid == 0) {
+            // Child process
+            
+            // Set up redirections
+            if (setup_redirections(start_index, end_index) == -1) {
+                fflush(stdout);
+                _exit(1);
+            }
+            
+            // Execute the command
+            exec_command(args, NULL);
+        } else if (pid > 0) {
+            // Parent process - wait for child
+            int status;
+            wait_for_child(pid, &status, 0);
+            result = WEXITSTATUS(status);
+        } else {
+            perror("fork");
+            result = -1;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Read the lines of a compound command that goes on after the first one
+ * @param first_line Line already read (and tokenised)
+ * @return Whole command joined into one line (caller frees), NULL at end
+ *         of input; the tokens hold it
+ * 
+ * Lines are joined with `;`, so a line break ends a command as in a
+ * script. An interactive shell prompts with "> " for every extra line.
+ * Heredoc bodies are read right after the line that has the `<<`, and
+ * carried over each time the joined text is tokenised again.
+ */
+static char* read_compound_command(const char *first_line) {
+    char *text = strdup(first_line);
+    if (text == NULL) {
+        perror("strdup");
+        return NULL;
     }
     
-    // Fork and exec for external commands
-    pid_t pid = fork();
-    if (pid == 0) {
-        // Child process
+    // Each pass tokenises the whole text again, so the previous words can go
+    size_t mark = arena_mark();
+    while (collect_heredocs() == 0 && compound_command_incomplete()) {
+        // The bodies read so far, in order (on the heap: the arena is released below)
+        int heredoc_count = 0;
+        for (int i = 0; i < token_count; i++) {
+            heredoc_count += tokens[i].type == TOKEN_HEREDOC;
+        }
+        int *heredocs = malloc(sizeof(int) * (heredoc_count + 1));
+        if (heredocs == NULL) {
+            perror("malloc");
+            release_heredocs();
+            free(text);
+            return NULL;
+        }
+        for (int i = 0, h = 0; i < token_count; i++) {
+            if (tokens[i].type == TOKEN_HEREDOC) {
+                heredocs[h++] = tokens[i].heredoc_fd;
+            }
+        }
         
-        // Set up redirections
-        if (setup_input_redirection(start_index, end_index) == -1 ||
-            setup_output_redirection(start_index, end_index) == -1) {
-            exit(1);
+        if (isatty(STDIN_FILENO)) {
+            printf("> ");
+            fflush(stdout);
         }
+        wait_for_input();
+        char *joined = NULL;
+        const char *line = read_command_line();
+        if (line == NULL) {
+            printf("Error: Unexpected end of input\n");
+        } else {
+            joined = malloc(strlen(text) + strlen(line) + 4);
+            if (joined == NULL) {
+                perror("malloc");
+            }
+        }
+        if (joined == NULL) {
+            release_heredocs();
+            free(heredocs);
+            free(text);
+            return NULL;
+        }
+        sprintf(joined, "%s ; %s", text, line);
+        free(text);
+        text = joined;
+        current_input = text;
+        arena_release(mark);
+        tokenise();
         
-        // Execute the command
-        execvp(args[0], args);
-        printf("Command not found!\n"); // If execvp returns, there was an error
-        exit(1);
-    } else if (pid > 0) {
-        // Parent process - wait for child
-        int status;
-        waitpid(pid, &status, 0);
-        return WEXITSTATUS(status);
-    } else {
-        perror("fork");
-        return -1;
+        for (int i = 0, h = 0; i < token_count && h < heredoc_count; i++) {
+            if (tokens[i].type == TOKEN_HEREDOC) {
+                tokens[i].heredoc_fd = heredocs[h++];
+            }
+        }
+        free(heredocs);
     }
+    return text;
 }
 
 //  Main Shell Loop 
@@ -86,28 +145,43 @@ int main() {
         return 1;
     }
 
-    // Initialize the log system and background jobs
+    // Import the environment, then initialize the log system and background jobs
+    init_variables();
+    init_builtins();
     init_log(home_directory);
     init_background_jobs();
     
+    // The event loop drains captured job output and handles all signals
+    init_event_loop();
+    
+    // Own the terminal so foreground jobs can be handed it
+    init_job_control();
+    
     // Setup signal handlers for job control (Ctrl-C, Ctrl-Z)
     setup_signal_handlers();
 
-    char input_buffer[MAX_PATH_LEN];
-
     // The main Read-Eval-Print-Loop (REPL)
     while (1) {
+        // Everything the previous line allocated from the arena (words,
+        // argument vectors, segment lists, command text) goes at once
+        arena_release(0);
+        
         // Check for completed background jobs before displaying prompt
         check_background_jobs();
         
         prompt(home_directory);
+        
+        // Service background events until the user types something
+        wait_for_input();
 
-        if (fgets(input_buffer, sizeof(input_buffer), stdin) == NULL) {
+        // A whole line however long, continued after an open quote or a trailing backslash
+        char *input_buffer = read_command_line();
+        if (input_buffer == NULL) {
             // Handle Ctrl-D (EOF)
             handle_eof();
         }
 
-        if (input_buffer[0] == '\n') {
+        if (input_buffer[0] == '\0') {
             continue;
         }
 
@@ -117,11 +191,29 @@ int main() {
         current_input = input_buffer;
         tokenise();
         
+        // if, while, for, case and { ...; } are compiled and run by the VM
+        if (is_compound_command()) {
+            char *text = read_compound_command(input_buffer);
+            if (text != NULL) {
+                if (collect_heredocs() == 0) {
+                    execute_compound_command(home_directory);
+                }
+                release_heredocs();
+            }
+            free(text);
+            current_input = input_buffer;
+            continue;
+        }
+        
         // Parse the tokens
         int parse_result = parse();
         if (parse_result) {
-            // Execute sequential/background commands
-            execute_sequential_commands(home_directory);
+            // Heredoc bodies follow the command line on the shell's input
+            if (collect_heredocs() == 0) {
+                // Execute sequential/background commands
+                execute_sequential_commands(home_directory);
+            }
+            release_heredocs();
         } else {
             printf("Invalid Syntax!\n");
         }
@@ -0,0 +1,112 @@
+#include "shell.h"
+#include <errno.h>
+
+// Global shell options
+ShellOptions shell_options = { .max_jobs = 0, .capture_output = 0, .capture_size = 65536,
+                                .command_timeout_ms = 0, .kill_after_ms = 0 };
+
+/**
+ * @brief Print all shell options in a form that can be fed back to `set`
+ */
+static void print_shell_options(void) {
+    printf("maxjobs %d\n", shell_options.max_jobs);
+    printf("capture %s\n", shell_options.capture_output ? "on" : "off");
+    printf("capturesize %zu\n", shell_options.capture_size);
+    printf("timeout %lldms\n", shell_options.command_timeout_ms);
+    printf("killafter %lldms\n", shell_options.kill_after_ms);
+}
+
+/**
+ * @brief Parse a non-negative option value
+ * @return 0 on success, -1 if the string is not a valid number
+ */
+static int parse_option_value(const char *str, long *value) {
+    char *end;
+    errno = 0;
+    *value = strtol(str, &end, 10);
+    if (str[0] == '\0' || *end != '\0' || errno != 0 || *value < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Execute the set command
+ * @return 0 on success, 1 on invalid usage
+ *
+ * Syntax:
+ * - set               print all options
+ * - set maxjobs N     run at most N background jobs at once, queue the rest
+ *                     (0 removes the limit)
+ * - set capture on    send stdout/stderr of new background jobs to per-job
+ *                     ring buffers (read with joblog, replayed by fg)
+ * - set capturesize N ring size per job in bytes
+ * - set timeout D     default timeout of foreground commands, e.g. 30s or 5m
+ *                     (0 turns it off; a `timeout` prefix overrides it)
+ * - set killafter D   send SIGKILL this long after the default timeout's SIGTERM
+ */
+int execute_set(void) {
+    if (token_count == 1) {
+        print_shell_options();
+        return 0;
+    }
+
+    if (token_count != 3) {
+        printf("Usage: set [maxjobs N | capture on|off | capturesize BYTES | timeout D | killafter D]\n");
+        return 1;
+    }
+    
+    const char *name = tokens[1].value;
+    const char *value = tokens[2].value;
+    long number;
+    
+    if (strcmp(name, "maxjobs") == 0) {
+        if (parse_option_value(value, &number) == -1) {
+            printf("set: Invalid value for maxjobs: %s\n", value);
+            return 1;
+        }
+        shell_options.max_jobs = (int)number;
+
+        // Raising the limit may admit queued jobs right away
+        start_queued_jobs();
+        return 0;
+    }
+    
+    if (strcmp(name, "capture") == 0) {
+        if (strcmp(value, "on") == 0) {
+            shell_options.capture_output = 1;
+        } else if (strcmp(value, "off") == 0) {
+            shell_options.capture_output = 0;
+        } else {
+            printf("set: capture must be on or off\n");
+            return 1;
+        }
+        return 0;
+    }
+    
+    if (strcmp(name, "capturesize") == 0) {
+        if (parse_option_value(value, &number) == -1 || number < 4096) {
+            printf("set: capturesize must be at least 4096 bytes\n");
+            return 1;
+        }
+        shell_options.capture_size = (size_t)number;
+        return 0;
+    }
+    
+    if (strcmp(name, "timeout") == 0 || strcmp(name, "killafter") == 0) {
+        long long duration;
+        if (parse_duration(value, &duration) == -1) {
+            printf("set: Invalid duration for %s: %s\n", name, value);
+            return 1;
+        }
+        if (strcmp(name, "timeout") == 0) {
+            shell_options.command_timeout_ms = duration;
+        } else {
+            shell_options.kill_after_ms = duration;
+        }
+        return 0;
+    }
+    
+    printf("set: Unknown option: %s\n", name);
+    return 1;
+}
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+
+#define PARALLEL_READ_SIZE 65536
+
+/**
+ * @brief One argument's job and the output it has produced so far
+ */
+typedef struct {
+    char *arg;          // Argument substituted into the command template
+    int owns_arg;       // arg was read from stdin and must be freed
+    char *output;       // Pending output (partial line, or held back by -k)
+    size_t length;
+    size_t capacity;
+    int done;           // Child has exited and its pipe reached EOF
+} ParallelTask;
+
+/**
+ * @brief A running job occupying one of the -j slots
+ */
+typedef struct {
+    pid_t pid;
+    int fd;             // Read end of the job's stdout pipe
+    int task;           // Index into the task array
+    int job_index;      // Slot in background_jobs, -1 if untracked
+} ParallelSlot;
+
+/**
+ * @brief Scheduler state for a single parallel invocation
+ */
+typedef struct {
+    int cmd_start;          // First template token
+    int cmd_end;            // One past the last template token
+    int has_placeholder;    // Template contains {}
+    int keep_order;         // -k: print outputs in argument order
+    int tag;                // --tag: prefix each line with its argument
+    int args_start;         // First argument after ::: (or -1 for stdin)
+    int args_end;
+    int next_arg;           // Next ::: argument to hand out
+    ParallelTask *tasks;
+    int task_count;
+    int task_capacity;
+    int next_to_print;      // -k: oldest task whose output is not flushed
+} ParallelState;
+
+/**
+ * @brief Count free entries in the job table
+ */
+static int count_free_job_slots(void) {
+    int free_slots = 0;
+    for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+        if (!background_jobs[i].is_active) {
+            free_slots++;
+        }
+    }
+    return free_slots;
+}
+
+/**
+ * @brief Fetch the next argument from ::: or stdin
+ * @param state Scheduler state
+ * @param owned Set to 1 if the returned string must be freed
+ * @return Next argument, or NULL when the input is exhausted
+ */
+static char* next_parallel_arg(ParallelState *state, int *owned) {
+    *owned = 0;
+    if (state->args_start != -1) {
+        if (state->next_arg < state->args_end) {
+            return tokens[state->next_arg++].value;
+        }
+        return NULL;
+    }
+
+    // One argument per line of stdin
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t length = getline(&line, &size, stdin);
+    if (length == -1) {
+        free(line);
+        return NULL;
+    }
+    if (length > 0 && line[length - 1] == '\n') {
+        line[length - 1] = '\0';
+    }
+    *owned = 1;
+    return line;
+}
+
+/**
+ * @brief Replace every {} in a word with the job's argument
+ * @return Newly allocated string
+ */
+static char* substitute_placeholder(const char *word, const char *arg) {
+    size_t arg_len = strlen(arg);
+    size_t len = strlen(word);
+    size_t count = 0;
+    for (const char *p = strstr(word, "{}"); p; p = strstr(p + 2, "{}")) {
+        count++;
+    }
+
+    char *result = malloc(len + count * arg_len + 1);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    char *out = result;
+    const char *p = word;
+    const char *match;
+    while ((match = strstr(p, "{}")) != NULL) {
+        memcpy(out, p, match - p);
+        out += match - p;
+        memcpy(out, arg, arg_len);
+        out += arg_len;
+        p = match + 2;
+    }
+    strcpy(out, p);
+    return result;
+}
+
+/**
+ * @brief Child side of a job: build argv from the template and exec it
+ */
+static void exec_parallel_task(ParallelState *state, const char *arg, int pipe_out) {
+    int template_len = state->cmd_end - state->cmd_start;
+    char **args = malloc((template_len + 2) * sizeof(char*));
+    if (args == NULL) {
+        fflush(stdout);
+        _exit(1);
+    }
+
+    int arg_count = 0;
+    for (int i = state->cmd_start; i < state->cmd_end; i++) {
+        args[arg_count++] = state->has_placeholder
+                          ? substitute_placeholder(tokens[i].value, arg)
+                          : tokens[i].value;
+    }
+    if (!state->has_placeholder) {
+        args[arg_count++] = (char*)arg;
+    }
+    args[arg_count] = NULL;
+
+    // Jobs must not consume the argument stream or the shell's own input
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd != -1) {
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+
+    if (dup2(pipe_out, STDOUT_FILENO) == -1) {
+        perror("dup2 parallel output");
+        fflush(stdout);
+        _exit(1);
+    }
+    close(pipe_out);
+
+    exec_command(args, NULL);
+}
+
+/**
+ * @brief Append bytes to a task's pending output
+ */
+static int append_task_output(ParallelTask *task, const char *data, size_t length) {
+    if (task->length + length > task->capacity) {
+        size_t capacity = task->capacity ? task->capacity : 4096;
+        while (capacity < task->length + length) {
+            capacity *= 2;
+        }
+        char *grown = realloc(task->output, capacity);
+        if (grown == NULL) {
+            perror("realloc parallel output");
+            return -1;
+        }
+        task->output = grown;
+        task->capacity = capacity;
+    }
+    memcpy(task->output + task->length, data, length);
+    task->length += length;
+    return 0;
+}
+
+/**
+ * @brief Write a task's complete lines (and its tail once finished) to stdout
+ * @param state Scheduler state
+ * @param task Task whose pending output should be written
+ *
+ * Only whole lines are written while the job runs, so lines from
+ * different jobs never interleave mid-line.
+ */
+static void emit_task_output(ParallelState *state, ParallelTask *task) {
+    size_t written = 0;
+    while (written < task->length) {
+        char *newline = memchr(task->output + written, '\n', task->length - written);
+        if (newline == NULL && !task->done) {
+            break;
+        }
+        size_t line_len = newline ? (size_t)(newline - (task->output + written)) + 1
+                                  : task->length - written;
+        if (state->tag) {
+            fputs(task->arg, stdout);
+            fputc('\t', stdout);
+        }
+        fwrite(task->output + written, 1, line_len, stdout);
+        written += line_len;
+    }
+
+    if (written > 0) {
+        memmove(task->output, task->output + written, task->length - written);
+        task->length -= written;
+    }
+    if (task->done) {
+        free(task->output);
+        task->output = NULL;
+        task->length = task->capacity = 0;
+        if (task->owns_arg) {
+            free(task->arg);
+            task->arg = NULL;
+        }
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief Flush whatever output may be printed under the current ordering
+ * @param state Scheduler state
+ * @param task_index Task that just produced output or finished
+ */
+static void flush_ready_output(ParallelState *state, int task_index) {
+    if (!state->keep_order) {
+        emit_task_output(state, &state->tasks[task_index]);
+        return;
+    }
+
+    // With -k only the oldest unfinished task may stream; finished tasks
+    // behind it are released in argument order
+    while (state->next_to_print < state->task_count) {
+        ParallelTask *head = &state->tasks[state->next_to_print];
+        emit_task_output(state, head);
+        if (!head->done) {
+            break;
+        }
+        state->next_to_print++;
+    }
+}
+
+/**
+ * @brief Fork a job for the next argument into a free slot
+ * @return 1 if a job was started, 0 if there are no more arguments, -1 on error
+ */
+static int launch_parallel_task(ParallelState *state, ParallelSlot *slot, int track_jobs) {
+    int owned;
+    char *arg = next_parallel_arg(state, &owned);
+    if (arg == NULL) {
+        return 0;
+    }
+
+    if (state->task_count == state->task_capacity) {
+        int capacity = state->task_capacity ? state->task_capacity * 2 : 64;
+        ParallelTask *grown = realloc(state->tasks, capacity * sizeof(ParallelTask));
+        if (grown == NULL) {
+            perror("realloc parallel tasks");
+            if (owned) free(arg);
+            return -1;
+        }
+        state->tasks = grown;
+        state->task_capacity = capacity;
+    }
+
+    ParallelTask *task = &state->tasks[state->task_count];
+    memset(task, 0, sizeof(*task));
+    task->arg = arg;
+    task->owns_arg = owned;
+
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+        perror("pipe");
+        if (owned) free(arg);
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(pipe_fds[0]);
+        exec_parallel_task(state, arg, pipe_fds[1]);
+    } else if (pid == -1) {
+        perror("fork");
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        if (owned) free(arg);
+        return -1;
+    }
+    close(pipe_fds[1]);
+
+    slot->pid = pid;
+    slot->fd = pipe_fds[0];
+    slot->task = state->task_count++;
+    slot->job_index = -1;
+
+    // Register the job so `activities` can see it while it runs
+    if (track_jobs) {
+        char command[MAX_PATH_LEN];
+        int written = snprintf(command, sizeof(command), "%s ", tokens[state->cmd_start].value);
+        strncat(command, arg, sizeof(command) - written - 1);
+        if (add_background_job(pid, command) > 0) {
+            slot->job_index = find_job_index_by_pid(pid);
+            // parallel reaps its own jobs
+            background_jobs[slot->job_index].managed = 1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Execute the parallel command
+ * @return Number of failed jobs (capped at 101), or 255 on usage errors
+ *
+ * Syntax: parallel [-j N] [-k] [--tag] [--] command [args...] [::: arg...]
+ * - Runs the command once per argument, at most N at a time (-jN works too)
+ *   (default: number of online CPUs, 0 means as many as the job table allows)
+ * - {} in the command is replaced by the argument, otherwise it is appended
+ * - Without :::, arguments are read one per line from stdin
+ * - -k prints outputs in argument order, --tag prefixes lines with the argument
+ * - Stops launching new jobs after one is interrupted with Ctrl-C
+ */
+int execute_parallel(void) {
+    ParallelState state;
+    memset(&state, 0, sizeof(state));
+    state.args_start = -1;
+
+    long slots = sysconf(_SC_NPROCESSORS_ONLN);
+    if (slots < 1) {
+        slots = 1;
+    }
+
+    // Parse options
+    int i = 1;
+    while (i < token_count && tokens[i].type == TOKEN_NAME && tokens[i].value[0] == '-') {
+        const char *option = tokens[i].value;
+        int attached = strncmp(option, "-j", 2) == 0 && option[2] != '\0';   // -jN
+        if (attached || (strcmp(option, "-j") == 0 && i + 1 < token_count && tokens[i + 1].type == TOKEN_NAME)) {
+            const char *count = attached ? option + 2 : tokens[++i].value;
+            char *end;
+            slots = strtol(count, &end, 10);
+            if (*end != '\0' || end == count || slots < 0) {
+                printf("parallel: Invalid job count: %s\n", count);
+                return 255;
+            }
+            i++;
+        } else if (strcmp(option, "-k") == 0) {
+            state.keep_order = 1;
+            i++;
+        } else if (strcmp(option, "--tag") == 0) {
+            state.tag = 1;
+            i++;
+        } else if (strcmp(option, "--") == 0) {
+            i++;
+            break;
+        } else {
+            printf("parallel: Unknown option: %s\n", option);
+            printf("Usage: parallel [-j N] [-k] [--tag] [--] command [args...] [::: arg...]\n");
+            return 255;
+        }
+    }
+
+    // Command template runs up to ::: or the first redirection
+    state.cmd_start = i;
+    while (i < token_count && tokens[i].type == TOKEN_NAME && strcmp(tokens[i].value, ":::") != 0) {
+        if (strstr(tokens[i].value, "{}") != NULL) {
+            state.has_placeholder = 1;
+        }
+        i++;
+    }
+    state.cmd_end = i;
+    if (i < token_count && strcmp(tokens[i].value, ":::") == 0) {
+        state.args_start = state.next_arg = ++i;
+        while (i < token_count && tokens[i].type == TOKEN_NAME) {
+            i++;
+        }
+        state.args_end = i;
+    }
+
+    if (state.cmd_start == state.cmd_end) {
+        printf("Usage: parallel [-j N] [-k] [--tag] [--] command [args...] [::: arg...]\n");
+        return 255;
+    }
+
+    // Each running job takes a job table entry; never oversubscribe it
+    int free_slots = count_free_job_slots();
+    int track_jobs = free_slots > 0;
+    if (track_jobs && (slots == 0 || slots > free_slots)) {
+        slots = free_slots;
+    } else if (slots == 0) {
+        slots = 1;
+    }
+
+    ParallelSlot *running = calloc(slots, sizeof(ParallelSlot));
+    struct pollfd *fds = calloc(slots, sizeof(struct pollfd));
+    if (running == NULL || fds == NULL) {
+        perror("calloc parallel slots");
+        free(running);
+        free(fds);
+        return 255;
+    }
+
+    char *buffer = malloc(PARALLEL_READ_SIZE);
+    int running_count = 0;
+    int failures = 0;
+    int exhausted = 0;
+    int halted = 0;
+
+    while (1) {
+        // Fill free slots
+        while (!exhausted && !halted && running_count < slots) {
+            int started = launch_parallel_task(&state, &running[running_count], track_jobs);
+            if (started <= 0) {
+                exhausted = 1;
+                break;
+            }
+            running_count++;
+        }
+
+        if (running_count == 0) {
+            break;
+        }
+
+        for (int s = 0; s < running_count; s++) {
+            fds[s].fd = running[s].fd;
+            fds[s].events = POLLIN;
+            fds[s].revents = 0;
+        }
+
+        if (poll(fds, running_count, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        // Walk backwards so finished slots can be compacted in place
+        for (int s = running_count - 1; s >= 0; s--) {
+            if (fds[s].revents == 0) {
+                continue;
+            }
+
+            ParallelSlot *slot = &running[s];
+            ssize_t n = read(slot->fd, buffer, PARALLEL_READ_SIZE);
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            if (n > 0) {
+                append_task_output(&state.tasks[slot->task], buffer, n);
+                flush_ready_output(&state, slot->task);
+                continue;
+            }
+
+            // EOF: the job closed its stdout, collect its exit status
+            close(slot->fd);
+            int status = 0;
+            if (wait_for_child(slot->pid, &status, 0) == -1) {
+                perror("waitpid");
+            }
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                failures++;
+            }
+            if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+                halted = 1;
+            }
+            if (slot->job_index != -1) {
+                cleanup_background_job(slot->job_index);
+            }
+
+            state.tasks[slot->task].done = 1;
+            flush_ready_output(&state, slot->task);
+
+            running[s] = running[--running_count];
+            fds[s] = fds[running_count];
+        }
+    }
+
+    free(buffer);
+    free(running);
+    free(fds);
+    for (int t = 0; t < state.task_count; t++) {
+        free(state.tasks[t].output);
+        if (state.tasks[t].owns_arg) {
+            free(state.tasks[t].arg);
+        }
+    }
+    free(state.tasks);
+
+    return failures > 101 ? 101 : failures;
+}
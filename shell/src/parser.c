@@ -15,9 +15,7 @@ Token current_token(void) {
     }
     
     // Return end token if we've reached the end
-    Token end_token;
-    end_token.type = TOKEN_END;
-    strcpy(end_token.value, "");
+    Token end_token = { TOKEN_END, "", -1 };
     return end_token;
 }
 
@@ -54,9 +52,10 @@ int parse_name(void) {
 }
 
 // Parse input redirection
-// input -> < name | <name
+// input -> n?< name | n?<> name | n?<& name | <<< name | << name
 int parse_input(void) {
-    if (match_token(TOKEN_INPUT)) {
+    if (match_token(TOKEN_INPUT) || match_token(TOKEN_READ_WRITE) || match_token(TOKEN_DUP_INPUT) ||
+        match_token(TOKEN_HERE_STRING) || match_token(TOKEN_HEREDOC)) {
         consume_token();
         
         if (parse_name()) {
@@ -69,9 +68,10 @@ int parse_input(void) {
 }
 
 // Parse output redirection
-// output -> > name | >name | >> name | >>name
+// output -> n?> name | n?>> name | n?>& name | &> name | &>> name
 int parse_output(void) {
-    if (match_token(TOKEN_OUTPUT) || match_token(TOKEN_DOUBLE_OUTPUT)) {
+    if (match_token(TOKEN_OUTPUT) || match_token(TOKEN_DOUBLE_OUTPUT) || match_token(TOKEN_DUP_OUTPUT) ||
+        match_token(TOKEN_OUTPUT_ALL) || match_token(TOKEN_APPEND_ALL)) {
         consume_token();
         
         if (parse_name()) {
@@ -131,22 +131,44 @@ int parse_cmd_group(void) {
     return 1;
 }
 
-// Parse shell command
-// shell_cmd -> cmd_group ((& | ;) cmd_group)* &?
-int parse_shell_cmd(void) {
+// Parse conditional list
+// and_or -> cmd_group ((&& | \|\|) cmd_group)*
+int parse_and_or(void) {
     // Must start with a command group
     if (!parse_cmd_group()) {
         return 0;
     }
     
-    // Parse optional command separators and additional command groups
+    // Each && or || must be followed by another command group
+    while (match_token(TOKEN_AND) || match_token(TOKEN_OR)) {
+        consume_token();
+        
+        if (!parse_cmd_group()) {
+            printf("Error: Expected command after %s\n",
+                   tokens[parser_state.current_token_index - 1].value);
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+// Parse shell command
+// shell_cmd -> and_or ((& | ;) and_or)* &?
+int parse_shell_cmd(void) {
+    // Must start with a conditional list
+    if (!parse_and_or()) {
+        return 0;
+    }
+    
+    // Parse optional command separators and additional conditional lists
     while (match_token(TOKEN_AMPERSAND) || match_token(TOKEN_SEMICOLON)) {
         TokenType separator = current_token().type;
         consume_token();
         
-        // Check if there's another command group or if it's just a trailing &
+        // Check if there's another conditional list or if it's just a trailing &
         if (!match_token(TOKEN_END)) {
-            if (!parse_cmd_group()) {
+            if (!parse_and_or()) {
                 // If we found a separator but no command group follows,
                 // it might be a trailing & which is allowed
                 if (separator == TOKEN_AMPERSAND && match_token(TOKEN_END)) {
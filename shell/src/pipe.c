@@ -2,6 +2,7 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdio_ext.h>
 
 /**
  * @brief Count the number of pipes in a command sequence
@@ -26,16 +27,15 @@ int count_pipes(int start_index, int end_index) {
  * @return 0 on success, -1 on error
  * 
  * Each segment is represented by [start_index, end_index] pairs
- * Caller is responsible for freeing the segments array
+ * The array comes from the arena, so the caller does not free it
  */
 int find_pipe_segments(int **segments, int *num_segments) {
     int pipe_count = count_pipes(0, token_count);
     *num_segments = pipe_count + 1; // Number of commands = number of pipes + 1
     
     // Allocate memory for segment boundaries (2 integers per segment: start, end)
-    *segments = malloc(*num_segments * 2 * sizeof(int));
+    *segments = arena_alloc(*num_segments * 2 * sizeof(int));
     if (*segments == NULL) {
-        perror("malloc segments");
         return -1;
     }
     
@@ -61,41 +61,39 @@ int find_pipe_segments(int **segments, int *num_segments) {
  * @param cmd_end End index of command tokens
  * @param pipe_in File descriptor for input pipe (-1 if none)
  * @param pipe_out File descriptor for output pipe (-1 if none)
+ * @param options Options of the command (a batch prefix applies to the first stage only), or NULL
  * @param home_directory Shell home directory for built-in commands
  */
-void execute_command_in_pipeline(int cmd_start, int cmd_end, int pipe_in, int pipe_out, const char* home_directory) {
-    // Build argument array for execvp
-    char *args[256];
-    int arg_count = 0;
+void execute_command_in_pipeline(int cmd_start, int cmd_end, int pipe_in, int pipe_out, const JobOptions *options,
+                                  const char* home_directory) {
+    // Leading NAME=value words go into this command's environment
+    int assignments = count_assignments(cmd_start, cmd_end);
+    apply_assignments(cmd_start, assignments, 1);
     
-    // Extract command and arguments (skip redirection tokens)
-    for (int i = cmd_start; i < cmd_end; i++) {
-        if (tokens[i].type == TOKEN_NAME) {
-            // Check if this is a redirection filename
-            if (i > cmd_start && 
-                (tokens[i-1].type == TOKEN_INPUT || 
-                 tokens[i-1].type == TOKEN_OUTPUT || 
-                 tokens[i-1].type == TOKEN_DOUBLE_OUTPUT)) {
-                continue; // Skip redirection filenames
-            }
-            args[arg_count] = tokens[i].value;
-            arg_count++;
-        }
+    // Build the argument vector (skip redirection tokens and filenames)
+    int arg_count;
+    char **args = build_arg_vector(cmd_start + assignments, cmd_end, &arg_count);
+    if (args == NULL) {
+        fflush(stdout);
+        _exit(1);
     }
-    args[arg_count] = NULL;
     
     if (arg_count == 0) {
         printf("Error: No command found in pipeline segment\n");
-        exit(1);
+        fflush(stdout);
+        _exit(1);
     }
     
     // Set up pipe connections first (before file redirections)
     if (pipe_in != -1) {
         if (dup2(pipe_in, STDIN_FILENO) == -1) {
             perror("dup2 pipe input");
-            exit(1);
+            fflush(stdout);
+            _exit(1);
         }
         close(pipe_in);
+        // Builtins read stdin through stdio: drop input buffered by the shell
+        __fpurge(stdin);
     } else {
         // No pipe input - check if this command expects input and provide empty input
         // Commands like 'wc', 'grep', 'cat' without arguments expect stdin input
@@ -114,20 +112,23 @@ void execute_command_in_pipeline(int cmd_start, int cmd_end, int pipe_in, int pi
     if (pipe_out != -1) {
         if (dup2(pipe_out, STDOUT_FILENO) == -1) {
             perror("dup2 pipe output");
-            exit(1);
+            fflush(stdout);
+            _exit(1);
         }
         close(pipe_out);
     }
 
     // Set up file redirections (these can override pipe connections if specified)
-    if (setup_input_redirection(cmd_start, cmd_end) == -1 ||
-        setup_output_redirection(cmd_start, cmd_end) == -1) {
-        exit(1);
+    if (setup_redirections(cmd_start, cmd_end) == -1) {
+        fflush(stdout);
+        _exit(1);
     }
 
     // Handle built-in commands that can participate in pipes
+    Command *command;
     if (strcmp(args[0], "exit") == 0) {
-        exit(0);
+        fflush(stdout);
+        _exit(0);
     } else if (strcmp(args[0], "pwd") == 0) {
         char cwd[MAX_PATH_LEN];
         if (getcwd(cwd, sizeof(cwd)) != NULL) {
@@ -135,41 +136,25 @@ void execute_command_in_pipeline(int cmd_start, int cmd_end, int pipe_in, int pi
         } else {
             perror("pwd");
         }
-        exit(0);
-    } else if (strcmp(args[0], "reveal") == 0) {
-        // Create temporary tokens for reveal
-        Token original_tokens[1024];
-        int original_count = token_count;
-        
-        // Save original tokens
-        memcpy(original_tokens, tokens, sizeof(Token) * token_count);
-        
-        // Copy segment tokens to the beginning of tokens array
-        int segment_size = cmd_end - cmd_start;
-        for (int i = 0; i < segment_size; i++) {
-            tokens[i] = original_tokens[cmd_start + i];
-        }
-        tokens[segment_size].type = TOKEN_END;
-        tokens[segment_size].value[0] = '\0';
-        token_count = segment_size;
+        fflush(stdout);
+        _exit(0);
+    } else if ((command = find_command(args[0])) != NULL && (command->function != NULL || command->redirect)) {
+        // Functions and builtins that print run in this child like a command:
+        // move the segment (after any NAME=value words) to the front
+        int segment_size = cmd_end - cmd_start - assignments;
+        memmove(tokens, tokens + cmd_start + assignments, sizeof(Token) * segment_size);
+        terminate_tokens(segment_size);
         
-        // Execute reveal (home directory not available in pipeline, use NULL)
-        execute_reveal(home_directory);
+        // The pipe and file redirections are already in place
+        int status = run_command(command, home_directory);
         
-        // Restore original tokens
-        memcpy(tokens, original_tokens, sizeof(Token) * original_count);
-        token_count = original_count;
-        
-        exit(0);
-    } else if (strcmp(args[0], "activities") == 0) {
-        execute_activities();
-        exit(0);
+        // _exit: flushing the shared stdin stream would move the shell's input
+        fflush(stdout);
+        _exit(status);
     }
 
-    // Execute the external command
-    execvp(args[0], args);
-    printf("Command not found!\n"); // If execvp returns, there was an error
-    exit(1);
+    // Execute the external command (or its batches)
+    exec_command(args, options);
 }
 
 //LLM GENERATED CODE STARTS HERE
@@ -184,6 +169,7 @@ void execute_command_in_pipeline(int cmd_start, int cmd_end, int pipe_in, int pi
  * - Redirects stdout of command[i] to write end of pipe[i]
  * - Redirects stdin of command[i+1] to read end of pipe[i]
  * - Parent waits for all commands to complete
+ * - All stages run in one process group that gets the terminal
  * - File redirection works together with pipes
  * - Attempts to run remaining commands even if one fails
  */
@@ -202,10 +188,18 @@ int execute_pipeline(const char* home_directory) {
     
     // If only one segment and no pipes, use regular command execution
     if (num_segments == 1) {
-        free(segments);
         return execute_command();
     }
     
+    // A `job`, `limit` or `timeout` prefix on the first command applies to
+    // every stage, and cgroup caps and the timeout to the pipeline as a whole
+    JobOptions options;
+    segments[0] = parse_job_options(segments[0], segments[1], &options);
+    if (segments[0] == -1) {
+        return 1;
+    }
+    apply_default_timeout(&options);
+    
     // Create pipes for pipeline
     int pipes[num_segments - 1][2]; // Need (num_segments - 1) pipes
     pid_t pids[num_segments];        // Store child PIDs
@@ -214,11 +208,15 @@ int execute_pipeline(const char* home_directory) {
     for (int i = 0; i < num_segments - 1; i++) {
         if (pipe(pipes[i]) == -1) {
             perror("pipe");
-            free(segments);
             return -1;
         }
     }
     
+    int cgroup_fd = create_foreground_cgroup(&options);
+    
+    // All stages share one process group, led by the first one forked
+    pid_t pgid = 0;
+    
     // Fork and execute each command in the pipeline
     for (int i = 0; i < num_segments; i++) {
         int cmd_start = segments[i * 2];
@@ -228,6 +226,7 @@ int execute_pipeline(const char* home_directory) {
         
         if (pids[i] == 0) {
             // Child process
+            enter_job_process_group(pgid, 1);
             
             // Close all pipe file descriptors that this process doesn't need
             for (int j = 0; j < num_segments - 1; j++) {
@@ -248,15 +247,25 @@ int execute_pipeline(const char* home_directory) {
             int pipe_in = (i > 0) ? pipes[i - 1][0] : -1;           // Input from previous pipe
             int pipe_out = (i < num_segments - 1) ? pipes[i][1] : -1; // Output to next pipe
             
+            join_job_cgroup(cgroup_fd);
+            apply_job_options(&options);
+            
             // Execute the command with appropriate pipe connections
-            execute_command_in_pipeline(cmd_start, cmd_end, pipe_in, pipe_out, home_directory);
+            execute_command_in_pipeline(cmd_start, cmd_end, pipe_in, pipe_out, i == 0 ? &options : NULL,
+                                        home_directory);
             
-            // Should not reach here if execvp succeeds
-            exit(1);
+            // Should not reach here if the exec succeeds
+            fflush(stdout);
+            _exit(1);
             
         } else if (pids[i] == -1) {
             perror("fork");
             // Continue trying to fork other processes
+        } else {
+            if (pgid == 0) {
+                pgid = pids[i];
+            }
+            setpgid(pids[i], pgid);
         }
     }
     
@@ -266,23 +275,52 @@ int execute_pipeline(const char* home_directory) {
         close(pipes[i][1]);
     }
     
-    // Wait for all child processes to complete
+    if (pgid == 0) {
+        remove_job_cgroup(cgroup_fd);
+        return -1;
+    }
+    
+    // The terminal goes to the whole pipeline, so Ctrl-C and Ctrl-Z reach
+    // every stage directly
+    give_terminal_to(pgid, NULL);
+    char *command = reconstruct_command_from_segment(segments[0], segments[num_segments * 2 - 1]);
+    set_foreground_process(pgid, command);
+    CommandTimer *timer = create_command_timer(&pgid, 1, &options);
+    
+    // Wait for all stages to complete; the last one's status is the pipeline's
+    int status;
+    int stopped = wait_for_job(pgid, pids[num_segments - 1], &status);
+    if (stopped == -1) {
+        perror("waitpid");
+    }
+    struct termios job_modes;
+    int has_job_modes = reclaim_terminal(status, &job_modes);
+    
+    // A stopped pipeline becomes one job, like a stopped command
+    int job_index = stopped == 1 ? add_stopped_foreground_job(pgid) : -1;
+    clear_foreground_process();
+    
     int final_status = 0;
-    for (int i = 0; i < num_segments; i++) {
-        if (pids[i] > 0) { // Only wait for successfully forked processes
-            int status;
-            if (waitpid(pids[i], &status, 0) == -1) {
-                perror("waitpid");
-            } else {
-                // Keep track of the last command's exit status
-                if (i == num_segments - 1) {
-                    final_status = WEXITSTATUS(status);
-                }
-            }
+    if (stopped == 1) {
+        final_status = 128 + WSTOPSIG(status);
+    }
+    if (job_index != -1) {
+        background_jobs[job_index].cgroup_fd = cgroup_fd;
+        background_jobs[job_index].timer = timer;
+        background_jobs[job_index].terminal_modes = job_modes;
+        background_jobs[job_index].has_terminal_modes = has_job_modes;
+    } else {
+        if (WIFEXITED(status)) {
+            final_status = WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+            final_status = 128 + WTERMSIG(status);
         }
+        int timeout_status = release_command_timer(timer);
+        if (timeout_status != 0) {
+            final_status = timeout_status;
+        }
+        remove_job_cgroup(cgroup_fd);
     }
-    
-    free(segments);
     return final_status;
 }
 
@@ -293,4 +331,50 @@ int execute_pipeline(const char* home_directory) {
 int has_pipes(void) {
     return count_pipes(0, token_count) > 0;
 }
-//LLM GENERATED CODE ENDS HERE
\ No newline at end of file
+//LLM GENERATED CODE ENDS HERE
+/**
+ * @brief Start the command of a <(...) or >(...) process substitution
+ * @param direction '<' if the consumer reads the command's output, '>' if it feeds its input
+ * @param command Substitution text, kept in the job table
+ * @param home_directory Shell home directory for built-in commands
+ * @return The shell's end of the pipe (passed on as /dev/fd/N), -1 on error
+ * 
+ * Like a pipeline stage, the command (already in the current tokens)
+ * runs in a forked shell with one end of a pipe as its stdout or stdin;
+ * the consumer gets the other end. It runs in its own process group
+ * without the terminal and is tracked as a hidden job, so it is reaped
+ * with the other jobs however long it outlives the consumer.
+ */
+int start_process_substitution(int direction, const char *command, const char *home_directory) {
+    int fds[2];
+    if (pipe(fds) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    int child_end = direction == '<' ? 1 : 0;
+    int shell_end = 1 - child_end;
+    fflush(stdout);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        enter_job_process_group(0, 0);
+        // Ends meant for the consumer must not keep this command's pipes open
+        release_process_substitutions(0);
+        close(fds[shell_end]);
+        dup2(fds[child_end], direction == '<' ? STDOUT_FILENO : STDIN_FILENO);
+        close(fds[child_end]);
+        run_substitution_command(home_directory);
+        fflush(stdout);
+        _exit(0);
+    }
+    
+    close(fds[child_end]);
+    if (pid == -1) {
+        perror("fork");
+        close(fds[shell_end]);
+        return -1;
+    }
+    setpgid(pid, pid);
+    add_hidden_job(pid, command);
+    return fds[shell_end];
+}
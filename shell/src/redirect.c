@@ -0,0 +1,401 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define MAX_REDIRECT_FD 65535
+
+/**
+ * @brief Check whether a token is a redirection operator
+ * @param type Token type
+ * @return 1 for <, >, >>, n<>, n<&, n>&, &>, &>>, <<< and <<, 0 otherwise
+ *
+ * Every redirection operator is followed by exactly one word: a file
+ * name, a descriptor number or -, a here-string or a heredoc delimiter.
+ */
+int is_redirection_token(TokenType type) {
+    switch (type) {
+    case TOKEN_INPUT:
+    case TOKEN_OUTPUT:
+    case TOKEN_DOUBLE_OUTPUT:
+    case TOKEN_READ_WRITE:
+    case TOKEN_DUP_INPUT:
+    case TOKEN_DUP_OUTPUT:
+    case TOKEN_OUTPUT_ALL:
+    case TOKEN_APPEND_ALL:
+    case TOKEN_HERE_STRING:
+    case TOKEN_HEREDOC:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Check whether a word token is the operand of a redirection
+ * @param index Index of the token
+ * @param start_index First token of the command (nothing before it counts)
+ * @return 1 if the token belongs to the preceding redirection, not to argv
+ */
+int is_redirect_filename(int index, int start_index) {
+    return index > start_index && is_redirection_token(tokens[index - 1].type);
+}
+
+/**
+ * @brief Get the descriptor a redirection applies to
+ * @param token Redirection operator token, e.g. "2>" or "<"
+ * @return The explicit descriptor number, or 0/1 for input/output operators
+ */
+static int redirection_target_fd(const Token *token) {
+    if (isdigit((unsigned char)token->value[0])) {
+        return atoi(token->value);
+    }
+    switch (token->type) {
+    case TOKEN_INPUT:
+    case TOKEN_READ_WRITE:
+    case TOKEN_DUP_INPUT:
+    case TOKEN_HERE_STRING:
+    case TOKEN_HEREDOC:
+        return STDIN_FILENO;
+    default:
+        return STDOUT_FILENO;
+    }
+}
+
+/**
+ * @brief Check whether a command redirects a given descriptor
+ * @param start_index Starting index in the tokens array
+ * @param end_index Ending index in the tokens array
+ * @param fd Descriptor to look for (&> and &>> count for 1 and 2)
+ * @return 1 if some redirection replaces or closes fd, 0 otherwise
+ */
+int redirects_fd(int start_index, int end_index, int fd) {
+    for (int i = start_index; i < end_index; i++) {
+        if (!is_redirection_token(tokens[i].type)) {
+            continue;
+        }
+        int target = redirection_target_fd(&tokens[i]);
+        if (target == fd || ((tokens[i].type == TOKEN_OUTPUT_ALL || tokens[i].type == TOKEN_APPEND_ALL) &&
+                             fd == STDERR_FILENO)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Create an anonymous in-memory file holding the given text
+ * @param name Name shown in /proc/PID/fd (debugging only)
+ * @param text Contents
+ * @param length Length of text
+ * @return Descriptor positioned at the start, -1 on error
+ *
+ * Here-strings and heredocs live in a memfd instead of a temp file, so
+ * they never touch the disk and vanish with their last descriptor.
+ */
+int create_text_memfd(const char *name, const char *text, size_t length) {
+    int fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd == -1) {
+        perror("memfd_create");
+        return -1;
+    }
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = write(fd, text + written, length - written);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("heredoc write");
+            close(fd);
+            return -1;
+        }
+        written += n;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/**
+ * @brief Parse the word after n>& or n<&
+ * @return Source descriptor, -2 for "-" (close), -1 if not a valid descriptor
+ */
+static int parse_dup_source(const char *word) {
+    if (strcmp(word, "-") == 0) {
+        return -2;
+    }
+    char *end;
+    long fd = strtol(word, &end, 10);
+    if (word[0] == '\0' || *end != '\0' || fd < 0 || fd > MAX_REDIRECT_FD) {
+        return -1;
+    }
+    return (int)fd;
+}
+
+/**
+ * @brief Open the descriptor a single redirection provides
+ * @param token Redirection operator
+ * @param word The operator's operand
+ * @return New descriptor, -2 to close the target, -1 on error (message printed)
+ */
+static int open_redirection_source(const Token *token, const char *word) {
+    int fd;
+    switch (token->type) {
+    case TOKEN_INPUT:
+        fd = open(word, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            printf("No such file or directory\n");
+        }
+        return fd;
+    case TOKEN_READ_WRITE:
+        fd = open(word, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            printf("Unable to open file for reading and writing\n");
+        }
+        return fd;
+    case TOKEN_OUTPUT:
+    case TOKEN_OUTPUT_ALL:
+        fd = open(word, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            printf("Unable to create file for writing\n");
+        }
+        return fd;
+    case TOKEN_DOUBLE_OUTPUT:
+    case TOKEN_APPEND_ALL:
+        fd = open(word, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            printf("Unable to create file for writing\n");
+        }
+        return fd;
+    case TOKEN_DUP_INPUT:
+    case TOKEN_DUP_OUTPUT: {
+        int source = parse_dup_source(word);
+        if (source == -2) {
+            return -2;
+        }
+        // Duplicate so that closing it later cannot affect the source
+        fd = source >= 0 ? fcntl(source, F_DUPFD_CLOEXEC, 0) : -1;
+        if (fd == -1) {
+            printf("%s: Bad file descriptor\n", word);
+        }
+        return fd;
+    }
+    case TOKEN_HERE_STRING: {
+        // Like bash, a here-string ends with a newline
+        size_t length = strlen(word);
+        char *buffer = arena_alloc(length + 1);
+        if (buffer == NULL) {
+            return -1;
+        }
+        memcpy(buffer, word, length);
+        buffer[length] = '\n';
+        return create_text_memfd("here-string", buffer, length + 1);
+    }
+    case TOKEN_HEREDOC:
+        if (token->heredoc_fd == -1) {
+            printf("Error: Missing heredoc body\n");
+            return -1;
+        }
+        fd = fcntl(token->heredoc_fd, F_DUPFD_CLOEXEC, 0);
+        if (fd != -1) {
+            // The copy shares its offset; start from the top for every command
+            lseek(fd, 0, SEEK_SET);
+        }
+        return fd;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * @brief Apply all redirections of a command, left to right
+ * @param start_index Starting index in the tokens array
+ * @param end_index Ending index in the tokens array
+ * @return 0 on success, -1 on error
+ *
+ * Supported forms (n defaults to 0 for input and 1 for output):
+ * - n< file, n> file, n>> file, n<> file (read/write, created if missing)
+ * - &> file, &>> file (stdout and stderr)
+ * - n>&m, n<&m (duplicate m), n>&-, n<&- (close)
+ * - <<< word (here-string), << DELIM (heredoc, see collect_heredocs())
+ *
+ * Order matters as in any shell: `> f 2>&1` sends both streams to f,
+ * while `2>&1 > f` leaves stderr on the old stdout.
+ */
+int setup_redirections(int start_index, int end_index) {
+    for (int i = start_index; i < end_index; i++) {
+        if (!is_redirection_token(tokens[i].type)) {
+            continue;
+        }
+        if (i + 1 >= end_index || tokens[i + 1].type != TOKEN_NAME) {
+            printf("Error: Missing filename after redirection\n");
+            return -1;
+        }
+
+        const Token *token = &tokens[i];
+        int target = redirection_target_fd(token);
+        int source = open_redirection_source(token, tokens[i + 1].value);
+        i++; // Skip the operand in next iteration
+
+        if (source == -2) {
+            close(target);
+            continue;
+        }
+        if (source == -1) {
+            return -1;
+        }
+        int both = token->type == TOKEN_OUTPUT_ALL || token->type == TOKEN_APPEND_ALL;
+        if (source == target) {
+            // The target was closed and open() reused it: just keep it across exec
+            fcntl(target, F_SETFD, 0);
+            if (both && dup2(source, STDERR_FILENO) == -1) {
+                perror("dup2 redirection");
+                return -1;
+            }
+            continue;
+        }
+        if (dup2(source, target) == -1 || (both && dup2(source, STDERR_FILENO) == -1)) {
+            perror("dup2 redirection");
+            close(source);
+            return -1;
+        }
+        close(source);
+    }
+    return 0;
+}
+
+/**
+ * @brief Save the descriptors a builtin's redirections will replace
+ * @param start_index Starting index in the tokens array
+ * @param end_index Ending index in the tokens array
+ * @param saved Array of at least MAX_SAVED_FDS entries
+ * @return Number of entries filled
+ *
+ * Builtins run inside the shell, so whatever setup_redirections() changes
+ * must be put back with restore_redirected_fds() afterwards.
+ */
+int save_redirected_fds(int start_index, int end_index, SavedFd *saved) {
+    int count = 0;
+    for (int i = start_index; i < end_index; i++) {
+        if (!is_redirection_token(tokens[i].type)) {
+            continue;
+        }
+        int targets[2] = { redirection_target_fd(&tokens[i]), -1 };
+        if (tokens[i].type == TOKEN_OUTPUT_ALL || tokens[i].type == TOKEN_APPEND_ALL) {
+            targets[1] = STDERR_FILENO;
+        }
+        for (int t = 0; t < 2 && targets[t] != -1; t++) {
+            int known = 0;
+            for (int s = 0; s < count; s++) {
+                known |= saved[s].fd == targets[t];
+            }
+            if (!known && count < MAX_SAVED_FDS) {
+                saved[count].fd = targets[t];
+                // -1 means the descriptor was closed and must be closed again
+                saved[count].copy = fcntl(targets[t], F_DUPFD_CLOEXEC, 10);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Undo a builtin's redirections
+ * @param saved Entries from save_redirected_fds()
+ * @param count Number of entries
+ */
+void restore_redirected_fds(SavedFd *saved, int count) {
+    fflush(stdout);
+    for (int s = count - 1; s >= 0; s--) {
+        if (saved[s].copy == -1) {
+            close(saved[s].fd);
+        } else {
+            dup2(saved[s].copy, saved[s].fd);
+            close(saved[s].copy);
+        }
+    }
+}
+
+/**
+ * @brief Read the bodies of all << heredocs on the current line
+ * @return 0 on success, -1 if input ended before a delimiter
+ *
+ * Called once a line has parsed, before anything runs: the body lines
+ * follow the command line on the shell's own input. Each body goes into
+ * a memfd kept in the operator token, so forked commands and builtins
+ * simply dup it. A "> " prompt is shown on a terminal. Heredocs that
+ * already have a body (earlier lines of a compound command) are skipped.
+ *
+ * The body is kept unexpanded: expansion happens each time the command
+ * runs, so `x=1; cat <<EOF` sees the new x and a loop sees each value.
+ */
+int collect_heredocs(void) {
+    for (int i = 0; i + 1 < token_count; i++) {
+        if (tokens[i].type != TOKEN_HEREDOC || tokens[i + 1].type != TOKEN_NAME || tokens[i].heredoc_fd != -1) {
+            continue;
+        }
+        // The body is stored as typed; expand_words() expands it if the delimiter is unquoted
+        char *delimiter = arena_strndup(tokens[i + 1].value, strlen(tokens[i + 1].value));
+        if (delimiter == NULL) {
+            return -1;
+        }
+        remove_quotes(delimiter);
+        size_t delimiter_length = strlen(delimiter);
+        int interactive = isatty(STDIN_FILENO);
+
+        char *body = NULL;
+        size_t body_length = 0;
+        FILE *stream = open_memstream(&body, &body_length);
+        if (stream == NULL) {
+            perror("open_memstream");
+            return -1;
+        }
+
+        char *line = NULL;
+        size_t line_size = 0;
+        int terminated = 0;
+        while (1) {
+            if (interactive) {
+                printf("> ");
+                fflush(stdout);
+            }
+            ssize_t read = getline(&line, &line_size, stdin);
+            if (read == -1) {
+                break;
+            }
+            size_t length = read;
+            if (strncmp(line, delimiter, delimiter_length) == 0 &&
+                (line[delimiter_length] == '\n' || line[delimiter_length] == '\0')) {
+                terminated = 1;
+                break;
+            }
+            fwrite(line, 1, length, stream);
+        }
+        free(line);
+        fclose(stream);
+
+        if (!terminated) {
+            printf("Warning: heredoc ended by end of input (wanted `%s')\n", delimiter);
+        }
+        tokens[i].heredoc_fd = create_text_memfd("heredoc", body, body_length);
+        free(body);
+        if (tokens[i].heredoc_fd == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Close the heredoc memfds of the current line
+ */
+void release_heredocs(void) {
+    for (int i = 0; i < token_count; i++) {
+        if (tokens[i].type == TOKEN_HEREDOC && tokens[i].heredoc_fd != -1) {
+            close(tokens[i].heredoc_fd);
+            tokens[i].heredoc_fd = -1;
+        }
+    }
+}
@@ -59,9 +59,7 @@ int get_reveal_target_path(const char* home_directory, int arg_index, char *targ
     for (int i = arg_index; i < token_count; i++) {
         if (tokens[i].type == TOKEN_NAME) {
             // Check if this is a redirection filename
-            if (i > 0 && (tokens[i-1].type == TOKEN_OUTPUT || 
-                         tokens[i-1].type == TOKEN_DOUBLE_OUTPUT || 
-                         tokens[i-1].type == TOKEN_INPUT)) {
+            if (is_redirect_filename(i, 0)) {
                 continue; // Skip redirection filenames
             }
             arg = tokens[i].value;
@@ -107,17 +105,17 @@ int get_reveal_target_path(const char* home_directory, int arg_index, char *targ
         }
     } else {
         // It's a regular path (absolute or relative)
-        if (arg[0] == '/') {
-            // Absolute path
-            strcpy(target_path, arg);
-        } else {
-            // Relative path
-            if (getcwd(target_path, MAX_PATH_LEN) == NULL) {
-                perror("getcwd error");
-                return -1;
-            }
-            strcat(target_path, "/");
-            strcat(target_path, arg);
+        char cwd[MAX_PATH_LEN] = "";
+        if (arg[0] != '/' && getcwd(cwd, sizeof(cwd)) == NULL) {
+            perror("getcwd error");
+            return -1;
+        }
+        // Words have no length limit, but paths do
+        int length = arg[0] == '/' ? snprintf(target_path, MAX_PATH_LEN, "%s", arg)
+                                   : snprintf(target_path, MAX_PATH_LEN, "%s/%s", cwd, arg);
+        if (length >= MAX_PATH_LEN) {
+            printf("No such directory!\n");
+            return -1;
         }
     }
     
@@ -140,9 +138,7 @@ void execute_reveal(const char* home_directory) {
     for (int i = arg_index; i < token_count; i++) {
         if (tokens[i].type == TOKEN_NAME) {
             // Check if this is a redirection filename
-            if (i > 0 && (tokens[i-1].type == TOKEN_OUTPUT || 
-                         tokens[i-1].type == TOKEN_DOUBLE_OUTPUT || 
-                         tokens[i-1].type == TOKEN_INPUT)) {
+            if (is_redirect_filename(i, 0)) {
                 continue; // Skip redirection filenames
             }
             dir_args++;
@@ -166,10 +162,12 @@ void execute_reveal(const char* home_directory) {
         return;
     }
     
-    // Read directory entries
+    // Read directory entries; names and the list live in the arena, so
+    // nothing is freed one entry at a time
     struct dirent *entry;
-    char **entries = malloc(1000 * sizeof(char*)); // Allocate for up to 1000 entries
+    char **entries = NULL;
     int entry_count = 0;
+    int entry_capacity = 0;
     
     while ((entry = readdir(dir)) != NULL) {
         // Skip hidden files if -a flag is not set
@@ -177,16 +175,32 @@ void execute_reveal(const char* home_directory) {
             continue;
         }
         
-        // Allocate memory for entry name and copy it
-        entries[entry_count] = malloc(strlen(entry->d_name) + 1);
-        strcpy(entries[entry_count], entry->d_name);
+        // Double the list when it is full (the old one stays in the arena)
+        if (entry_count == entry_capacity) {
+            entry_capacity = entry_capacity ? entry_capacity * 2 : 256;
+            char **grown = arena_alloc(entry_capacity * sizeof(char*));
+            if (grown == NULL) {
+                break;
+            }
+            if (entry_count > 0) {
+                memcpy(grown, entries, entry_count * sizeof(char*));
+            }
+            entries = grown;
+        }
+        
+        entries[entry_count] = arena_strndup(entry->d_name, strlen(entry->d_name));
+        if (entries[entry_count] == NULL) {
+            break;
+        }
         entry_count++;
     }
     
     closedir(dir);
     
     // Sort entries lexicographically
-    qsort(entries, entry_count, sizeof(char*), compare_entries);
+    if (entry_count > 1) {
+        qsort(entries, entry_count, sizeof(char*), compare_entries);
+    }
     
     // Display entries
     if (line_format) {
@@ -206,10 +220,4 @@ void execute_reveal(const char* home_directory) {
             printf("\n");
         }
     }
-    
-    // Free allocated memory
-    for (int i = 0; i < entry_count; i++) {
-        free(entries[i]);
-    }
-    free(entries);
 }
\ No newline at end of file
@@ -3,7 +3,15 @@
 
 //LLM Generated Code Begins Here
 /**
- * @brief Find segments of commands separated by semicolons and ampersands
+ * @brief Check whether a token separates commands (; & && ||)
+ */
+static int is_command_separator(TokenType type) {
+    return type == TOKEN_SEMICOLON || type == TOKEN_AMPERSAND ||
+           type == TOKEN_AND || type == TOKEN_OR;
+}
+
+/**
+ * @brief Find segments of commands separated by ;, &, && and ||
  * @param segments Pointer to array that will hold segment boundaries (will be allocated)
  * @param num_segments Pointer to store number of segments found
  * @param separators Pointer to array that will hold the separators between segments
@@ -11,30 +19,27 @@
  * 
  * Each segment is represented by [start_index, end_index] pairs
  * Separators array contains the TokenType that comes after each segment
- * Caller is responsible for freeing the segments and separators arrays
+ * Both arrays live in the arena, so they go when the line is done
  */
 int find_command_segments(int **segments, int *num_segments, TokenType **separators) {
     *num_segments = 1; // At least one command
     
-    // Count the number of semicolons and ampersands to determine number of segments
+    // Count the number of separators to determine number of segments
     for (int i = 0; i < token_count; i++) {
-        if (tokens[i].type == TOKEN_SEMICOLON || tokens[i].type == TOKEN_AMPERSAND) {
+        if (is_command_separator(tokens[i].type)) {
             (*num_segments)++;
         }
     }
     
     // Allocate memory for segment boundaries (2 integers per segment: start, end)
-    *segments = malloc(*num_segments * 2 * sizeof(int));
+    *segments = arena_alloc(*num_segments * 2 * sizeof(int));
     if (*segments == NULL) {
-        perror("malloc segments");
         return -1;
     }
     
     // Allocate memory for separators (one less than segments, plus one for end marker)
-    *separators = malloc(*num_segments * sizeof(TokenType));
+    *separators = arena_alloc(*num_segments * sizeof(TokenType));
     if (*separators == NULL) {
-        perror("malloc separators");
-        free(*segments);
         return -1;
     }
     
@@ -43,7 +48,7 @@ int find_command_segments(int **segments, int *num_segments, TokenType **separat
     
     for (int i = 0; i <= token_count; i++) {
         // Found a separator or reached end of tokens
-        if (i == token_count || tokens[i].type == TOKEN_SEMICOLON || tokens[i].type == TOKEN_AMPERSAND) {
+        if (i == token_count || is_command_separator(tokens[i].type)) {
             (*segments)[segment_index * 2] = current_start;     // start index
             (*segments)[segment_index * 2 + 1] = i;             // end index
             
@@ -65,7 +70,11 @@ int find_command_segments(int **segments, int *num_segments, TokenType **separat
  * @brief Reconstruct command string from token segment
  * @param start_index Starting token index
  * @param end_index Ending token index
- * @return Dynamically allocated string containing the command (caller must free)
+ * @return Command text in the arena (valid until the arena is released
+ *         past it), NULL if the segment is empty or out of memory
+ *
+ * Each token is copied once to the end of the text built so far, so the
+ * cost is linear in the length of the command.
  */
 char* reconstruct_command_from_segment(int start_index, int end_index) {
     if (start_index >= end_index) {
@@ -73,29 +82,66 @@ char* reconstruct_command_from_segment(int start_index, int end_index) {
     }
     
     // Calculate required buffer size
-    int total_len = 0;
+    size_t total_len = 0;
     for (int i = start_index; i < end_index; i++) {
         total_len += strlen(tokens[i].value) + 1; // +1 for space or null terminator
     }
     
-    char *command = malloc(total_len + 1);
+    char *command = arena_alloc(total_len);
     if (command == NULL) {
         return NULL;
     }
     
-    command[0] = '\0';
-    
     // Reconstruct command with proper spacing
+    char *end = command;
     for (int i = start_index; i < end_index; i++) {
         if (i > start_index) {
-            strcat(command, " ");
+            *end++ = ' ';
         }
-        strcat(command, tokens[i].value);
+        size_t length = strlen(tokens[i].value);
+        memcpy(end, tokens[i].value, length);
+        end += length;
     }
+    *end = '\0';
     
     return command;
 }
 
+/**
+ * @brief Run an in-process builtin or function with the segment's redirections applied
+ * @param command Builtin or function to run against the current tokens
+ * @param home_directory Shell home directory
+ * @return Exit status of the command, or 1 if a redirection failed
+ */
+static int run_builtin_with_redirection(Command *command, const char* home_directory) {
+    SavedFd saved[MAX_SAVED_FDS];
+    int saved_count = save_redirected_fds(0, token_count, saved);
+    FILE *saved_stream = stdin;
+    int result;
+    
+    if (setup_redirections(0, token_count) == -1) {
+        result = 1;
+    } else {
+        // Read redirected input through its own stream so that input the
+        // shell has already buffered from its own stdin is not lost
+        if (has_input_redirection(0, token_count)) {
+            FILE *redirected = fdopen(dup(STDIN_FILENO), "r");
+            if (redirected != NULL) {
+                stdin = redirected;
+            }
+        }
+        result = run_command(command, home_directory);
+        fflush(stdout);
+    }
+    
+    if (stdin != saved_stream) {
+        fclose(stdin);
+        stdin = saved_stream;
+    }
+    restore_redirected_fds(saved, saved_count);
+    return result;
+}
+
 /**
  * @brief Execute a single command segment
  * @param start_index Starting token index
@@ -108,101 +154,235 @@ int execute_single_segment(int start_index, int end_index, const char* home_dire
         return 0; // Empty segment
     }
     
-    // Create a temporary tokens array for this segment
-    Token original_tokens[1024];
+    // Save the original tokens (in the arena, not on the stack: functions nest this call)
+    Token *original_tokens = arena_alloc(sizeof(Token) * (token_count + 1));
+    if (original_tokens == NULL) {
+        return 1;
+    }
     int original_count = token_count;
-    
-    // Save original tokens
-    memcpy(original_tokens, tokens, sizeof(Token) * token_count);
+    memcpy(original_tokens, tokens, sizeof(Token) * (token_count + 1));
     
     // Copy segment tokens to the beginning of tokens array
     int segment_size = end_index - start_index;
     for (int i = 0; i < segment_size; i++) {
         tokens[i] = original_tokens[start_index + i];
     }
-    tokens[segment_size].type = TOKEN_END;
-    tokens[segment_size].value[0] = '\0';
-    token_count = segment_size;
+    terminate_tokens(segment_size);
     
     int result = 0;
+    int substitutions = pending_process_substitutions();
+    int assignments = 0;
     
-    // Check if the segment contains pipes
-    if (has_pipes()) {
+    // Replace aliases, then variables, $(...) and `...` with their values
+    if (expand_aliases() == -1 || expand_words(home_directory) == -1) {
+        result = 1;
+    } else if (has_pipes()) {
         // Execute as pipeline
+        build_environment();
         result = execute_pipeline(home_directory);
+    } else if ((assignments = count_assignments(0, token_count)) == token_count) {
+        // NAME=value alone sets shell variables; its status is that of its last $(...)
+        apply_assignments(0, assignments, 0);
+        int substituted = last_substitution_status();
+        result = substituted == -1 ? 0 : substituted;
     } else {
-        // Check for built-in commands
+        // Builtins and functions are found by one lookup in the command table
+        Command *command = NULL;
+        if (tokens[assignments].type == TOKEN_NAME) {
+            command = find_command(tokens[assignments].value);
+        }
+        int scoped = assignments > 0 && command != NULL && command->function != NULL;
+        
+        // NAME=value before a command only goes into that command's
+        // environment (a function's variables while it runs), so the
+        // dispatch below sees the command itself
+        if (scoped && push_local_scope() == 0) {
+            apply_local_assignments(0, assignments);
+        } else if (assignments > 0) {
+            scoped = 0;
+            set_command_assignments(0, assignments);
+        }
+        if (assignments > 0) {
+            memmove(tokens, tokens + assignments, sizeof(Token) * (token_count - assignments + 1));
+            token_count -= assignments;
+        }
+        build_environment();
+        
         if (token_count > 0 && tokens[0].type == TOKEN_NAME) {
-            if (strcmp(tokens[0].value, "hop") == 0) {
-                execute_hop(home_directory);
-                result = 0;
-            } else if (strcmp(tokens[0].value, "reveal") == 0) {
-                // Save original stdout for built-in commands with redirection
-                int saved_stdout = -1;
-                if (has_output_redirection(0, token_count)) {
-                    saved_stdout = dup(STDOUT_FILENO);
-                    if (setup_output_redirection(0, token_count) == -1) {
-                        if (saved_stdout != -1) close(saved_stdout);
-                        result = -1;
-                    } else {
-                        execute_reveal(home_directory);
-                        // Restore original stdout
-                        dup2(saved_stdout, STDOUT_FILENO);
-                        close(saved_stdout);
-                        result = 0;
-                    }
-                } else {
-                    execute_reveal(home_directory);
-                    result = 0;
-                }
-            } else if (strcmp(tokens[0].value, "log") == 0) {
-                execute_log(home_directory);
-                result = 0;
-            } else if (strcmp(tokens[0].value, "activities") == 0) {
-                // Save original stdout for built-in commands with redirection
-                int saved_stdout = -1;
-                if (has_output_redirection(0, token_count)) {
-                    saved_stdout = dup(STDOUT_FILENO);
-                    if (setup_output_redirection(0, token_count) == -1) {
-                        if (saved_stdout != -1) close(saved_stdout);
-                        result = -1;
-                    } else {
-                        execute_activities();
-                        // Restore original stdout
-                        dup2(saved_stdout, STDOUT_FILENO);
-                        close(saved_stdout);
-                        result = 0;
-                    }
-                } else {
-                    execute_activities();
-                    result = 0;
-                }
-            } else if (strcmp(tokens[0].value, "ping") == 0) {
-                execute_ping();
-                result = 0;
-            } else if (strcmp(tokens[0].value, "fg") == 0) {
-                execute_fg();
-                result = 0;
-            } else if (strcmp(tokens[0].value, "bg") == 0) {
-                execute_bg();
-                result = 0;
-            } else if (strcmp(tokens[0].value, "exit") == 0) {
-                printf("Shell terminated.\n");
-                exit(0);
+            if (command != NULL && (command->function != NULL || command->redirect)) {
+                result = run_builtin_with_redirection(command, home_directory);
+            } else if (command != NULL && command->builtin != NULL) {
+                result = run_command(command, home_directory);
             } else {
                 // Execute external command
                 result = execute_command();
             }
         }
+        if (scoped) {
+            pop_local_scope();
+        }
+        clear_command_assignments();
     }
     
+    // The command is done with its <(...) and >(...) pipes
+    release_process_substitutions(substitutions);
+    
     // Restore original tokens
-    memcpy(tokens, original_tokens, sizeof(Token) * original_count);
+    memcpy(tokens, original_tokens, sizeof(Token) * (original_count + 1));
     token_count = original_count;
     
     return result;
 }
 
+/**
+ * @brief Run one command in the foreground, with its `time` prefixes
+ * @param start_index Starting token index
+ * @param end_index Ending token index
+ * @param home_directory Shell home directory for built-in commands
+ * @param active_timers Incremented for every `time` prefix that starts a timer
+ * @return Exit status of the command (also stored as $?)
+ */
+int execute_foreground_segment(int start_index, int end_index, const char* home_directory,
+                               int *active_timers) {
+    // Strip a leading `time` prefix and start measuring
+    int exec_start = start_index;
+    while (is_time_prefix(exec_start, end_index)) {
+        exec_start = begin_timing(exec_start, end_index);
+        if (exec_start == -1) {
+            break;
+        }
+        (*active_timers)++;
+    }
+    
+    int status = 0;
+    if (exec_start == -1) {
+        // Bad `time` flags
+        status = 2;
+    } else if (exec_start < end_index) {
+        status = execute_single_segment(exec_start, end_index, home_directory);
+    }
+    set_last_status(status);
+    return status;
+}
+
+/**
+ * @brief Run one command of a conditional list in the foreground
+ * @param start_index Starting token index
+ * @param end_index Ending token index
+ * @param home_directory Shell home directory for built-in commands
+ * @param active_timers Incremented for every `time` prefix that starts a timer
+ * @return Exit status of the command
+ */
+static int run_foreground_segment(int start_index, int end_index, const char* home_directory,
+                                  int *active_timers) {
+    if (start_index >= end_index) {
+        return 0; // Empty segment
+    }
+    
+    // Reconstruct command string for logging
+    char *command_str = reconstruct_command_from_segment(start_index, end_index);
+    
+    int status = execute_foreground_segment(start_index, end_index, home_directory, active_timers);
+    
+    // Log successful commands (but continue even if command failed)
+    if (command_str && should_log_command(command_str)) {
+        add_command_to_log(command_str);
+    }
+    
+    return status;
+}
+
+/**
+ * @brief Run a conditional list (`a && b || c`) with short-circuit evaluation
+ * @param segments Segment boundaries from find_command_segments()
+ * @param separators Separator after each segment
+ * @param first Index of the list's first segment
+ * @param last Index of the list's last segment
+ * @param home_directory Shell home directory for built-in commands
+ * @param active_timers Incremented for every `time` prefix that starts a timer
+ * @return Exit status of the last command that ran
+ * 
+ * A command after && only runs if the status so far is 0, one after ||
+ * only if it is not; a skipped command leaves the status unchanged, so
+ * `false && a || b` runs b.
+ */
+static int run_and_or_list(const int *segments, const TokenType *separators, int first, int last,
+                           const char* home_directory, int *active_timers) {
+    int status = 0;
+    for (int i = first; i <= last; i++) {
+        if (i > first && (separators[i - 1] == TOKEN_AND) != (status == 0)) {
+            continue;
+        }
+        status = run_foreground_segment(segments[i * 2], segments[i * 2 + 1], home_directory, active_timers);
+    }
+    return status;
+}
+
+/**
+ * @brief Start the current (expanded) tokens as a background job
+ * @param job_str Text the job is tracked under
+ * @param home_directory Shell home directory
+ *
+ * A shell function runs in a forked shell that is the job; any other
+ * command goes to execute_background_command().
+ */
+static void run_background_command(const char *job_str, const char* home_directory) {
+    int assignments = count_assignments(0, token_count);
+    Command *command = NULL;
+    if (assignments < token_count && tokens[assignments].type == TOKEN_NAME) {
+        command = find_command(tokens[assignments].value);
+    }
+    if (command == NULL || command->function == NULL) {
+        execute_background_command(0, token_count, job_str);
+        return;
+    }
+    fflush(stdout);
+    if (fork_background_subshell(job_str) == 0) {
+        apply_assignments(0, assignments, 1);
+        memmove(tokens, tokens + assignments, sizeof(Token) * (token_count - assignments + 1));
+        token_count -= assignments;
+        _exit(run_builtin_with_redirection(command, home_directory));
+    }
+}
+
+/**
+ * @brief Start one command in the background once its substitutions are expanded
+ * @param start_index Starting token index
+ * @param end_index Ending token index
+ * @param home_directory Shell home directory for built-in commands
+ * 
+ * The job is shown under its expanded text. A job queued with `set
+ * maxjobs` keeps its expanded tokens and runs those, so its
+ * substitutions do not run a second time and their output is never
+ * read as quotes, operators or redirections.
+ */
+void run_background_segment(int start_index, int end_index, const char* home_directory) {
+    Token *saved_tokens = arena_alloc(sizeof(Token) * (token_count + 1));
+    if (saved_tokens == NULL) {
+        return;
+    }
+    int saved_count = token_count;
+    memcpy(saved_tokens, tokens, sizeof(Token) * (token_count + 1));
+    
+    // Work on the segment alone, so expansion cannot shift the others
+    int segment_size = end_index - start_index;
+    memmove(tokens, saved_tokens + start_index, sizeof(Token) * segment_size);
+    terminate_tokens(segment_size);
+    
+    int substitutions = pending_process_substitutions();
+    if (expand_aliases() == 0 && expand_words(home_directory) == 0 && token_count > 0) {
+        build_environment();
+        char *job_str = reconstruct_command_from_segment(0, token_count);
+        if (job_str) {
+            run_background_command(job_str, home_directory);
+        }
+    }
+    release_process_substitutions(substitutions);
+    
+    memcpy(tokens, saved_tokens, sizeof(Token) * (saved_count + 1));
+    token_count = saved_count;
+}
+
 /**
  * @brief Execute sequential commands separated by semicolons and handle background execution
  * @return 0 on success, -1 on error
@@ -214,13 +394,15 @@ int execute_single_segment(int start_index, int end_index, const char* home_dire
  * - Shell waits for each foreground command to complete
  * - Background commands don't block shell execution
  * - Continue execution even if a command fails
+ * - && and || run the next command only on success / failure of the
+ *   previous one; `a && b &` runs the whole list in a background subshell
  */
 int execute_sequential_commands(const char* home_directory) {
     if (token_count == 0) {
         return 0;
     }
     
-    // Find command segments separated by ; and &
+    // Find command segments separated by ;, &, && and ||
     int *segments = NULL;
     int num_segments = 0;
     TokenType *separators = NULL;
@@ -229,45 +411,64 @@ int execute_sequential_commands(const char* home_directory) {
         return -1;
     }
     
-    // Execute each command segment
-    for (int i = 0; i < num_segments; i++) {
-        int start_index = segments[i * 2];
-        int end_index = segments[i * 2 + 1];
-        TokenType separator = separators[i];
-        
-        if (start_index >= end_index) {
-            continue; // Skip empty segments
+    // A `time` prefix measures everything from its segment to the end of
+    // the line, so it covers atomic commands, pipelines and `;` sequences
+    int active_timers = 0;
+    int last_status = 0;
+    
+    // Execute each list of segments joined by && and ||
+    int first = 0;
+    while (first < num_segments) {
+        int last = first;
+        while (separators[last] == TOKEN_AND || separators[last] == TOKEN_OR) {
+            last++;
         }
+        int start_index = segments[first * 2];
+        int end_index = segments[last * 2 + 1];
         
-        // Reconstruct command string for logging/background tracking
-        char *command_str = reconstruct_command_from_segment(start_index, end_index);
-        
-        if (separator == TOKEN_AMPERSAND) {
-            // Execute in background
-            if (command_str) {
-                execute_background_command(start_index, end_index, command_str);
+        if (separators[last] == TOKEN_AMPERSAND && last > first) {
+            // A conditional list in the background runs in a forked shell
+            char *command_str = reconstruct_command_from_segment(start_index, end_index);
+            pid_t pid = fork_background_subshell(command_str ? command_str : "");
+            if (pid == 0) {
+                int child_timers = 0;
+                int status = run_and_or_list(segments, separators, first, last, home_directory, &child_timers);
+                while (child_timers-- > 0) {
+                    end_timing(status);
+                }
+                fflush(stdout);
+                _exit(status);
+            }
+        } else if (separators[last] == TOKEN_AMPERSAND && start_index < end_index) {
+            // Execute in background, tracked without its `time` prefix
+            int exec_start = start_index;
+            while (is_time_prefix(exec_start, end_index)) {
+                exec_start = begin_timing(exec_start, end_index);
+                if (exec_start == -1) {
+                    break;
+                }
+                active_timers++;
             }
-        } else {
-            // Execute in foreground (sequential)
-            execute_single_segment(start_index, end_index, home_directory);
             
-            // Log successful commands (but continue even if command failed)
-            if (command_str && should_log_command(command_str)) {
-                add_command_to_log(command_str);
+            if (exec_start != -1 && exec_start < end_index) {
+                run_background_segment(exec_start, end_index, home_directory);
             }
+        } else {
+            // Execute in foreground (sequential)
+            last_status = run_and_or_list(segments, separators, first, last, home_directory, &active_timers);
         }
         
-        // Free command string
-        if (command_str) {
-            free(command_str);
-        }
-        
-        // Note: We continue executing subsequent commands even if current command failed
+        // Note: We continue with the next list even if this one failed
         // This is the required behavior for sequential execution
+        first = last + 1;
+    }
+    
+    // Report timers innermost first
+    while (active_timers > 0) {
+        end_timing(last_status);
+        active_timers--;
     }
     
-    free(segments);
-    free(separators);
     return 0;
 }
 
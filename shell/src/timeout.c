@@ -0,0 +1,184 @@
+#include "shell.h"
+#include <sys/timerfd.h>
+#include <signal.h>
+#include <errno.h>
+#include <math.h>
+
+/**
+ * @brief Parse a duration such as 10, 2.5, 500ms, 30s, 5m, 1h or 1d
+ * @param str Duration text (a number without suffix is in seconds)
+ * @param ms Set to the duration in milliseconds
+ * @return 0 on success, -1 if the string is not a valid duration
+ */
+int parse_duration(const char *str, long long *ms) {
+    char *end;
+    errno = 0;
+    double value = strtod(str, &end);
+    if (end == str || errno != 0 || value < 0 || !isfinite(value)) {
+        return -1;
+    }
+
+    double scale;
+    if (strcmp(end, "") == 0 || strcmp(end, "s") == 0) {
+        scale = 1000;
+    } else if (strcmp(end, "ms") == 0) {
+        scale = 1;
+    } else if (strcmp(end, "m") == 0) {
+        scale = 60 * 1000;
+    } else if (strcmp(end, "h") == 0) {
+        scale = 3600 * 1000;
+    } else if (strcmp(end, "d") == 0) {
+        scale = 86400 * 1000;
+    } else {
+        return -1;
+    }
+    *ms = (long long)(value * scale);
+    return 0;
+}
+
+/**
+ * @brief Parse a signal given by name (TERM, SIGTERM) or number
+ * @return Signal number, -1 if unknown
+ */
+int parse_signal_name(const char *str) {
+    static const struct { const char *name; int number; } signals[] = {
+        { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "KILL", SIGKILL },
+        { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "ALRM", SIGALRM }, { "TERM", SIGTERM },
+    };
+
+    if (isdigit((unsigned char)str[0])) {
+        int number = atoi(str);
+        return number > 0 && number < NSIG ? number : -1;
+    }
+    if (strncmp(str, "SIG", 3) == 0) {
+        str += 3;
+    }
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+        if (strcmp(str, signals[i].name) == 0) {
+            return signals[i].number;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Use `set timeout` / `set killafter` for a foreground command without its own timeout
+ * @param options Options of the command
+ */
+void apply_default_timeout(JobOptions *options) {
+    if (options->timeout_ms == 0) {
+        options->timeout_ms = shell_options.command_timeout_ms;
+        if (options->kill_after_ms == 0) {
+            options->kill_after_ms = shell_options.kill_after_ms;
+        }
+    }
+}
+
+/**
+ * @brief Arm a timerfd to fire once after the given time
+ */
+static int arm_timer(int fd, long long ms) {
+    struct itimerspec spec = { { 0, 0 }, { ms / 1000, (ms % 1000) * 1000000L } };
+    if (ms == 0) {
+        spec.it_value.tv_nsec = 1;  // An all-zero value would disarm the timer
+    }
+    return timerfd_settime(fd, 0, &spec, NULL);
+}
+
+/**
+ * @brief Send a signal to each process (group) of a timed command
+ */
+static void signal_timed_command(const CommandTimer *timer, int sig) {
+    for (int i = 0; i < timer->pid_count; i++) {
+        pid_t pid = timer->pids[i];
+        // Group leaders take their whole group along
+        if (pid > 0 && (getpgid(pid) != pid || kill(-pid, sig) == -1)) {
+            kill(pid, sig);
+        }
+    }
+}
+
+/**
+ * @brief Event loop callback: the command's deadline has passed
+ * @param fd The timer's timerfd
+ * @param data The CommandTimer
+ *
+ * The first expiry sends the timeout signal (SIGTERM by default). With
+ * --kill-after the timer is re-armed and the second expiry sends SIGKILL.
+ */
+static void handle_timer_event(int fd, void *data) {
+    CommandTimer *timer = data;
+    unsigned long long expirations;
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+
+    if (timer->stage == 0) {
+        timer->stage = 1;
+        signal_timed_command(timer, timer->signal);
+        if (timer->kill_after_ms > 0) {
+            arm_timer(fd, timer->kill_after_ms);
+        }
+    } else if (timer->stage == 1) {
+        timer->stage = 2;
+        signal_timed_command(timer, SIGKILL);
+    }
+}
+
+/**
+ * @brief Start the timeout of a command, if its options ask for one
+ * @param pids Processes of the command (a group leader's whole group is signalled)
+ * @param pid_count Number of processes
+ * @param options Options with timeout_ms, kill_after_ms and timeout_signal
+ * @return New timer, or NULL if there is no timeout (or it cannot be set up)
+ *
+ * The timer is a timerfd in the shell's event loop, so it fires while
+ * the shell waits for the command and costs nothing otherwise.
+ */
+CommandTimer* create_command_timer(const pid_t *pids, int pid_count, const JobOptions *options) {
+    if (options->timeout_ms <= 0 || pid_count <= 0 || !event_loop_available()) {
+        return NULL;
+    }
+
+    CommandTimer *timer = calloc(1, sizeof(CommandTimer) + sizeof(pid_t) * pid_count);
+    if (timer == NULL) {
+        perror("calloc timer");
+        return NULL;
+    }
+    timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer->fd == -1) {
+        perror("timerfd_create");
+        free(timer);
+        return NULL;
+    }
+    timer->signal = options->timeout_signal;
+    timer->kill_after_ms = options->kill_after_ms;
+    timer->pid_count = pid_count;
+    memcpy(timer->pids, pids, sizeof(pid_t) * pid_count);
+
+    if (arm_timer(timer->fd, options->timeout_ms) == -1 ||
+        event_loop_add(timer->fd, handle_timer_event, timer) == -1) {
+        perror("timerfd_settime");
+        close(timer->fd);
+        free(timer);
+        return NULL;
+    }
+    return timer;
+}
+
+/**
+ * @brief Stop and free a command timer
+ * @param timer Timer from create_command_timer() (may be NULL)
+ * @return 0 if the timeout never fired, 124 if the command was signalled,
+ *         137 if it had to be killed with SIGKILL (like timeout(1))
+ */
+int release_command_timer(CommandTimer *timer) {
+    if (timer == NULL) {
+        return 0;
+    }
+    int stage = timer->stage;
+    event_loop_remove(timer->fd);
+    close(timer->fd);
+    free(timer);
+    return stage == 0 ? 0 : stage == 1 ? 124 : 128 + SIGKILL;
+}
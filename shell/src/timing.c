@@ -0,0 +1,222 @@
+#include "shell.h"
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define MAX_ACTIVE_TIMERS 8
+
+/**
+ * @brief Snapshot taken when a `time` prefix starts measuring
+ */
+typedef struct {
+    struct timespec wall;          // CLOCK_MONOTONIC at start
+    struct rusage self;            // RUSAGE_SELF at start (in-process builtins)
+    struct rusage children;        // RUSAGE_CHILDREN at start (reaped children)
+    long max_rss_kb;               // Largest child RSS seen through wait4()
+    int json;                      // Report as a single JSON line
+    char command[MAX_PATH_LEN];    // Command text shown in JSON reports
+} TimeSample;
+
+static TimeSample active_timers[MAX_ACTIVE_TIMERS];
+static int active_timer_count = 0;
+
+/**
+ * @brief Wait for a child and account its resource usage for `time`
+ * @param pid Process ID to wait for
+ * @param status Where to store the wait status
+ * @param options Options passed through to wait4()
+ * @return Same as waitpid(): pid on state change, 0 for WNOHANG, -1 on error
+ *
+ * All foreground waits go through here so that wait4() can report the
+ * peak RSS of every child that finishes while a timer is running.
+ * RUSAGE_CHILDREN cannot provide this because ru_maxrss is a maximum,
+ * not a counter, so it does not give a meaningful delta.
+ */
+pid_t wait_for_child(pid_t pid, int *status, int options) {
+    struct rusage usage;
+    pid_t result;
+    
+    if ((options & WNOHANG) || !event_loop_available()) {
+        result = wait4(pid, status, options, &usage);
+    } else {
+        // Run the event loop while blocked so captured job output keeps
+        // draining and queued jobs keep starting; SIGCHLD wakes it up
+        while ((result = wait4(pid, status, options | WNOHANG, &usage)) == 0) {
+            run_event_loop_once(-1);
+        }
+    }
+
+    if (result > 0 && active_timer_count > 0 &&
+        (WIFEXITED(*status) || WIFSIGNALED(*status))) {
+        for (int i = 0; i < active_timer_count; i++) {
+            if (usage.ru_maxrss > active_timers[i].max_rss_kb) {
+                active_timers[i].max_rss_kb = usage.ru_maxrss;
+            }
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Check whether a token range starts with the `time` prefix
+ * @param start_index Starting token index
+ * @param end_index Ending token index
+ * @return 1 if the first token is `time`, 0 otherwise
+ */
+int is_time_prefix(int start_index, int end_index) {
+    return start_index < end_index &&
+           tokens[start_index].type == TOKEN_NAME &&
+           strcmp(tokens[start_index].value, "time") == 0;
+}
+
+/**
+ * @brief Start a timer for the `time` prefix
+ * @param start_index Index of the `time` token
+ * @param end_index Ending token index of the segment
+ * @return Index of the first token after the prefix and its flags, -1 on error
+ *
+ * Syntax: time [-j] [--] command
+ * -j reports a single JSON line instead of the human readable table.
+ */
+int begin_timing(int start_index, int end_index) {
+    if (active_timer_count >= MAX_ACTIVE_TIMERS) {
+        printf("time: Too many nested timers\n");
+        return -1;
+    }
+
+    TimeSample *sample = &active_timers[active_timer_count];
+    sample->json = 0;
+    sample->max_rss_kb = 0;
+
+    int i = start_index + 1;
+    while (i < end_index && tokens[i].type == TOKEN_NAME && tokens[i].value[0] == '-') {
+        if (strcmp(tokens[i].value, "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(tokens[i].value, "-j") == 0) {
+            sample->json = 1;
+        } else {
+            printf("Usage: time [-j] command\n");
+            return -1;
+        }
+        i++;
+    }
+
+    // Report the timed command without "time" and its flags
+    char *shown = reconstruct_command_from_segment(i, end_index);
+    strncpy(sample->command, shown ? shown : "", MAX_PATH_LEN - 1);
+    sample->command[MAX_PATH_LEN - 1] = '\0';
+
+    getrusage(RUSAGE_SELF, &sample->self);
+    getrusage(RUSAGE_CHILDREN, &sample->children);
+    clock_gettime(CLOCK_MONOTONIC, &sample->wall);
+
+    active_timer_count++;
+    return i;
+}
+
+/**
+ * @brief Get the current CLOCK_MONOTONIC time in milliseconds
+ *
+ * The one clock for deadlines and sampling intervals (event loop, wait,
+ * job stats): it never jumps when the wall clock is set.
+ */
+long long monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Convert a timeval to seconds
+ */
+static double timeval_seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * @brief Print a duration in the traditional "0m0.000s" format
+ */
+static void print_duration(const char *label, double seconds) {
+    long minutes = (long)(seconds / 60);
+    fprintf(stderr, "%s\t%ldm%.3fs\n", label, minutes, seconds - minutes * 60);
+}
+
+/**
+ * @brief Print a string as a JSON string literal
+ */
+static void print_json_string(const char *str) {
+    fputc('"', stderr);
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(stderr, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(stderr, "\\u%04x", *p);
+        } else {
+            fputc(*p, stderr);
+        }
+    }
+    fputc('"', stderr);
+}
+
+/**
+ * @brief Stop the innermost timer and report its measurements on stderr
+ * @param status Exit status of the last command run under the timer
+ *
+ * CPU time, context switches and page faults are the sum of the shell's
+ * own deltas (builtins run in-process) and the RUSAGE_CHILDREN deltas
+ * (everything reaped while the timer was running).
+ */
+void end_timing(int status) {
+    if (active_timer_count == 0) {
+        return;
+    }
+
+    struct timespec now;
+    struct rusage self, children;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    TimeSample *sample = &active_timers[--active_timer_count];
+
+    double real = (now.tv_sec - sample->wall.tv_sec) +
+                  (now.tv_nsec - sample->wall.tv_nsec) / 1e9;
+    double user = timeval_seconds(self.ru_utime) - timeval_seconds(sample->self.ru_utime) +
+                  timeval_seconds(children.ru_utime) - timeval_seconds(sample->children.ru_utime);
+    double sys = timeval_seconds(self.ru_stime) - timeval_seconds(sample->self.ru_stime) +
+                 timeval_seconds(children.ru_stime) - timeval_seconds(sample->children.ru_stime);
+    long voluntary = (self.ru_nvcsw - sample->self.ru_nvcsw) +
+                     (children.ru_nvcsw - sample->children.ru_nvcsw);
+    long involuntary = (self.ru_nivcsw - sample->self.ru_nivcsw) +
+                       (children.ru_nivcsw - sample->children.ru_nivcsw);
+    long minor_faults = (self.ru_minflt - sample->self.ru_minflt) +
+                        (children.ru_minflt - sample->children.ru_minflt);
+    long major_faults = (self.ru_majflt - sample->self.ru_majflt) +
+                        (children.ru_majflt - sample->children.ru_majflt);
+
+    // No child finished: only builtins ran, so report the shell's own peak
+    long max_rss = sample->max_rss_kb > 0 ? sample->max_rss_kb : self.ru_maxrss;
+
+    fflush(stdout);
+    if (sample->json) {
+        fprintf(stderr, "{\"command\":");
+        print_json_string(sample->command);
+        fprintf(stderr, ",\"status\":%d,\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,"
+                "\"max_rss_kb\":%ld,\"voluntary_ctxsw\":%ld,\"involuntary_ctxsw\":%ld,"
+                "\"minor_faults\":%ld,\"major_faults\":%ld}\n",
+                status, real, user, sys, max_rss, voluntary, involuntary,
+                minor_faults, major_faults);
+    } else {
+        fprintf(stderr, "\n");
+        print_duration("real", real);
+        print_duration("user", user);
+        print_duration("sys", sys);
+        fprintf(stderr, "maxrss\t%ld KB\n", max_rss);
+        fprintf(stderr, "ctxsw\t%ld voluntary, %ld involuntary\n", voluntary, involuntary);
+        fprintf(stderr, "faults\t%ld minor, %ld major\n", minor_faults, major_faults);
+    }
+    fflush(stderr);
+}
@@ -1,78 +1,332 @@
 #include "shell.h"
+#include <stdint.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
-Token tokens[1024];
+Token*tokens=NULL;
 int token_count=0;
 const char*current_input;
+static int token_capacity=0;
+
+//Make room for count tokens plus the END token; returns -1 if out of memory
+int reserve_tokens(int count)
+{
+    if(count+1<=token_capacity)
+    {
+        return 0;
+    }
+    int capacity=token_capacity ? token_capacity : 64;
+    while(capacity<count+1)
+    {
+        capacity*=2;
+    }
+    Token*grown=realloc(tokens,sizeof(Token)*capacity);
+    if(grown==NULL)
+    {
+        printf("Error: Out of memory for %d words\n",count);
+        return -1;
+    }
+    tokens=grown;
+    token_capacity=capacity;
+    return 0;
+}
+
+//End the current tokens after the first count of them
+void terminate_tokens(int count)
+{
+    tokens[count].type=TOKEN_END;
+    tokens[count].value="";
+    tokens[count].heredoc_fd=-1;
+    token_count=count;
+}
+
+//Give copied tokens their own copies of their text (for programs and aliases, which outlive the line);
+//returns -1 if out of memory, with nothing left to free
+int copy_token_values(Token*copy,int count)
+{
+    for(int i=0;i<count;i++)
+    {
+        char*value=strdup(copy[i].value);
+        if(value==NULL)
+        {
+            perror("strdup");
+            free_token_values(copy,i);
+            return -1;
+        }
+        copy[i].value=value;
+    }
+    return 0;
+}
+
+//Free the text of tokens copied with copy_token_values()
+void free_token_values(Token*copy,int count)
+{
+    for(int i=0;i<count;i++)
+    {
+        free(copy[i].value);
+    }
+}
+
+#if !defined(__x86_64__)
+//Whether a byte ends a run of plain word characters: the end of input, whitespace,
+//an operator, or the start of a substitution, quote or escape
+static int is_word_stop(unsigned char c)
+{
+    return c=='\0' || isspace(c) || strchr("<|>&;$`'\"\\",c)!=NULL;
+}
+
+//Scalar scan: length of the run of plain word characters at p
+static size_t plain_run_scalar(const char*p)
+{
+    const char*q=p;
+    while(!is_word_stop((unsigned char)*q))
+    {
+        q++;
+    }
+    return q-p;
+}
+#else
+//Bit i set for each byte i of a 16-byte block that ends a plain run
+static unsigned stop_mask_sse2(__m128i block)
+{
+    //whitespace is ' ' or \t..\r, i.e. (c-9) <= 4 unsigned
+    __m128i shifted=_mm_sub_epi8(block,_mm_set1_epi8(9));
+    __m128i stops=_mm_cmpeq_epi8(_mm_min_epu8(shifted,_mm_set1_epi8(4)),shifted);
+    static const char specials[]={'\0',' ','<','|','>','&',';','$','`','\'','"','\\'};
+    for(size_t k=0;k<sizeof(specials);k++)
+    {
+        stops=_mm_or_si128(stops,_mm_cmpeq_epi8(block,_mm_set1_epi8(specials[k])));
+    }
+    return (unsigned)_mm_movemask_epi8(stops);
+}
+
+//SSE2 scan, 16 bytes per step. Loads are aligned, so they never cross into an
+//unmapped page past the terminating NUL (the sanitizer cannot know that); bytes
+//before p are masked off.
+__attribute__((no_sanitize_address))
+static size_t plain_run_sse2(const char*p)
+{
+    const char*block=(const char*)((uintptr_t)p & ~(uintptr_t)15);
+    unsigned mask=stop_mask_sse2(_mm_load_si128((const __m128i*)block)) & (~0u<<(p-block));
+    while(mask==0)
+    {
+        block+=16;
+        mask=stop_mask_sse2(_mm_load_si128((const __m128i*)block));
+    }
+    return block+__builtin_ctz(mask)-p;
+}
+
+//Bit i set for each byte i of a 32-byte block that ends a plain run
+__attribute__((target("avx2")))
+static unsigned stop_mask_avx2(__m256i block)
+{
+    __m256i shifted=_mm256_sub_epi8(block,_mm256_set1_epi8(9));
+    __m256i stops=_mm256_cmpeq_epi8(_mm256_min_epu8(shifted,_mm256_set1_epi8(4)),shifted);
+    static const char specials[]={'\0',' ','<','|','>','&',';','$','`','\'','"','\\'};
+    for(size_t k=0;k<sizeof(specials);k++)
+    {
+        stops=_mm256_or_si256(stops,_mm256_cmpeq_epi8(block,_mm256_set1_epi8(specials[k])));
+    }
+    return (unsigned)_mm256_movemask_epi8(stops);
+}
+
+//AVX2 scan, 32 bytes per step (same alignment rule as the SSE2 scan)
+__attribute__((target("avx2"),no_sanitize_address))
+static size_t plain_run_avx2(const char*p)
+{
+    const char*block=(const char*)((uintptr_t)p & ~(uintptr_t)31);
+    unsigned mask=stop_mask_avx2(_mm256_load_si256((const __m256i*)block)) & (~0u<<(p-block));
+    while(mask==0)
+    {
+        block+=32;
+        mask=stop_mask_avx2(_mm256_load_si256((const __m256i*)block));
+    }
+    return block+__builtin_ctz(mask)-p;
+}
+#endif
+
+//Length of the run of plain word characters at p, using the widest scan the CPU has
+static size_t plain_run_length(const char*p)
+{
+#if defined(__x86_64__)
+    static size_t(*scan)(const char*)=NULL;
+    if(scan==NULL)
+    {
+        __builtin_cpu_init();
+        scan=__builtin_cpu_supports("avx2") ? plain_run_avx2 : plain_run_sse2;
+    }
+    return scan(p);
+#else
+    return plain_run_scalar(p);
+#endif
+}
+
+//Length of a descriptor number that directly precedes < or > (2> 3<>), 0 if none
+static int redirect_prefix_length(const char*p)
+{
+    int i=0;
+    while(isdigit(p[i]))
+    {
+        i++;
+    }
+    return (p[i]=='<' || p[i]=='>') && i<=5 ? i : 0;
+}
 
 //Function to tokenise
+//There is no limit on the number or length of tokens: the array grows and
+//the text of each token is copied into the arena
 void tokenise()
 {
     token_count=0;
     const char*p=current_input;
+    if(reserve_tokens(0)==-1)
+    {
+        return;
+    }
 
-    while(*p!='\0' && token_count<1023)
+    while(*p!='\0')
     {   //skipping whitespace characters
-        if(isspace(*p))
+        if(isspace((unsigned char)*p))
         {
             p++;
             continue;
         }
         //identifying tokens
+        if(reserve_tokens(token_count+1)==-1)
+        {
+            token_count=0;
+            break;
+        }
         Token*token=&tokens[token_count];
-        if(*p=='|')
+        token->heredoc_fd=-1;
+        const char*start=p;
+        if(*p=='|' && *(p+1)=='|')
         {
-            token->type=TOKEN_PIPE;
-            strncpy(token->value,p,1);
-            token->value[1]='\0';
-            p++;
+            token->type=TOKEN_OR;
+            p+=2;
         }
-        else if(*p=='<')
+        else if(*p=='|')
         {
-            token->type=TOKEN_INPUT;
-            strncpy(token->value,p,1);
-            token->value[1]='\0';
+            token->type=TOKEN_PIPE;
             p++;
         }
-        else if(*p=='>')
+        else if(((*p=='<' || *p=='>') && *(p+1)!='(') || (isdigit(*p) && redirect_prefix_length(p)>0))
         {
-            if (*(p + 1) == '>') { 
-                token->type = TOKEN_DOUBLE_OUTPUT;
-                strncpy(token->value, p, 2);
-                token->value[2] = '\0';
-                p += 2;
-            } else {
-                token->type = TOKEN_OUTPUT;
-                strncpy(token->value, p, 1);
-                token->value[1] = '\0';
-                p++;
+            //optional descriptor number directly before the operator, e.g. 2> or 3<>
+            int digits=isdigit(*p) ? redirect_prefix_length(p) : 0;
+            const char*op=p+digits;
+            int length=1;
+            if(*op=='<')
+            {
+                if(*(op+1)=='<' && *(op+2)=='<')
+                {
+                    token->type=TOKEN_HERE_STRING;
+                    length=3;
+                }
+                else if(*(op+1)=='<')
+                {
+                    token->type=TOKEN_HEREDOC;
+                    length=2;
+                }
+                else if(*(op+1)=='&')
+                {
+                    token->type=TOKEN_DUP_INPUT;
+                    length=2;
+                }
+                else if(*(op+1)=='>')
+                {
+                    token->type=TOKEN_READ_WRITE;
+                    length=2;
+                }
+                else
+                {
+                    token->type=TOKEN_INPUT;
+                }
+            }
+            else if(*(op+1)=='>')
+            {
+                token->type=TOKEN_DOUBLE_OUTPUT;
+                length=2;
+            }
+            else if(*(op+1)=='&')
+            {
+                token->type=TOKEN_DUP_OUTPUT;
+                length=2;
             }
+            else
+            {
+                token->type=TOKEN_OUTPUT;
+            }
+            p+=digits+length;
+        }
+        else if(*p=='&' && *(p+1)=='&')
+        {
+            token->type=TOKEN_AND;
+            p+=2;
+        }
+        else if(*p=='&' && *(p+1)=='>' && *(p+2)=='>')
+        {
+            token->type=TOKEN_APPEND_ALL;
+            p+=3;
+        }
+        else if(*p=='&' && *(p+1)=='>')
+        {
+            token->type=TOKEN_OUTPUT_ALL;
+            p+=2;
         }
         else if(*p=='&')
         {
             token->type=TOKEN_AMPERSAND;
-            strncpy(token->value,p,1);
-            token->value[1]='\0';
             p++;
         }
+        else if(*p==';' && *(p+1)==';')
+        {
+            //ends a case item; elsewhere it separates like ;
+            token->type=TOKEN_SEMICOLON;
+            p+=2;
+        }
         else if(*p==';')
         {
             token->type=TOKEN_SEMICOLON;
-            strncpy(token->value,p,1);
-            token->value[1]='\0';
             p++;
         }
         else{
             token->type=TOKEN_NAME;
-            int i=0;
-            while(*p!='\0' && !isspace(*p) && !strchr("<|>&;",*p))
+            while(*p!='\0' && !isspace((unsigned char)*p))
             {
-                token->value[i++]=*p;
-                p++;
+                //plain characters are found a block at a time
+                const char*stop=p+plain_run_length(p);
+                if(stop==p)
+                {
+                    const char*end=NULL;
+                    //a command or process substitution, a quoted section or an escape belongs to the
+                    //word, spaces and operators included; quotes are kept for expansion to remove
+                    if((*p=='$' && *(p+1)=='(') || *p=='`' || (p==start && (*p=='<' || *p=='>') && *(p+1)=='('))
+                    {
+                        end=find_substitution_end(p);
+                    }
+                    else if(*p=='\'' || *p=='"' || *p=='\\')
+                    {
+                        end=find_quote_end(p);
+                    }
+                    else if(strchr("<|>&;",*p))
+                    {
+                        break;
+                    }
+                    stop=end!=NULL ? end+1 : (*p=='$' ? p+1 : p+strlen(p));
+                }
+                p=stop;
             }
-            token->value[i]='\0';
+        }
+        //the token's text is copied in one go
+        token->value=arena_strndup(start,p-start);
+        if(token->value==NULL)
+        {
+            token_count=0;
+            break;
         }
         token_count++;
     }
-    tokens[token_count].type=TOKEN_END;
-    tokens[token_count].value[0]='\0';
+    terminate_tokens(token_count);
 }
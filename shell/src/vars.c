@@ -0,0 +1,695 @@
+#define _GNU_SOURCE
+#include "shell.h"
+
+#define INITIAL_VARIABLE_BUCKETS 64
+
+extern char **environ;
+
+/**
+ * @brief A shell variable
+ *
+ * The value is stored as a ready "NAME=value" entry, so exporting it
+ * costs one pointer in the environment array and no copying.
+ */
+typedef struct Variable {
+    char *entry;            // "NAME=value"
+    size_t name_length;
+    int exported;
+    struct Variable *next;  // Next variable in the same bucket
+} Variable;
+
+static Variable **variable_buckets = NULL;
+static size_t bucket_count = 0;
+static size_t variable_count = 0;
+
+// Environment for exec, rebuilt only after an exported variable changed
+static char **environment_cache = NULL;
+static int environment_dirty = 1;
+
+// Per-command assignments (VAR=value cmd) of the command being run
+static char **command_assignments = NULL;
+static int command_assignment_count = 0;
+
+static int last_exit_status = 0;
+static pid_t shell_pid = 0;
+
+// Positional parameters ($1, $2, ...) of the function being run
+static char **positional_parameters = NULL;
+static int positional_count = 0;
+static char *positional_joined = NULL;   // $@ and $*: the parameters joined by spaces
+
+/**
+ * @brief A variable as it was before `local` shadowed it
+ */
+typedef struct SavedVariable {
+    char *name;
+    char *value;                // NULL if it was not set
+    int exported;
+    struct SavedVariable *next;
+} SavedVariable;
+
+/**
+ * @brief The local variables of one function call
+ */
+typedef struct LocalScope {
+    SavedVariable *saved;
+    struct LocalScope *outer;   // Scope of the calling function
+} LocalScope;
+
+static LocalScope *local_scope = NULL;
+
+/**
+ * @brief FNV-1a hash of a variable name
+ * @param name Name (not necessarily NUL-terminated)
+ * @param length Length of the name
+ */
+static size_t hash_name(const char *name, size_t length) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Find a variable by name
+ * @return The variable, or NULL if it is not set
+ */
+static Variable* find_variable(const char *name, size_t length) {
+    if (bucket_count == 0) {
+        return NULL;
+    }
+    Variable *variable = variable_buckets[hash_name(name, length) & (bucket_count - 1)];
+    while (variable != NULL) {
+        if (variable->name_length == length && strncmp(variable->entry, name, length) == 0) {
+            return variable;
+        }
+        variable = variable->next;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Double the bucket array once there are more variables than buckets
+ * @return 0 on success, -1 if out of memory
+ */
+static int grow_variable_table(void) {
+    size_t new_count = bucket_count ? bucket_count * 2 : INITIAL_VARIABLE_BUCKETS;
+    Variable **buckets = calloc(new_count, sizeof(Variable*));
+    if (buckets == NULL) {
+        perror("calloc variables");
+        return -1;
+    }
+    for (size_t b = 0; b < bucket_count; b++) {
+        Variable *variable = variable_buckets[b];
+        while (variable != NULL) {
+            Variable *next = variable->next;
+            size_t index = hash_name(variable->entry, variable->name_length) & (new_count - 1);
+            variable->next = buckets[index];
+            buckets[index] = variable;
+            variable = next;
+        }
+    }
+    free(variable_buckets);
+    variable_buckets = buckets;
+    bucket_count = new_count;
+    return 0;
+}
+
+/**
+ * @brief Check whether a string is a valid variable name
+ * @param name Candidate name
+ * @param length Number of characters to check
+ * @return 1 for [A-Za-z_][A-Za-z0-9_]*, 0 otherwise
+ */
+int is_valid_variable_name(const char *name, size_t length) {
+    if (length == 0 || !(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        if (!(isalnum((unsigned char)name[i]) || name[i] == '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Set a variable, creating it if needed
+ * @param name Variable name
+ * @param length Length of the name
+ * @param value New value
+ * @param export 1 to export it, 0 to keep its current export flag
+ * @return 0 on success, -1 on error
+ */
+static int store_variable(const char *name, size_t length, const char *value, int export) {
+    size_t value_length = strlen(value);
+    char *entry = malloc(length + value_length + 2);
+    if (entry == NULL) {
+        perror("malloc variable");
+        return -1;
+    }
+    memcpy(entry, name, length);
+    entry[length] = '=';
+    memcpy(entry + length + 1, value, value_length + 1);
+
+    Variable *variable = find_variable(name, length);
+    if (variable == NULL) {
+        if (variable_count >= bucket_count && grow_variable_table() == -1) {
+            free(entry);
+            return -1;
+        }
+        variable = calloc(1, sizeof(Variable));
+        if (variable == NULL) {
+            perror("calloc variable");
+            free(entry);
+            return -1;
+        }
+        size_t index = hash_name(name, length) & (bucket_count - 1);
+        variable->name_length = length;
+        variable->next = variable_buckets[index];
+        variable_buckets[index] = variable;
+        variable_count++;
+    } else {
+        free(variable->entry);
+    }
+    variable->entry = entry;
+    variable->exported |= export;
+    if (variable->exported) {
+        environment_dirty = 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Set a shell variable
+ * @param name Variable name
+ * @param value New value
+ * @param export 1 to also export it; an exported variable stays exported
+ * @return 0 on success, -1 on error
+ */
+int set_variable(const char *name, const char *value, int export) {
+    return store_variable(name, strlen(name), value, export);
+}
+
+/**
+ * @brief Get the value of a variable
+ * @param name Variable name
+ * @return The value, or NULL if the variable is not set
+ */
+const char* get_variable(const char *name) {
+    Variable *variable = find_variable(name, strlen(name));
+    return variable != NULL ? variable->entry + variable->name_length + 1 : NULL;
+}
+
+/**
+ * @brief Remove a variable
+ * @param name Variable name
+ */
+void unset_variable(const char *name) {
+    size_t length = strlen(name);
+    if (bucket_count == 0) {
+        return;
+    }
+    Variable **link = &variable_buckets[hash_name(name, length) & (bucket_count - 1)];
+    while (*link != NULL) {
+        Variable *variable = *link;
+        if (variable->name_length == length && strncmp(variable->entry, name, length) == 0) {
+            *link = variable->next;
+            if (variable->exported) {
+                environment_dirty = 1;
+            }
+            free(variable->entry);
+            free(variable);
+            variable_count--;
+            return;
+        }
+        link = &variable->next;
+    }
+}
+
+/**
+ * @brief Import the inherited environment (called once at startup)
+ *
+ * Every inherited variable is exported again to the shell's commands.
+ */
+void init_variables(void) {
+    shell_pid = getpid();
+    for (char **env = environ; *env != NULL; env++) {
+        const char *equals = strchr(*env, '=');
+        if (equals != NULL && is_valid_variable_name(*env, equals - *env)) {
+            store_variable(*env, equals - *env, equals + 1, 1);
+        }
+    }
+}
+
+/**
+ * @brief Get the environment for exec: all exported variables
+ * @return NULL-terminated "NAME=value" array owned by the shell
+ *
+ * The array is cached and only rebuilt after an exported variable was
+ * set or unset, so an exec costs nothing extra however large the
+ * environment is. The entries are the variables' own strings.
+ */
+char** build_environment(void) {
+    if (!environment_dirty && environment_cache != NULL) {
+        return environment_cache;
+    }
+    size_t exported = 0;
+    for (size_t b = 0; b < bucket_count; b++) {
+        for (Variable *variable = variable_buckets[b]; variable != NULL; variable = variable->next) {
+            exported += variable->exported;
+        }
+    }
+    char **environment = malloc(sizeof(char*) * (exported + 1));
+    if (environment == NULL) {
+        perror("malloc environment");
+        return environment_cache != NULL ? environment_cache : environ;
+    }
+    size_t count = 0;
+    for (size_t b = 0; b < bucket_count; b++) {
+        for (Variable *variable = variable_buckets[b]; variable != NULL; variable = variable->next) {
+            if (variable->exported) {
+                environment[count++] = variable->entry;
+            }
+        }
+    }
+    environment[count] = NULL;
+
+    free(environment_cache);
+    environment_cache = environment;
+    environment_dirty = 0;
+    return environment_cache;
+}
+
+/**
+ * @brief Replace the process with a command, passing the exported variables
+ * @param args NULL-terminated argument vector
+ *
+ * Returns only if the exec failed. Called in forked children.
+ */
+void exec_with_environment(char **args) {
+    apply_command_assignments();
+    char **environment = build_environment();
+    // execvpe() searches the PATH of the caller's own environment
+    environ = environment;
+    execvpe(args[0], args, environment);
+}
+
+/**
+ * @brief Check whether a word is an assignment (NAME=value)
+ * @param word Token text
+ * @return 1 if it assigns a variable, 0 otherwise
+ */
+int is_assignment_word(const char *word) {
+    const char *equals = strchr(word, '=');
+    return equals != NULL && is_valid_variable_name(word, equals - word);
+}
+
+/**
+ * @brief Count the assignment words a command starts with
+ * @param start_index First token of the command
+ * @param end_index End of the command
+ * @return Number of leading NAME=value words
+ */
+int count_assignments(int start_index, int end_index) {
+    int count = 0;
+    while (start_index + count < end_index && tokens[start_index + count].type == TOKEN_NAME &&
+           is_assignment_word(tokens[start_index + count].value)) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Perform the assignments of a command's leading NAME=value words
+ * @param start_index First assignment token
+ * @param count Number of assignment tokens
+ * @param export 1 to export them (for a command's environment in its child)
+ */
+void apply_assignments(int start_index, int count, int export) {
+    for (int i = start_index; i < start_index + count; i++) {
+        const char *word = tokens[i].value;
+        const char *equals = strchr(word, '=');
+        store_variable(word, equals - word, equals + 1, export);
+    }
+}
+
+/**
+ * @brief Remember the VAR=value words of the command about to run
+ * @param start_index First assignment token
+ * @param count Number of assignment tokens
+ *
+ * The builtin dispatch only sees the command itself; the assignments are
+ * applied in the forked child by exec_with_environment().
+ */
+void set_command_assignments(int start_index, int count) {
+    clear_command_assignments();
+    command_assignments = malloc(sizeof(char*) * count);
+    if (command_assignments == NULL) {
+        perror("malloc assignments");
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        command_assignments[command_assignment_count] = strdup(tokens[start_index + i].value);
+        if (command_assignments[command_assignment_count] != NULL) {
+            command_assignment_count++;
+        }
+    }
+}
+
+/**
+ * @brief Forget the VAR=value words of the command that just ran
+ */
+void clear_command_assignments(void) {
+    for (int i = 0; i < command_assignment_count; i++) {
+        free(command_assignments[i]);
+    }
+    free(command_assignments);
+    command_assignments = NULL;
+    command_assignment_count = 0;
+}
+
+/**
+ * @brief Export the remembered VAR=value words into this (child) process
+ */
+void apply_command_assignments(void) {
+    for (int i = 0; i < command_assignment_count; i++) {
+        const char *equals = strchr(command_assignments[i], '=');
+        store_variable(command_assignments[i], equals - command_assignments[i], equals + 1, 1);
+    }
+}
+
+/**
+ * @brief Record the exit status of the last foreground command ($?)
+ */
+void set_last_status(int status) {
+    last_exit_status = status < 0 ? 1 : status;
+}
+
+/**
+ * @brief Get the exit status of the last foreground command ($?)
+ */
+int get_last_status(void) {
+    return last_exit_status;
+}
+
+/**
+ * @brief Exchange the positional parameters with another set
+ * @param words In: the new parameters; out: the previous ones
+ * @param count In: number of new parameters; out: previous number
+ *
+ * A function call swaps its arguments in and the caller's back out,
+ * so nothing is copied either way.
+ */
+void swap_positional_parameters(char ***words, int *count) {
+    char **previous_words = positional_parameters;
+    int previous_count = positional_count;
+    positional_parameters = *words;
+    positional_count = *count;
+    *words = previous_words;
+    *count = previous_count;
+
+    free(positional_joined);
+    positional_joined = NULL;
+    size_t length = 0;
+    for (int i = 0; i < positional_count; i++) {
+        length += strlen(positional_parameters[i]) + 1;
+    }
+    if (positional_count > 0 && (positional_joined = malloc(length)) != NULL) {
+        char *p = positional_joined;
+        for (int i = 0; i < positional_count; i++) {
+            size_t word_length = strlen(positional_parameters[i]);
+            memcpy(p, positional_parameters[i], word_length);
+            p += word_length;
+            *p++ = ' ';
+        }
+        p[-1] = '\0';
+    }
+}
+
+/**
+ * @brief Get the positional parameters (for `for NAME` without `in`)
+ * @param count Set to the number of parameters
+ */
+char** get_positional_parameters(int *count) {
+    *count = positional_count;
+    return positional_parameters;
+}
+
+/**
+ * @brief Open the local variable scope of a function call
+ * @return 0 on success, -1 if out of memory
+ */
+int push_local_scope(void) {
+    LocalScope *scope = calloc(1, sizeof(LocalScope));
+    if (scope == NULL) {
+        perror("calloc scope");
+        return -1;
+    }
+    scope->outer = local_scope;
+    local_scope = scope;
+    return 0;
+}
+
+/**
+ * @brief Close the innermost scope, restoring the variables it shadowed
+ */
+void pop_local_scope(void) {
+    LocalScope *scope = local_scope;
+    if (scope == NULL) {
+        return;
+    }
+    local_scope = scope->outer;
+    while (scope->saved != NULL) {
+        SavedVariable *saved = scope->saved;
+        scope->saved = saved->next;
+        unset_variable(saved->name);
+        if (saved->value != NULL) {
+            store_variable(saved->name, strlen(saved->name), saved->value, saved->exported);
+        }
+        free(saved->name);
+        free(saved->value);
+        free(saved);
+    }
+    free(scope);
+}
+
+/**
+ * @brief Remember a variable's value before the current scope shadows it
+ * @return 0 on success, -1 if out of memory
+ */
+static int save_shadowed_variable(const char *name, size_t length) {
+    for (SavedVariable *saved = local_scope->saved; saved != NULL; saved = saved->next) {
+        if (strlen(saved->name) == length && strncmp(saved->name, name, length) == 0) {
+            return 0;   // Already local in this call
+        }
+    }
+    SavedVariable *saved = calloc(1, sizeof(SavedVariable));
+    if (saved == NULL || (saved->name = strndup(name, length)) == NULL) {
+        perror("calloc local");
+        free(saved);
+        return -1;
+    }
+    Variable *variable = find_variable(name, length);
+    if (variable != NULL) {
+        saved->value = strdup(variable->entry + length + 1);
+        saved->exported = variable->exported;
+    }
+    saved->next = local_scope->saved;
+    local_scope->saved = saved;
+    return 0;
+}
+
+/**
+ * @brief Set NAME=value words for the length of the current scope
+ * @param start_index First assignment token
+ * @param count Number of assignment tokens
+ *
+ * `NAME=value func` exports NAME to the function and its commands; the
+ * old value comes back when the caller pops the scope.
+ */
+void apply_local_assignments(int start_index, int count) {
+    for (int i = start_index; i < start_index + count; i++) {
+        const char *word = tokens[i].value;
+        size_t length = strchr(word, '=') - word;
+        if (save_shadowed_variable(word, length) == 0) {
+            store_variable(word, length, word + length + 1, 1);
+        }
+    }
+}
+
+/**
+ * @brief Execute the local command
+ * @return 0 on success, 1 on error
+ *
+ * Syntax: local NAME[=VALUE]...
+ * The variables get their previous values back when the function
+ * returns. A NAME without a value starts out unset.
+ */
+int execute_local(void) {
+    if (local_scope == NULL) {
+        printf("local: Can only be used in a function\n");
+        return 1;
+    }
+    int status = 0;
+    for (int i = 1; i < token_count && tokens[i].type == TOKEN_NAME; i++) {
+        if (is_redirect_filename(i, 0)) {
+            continue;
+        }
+        const char *word = tokens[i].value;
+        const char *equals = strchr(word, '=');
+        size_t length = equals != NULL ? (size_t)(equals - word) : strlen(word);
+        if (!is_valid_variable_name(word, length)) {
+            printf("local: Invalid variable name: %s\n", word);
+            status = 1;
+            continue;
+        }
+        if (save_shadowed_variable(word, length) == -1) {
+            return 1;
+        }
+        if (equals != NULL) {
+            store_variable(word, length, equals + 1, 0);
+        } else {
+            char name[MAX_PATH_LEN];
+            snprintf(name, sizeof(name), "%.*s", (int)length, word);
+            unset_variable(name);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief Look up a variable or special parameter for expansion
+ * @param name Name without the $ (e.g. "HOME", "?", "$", "1", "#")
+ * @param length Length of the name
+ * @param buffer Space for special parameters that are computed
+ * @return The value, or "" if unset
+ */
+const char* expand_variable(const char *name, size_t length, char *buffer, size_t size) {
+    if (length == 1 && name[0] == '?') {
+        snprintf(buffer, size, "%d", last_exit_status);
+        return buffer;
+    }
+    if (length == 1 && name[0] == '$') {
+        snprintf(buffer, size, "%d", (int)shell_pid);
+        return buffer;
+    }
+    if (length == 1 && name[0] == '#') {
+        snprintf(buffer, size, "%d", positional_count);
+        return buffer;
+    }
+    if (length == 1 && (name[0] == '@' || name[0] == '*')) {
+        return positional_joined != NULL ? positional_joined : "";
+    }
+    if (isdigit((unsigned char)name[0])) {
+        long index = 0;
+        for (size_t i = 0; i < length && index <= positional_count; i++) {
+            index = index * 10 + (name[i] - '0');
+        }
+        return index >= 1 && index <= positional_count ? positional_parameters[index - 1] : "";
+    }
+    Variable *variable = find_variable(name, length);
+    return variable != NULL ? variable->entry + variable->name_length + 1 : "";
+}
+
+/**
+ * @brief Compare two "NAME=value" entries by name (for export listing)
+ */
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief Execute the export command
+ * @return 0 on success, 1 if a name was invalid
+ *
+ * Syntax: export [NAME[=VALUE] ...]
+ * Without arguments, lists the exported variables sorted by name.
+ */
+int execute_export(void) {
+    int status = 0;
+    int names = 0;
+
+    for (int i = 1; i < token_count && tokens[i].type == TOKEN_NAME; i++) {
+        if (is_redirect_filename(i, 0)) {
+            continue;
+        }
+        names++;
+        const char *word = tokens[i].value;
+        const char *equals = strchr(word, '=');
+        size_t length = equals != NULL ? (size_t)(equals - word) : strlen(word);
+        if (!is_valid_variable_name(word, length)) {
+            printf("export: Invalid variable name: %s\n", word);
+            status = 1;
+            continue;
+        }
+        if (equals != NULL) {
+            store_variable(word, length, equals + 1, 1);
+        } else {
+            Variable *variable = find_variable(word, length);
+            if (variable == NULL) {
+                store_variable(word, length, "", 1);
+            } else if (!variable->exported) {
+                variable->exported = 1;
+                environment_dirty = 1;
+            }
+        }
+    }
+
+    if (names == 0) {
+        char **environment = build_environment();
+        size_t count = 0;
+        while (environment[count] != NULL) {
+            count++;
+        }
+        char **sorted = malloc(sizeof(char*) * (count + 1));
+        if (sorted == NULL) {
+            perror("malloc");
+            return 1;
+        }
+        memcpy(sorted, environment, sizeof(char*) * count);
+        qsort(sorted, count, sizeof(char*), compare_entries);
+        for (size_t i = 0; i < count; i++) {
+            printf("export %s\n", sorted[i]);
+        }
+        free(sorted);
+    }
+    return status;
+}
+
+/**
+ * @brief Execute the unset command
+ * @return 0 on success, 1 if a name was invalid
+ *
+ * Syntax: unset [-f | -v] NAME...
+ * With -f the names are shell functions instead of variables.
+ */
+int execute_unset(void) {
+    int status = 0;
+    int functions = 0;
+    int i = 1;
+    for (; i < token_count && tokens[i].type == TOKEN_NAME && tokens[i].value[0] == '-'; i++) {
+        if (strcmp(tokens[i].value, "-f") == 0) {
+            functions = 1;
+        } else if (strcmp(tokens[i].value, "-v") == 0) {
+            functions = 0;
+        } else {
+            printf("Usage: unset [-f | -v] NAME...\n");
+            return 2;
+        }
+    }
+    for (; i < token_count && tokens[i].type == TOKEN_NAME; i++) {
+        if (functions) {
+            undefine_function(tokens[i].value);
+            continue;
+        }
+        if (!is_valid_variable_name(tokens[i].value, strlen(tokens[i].value))) {
+            printf("unset: Invalid variable name: %s\n", tokens[i].value);
+            status = 1;
+            continue;
+        }
+        unset_variable(tokens[i].value);
+    }
+    return status;
+}
@@ -0,0 +1,631 @@
+#include "shell.h"
+#include <sys/wait.h>
+#include <stdio_ext.h>
+#include <fnmatch.h>
+
+/**
+ * @brief Kinds of VM frames
+ */
+typedef enum {
+    FRAME_LOOP,         // while, until or for
+    FRAME_CASE,
+    FRAME_REDIRECT,
+    FRAME_TIMER         // A `time` prefix; leaving it reports the measurements
+} FrameKind;
+
+/**
+ * @brief State of a compound command the VM is inside of
+ */
+typedef struct {
+    FrameKind kind;
+    int status;                 // Loops: $? of the last body run
+    char **words;               // for: the words to assign; case: the subject
+    BraceSequence *sequences;   // for: values of a NULL words[i], made one at a time
+    int word_count;
+    int next_word;
+    long long next_value;       // for: position in sequences[next_word]
+    SavedFd saved[MAX_SAVED_FDS];   // Redirections: descriptors to restore
+    int saved_count;
+    pid_t timer_owner;          // Timers: shell that started it (forked stages inherit the frame)
+} Frame;
+
+typedef struct {
+    Frame *frames;
+    int count;
+    int capacity;
+} FrameStack;
+
+/**
+ * @brief Enter a frame
+ * @return The new (zeroed) frame, NULL if out of memory
+ */
+static Frame* push_frame(FrameStack *stack, FrameKind kind) {
+    if (stack->count == stack->capacity) {
+        int capacity = stack->capacity ? stack->capacity * 2 : 8;
+        Frame *frames = realloc(stack->frames, sizeof(Frame) * capacity);
+        if (frames == NULL) {
+            perror("realloc frames");
+            return NULL;
+        }
+        stack->frames = frames;
+        stack->capacity = capacity;
+    }
+    Frame *frame = &stack->frames[stack->count++];
+    memset(frame, 0, sizeof(*frame));
+    frame->kind = kind;
+    return frame;
+}
+
+/**
+ * @brief Leave the innermost frame, undoing its redirections or ending its timer
+ */
+static void pop_frame(FrameStack *stack) {
+    if (stack->count == 0) {
+        return;
+    }
+    Frame *frame = &stack->frames[--stack->count];
+    if (frame->kind == FRAME_REDIRECT) {
+        fflush(stdout);
+        restore_redirected_fds(frame->saved, frame->saved_count);
+    } else if (frame->kind == FRAME_TIMER && frame->timer_owner == getpid()) {
+        end_timing(get_last_status());
+    }
+    for (int i = 0; i < frame->word_count; i++) {
+        free(frame->words[i]);
+        if (frame->sequences != NULL && frame->words[i] == NULL) {
+            free_brace_sequence(&frame->sequences[i]);
+        }
+    }
+    free(frame->words);
+    free(frame->sequences);
+}
+
+/**
+ * @brief Get the innermost frame
+ */
+static Frame* top_frame(FrameStack *stack) {
+    return stack->count > 0 ? &stack->frames[stack->count - 1] : NULL;
+}
+
+/**
+ * @brief Make a range of the program's tokens the shell's current tokens
+ *
+ * The existing executors (seq.c, redirect.c, expand.c) then run them as
+ * if they had just been typed.
+ */
+static void load_tokens(const Program *program, int start, int end) {
+    int count = end - start;
+    if (reserve_tokens(count) == -1) {
+        terminate_tokens(0);
+        return;
+    }
+    memcpy(tokens, program->tokens + start, sizeof(Token) * count);
+    terminate_tokens(count);
+}
+
+/**
+ * @brief Check whether the last command was killed by Ctrl-C
+ *
+ * Like bash, the shell then gives up the whole compound command instead
+ * of running the rest of the loop.
+ */
+static int interrupted(void) {
+    return get_last_status() == 128 + SIGINT;
+}
+
+/**
+ * @brief Make room for more words in a for loop's frame
+ * @return 0 on success, -1 if out of memory
+ */
+static int reserve_loop_words(Frame *frame, int *capacity, int extra) {
+    if (frame->word_count + extra <= *capacity) {
+        return 0;
+    }
+    int new_capacity = (frame->word_count + extra) * 2;
+    char **words = realloc(frame->words, sizeof(char*) * new_capacity);
+    if (words == NULL) {
+        return -1;
+    }
+    frame->words = words;
+    BraceSequence *sequences = realloc(frame->sequences, sizeof(BraceSequence) * new_capacity);
+    if (sequences == NULL) {
+        return -1;
+    }
+    frame->sequences = sequences;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * @brief Expand the tokens start..end of a for loop's words into its frame
+ * @return 0 on success, -1 on error
+ */
+static int expand_loop_words(Frame *frame, int *capacity, const Program *program, int start, int end,
+                             const char *home_directory) {
+    load_tokens(program, start, end);
+    if (expand_words(home_directory) == -1 || reserve_loop_words(frame, capacity, token_count) == -1) {
+        return -1;
+    }
+    for (int i = 0; i < token_count; i++) {
+        char *word = strdup(tokens[i].value);
+        if (word != NULL) {
+            frame->words[frame->word_count++] = word;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Expand the words of a for loop into its frame
+ *
+ * A word that is just a {x..y} sequence with plain text around it is
+ * not expanded: its values are made one per iteration, so
+ * `for i in {1..10000000}` runs in constant memory.
+ */
+static void load_loop_words(Frame *frame, const Program *program, int start, int end,
+                            const char *home_directory) {
+    int substitutions = pending_process_substitutions();
+    int capacity = 0;
+    int run_start = start;
+    for (int i = start; i <= end && frame->status == 0; i++) {
+        BraceSequence sequence;
+        if (i < end && !parse_brace_sequence(program->tokens[i].value, &sequence)) {
+            continue;
+        }
+        if (run_start < i && expand_loop_words(frame, &capacity, program, run_start, i, home_directory) == -1) {
+            frame->status = 1;
+        }
+        if (i < end && (frame->status != 0 || reserve_loop_words(frame, &capacity, 1) == -1)) {
+            free_brace_sequence(&sequence);
+            frame->status = 1;
+        } else if (i < end) {
+            frame->sequences[frame->word_count] = sequence;
+            frame->words[frame->word_count++] = NULL;
+        }
+        run_start = i + 1;
+    }
+    release_process_substitutions(substitutions);
+}
+
+/**
+ * @brief Assign the next word of a for loop to its variable
+ * @return 1 if a word was assigned, 0 when the loop is done
+ */
+static int next_loop_word(Frame *frame, const char *variable) {
+    while (frame->next_word < frame->word_count) {
+        const char *word = frame->words[frame->next_word];
+        if (word != NULL) {
+            frame->next_word++;
+            set_variable(variable, word, 0);
+            return 1;
+        }
+        BraceSequence *sequence = &frame->sequences[frame->next_word];
+        if (frame->next_value < sequence->count) {
+            char value[MAX_PATH_LEN];
+            format_brace_sequence(sequence, frame->next_value++, value, sizeof(value));
+            set_variable(variable, value, 0);
+            return 1;
+        }
+        frame->next_word++;
+        frame->next_value = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Copy the positional parameters into a for loop's frame
+ */
+static void load_positional_words(Frame *frame) {
+    int count;
+    char **words = get_positional_parameters(&count);
+    if (count == 0 || (frame->words = malloc(sizeof(char*) * count)) == NULL) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        char *word = strdup(words[i]);
+        if (word != NULL) {
+            frame->words[frame->word_count++] = word;
+        }
+    }
+}
+
+/**
+ * @brief Apply the redirections of a compound command
+ * @return 0 on success, -1 on error (the frame is left again)
+ */
+static int enter_redirect_frame(FrameStack *stack, const Program *program, int start, int end,
+                                const char *home_directory) {
+    Frame *frame = push_frame(stack, FRAME_REDIRECT);
+    if (frame == NULL) {
+        return -1;
+    }
+    load_tokens(program, start, end);
+    int substitutions = pending_process_substitutions();
+    int result = expand_words(home_directory);
+    if (result == 0) {
+        fflush(stdout);
+        frame->saved_count = save_redirected_fds(0, token_count, frame->saved);
+        result = setup_redirections(0, token_count);
+    }
+    release_process_substitutions(substitutions);
+    if (result == -1) {
+        pop_frame(stack);
+    }
+    return result;
+}
+
+/**
+ * @brief Start the timers of the `time` prefixes in front of a compiled pipeline
+ * @param start First `time` token
+ * @param end End of the timed pipeline (shown in the report)
+ * @return 0 on success, -1 on bad flags (the timers started are ended again)
+ *
+ * One frame per prefix, so the report comes when the pipeline is left,
+ * also through break or return.
+ */
+static int enter_timer_frames(FrameStack *stack, const Program *program, int start, int end) {
+    load_tokens(program, start, end);
+    int started = 0;
+    int i = 0;
+    while (is_time_prefix(i, token_count)) {
+        Frame *frame = push_frame(stack, FRAME_TIMER);
+        if (frame == NULL) {
+            break;
+        }
+        frame->timer_owner = getpid();
+        if ((i = begin_timing(i, token_count)) == -1) {
+            stack->count--;     // No timer was started for it
+            break;
+        }
+        started++;
+    }
+    if (i != -1 && is_time_prefix(i, token_count) == 0 && started > 0) {
+        return 0;
+    }
+    set_last_status(2);
+    while (started-- > 0) {
+        pop_frame(stack);
+    }
+    return -1;
+}
+
+/**
+ * @brief Fork the stages of a pipeline with compound commands
+ * @param program Program being run
+ * @param pc Index of the OP_PIPELINE instruction
+ * @return In a stage's shell: where its code starts; in the shell: -1
+ *         (with $? set to the status of the last stage)
+ *
+ * Every stage is a forked shell running its part of the program, with
+ * the stages in one process group that gets the terminal. The commands
+ * the stages run do not take the terminal themselves.
+ */
+static int start_pipeline(const Program *program, int pc) {
+    const Instruction *pipeline = &program->code[pc];
+    const Instruction *stages = pipeline + 1;
+    int count = pipeline->a;
+    int pipes[count - 1][2];
+    pid_t pids[count];
+    pid_t pgid = 0;
+
+    for (int i = 0; i < count - 1; i++) {
+        if (pipe(pipes[i]) == -1) {
+            perror("pipe");
+            while (--i >= 0) {
+                close(pipes[i][0]);
+                close(pipes[i][1]);
+            }
+            set_last_status(1);
+            return -1;
+        }
+    }
+
+    fflush(stdout);
+    for (int i = 0; i < count; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            enter_job_process_group(pgid, 0);
+            if (i > 0) {
+                dup2(pipes[i - 1][0], STDIN_FILENO);
+                // Builtins read stdin through stdio: drop input buffered by the shell
+                __fpurge(stdin);
+            }
+            if (i < count - 1) {
+                dup2(pipes[i][1], STDOUT_FILENO);
+            }
+            for (int j = 0; j < count - 1; j++) {
+                close(pipes[j][0]);
+                close(pipes[j][1]);
+            }
+            return stages[i].a;
+        } else if (pids[i] == -1) {
+            perror("fork");
+        } else {
+            if (pgid == 0) {
+                pgid = pids[i];
+            }
+            setpgid(pids[i], pgid);
+        }
+    }
+    for (int i = 0; i < count - 1; i++) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+    if (pgid == 0) {
+        set_last_status(1);
+        return -1;
+    }
+
+    load_tokens(program, stages[0].b, stages[count - 1].c);
+    char *command = reconstruct_command_from_segment(0, token_count);
+    give_terminal_to(pgid, NULL);
+    set_foreground_process(pgid, command);
+
+    int status;
+    int stopped = wait_for_job(pgid, pids[count - 1], &status);
+    if (stopped == -1) {
+        perror("waitpid");
+    }
+    reclaim_terminal(status, NULL);
+    if (stopped == 1) {
+        add_stopped_foreground_job(pgid);
+    }
+    clear_foreground_process();
+
+    if (stopped == 1) {
+        set_last_status(128 + WSTOPSIG(status));
+    } else if (WIFSIGNALED(status)) {
+        set_last_status(128 + WTERMSIG(status));
+    } else {
+        set_last_status(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+    }
+    return -1;
+}
+
+/**
+ * @brief Run a compiled program
+ * @param program Program from compile_program() or a function body
+ * @param home_directory Shell home directory for built-in commands
+ * @return Exit status of the last command ($?)
+ *
+ * Every instruction works on $? (get_last_status()), so conditions,
+ * loops and the commands they run share one status register. Loop,
+ * case and redirection state lives in a frame stack; break and continue
+ * unwind it to the loop they leave, and return leaves the program.
+ */
+int run_program(Program *program, const char *home_directory) {
+    FrameStack stack = { 0 };
+    int pc = 0;
+    int forked = 0;     // This is a stage's or background list's shell
+    size_t mark = arena_mark();
+
+    while (pc < program->length) {
+        // Words expanded by the previous instruction are done with, so a
+        // long loop runs in constant memory
+        arena_release(mark);
+        const Instruction *in = &program->code[pc++];
+        Frame *frame;
+
+        switch (in->op) {
+        case OP_RUN: {
+            load_tokens(program, in->a, in->b);
+            int active_timers = 0;
+            int status = execute_foreground_segment(0, token_count, home_directory, &active_timers);
+            while (active_timers-- > 0) {
+                end_timing(status);
+            }
+            if (interrupted()) {
+                pc = program->length;
+            }
+            break;
+        }
+        case OP_BACKGROUND:
+            load_tokens(program, in->a, in->b);
+            run_background_segment(0, token_count, home_directory);
+            set_last_status(0);
+            break;
+        case OP_FORK: {
+            load_tokens(program, in->b, in->c);
+            char *command = reconstruct_command_from_segment(0, token_count);
+            fflush(stdout);
+            pid_t pid = fork_background_subshell(command ? command : "");
+            forked |= pid == 0;
+            if (pid != 0) {
+                // The forked shell runs the code up to its OP_EXIT
+                pc = in->a;
+                set_last_status(0);
+            }
+            break;
+        }
+        case OP_PIPELINE: {
+            int stage = start_pipeline(program, pc - 1);
+            forked |= stage >= 0;
+            pc = stage >= 0 ? stage : in->b;
+            if (stage < 0 && interrupted()) {
+                pc = program->length;
+            }
+            break;
+        }
+        case OP_STAGE:
+            break;
+        case OP_EXIT:
+            // _exit: flushing the shared stdin stream would move the shell's input
+            fflush(stdout);
+            _exit(get_last_status());
+        case OP_JUMP:
+            pc = in->a;
+            break;
+        case OP_JUMP_IF_TRUE:
+            if (get_last_status() == 0) {
+                pc = in->a;
+            }
+            break;
+        case OP_JUMP_IF_FALSE:
+            if (get_last_status() != 0) {
+                pc = in->a;
+            }
+            break;
+        case OP_NOT:
+            set_last_status(get_last_status() == 0);
+            break;
+        case OP_SET_STATUS:
+            set_last_status(in->a);
+            break;
+        case OP_LOOP_BEGIN:
+            if (push_frame(&stack, FRAME_LOOP) == NULL) {
+                pc = program->length;
+            }
+            break;
+        case OP_LOOP_SAVE:
+            top_frame(&stack)->status = get_last_status();
+            break;
+        case OP_LOOP_END:
+            set_last_status(top_frame(&stack)->status);
+            pop_frame(&stack);
+            break;
+        case OP_FOR_BEGIN:
+            frame = push_frame(&stack, FRAME_LOOP);
+            if (frame == NULL) {
+                pc = program->length;
+            } else if (in->a < 0) {
+                load_positional_words(frame);
+            } else if (in->a < in->b) {
+                load_loop_words(frame, program, in->a, in->b, home_directory);
+            }
+            break;
+        case OP_FOR_NEXT:
+            if (!next_loop_word(top_frame(&stack), program->strings[in->a])) {
+                pc = in->b;
+            }
+            break;
+        case OP_CASE_BEGIN: {
+            char *subject = expand_text(program->tokens[in->a].value, home_directory);
+            frame = push_frame(&stack, FRAME_CASE);
+            if (frame == NULL || (frame->words = malloc(sizeof(char*))) == NULL) {
+                free(subject);
+                pc = program->length;
+                break;
+            }
+            frame->words[0] = subject != NULL ? subject : strdup("");
+            frame->word_count = frame->words[0] != NULL;
+            break;
+        }
+        case OP_CASE_MATCH: {
+            frame = top_frame(&stack);
+            char *pattern = expand_pattern(program->strings[in->a], home_directory);
+            if (pattern != NULL && frame->word_count > 0 && fnmatch(pattern, frame->words[0], 0) == 0) {
+                pc = in->b;
+            }
+            free(pattern);
+            break;
+        }
+        case OP_REDIRECT:
+            if (enter_redirect_frame(&stack, program, in->a, in->b, home_directory) == -1) {
+                set_last_status(1);
+                pc = in->c;
+            }
+            break;
+        case OP_TIME:
+            if (enter_timer_frames(&stack, program, in->a, in->b) == -1) {
+                pc = in->c;
+            }
+            break;
+        case OP_POP:
+            for (int i = 0; i < in->a; i++) {
+                pop_frame(&stack);
+            }
+            break;
+        case OP_BREAK: {
+            int loops = in->a;
+            while (stack.count > 0 && loops > 0) {
+                loops -= top_frame(&stack)->kind == FRAME_LOOP;
+                pop_frame(&stack);
+            }
+            set_last_status(0);
+            pc = in->b;
+            break;
+        }
+        case OP_CONTINUE: {
+            int loops = in->a - 1;
+            while (stack.count > 0) {
+                if (top_frame(&stack)->kind == FRAME_LOOP && loops-- == 0) {
+                    break;
+                }
+                pop_frame(&stack);
+            }
+            pc = in->b;
+            break;
+        }
+        case OP_DEFINE: {
+            load_tokens(program, in->b, in->c);
+            Program *body = compile_function_body();
+            if (body != NULL) {
+                define_function(program->strings[in->a], body);
+            }
+            set_last_status(body != NULL ? 0 : 2);
+            break;
+        }
+        case OP_RETURN:
+            if (in->a >= 0) {
+                char *text = expand_text(program->tokens[in->a].value, home_directory);
+                char *end = NULL;
+                long status = text != NULL ? strtol(text, &end, 10) : 0;
+                if (text == NULL || end == text || *end != '\0') {
+                    printf("return: Numeric argument required: %s\n", program->tokens[in->a].value);
+                    status = 2;
+                }
+                free(text);
+                set_last_status((int)(status & 0xff));
+            }
+            pc = program->length;
+            break;
+        }
+    }
+
+    while (stack.count > 0) {
+        pop_frame(&stack);
+    }
+    free(stack.frames);
+    if (forked) {
+        // A forked shell that left its code early (Ctrl-C, return) must
+        // not go on to run the rest of the caller
+        fflush(stdout);
+        _exit(get_last_status());
+    }
+    return get_last_status();
+}
+
+/**
+ * @brief Compile and run the compound command in the current tokens
+ * @param home_directory Shell home directory for built-in commands
+ * @return Exit status, 2 on a syntax error
+ *
+ * The command is logged once as typed, not every command it runs. The
+ * current tokens (and their heredocs) are restored afterwards.
+ */
+int execute_compound_command(const char *home_directory) {
+    Program *program = compile_program();
+    if (program == NULL) {
+        set_last_status(2);
+        return 2;
+    }
+
+    Token *saved_tokens = arena_alloc(sizeof(Token) * (token_count + 1));
+    if (saved_tokens == NULL) {
+        free_program(program);
+        return 1;
+    }
+    int saved_count = token_count;
+    memcpy(saved_tokens, tokens, sizeof(Token) * (token_count + 1));
+    char *command = reconstruct_command_from_segment(0, token_count);
+
+    int status = run_program(program, home_directory);
+
+    memcpy(tokens, saved_tokens, sizeof(Token) * (saved_count + 1));
+    token_count = saved_count;
+    if (command != NULL) {
+        add_command_to_log(command);
+    }
+    free_program(program);
+    return status;
+}
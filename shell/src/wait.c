@@ -0,0 +1,216 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <errno.h>
+
+#define WAIT_TIMEOUT_STATUS 124   // Same as timeout(1)
+
+/**
+ * @brief A job the wait builtin is waiting for
+ */
+typedef struct {
+    int job_number;
+    int pidfd;          // -1 until the job has a process (or without pidfd support)
+    int exited;         // pidfd reported the exit; reaping happens in the loop
+} WaitTarget;
+
+/**
+ * @brief Event loop callback: a waited-for process exited
+ * @param fd The job's pidfd
+ * @param data The WaitTarget
+ *
+ * A pidfd stays readable after exit, so it is removed from the loop at
+ * once; the job itself is reaped by reap_background_jobs().
+ */
+static void handle_pidfd_event(int fd, void *data) {
+    WaitTarget *target = data;
+    event_loop_remove(fd);
+    target->exited = 1;
+    reap_background_jobs();
+}
+
+/**
+ * @brief Watch a started job's process through a pidfd
+ * @param target Target to watch
+ * @param pid Process ID of the job
+ *
+ * Without pidfd support (Linux < 5.3) the SIGCHLD self-pipe still wakes
+ * the loop, so nothing is lost but the direct wakeup.
+ */
+static void watch_target(WaitTarget *target, pid_t pid) {
+    if (target->pidfd != -1 || pid <= 0) {
+        return;
+    }
+    target->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (target->pidfd != -1 && event_loop_add(target->pidfd, handle_pidfd_event, target) == -1) {
+        close(target->pidfd);
+        target->pidfd = -1;
+    }
+}
+
+/**
+ * @brief Stop watching a target and close its pidfd
+ */
+static void release_target(WaitTarget *target) {
+    if (target->pidfd != -1) {
+        if (!target->exited) {
+            event_loop_remove(target->pidfd);
+        }
+        close(target->pidfd);
+        target->pidfd = -1;
+    }
+}
+
+/**
+ * @brief Resolve a wait argument to a job
+ * @param arg %N (job number), N (job number if such a job exists, else a pid)
+ * @return Index in background_jobs, -1 if there is no such job
+ */
+static int find_wait_target(const char *arg) {
+    int is_job = arg[0] == '%';
+    const char *number = is_job ? arg + 1 : arg;
+    if (!is_valid_job_number(number)) {
+        return -1;
+    }
+    int index = find_job_by_number(atoi(number));
+    if (index == -1 && !is_job) {
+        index = find_job_index_by_pid(atoi(number));
+    }
+    return index;
+}
+
+/**
+ * @brief Add a job to the targets unless it is already one of them
+ * @param targets Array of MAX_BACKGROUND_JOBS targets
+ * @param count Number of targets so far, updated
+ * @param job_number Job to wait for
+ *
+ * Naming a job twice (`wait %1 %1`) waits for it once, so there are
+ * never more targets than job slots.
+ */
+static void add_target(WaitTarget *targets, int *count, int job_number) {
+    for (int t = 0; t < *count; t++) {
+        if (targets[t].job_number == job_number) {
+            return;
+        }
+    }
+    targets[*count].job_number = job_number;
+    targets[*count].pidfd = -1;
+    targets[*count].exited = 0;
+    (*count)++;
+}
+
+/**
+ * @brief Execute the wait command
+ * @return Exit status of the last job waited for (the first finished one
+ *         with -n), 124 on timeout, 127 for an unknown job, 130 on Ctrl-C
+ *
+ * Syntax: wait [-n] [--timeout SECS] [%job | job_number | pid ...]
+ * - Without jobs, waits for every running and queued background job
+ * - -n returns as soon as any one of the jobs finishes
+ * - --timeout gives up after SECS seconds (fractions allowed)
+ *
+ * The shell sleeps in the event loop on one pidfd per job, so it wakes
+ * only when a job exits (or a queued one starts). Jobs collected here
+ * are not reported again at the prompt.
+ */
+int execute_wait(void) {
+    WaitTarget targets[MAX_BACKGROUND_JOBS];
+    int target_count = 0;
+    int any = 0;
+    long long deadline = -1;
+    int explicit_jobs = 0;
+    int status = 0;
+
+    for (int i = 1; i < token_count && tokens[i].type == TOKEN_NAME; i++) {
+        const char *arg = tokens[i].value;
+        if (strcmp(arg, "-n") == 0) {
+            any = 1;
+        } else if (strcmp(arg, "--timeout") == 0 && i + 1 < token_count) {
+            char *end;
+            double seconds = strtod(tokens[++i].value, &end);
+            if (*end != '\0' || seconds < 0) {
+                printf("wait: Invalid timeout: %s\n", tokens[i].value);
+                return 2;
+            }
+            deadline = monotonic_ms() + (long long)(seconds * 1000);
+        } else if (arg[0] == '-') {
+            printf("Usage: wait [-n] [--timeout SECS] [%%job | job_number | pid ...]\n");
+            return 2;
+        } else {
+            explicit_jobs = 1;
+            int index = find_wait_target(arg);
+            if (index == -1) {
+                printf("wait: No such job: %s\n", arg);
+                status = 127;
+                continue;
+            }
+            add_target(targets, &target_count, background_jobs[index].job_number);
+        }
+    }
+
+    if (!explicit_jobs) {
+        // Stopped jobs would never finish on their own
+        for (int i = 0; i < MAX_BACKGROUND_JOBS; i++) {
+            BackgroundJob *job = &background_jobs[i];
+            if (job->is_active && !job->managed && !job->hidden &&
+                (job->state == PROCESS_RUNNING || job->state == PROCESS_QUEUED)) {
+                add_target(targets, &target_count, job->job_number);
+            }
+        }
+    }
+
+    int remaining = target_count;
+    while (remaining > 0) {
+        // Collect finished targets; watch ones that have (re)started
+        for (int t = 0; t < target_count; t++) {
+            if (targets[t].job_number == 0) {
+                continue;
+            }
+            int index = find_job_by_number(targets[t].job_number);
+            if (index == -1 || background_jobs[index].state == PROCESS_DONE) {
+                if (index != -1) {
+                    BackgroundJob *job = &background_jobs[index];
+                    status = exit_status_of(job->wait_status);
+                    job->notified = 1;
+                    if (job->capture == NULL) {
+                        cleanup_background_job(index);
+                    }
+                }
+                release_target(&targets[t]);
+                targets[t].job_number = 0;
+                remaining--;
+            } else {
+                watch_target(&targets[t], background_jobs[index].pid);
+            }
+        }
+        if (remaining == 0 || (any && remaining < target_count)) {
+            break;
+        }
+
+        int timeout_ms = -1;
+        if (deadline != -1) {
+            long long left = deadline - monotonic_ms();
+            if (left <= 0) {
+                status = WAIT_TIMEOUT_STATUS;
+                break;
+            }
+            timeout_ms = (int)left;
+        }
+        if (!event_loop_available()) {
+            printf("wait: Not available here\n");
+            status = 2;
+            break;
+        }
+        if (run_event_loop_once(timeout_ms) == -1) {
+            status = 130;
+            break;
+        }
+    }
+
+    for (int t = 0; t < target_count; t++) {
+        release_target(&targets[t]);
+    }
+    return status;
+}
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Feed each cases/NAME.in to the shell on stdin and compare what it prints
+# (prompts removed, process IDs shown as N) with cases/NAME.out. Every case runs in a fresh
+# directory, which is also the shell's home, so logs and files it makes
+# do not leak between cases.
+
+cd "$(dirname "$0")" || exit 1
+shell="$(cd .. && pwd)/shell.out"
+failed=0
+total=0
+
+for input in cases/*.in; do
+    name=$(basename "$input" .in)
+    expected="cases/$name.out"
+    work=$(mktemp -d)
+    actual="$work/actual"
+    (cd "$work" && HOME="$work" timeout 20 "$shell" < "$OLDPWD/$input" 2>&1) |
+        sed 's/<[^>]*> //g; s/pid [0-9][0-9]*/pid N/g; s/^\[[0-9][0-9]*\] :/[N] :/' > "$actual"
+    total=$((total + 1))
+    if diff -u "$expected" "$actual" > "$work/diff"; then
+        echo "PASS $name"
+    else
+        echo "FAIL $name"
+        cat "$work/diff"
+        failed=$((failed + 1))
+    fi
+    rm -rf "$work"
+done
+
+echo "$((total - failed))/$total passed"
+[ "$failed" -eq 0 ]